@@ -97,6 +97,8 @@ static boolean sendingsavegame[MAXNETNODES]; // Are we sending the savegame?
 static boolean resendingsavegame[MAXNETNODES]; // Are we resending the savegame?
 static tic_t savegameresendcooldown[MAXNETNODES]; // How long before we can resend again?
 static tic_t freezetimeout[MAXNETNODES]; // Until when can this node freeze the server before getting a timeout?
+static UINT8 nodeticcaps[MAXNETNODES]; // TICCAP_ flags sent by the node when joining
+static UINT8 nodesavecaps[MAXNETNODES]; // SAVECAP_ flags sent by the node when joining
 
 // Incremented by cv_joindelay when a client joins, decremented each tic.
 // If higher than cv_joindelay * 2 (3 joins in a short timespan), joins are temporarily disabled.
@@ -206,6 +208,198 @@ static inline void *G_ScpyTiccmd(ticcmd_t* dest, void* src, const size_t n)
 	return ret+n;
 }
 
+// PT_SERVERTICSDELTA cmds: for each tic, a bitmap of the slots whose cmd
+// differs from the previous tic (from an empty cmd for the first tic of the
+// packet, so packets don't depend on each other), then for each of those
+// a TICDELTA_ mask and the fields it names. Angles and aiming are sent as
+// zigzag varint differences, buttons as a varint of the bits that changed.
+#define TICDELTA_FORWARDMOVE 0x01
+#define TICDELTA_SIDEMOVE    0x02
+#define TICDELTA_ANGLETURN   0x04
+#define TICDELTA_AIMING      0x08
+#define TICDELTA_BUTTONS     0x10
+#define TICDELTA_LATENCY     0x20
+#define MAXTICDELTASIZE 13 // Mask, two bytes, three varints of up to 3 bytes, one byte
+
+static UINT8 *WriteVarint(UINT8 *p, UINT32 value)
+{
+	while (value >= 0x80)
+	{
+		*p++ = (UINT8)(value | 0x80);
+		value >>= 7;
+	}
+	*p++ = (UINT8)value;
+	return p;
+}
+
+static const UINT8 *ReadVarint(const UINT8 *p, const UINT8 *end, UINT32 *value)
+{
+	UINT32 v = 0;
+	INT32 shift;
+
+	for (shift = 0; p < end && shift < 32; shift += 7)
+	{
+		UINT8 b = *p++;
+
+		v |= (UINT32)(b & 0x7F) << shift;
+		if (!(b & 0x80))
+		{
+			*value = v;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+static UINT8 *WriteShortDelta(UINT8 *p, INT16 from, INT16 to)
+{
+	INT32 d = (INT16)(to - from);
+	return WriteVarint(p, d >= 0 ? (UINT32)d << 1 : ((UINT32)-d << 1) - 1);
+}
+
+static INT16 ApplyShortDelta(INT16 from, UINT32 zigzag)
+{
+	INT32 d = (zigzag & 1) ? -(INT32)((zigzag + 1) >> 1) : (INT32)(zigzag >> 1);
+	return (INT16)(from + d);
+}
+
+/** Delta-encodes one tic of cmds
+  *
+  * \param p Where to write
+  * \param prev The cmds of the previous tic, or NULL for empty cmds
+  * \param cmds The cmds to encode
+  * \param numslots How many slots to encode
+  * \return The end of what was written
+  *
+  */
+static UINT8 *G_WriteTiccmdDeltas(UINT8 *p, const ticcmd_t *prev, const ticcmd_t *cmds, INT32 numslots)
+{
+	static const ticcmd_t emptycmd;
+	UINT8 *bitmap = p;
+	INT32 i;
+
+	memset(bitmap, 0, (numslots + 7) / 8);
+	p += (numslots + 7) / 8;
+
+	for (i = 0; i < numslots; i++)
+	{
+		const ticcmd_t *from = prev ? &prev[i] : &emptycmd;
+		const ticcmd_t *to = &cmds[i];
+		UINT8 *mask = p++;
+
+		*mask = 0;
+		if (to->forwardmove != from->forwardmove)
+		{
+			*mask |= TICDELTA_FORWARDMOVE;
+			WRITESINT8(p, to->forwardmove);
+		}
+		if (to->sidemove != from->sidemove)
+		{
+			*mask |= TICDELTA_SIDEMOVE;
+			WRITESINT8(p, to->sidemove);
+		}
+		if (to->angleturn != from->angleturn)
+		{
+			*mask |= TICDELTA_ANGLETURN;
+			p = WriteShortDelta(p, from->angleturn, to->angleturn);
+		}
+		if (to->aiming != from->aiming)
+		{
+			*mask |= TICDELTA_AIMING;
+			p = WriteShortDelta(p, from->aiming, to->aiming);
+		}
+		if (to->buttons != from->buttons)
+		{
+			*mask |= TICDELTA_BUTTONS;
+			p = WriteVarint(p, (UINT16)(to->buttons ^ from->buttons));
+		}
+		if (to->latency != from->latency)
+		{
+			*mask |= TICDELTA_LATENCY;
+			WRITEUINT8(p, to->latency);
+		}
+
+		if (*mask)
+			bitmap[i / 8] |= 1 << (i % 8);
+		else
+			p--; // Unchanged, not even a mask
+	}
+
+	return p;
+}
+
+/** Applies one tic of delta-encoded cmds
+  *
+  * \param p Where to read
+  * \param end The end of the packet
+  * \param cmds The cmds of the previous tic, updated in place
+  * \param numslots How many slots were encoded
+  * \return The end of what was read, or NULL if the data is truncated
+  *
+  */
+static const UINT8 *G_ReadTiccmdDeltas(const UINT8 *p, const UINT8 *end, ticcmd_t *cmds, INT32 numslots)
+{
+	const UINT8 *bitmap = p;
+	INT32 i;
+
+	if (end - p < (numslots + 7) / 8)
+		return NULL;
+	p += (numslots + 7) / 8;
+
+	for (i = 0; i < numslots; i++)
+	{
+		ticcmd_t *cmd = &cmds[i];
+		UINT32 value;
+		UINT8 mask;
+
+		if (!(bitmap[i / 8] & (1 << (i % 8))))
+			continue;
+
+		if (p >= end)
+			return NULL;
+		mask = *p++;
+
+		if (mask & TICDELTA_FORWARDMOVE)
+		{
+			if (p >= end)
+				return NULL;
+			cmd->forwardmove = (SINT8)*p++;
+		}
+		if (mask & TICDELTA_SIDEMOVE)
+		{
+			if (p >= end)
+				return NULL;
+			cmd->sidemove = (SINT8)*p++;
+		}
+		if (mask & TICDELTA_ANGLETURN)
+		{
+			if (!(p = ReadVarint(p, end, &value)))
+				return NULL;
+			cmd->angleturn = ApplyShortDelta(cmd->angleturn, value);
+		}
+		if (mask & TICDELTA_AIMING)
+		{
+			if (!(p = ReadVarint(p, end, &value)))
+				return NULL;
+			cmd->aiming = ApplyShortDelta(cmd->aiming, value);
+		}
+		if (mask & TICDELTA_BUTTONS)
+		{
+			if (!(p = ReadVarint(p, end, &value)))
+				return NULL;
+			cmd->buttons ^= (UINT16)value;
+		}
+		if (mask & TICDELTA_LATENCY)
+		{
+			if (p >= end)
+				return NULL;
+			cmd->latency = *p++;
+		}
+	}
+
+	return p;
+}
+
 
 
 // Some software don't support largest packet
@@ -621,8 +815,25 @@ static inline void CL_DrawConnectionStatus(void)
 					cltext = M_GetText("Waiting to download game state...");
 				break;
 			case CL_ASKFULLFILELIST:
+				cltext = M_GetText("Checking server addon list...");
+				break;
 			case CL_CHECKFILES:
 				cltext = M_GetText("Checking server addon list...");
+#if defined (HAVE_THREADS) && !defined (NOMD5)
+				{
+					UINT32 hashed, total;
+
+					// Files are hashed on the worker threads first
+					if (W_GetMD5QueueProgress(&hashed, &total))
+					{
+						cltext = M_GetText("Checking server addons...");
+						V_DrawFill(BASEVIDWIDTH/2-128, BASEVIDHEIGHT-16, 256, 8, 111);
+						V_DrawFill(BASEVIDWIDTH/2-128, BASEVIDHEIGHT-16, (INT32)((hashed/(double)total) * 256), 8, 96);
+						V_DrawCenteredString(BASEVIDWIDTH/2, BASEVIDHEIGHT-16, V_20TRANS|V_MONOSPACE,
+							va(" %2u/%2u Files", hashed, total));
+					}
+				}
+#endif
 				break;
 			case CL_CONFIRMCONNECT:
 				cltext = "";
@@ -780,6 +991,10 @@ static boolean CL_SendJoin(void)
 
 	netbuffer->u.clientcfg.tsourdt3rd = true; // STAR STUFF: set our variable right quick //
 
+	netbuffer->u.clientcfg.filetxcaps = FILETXCAP_SACK;
+	netbuffer->u.clientcfg.ticcaps = TICCAP_DELTA;
+	netbuffer->u.clientcfg.savecaps = SAVECAP_CHUNKED;
+
 	return HSendPacket(servernode, true, 0, sizeof (clientconfig_pak));
 }
 
@@ -1018,8 +1233,6 @@ static boolean SV_SendServerConfig(INT32 node)
 	return waspacketsent;
 }
 
-#define SAVEGAMESIZE (768*1024)
-
 static boolean SV_ResendingSavegameToAnyone(void)
 {
 	INT32 i;
@@ -1030,82 +1243,175 @@ static boolean SV_ResendingSavegameToAnyone(void)
 	return false;
 }
 
-static void SV_SendSaveGame(INT32 node, boolean resending)
+// Savegames sent to SAVECAP_CHUNKED nodes are SAVECHUNKMAGIC, a UINT32
+// total raw length, then one record per archive chunk: UINT32 raw length,
+// UINT32 compressed length (0 if the chunk is stored as is), then the chunk
+// data. Other nodes get the whole save as one block, after a UINT32 raw
+// length, or 0 if the block is stored as is. The magic can't be mistaken
+// for that length, since older servers never sent more than 768 KiB.
+#define SAVECHUNKMAGIC 0xFFFFFFFF
+#define SAVECHUNKHEADER (2*sizeof(UINT32))
+
+typedef struct
 {
-	size_t length, compressedlen;
-	UINT8 *savebuffer;
-	UINT8 *compressedsave;
-	UINT8 *buffertosend;
+	UINT8 *buffer;
+	size_t length;
+	size_t capacity;
+	boolean failed;
+} savesend_t;
+
+static boolean SV_GrowSaveSend(savesend_t *out, size_t needed)
+{
+	size_t newcapacity = out->capacity * 2;
+	UINT8 *newbuffer;
+
+	if (out->failed)
+		return false;
+	if (needed <= out->capacity)
+		return true;
 
-	// first save it in a malloced buffer
-	savebuffer = (UINT8 *)malloc(SAVEGAMESIZE);
-	if (!savebuffer)
+	if (newcapacity < needed)
+		newcapacity = needed;
+	newbuffer = realloc(out->buffer, newcapacity);
+	if (!newbuffer)
 	{
-		CONS_Alert(CONS_ERROR, M_GetText("No more free memory for savegame\n"));
-		return;
+		out->failed = true;
+		return false;
 	}
+	out->buffer = newbuffer;
+	out->capacity = newcapacity;
+	return true;
+}
 
-	// Leave room for the uncompressed length.
-	save_p = savebuffer + sizeof(UINT32);
+static void SV_CompressSaveChunk(const UINT8 *data, size_t length, void *userdata)
+{
+	savesend_t *out = userdata;
+	size_t compressedlen;
+	UINT8 *p;
 
-	P_SaveNetGame(resending);
+	if (!SV_GrowSaveSend(out, out->length + SAVECHUNKHEADER + length))
+		return;
 
-	length = save_p - savebuffer;
-	if (length > SAVEGAMESIZE)
+	// Compress straight into the send buffer; if that doesn't make the
+	// chunk any smaller, store it instead.
+	p = out->buffer + out->length;
+	compressedlen = lzf_compress(data, length, p + SAVECHUNKHEADER, length - 1);
+	WRITEUINT32(p, length);
+	WRITEUINT32(p, compressedlen);
+	if (!compressedlen)
 	{
-		free(savebuffer);
-		save_p = NULL;
-		I_Error("Savegame buffer overrun");
+		M_Memcpy(p, data, length);
+		compressedlen = length;
 	}
 
-	// Allocate space for compressed save: one byte fewer than for the
-	// uncompressed data to ensure that the compression is worthwhile.
-	compressedsave = malloc(length - 1);
-	if (!compressedsave)
-	{
-		CONS_Alert(CONS_ERROR, M_GetText("No more free memory for savegame\n"));
+	out->length += SAVECHUNKHEADER + compressedlen;
+}
+
+// For nodes without SAVECAP_CHUNKED, gathers the raw save to compress at once
+static void SV_CollectSaveChunk(const UINT8 *data, size_t length, void *userdata)
+{
+	savesend_t *out = userdata;
+
+	if (!SV_GrowSaveSend(out, out->length + length))
 		return;
-	}
 
-	// Attempt to compress it.
-	if((compressedlen = lzf_compress(savebuffer + sizeof(UINT32), length - sizeof(UINT32), compressedsave + sizeof(UINT32), length - sizeof(UINT32) - 1)))
-	{
-		// Compressing succeeded; send compressed data
+	M_Memcpy(out->buffer + out->length, data, length);
+	out->length += length;
+}
+
+// Compresses a save gathered by SV_CollectSaveChunk as a single block, in
+// place of out->buffer if that makes it smaller.
+static void SV_CompressSaveBlock(savesend_t *out)
+{
+	const size_t rawlen = out->length - sizeof(UINT32);
+	UINT8 *compressedsave = malloc(out->length - 1);
+	size_t compressedlen = 0;
+	UINT8 *p;
 
-		free(savebuffer);
+	if (compressedsave)
+		compressedlen = lzf_compress(out->buffer + sizeof(UINT32), rawlen, compressedsave + sizeof(UINT32), rawlen - 1);
 
-		// State that we're compressed.
-		buffertosend = compressedsave;
-		WRITEUINT32(compressedsave, length - sizeof(UINT32));
-		length = compressedlen + sizeof(UINT32);
+	if (compressedlen)
+	{
+		free(out->buffer);
+		out->buffer = compressedsave;
+		out->length = compressedlen + sizeof(UINT32);
+		p = out->buffer;
+		WRITEUINT32(p, rawlen);
 	}
 	else
 	{
 		// Compression failed to make it smaller; send original
-
 		free(compressedsave);
+		p = out->buffer;
+		WRITEUINT32(p, 0);
+	}
+}
 
-		// State that we're not compressed
-		buffertosend = savebuffer;
-		WRITEUINT32(savebuffer, 0);
+static void SV_SendSaveGame(INT32 node, boolean resending)
+{
+	const boolean chunked = (nodesavecaps[node] & SAVECAP_CHUNKED) != 0;
+	savesend_t out;
+	size_t length;
+	UINT8 *p;
+
+	out.capacity = 256*1024;
+	out.buffer = malloc(out.capacity);
+	// Leave room for the magic and the uncompressed length.
+	out.length = chunked ? 2*sizeof(UINT32) : sizeof(UINT32);
+	out.failed = false;
+
+	if (!out.buffer || !P_BeginSaveStream(chunked ? SV_CompressSaveChunk : SV_CollectSaveChunk, &out))
+	{
+		free(out.buffer);
+		CONS_Alert(CONS_ERROR, M_GetText("No more free memory for savegame\n"));
+		return;
 	}
 
-	AddRamToSendQueue(node, buffertosend, length, SF_RAM, 0);
-	save_p = NULL;
+	P_SaveNetGame(resending);
+	length = P_EndSaveStream();
+
+	if (out.failed)
+	{
+		free(out.buffer);
+		CONS_Alert(CONS_ERROR, M_GetText("No more free memory for savegame\n"));
+		return;
+	}
+
+	if (chunked)
+	{
+		p = out.buffer;
+		WRITEUINT32(p, SAVECHUNKMAGIC);
+		WRITEUINT32(p, length);
+	}
+	else
+		SV_CompressSaveBlock(&out);
+
+	AddRamToSendQueue(node, out.buffer, out.length, SF_RAM, 0);
 
 	// Remember when we started sending the savegame so we can handle timeouts
 	sendingsavegame[node] = true;
-	freezetimeout[node] = I_GetTime() + jointimeout + length / 1024; // 1 extra tic for each kilobyte
+	freezetimeout[node] = I_GetTime() + jointimeout + out.length / 1024; // 1 extra tic for each kilobyte
 }
 
 #ifdef DUMPCONSISTENCY
 #define TMPSAVENAME "badmath.sav"
 static consvar_t cv_dumpconsistency = CVAR_INIT ("dumpconsistency", "Off", CV_SAVE|CV_NETVAR, CV_OnOff, NULL);
 
+static void SV_WriteSaveChunk(const UINT8 *data, size_t length, void *userdata)
+{
+	FILE **handle = userdata;
+
+	if (*handle && fwrite(data, 1, length, *handle) != length)
+	{
+		fclose(*handle);
+		*handle = NULL;
+	}
+}
+
 static void SV_SavedGame(void)
 {
-	size_t length;
-	UINT8 *savebuffer;
+	FILE *handle;
 	char tmpsave[256];
 
 	if (!cv_dumpconsistency.value)
@@ -1113,30 +1419,21 @@ static void SV_SavedGame(void)
 
 	sprintf(tmpsave, "%s" PATHSEP TMPSAVENAME, srb2home);
 
-	// first save it in a malloced buffer
-	save_p = savebuffer = (UINT8 *)malloc(SAVEGAMESIZE);
-	if (!save_p)
+	// stream it straight to disk
+	handle = fopen(tmpsave, "wb");
+	if (!handle || !P_BeginSaveStream(SV_WriteSaveChunk, &handle))
 	{
-		CONS_Alert(CONS_ERROR, M_GetText("No more free memory for savegame\n"));
+		if (handle)
+			fclose(handle);
+		CONS_Printf(M_GetText("Didn't save %s for netgame"), tmpsave);
 		return;
 	}
 
 	P_SaveNetGame(false);
+	P_EndSaveStream();
 
-	length = save_p - savebuffer;
-	if (length > SAVEGAMESIZE)
-	{
-		free(savebuffer);
-		save_p = NULL;
-		I_Error("Savegame buffer overrun");
-	}
-
-	// then save it!
-	if (!FIL_WriteFile(tmpsave, savebuffer, length))
+	if (!handle || fclose(handle))
 		CONS_Printf(M_GetText("Didn't save %s for netgame"), tmpsave);
-
-	free(savebuffer);
-	save_p = NULL;
 }
 
 #undef  TMPSAVENAME
@@ -1147,6 +1444,7 @@ static void SV_SavedGame(void)
 static void CL_LoadReceivedSavegame(boolean reloading)
 {
 	UINT8 *savebuffer = NULL;
+	UINT8 *decompressedbuffer, *p, *end;
 	size_t length, decompressedlen;
 	char tmpsave[256];
 
@@ -1164,13 +1462,56 @@ static void CL_LoadReceivedSavegame(boolean reloading)
 	}
 
 	save_p = savebuffer;
+	end = savebuffer + length;
 
-	// Decompress saved game if necessary.
+	if (length < sizeof(UINT32))
+		I_Error("Bad savegame sent");
 	decompressedlen = READUINT32(save_p);
-	if(decompressedlen > 0)
+
+	if (decompressedlen != SAVECHUNKMAGIC)
+	{
+		// Older servers send the save as one block, compressed if nonzero.
+		if (decompressedlen > 0)
+		{
+			decompressedbuffer = Z_Malloc(decompressedlen, PU_STATIC, NULL);
+			if (lzf_decompress(save_p, end - save_p, decompressedbuffer, decompressedlen) != decompressedlen)
+				I_Error("Bad savegame sent");
+			Z_Free(savebuffer);
+			save_p = savebuffer = decompressedbuffer;
+		}
+	}
+	else
 	{
-		UINT8 *decompressedbuffer = Z_Malloc(decompressedlen, PU_STATIC, NULL);
-		lzf_decompress(save_p, length - sizeof(UINT32), decompressedbuffer, decompressedlen);
+		// Decompress the saved game chunk by chunk.
+		if (end - save_p < (ptrdiff_t)sizeof(UINT32))
+			I_Error("Bad savegame sent");
+		decompressedlen = READUINT32(save_p);
+		decompressedbuffer = p = Z_Malloc(decompressedlen, PU_STATIC, NULL);
+		while (end - save_p >= (ptrdiff_t)SAVECHUNKHEADER)
+		{
+			size_t rawlen = READUINT32(save_p);
+			size_t chunklen = READUINT32(save_p);
+
+			if (rawlen > (size_t)(decompressedbuffer + decompressedlen - p)
+			 || (chunklen ? chunklen : rawlen) > (size_t)(end - save_p))
+				I_Error("Bad savegame sent");
+
+			if (chunklen)
+			{
+				if (lzf_decompress(save_p, chunklen, p, rawlen) != rawlen)
+					I_Error("Bad savegame sent");
+				save_p += chunklen;
+			}
+			else
+			{
+				M_Memcpy(p, save_p, rawlen);
+				save_p += rawlen;
+			}
+			p += rawlen;
+		}
+		if (p != decompressedbuffer + decompressedlen)
+			I_Error("Bad savegame sent");
+
 		Z_Free(savebuffer);
 		save_p = savebuffer = decompressedbuffer;
 	}
@@ -2990,6 +3331,11 @@ consvar_t cv_noticedownload = CVAR_INIT ("noticedownload", "Off", CV_SAVE|CV_NET
 static CV_PossibleValue_t downloadspeed_cons_t[] = {{1, "MIN"}, {300, "MAX"}, {0, NULL}};
 consvar_t cv_downloadspeed = CVAR_INIT ("downloadspeed", "16", CV_SAVE|CV_NETVAR, downloadspeed_cons_t, NULL);
 
+// Fixed: send downloadspeed packets per tic in total
+// Adaptive: pace each node from its acknowledgements, starting at downloadspeed
+static CV_PossibleValue_t downloadpacing_cons_t[] = {{0, "Fixed"}, {1, "Adaptive"}, {0, NULL}};
+consvar_t cv_downloadpacing = CVAR_INIT ("downloadpacing", "Fixed", CV_SAVE|CV_NETVAR, downloadpacing_cons_t, NULL);
+
 static void Got_AddPlayer(UINT8 **p, INT32 playernum);
 
 // called one time at init
@@ -3015,6 +3361,10 @@ void D_ClientServerInit(void)
 #ifdef _DEBUG
 	COM_AddCommand("numnodes", Command_Numnodes, COM_LUA);
 #endif
+	COM_AddCommand("netbench", Command_NetBench, 0);
+	COM_AddCommand("nodebench", Command_NodeBench, 0);
+	COM_AddCommand("ackbench", Command_AckBench, 0);
+	COM_AddCommand("filetxbench", Command_FileTxBench, 0);
 
 	RegisterNetXCmd(XD_KICK, Got_KickCmd);
 	RegisterNetXCmd(XD_ADDPLAYER, Got_AddPlayer);
@@ -3048,6 +3398,8 @@ static void ResetNode(INT32 node)
 	sendingsavegame[node] = false;
 	resendingsavegame[node] = false;
 	savegameresendcooldown[node] = 0;
+	nodeticcaps[node] = 0;
+	nodesavecaps[node] = 0;
 }
 
 void SV_ResetServer(void)
@@ -3610,6 +3962,18 @@ static void HandleConnect(SINT8 node)
 
 		// client authorised to join
 		nodewaiting[node] = (UINT8)(netbuffer->u.clientcfg.localplayers - playerpernode[node]);
+
+		// Older clients send a shorter join packet without capabilities
+		if (doomcom->datalength >= (INT16)(BASEPACKETSIZE + offsetof(clientconfig_pak, filetxcaps) + 1))
+			SV_SetFileTransferCaps(node, netbuffer->u.clientcfg.filetxcaps);
+		if (doomcom->datalength >= (INT16)(BASEPACKETSIZE + offsetof(clientconfig_pak, ticcaps) + 1))
+			nodeticcaps[node] = netbuffer->u.clientcfg.ticcaps & TICCAP_DELTA;
+		else
+			nodeticcaps[node] = 0;
+		if (doomcom->datalength >= (INT16)(BASEPACKETSIZE + offsetof(clientconfig_pak, savecaps) + 1))
+			nodesavecaps[node] = netbuffer->u.clientcfg.savecaps & SAVECAP_CHUNKED;
+		else
+			nodesavecaps[node] = 0;
 		if (!nodeingame[node])
 		{
 			gamestate_t backupstate = gamestate;
@@ -3699,6 +4063,90 @@ static void HandleServerInfo(SINT8 node)
 	SL_InsertServer(&netbuffer->u.serverinfo, node);
 }
 
+/** Walks the tics of a PT_SERVERTICSDELTA packet
+  *
+  * \param start The first tic to read, which must be the first in the packet
+  * \param end The tic to stop at
+  * \param apply False to only check that the packet isn't truncated
+  * \return False if it is
+  *
+  */
+static boolean CL_ReadServerTicsDelta(tic_t start, tic_t end, boolean apply)
+{
+	const UINT8 *p = (UINT8 *)&netbuffer->u.serverpak.cmds;
+	const UINT8 *bufend = (UINT8 *)netbuffer + doomcom->datalength;
+	INT32 numslots = netbuffer->u.serverpak.numslots;
+	ticcmd_t cmds[MAXPLAYERS];
+	tic_t i;
+
+	memset(cmds, 0, sizeof (cmds));
+	for (i = start; i < end; i++)
+	{
+		UINT8 numtxtpak, j;
+
+		p = G_ReadTiccmdDeltas(p, bufend, cmds, numslots);
+		if (!p || p >= bufend)
+			return false;
+
+		if (apply)
+		{
+			// clear first
+			D_Clearticcmd(i);
+			M_Memcpy(netcmds[i%BACKUPTICS], cmds, numslots * sizeof (ticcmd_t));
+		}
+
+		// copy the textcmds
+		numtxtpak = *p++;
+		for (j = 0; j < numtxtpak; j++)
+		{
+			INT32 k;
+			size_t txtsize;
+
+			if (bufend - p < 2)
+				return false;
+			k = *p++; // playernum
+			txtsize = p[0]+1;
+			if (k >= MAXPLAYERS || (size_t)(bufend - p) < txtsize)
+				return false;
+
+			if (apply && i >= gametic) // Don't copy old net commands
+				M_Memcpy(D_GetTextcmd(i, k), p, txtsize);
+			p += txtsize;
+		}
+	}
+
+	return true;
+}
+
+/** Copies the tics of a PT_SERVERTICSDELTA packet the client still needs
+  */
+static void PT_ServerTicsDelta(void)
+{
+	tic_t realstart = netbuffer->u.serverpak.starttic;
+	tic_t realend = realstart + netbuffer->u.serverpak.numtics;
+
+	if (realend > gametic + CLIENTBACKUPTICS)
+		realend = gametic + CLIENTBACKUPTICS;
+	cl_packetmissed = realstart > neededtic;
+
+	if (realstart > neededtic || realend <= neededtic)
+	{
+		DEBFILE(va("frame not in bound: %u\n", neededtic));
+		return;
+	}
+
+	// Check the whole packet first, so a truncated one changes nothing
+	if (netbuffer->u.serverpak.numslots > MAXPLAYERS
+		|| !CL_ReadServerTicsDelta(realstart, realend, false))
+	{
+		DEBFILE("malformed PT_SERVERTICSDELTA packet\n");
+		return;
+	}
+
+	CL_ReadServerTicsDelta(realstart, realend, true);
+	neededtic = realend;
+}
+
 static void PT_WillResendGamestate(void)
 {
 	char tmpsave[256];
@@ -3892,6 +4340,7 @@ static void HandlePacketFromAwayNode(SINT8 node)
 
 		// Handled in d_netfil.c
 		case PT_FILEFRAGMENT:
+		case PT_FILESACKFRAGMENT:
 			if (server)
 			{ // But wait I thought I'm the server?
 				Net_CloseConnection(node);
@@ -3906,6 +4355,11 @@ static void HandlePacketFromAwayNode(SINT8 node)
 				PT_FileAck();
 			break;
 
+		case PT_FILESACK:
+			if (server)
+				PT_FileSack();
+			break;
+
 		case PT_FILERECEIVED:
 			if (server)
 				PT_FileReceived();
@@ -3931,6 +4385,7 @@ static void HandlePacketFromAwayNode(SINT8 node)
 			break; // This is not an "unknown packet"
 
 		case PT_SERVERTICS:
+		case PT_SERVERTICSDELTA:
 			// Do not remove my own server (we have just get a out of order packet)
 			if (node == servernode)
 				break;
@@ -4298,6 +4753,17 @@ static void HandlePacketFromPlayer(SINT8 node)
 							"IRC or Discord so it can be fixed.\n", (INT32)realstart, (INT32)realend, (INT32)neededtic);*/
 			}
 			break;
+		case PT_SERVERTICSDELTA:
+			// Only accept PT_SERVERTICSDELTA from the server.
+			if (node != servernode)
+			{
+				CONS_Alert(CONS_WARNING, M_GetText("%s received from non-host %d\n"), "PT_SERVERTICSDELTA", node);
+				if (server)
+					SendKick(netconsole, KICK_MSG_CON_FAIL | KICK_MSG_KEEP_BODY);
+				break;
+			}
+			PT_ServerTicsDelta();
+			break;
 		case PT_PING:
 			// Only accept PT_PING from the server.
 			if (node != servernode)
@@ -4323,6 +4789,7 @@ static void HandlePacketFromPlayer(SINT8 node)
 		case PT_SERVERCFG:
 			break;
 		case PT_FILEFRAGMENT:
+		case PT_FILESACKFRAGMENT:
 			// Only accept PT_FILEFRAGMENT from the server.
 			if (node != servernode)
 			{
@@ -4338,6 +4805,10 @@ static void HandlePacketFromPlayer(SINT8 node)
 			if (server)
 				PT_FileAck();
 			break;
+		case PT_FILESACK:
+			if (server)
+				PT_FileSack();
+			break;
 		case PT_FILERECEIVED:
 			if (server)
 				PT_FileReceived();
@@ -4609,16 +5080,147 @@ static void CL_SendClientCmd(void)
 	}
 }
 
+static UINT8 *SV_WriteTextCmds(UINT8 *bufpos, tic_t tic)
+{
+	UINT8 *ntextcmd = bufpos++;
+	INT32 j;
+
+	*ntextcmd = 0;
+	for (j = 0; j < MAXPLAYERS; j++)
+	{
+		UINT8 *textcmd = D_GetExistingTextcmd(tic, j);
+		INT32 size = textcmd ? textcmd[0] : 0;
+
+		if ((!j || playeringame[j]) && size)
+		{
+			(*ntextcmd)++;
+			WRITEUINT8(bufpos, j);
+			M_Memcpy(bufpos, textcmd, size + 1);
+			bufpos += size + 1;
+		}
+	}
+
+	return bufpos;
+}
+
+// Packs tics from realfirsttic to lasttictosend-1 into a PT_SERVERTICS packet,
+// fewer if they don't fit, and returns the tic after the last one packed
+static tic_t SV_PackTics(INT32 n, tic_t realfirsttic, tic_t lasttictosend, size_t *packsize)
+{
+	tic_t i;
+	UINT8 *bufpos;
+
+	// compute the length of the packet and cut it if too large
+	*packsize = BASESERVERTICSSIZE;
+	for (i = realfirsttic; i < lasttictosend; i++)
+	{
+		*packsize += sizeof (ticcmd_t) * doomcom->numslots;
+		*packsize += TotalTextCmdPerTic(i);
+
+		if (*packsize > software_MAXPACKETLENGTH)
+		{
+			DEBFILE(va("packet too large (%s) at tic %d (should be from %d to %d)\n",
+				sizeu1(*packsize), i, realfirsttic, lasttictosend));
+			lasttictosend = i;
+
+			// too bad: too much player have send extradata and there is too
+			//          much data in one tic.
+			// To avoid it put the data on the next tic. (see getpacket
+			// textcmd case) but when numplayer changes the computation can be different
+			if (lasttictosend == realfirsttic)
+			{
+				if (*packsize > MAXPACKETLENGTH)
+					I_Error("Too many players: can't send %s data for %d players to node %d\n"
+					        "Well sorry nobody is perfect....\n",
+					        sizeu1(*packsize), doomcom->numslots, n);
+				else
+				{
+					lasttictosend++; // send it anyway!
+					DEBFILE("sending it anyway\n");
+				}
+			}
+			break;
+		}
+	}
+
+	// Send the tics
+	netbuffer->packettype = PT_SERVERTICS;
+	netbuffer->u.serverpak.starttic = realfirsttic;
+	netbuffer->u.serverpak.numtics = (UINT8)(lasttictosend - realfirsttic);
+	netbuffer->u.serverpak.numslots = (UINT8)SHORT(doomcom->numslots);
+	bufpos = (UINT8 *)&netbuffer->u.serverpak.cmds;
+
+	for (i = realfirsttic; i < lasttictosend; i++)
+	{
+		bufpos = G_DcpyTiccmd(bufpos, netcmds[i%BACKUPTICS], doomcom->numslots * sizeof (ticcmd_t));
+	}
+
+	// add textcmds
+	for (i = realfirsttic; i < lasttictosend; i++)
+		bufpos = SV_WriteTextCmds(bufpos, i);
+
+	*packsize = bufpos - (UINT8 *)&(netbuffer->u);
+	return lasttictosend;
+}
+
+// Same as SV_PackTics, but into a PT_SERVERTICSDELTA packet with each tic
+// followed by its textcmds. rawsize is what SV_PackTics would have sent.
+static tic_t SV_PackTicsDelta(INT32 n, tic_t realfirsttic, tic_t lasttictosend, size_t *packsize, size_t *rawsize)
+{
+	static UINT8 cmdbuf[(MAXPLAYERS + 7) / 8 + MAXPLAYERS * MAXTICDELTASIZE];
+	UINT8 *bufpos = (UINT8 *)&netbuffer->u.serverpak.cmds;
+	tic_t i;
+
+	netbuffer->packettype = PT_SERVERTICSDELTA;
+	netbuffer->u.serverpak.starttic = realfirsttic;
+	netbuffer->u.serverpak.numslots = (UINT8)SHORT(doomcom->numslots);
+	*rawsize = bufpos - (UINT8 *)&(netbuffer->u);
+
+	for (i = realfirsttic; i < lasttictosend; i++)
+	{
+		const ticcmd_t *prev = i > realfirsttic ? netcmds[(i-1)%BACKUPTICS] : NULL;
+		size_t cmdsize = G_WriteTiccmdDeltas(cmdbuf, prev, netcmds[i%BACKUPTICS], doomcom->numslots) - cmdbuf;
+		size_t textsize = TotalTextCmdPerTic(i);
+		size_t size = (bufpos - (UINT8 *)netbuffer) + cmdsize + textsize;
+
+		if (size > software_MAXPACKETLENGTH)
+		{
+			DEBFILE(va("packet too large (%s) at tic %d (should be from %d to %d)\n",
+				sizeu1(size), i, realfirsttic, lasttictosend));
+
+			// Same as SV_PackTics: a tic too large on its own is sent anyway
+			if (i > realfirsttic)
+				break;
+			if (size > MAXPACKETLENGTH)
+				I_Error("Too many players: can't send %s data for %d players to node %d\n"
+				        "Well sorry nobody is perfect....\n",
+				        sizeu1(size), doomcom->numslots, n);
+			DEBFILE("sending it anyway\n");
+		}
+
+		M_Memcpy(bufpos, cmdbuf, cmdsize);
+		bufpos = SV_WriteTextCmds(bufpos + cmdsize, i);
+		*rawsize += sizeof (ticcmd_t) * doomcom->numslots + textsize;
+
+		if (size > software_MAXPACKETLENGTH)
+		{
+			i++;
+			break;
+		}
+	}
+
+	netbuffer->u.serverpak.numtics = (UINT8)(i - realfirsttic);
+	*packsize = bufpos - (UINT8 *)&(netbuffer->u);
+	return i;
+}
+
 // send the server packet
 // send tic from firstticstosend to maketic-1
 static void SV_SendTics(void)
 {
-	tic_t realfirsttic, lasttictosend, i;
+	tic_t realfirsttic, lasttictosend;
 	UINT32 n;
-	INT32 j;
-	size_t packsize;
-	UINT8 *bufpos;
-	UINT8 *ntextcmd;
+	size_t packsize, rawsize;
 
 	// send to all client but not to me
 	// for each node create a packet with x tics and send it
@@ -4647,71 +5249,15 @@ static void SV_SendTics(void)
 			if (realfirsttic < firstticstosend)
 				realfirsttic = firstticstosend;
 
-			// compute the length of the packet and cut it if too large
-			packsize = BASESERVERTICSSIZE;
-			for (i = realfirsttic; i < lasttictosend; i++)
-			{
-				packsize += sizeof (ticcmd_t) * doomcom->numslots;
-				packsize += TotalTextCmdPerTic(i);
-
-				if (packsize > software_MAXPACKETLENGTH)
-				{
-					DEBFILE(va("packet too large (%s) at tic %d (should be from %d to %d)\n",
-						sizeu1(packsize), i, realfirsttic, lasttictosend));
-					lasttictosend = i;
-
-					// too bad: too much player have send extradata and there is too
-					//          much data in one tic.
-					// To avoid it put the data on the next tic. (see getpacket
-					// textcmd case) but when numplayer changes the computation can be different
-					if (lasttictosend == realfirsttic)
-					{
-						if (packsize > MAXPACKETLENGTH)
-							I_Error("Too many players: can't send %s data for %d players to node %d\n"
-							        "Well sorry nobody is perfect....\n",
-							        sizeu1(packsize), doomcom->numslots, n);
-						else
-						{
-							lasttictosend++; // send it anyway!
-							DEBFILE("sending it anyway\n");
-						}
-					}
-					break;
-				}
-			}
-
-			// Send the tics
-			netbuffer->packettype = PT_SERVERTICS;
-			netbuffer->u.serverpak.starttic = realfirsttic;
-			netbuffer->u.serverpak.numtics = (UINT8)(lasttictosend - realfirsttic);
-			netbuffer->u.serverpak.numslots = (UINT8)SHORT(doomcom->numslots);
-			bufpos = (UINT8 *)&netbuffer->u.serverpak.cmds;
-
-			for (i = realfirsttic; i < lasttictosend; i++)
-			{
-				bufpos = G_DcpyTiccmd(bufpos, netcmds[i%BACKUPTICS], doomcom->numslots * sizeof (ticcmd_t));
-			}
-
-			// add textcmds
-			for (i = realfirsttic; i < lasttictosend; i++)
+			if (nodeticcaps[n] & TICCAP_DELTA)
+				lasttictosend = SV_PackTicsDelta(n, realfirsttic, lasttictosend, &packsize, &rawsize);
+			else
 			{
-				ntextcmd = bufpos++;
-				*ntextcmd = 0;
-				for (j = 0; j < MAXPLAYERS; j++)
-				{
-					UINT8 *textcmd = D_GetExistingTextcmd(i, j);
-					INT32 size = textcmd ? textcmd[0] : 0;
-
-					if ((!j || playeringame[j]) && size)
-					{
-						(*ntextcmd)++;
-						WRITEUINT8(bufpos, j);
-						M_Memcpy(bufpos, textcmd, size + 1);
-						bufpos += size + 1;
-					}
-				}
+				lasttictosend = SV_PackTics(n, realfirsttic, lasttictosend, &packsize);
+				rawsize = packsize;
 			}
-			packsize = bufpos - (UINT8 *)&(netbuffer->u);
+			ticrawbytes += (INT32)rawsize;
+			ticsentbytes += (INT32)packsize;
 
 			HSendPacket(n, false, 0, packsize);
 			// when tic are too large, only one tic is sent so don't go backward!
@@ -5218,6 +5764,10 @@ void NetUpdate(void)
 	}
 
 	FileSendTicker();
+
+	// Everything for this tic has been sent, let the driver flush it
+	if (I_NetFlush)
+		I_NetFlush();
 }
 
 /** Returns the number of players playing.
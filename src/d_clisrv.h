@@ -100,6 +100,11 @@ typedef enum
 	PT_MOREFILESNEEDED, // Server, to client: "you need these (+ more on top of those)"
 
 	PT_PING,          // Packet sent to tell clients the other client's latency to server.
+
+	PT_FILESACKFRAGMENT, // A part of a file, to be acknowledged with PT_FILESACK
+	PT_FILESACK,         // Selective acknowledgement of file fragments
+
+	PT_SERVERTICSDELTA, // PT_SERVERTICS with each cmd delta-encoded against the previous tic
 	NUMPACKETTYPE
 } packettype_t;
 
@@ -110,6 +115,8 @@ void Command_Droprate(void);
 #ifdef _DEBUG
 void Command_Numnodes(void);
 #endif
+void Command_NetBench(void);
+void Command_NodeBench(void);
 
 #if defined(_MSC_VER)
 #pragma pack(1)
@@ -201,6 +208,22 @@ typedef struct
 	fileacksegment_t segments[0];
 } ATTRPACK fileack_pak;
 
+typedef struct
+{
+	UINT32 start;
+	UINT32 count;
+} ATTRPACK filesackrange_t;
+
+#define MAXSACKRANGES 64
+
+typedef struct
+{
+	UINT8 fileid;
+	UINT8 numranges;
+	UINT32 cumack; // Every fragment before this one was received
+	filesackrange_t ranges[0]; // Received fragments past cumack
+} ATTRPACK filesack_pak;
+
 #ifdef _MSC_VER
 #pragma warning(default : 4200)
 #endif
@@ -217,8 +240,15 @@ typedef struct
 
 	// TSoURDt3rd
 	UINT8 tsourdt3rd;
+
+	UINT8 filetxcaps; // FILETXCAP_ flags, absent from older clients
+	UINT8 ticcaps; // TICCAP_ flags, absent from older clients
+	UINT8 savecaps; // SAVECAP_ flags, absent from older clients
 } ATTRPACK clientconfig_pak;
 
+#define TICCAP_DELTA 0x01 // Understands PT_SERVERTICSDELTA
+#define SAVECAP_CHUNKED 0x01 // Understands savegames sent in compressed chunks
+
 #define SV_DEDICATED    0x40 // server is dedicated
 #define SV_LOTSOFADDONS 0x20 // flag used to ask for full file list in d_netfil
 
@@ -331,6 +361,7 @@ typedef struct
 		UINT8 textcmd[MAXTEXTCMD+1];        //       66049 bytes (wut??? 64k??? More like 257 bytes...)
 		filetx_pak filetxpak;               //         139 bytes
 		fileack_pak fileack;
+		filesack_pak filesack;
 		UINT8 filereceived;
 		clientconfig_pak clientcfg;         //         136 bytes
 		UINT8 md5sum[16];
@@ -414,7 +445,7 @@ extern tic_t servermaxping;
 
 extern consvar_t cv_netticbuffer, cv_allownewplayer, cv_joinnextround, cv_maxplayers, cv_joindelay, cv_rejointimeout;
 extern consvar_t cv_resynchattempts, cv_blamecfail;
-extern consvar_t cv_maxsend, cv_noticedownload, cv_downloadspeed;
+extern consvar_t cv_maxsend, cv_noticedownload, cv_downloadspeed, cv_downloadpacing;
 extern consvar_t cv_dedicatedidletime;
 
 extern consvar_t cv_discordinvites;
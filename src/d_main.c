@@ -687,6 +687,11 @@ static void D_Display(void)
 
 			s[sizeof s - 1] = '\0';
 
+			if (server && netgame)
+			{
+				snprintf(s, sizeof s - 1, "TicSaved %.2f%%", ticsavedpercent);
+				V_DrawRightAlignedString(BASEVIDWIDTH, BASEVIDHEIGHT-50, V_YELLOWMAP, s);
+			}
 			snprintf(s, sizeof s - 1, "get %d b/s", getbps);
 			V_DrawRightAlignedString(BASEVIDWIDTH, BASEVIDHEIGHT-40, V_YELLOWMAP, s);
 			snprintf(s, sizeof s - 1, "send %d b/s", sendbps);
@@ -1644,6 +1649,8 @@ void D_SRB2Main(void)
 	CONS_Printf("ST_Init(): Init status bar.\n");
 	ST_Init();
 
+	W_PrintLookupStats();
+
 	if (M_CheckParm("-room"))
 	{
 		if (!M_IsNextParm())
@@ -73,6 +73,7 @@ boolean (*I_NetGet)(void) = NULL;
 void (*I_NetSend)(void) = NULL;
 boolean (*I_NetCanSend)(void) = NULL;
 boolean (*I_NetCanGet)(void) = NULL;
+void (*I_NetFlush)(void) = NULL;
 void (*I_NetCloseSocket)(void) = NULL;
 void (*I_NetFreeNodenum)(INT32 nodenum) = NULL;
 SINT8 (*I_NetMakeNodewPort)(const char *address, const char* port) = NULL;
@@ -93,10 +94,11 @@ INT64 sendbytes = 0;
 static INT32 retransmit = 0, duppacket = 0;
 static INT32 sendackpacket = 0, getackpacket = 0;
 INT32 ticruned = 0, ticmiss = 0;
+INT32 ticrawbytes = 0, ticsentbytes = 0; // Server tics as PT_SERVERTICS would send them, and as sent
 
 // globals
 INT32 getbps, sendbps;
-float lostpercent, duppercent, gamelostpercent;
+float lostpercent, duppercent, gamelostpercent, ticsavedpercent;
 INT32 packetheaderlength;
 
 boolean Net_GetNetStat(void)
@@ -121,8 +123,13 @@ boolean Net_GetNetStat(void)
 			gamelostpercent = 100.0f*(float)ticmiss/(float)ticruned;
 		else
 			gamelostpercent = 0.0f;
+		if (ticrawbytes)
+			ticsavedpercent = 100.0f - 100.0f*(float)ticsentbytes/(float)ticrawbytes;
+		else
+			ticsavedpercent = 0.0f;
 
 		ticmiss = ticruned = 0;
+		ticrawbytes = ticsentbytes = 0;
 		oldsendbyte = sendbytes;
 		getbytes = 0;
 		sendackpacket = getackpacket = duppacket = retransmit = 0;
@@ -141,6 +148,10 @@ boolean Net_GetNetStat(void)
 #define URGENTFREESLOTNUM 10
 #define ACKTOSENDTIMEOUT (TICRATE/11)
 
+#define ACKWHEELSIZE 32 // Tics covered by the resend timer wheel, more than NODETIMEOUT
+#define NOACKSLOT -1
+#define UNSCHEDULED -2
+
 typedef struct
 {
 	UINT8 acknum;
@@ -149,6 +160,8 @@ typedef struct
 	tic_t senttime; // The time when the ack was sent
 	UINT16 length; // The packet size
 	UINT16 resentnum; // The number of times the ack has been resent
+	INT16 wheelprev, wheelnext; // Links in the resend timer wheel bucket
+	UINT8 wheelbucket;
 	union {
 		SINT8 raw[MAXPACKETLENGTH];
 		doomdata_t data;
@@ -164,6 +177,14 @@ typedef enum
 // Table of packets that were not acknowleged can be resent (the sender window)
 static ackpak_t ackpak[MAXACKPACKETS];
 
+// Unused ackpak slots, as a stack
+static INT16 freeacks[MAXACKPACKETS];
+static INT32 numfreeacks;
+
+// Ackpak slots waiting to be resent, bucketed by the tic they are due at
+static INT16 ackwheel[ACKWHEELSIZE];
+static tic_t ackwheeltic; // Every bucket up to this tic was processed
+
 typedef struct
 {
 	// ack return to send (like sliding window protocol)
@@ -184,6 +205,10 @@ typedef struct
 	UINT8 remotefirstack;
 	UINT8 nextacknum;
 
+	// ackpak slot of each of our acks the node hasn't returned, plus one
+	UINT8 ackslots[256];
+	UINT8 numacks;
+
 	UINT8 flags;
 } node_t;
 
@@ -203,6 +228,65 @@ FUNCMATH static INT32 cmpack(UINT8 a, UINT8 b)
 	return d;
 }
 
+// Acks go from 1 to 255, 0 meaning none
+static UINT8 NextAck(UINT8 ack)
+{
+	return (UINT8)(ack + 1) ? (UINT8)(ack + 1) : 1;
+}
+
+/** Puts an ack in the wheel bucket of the tic it must be resent at
+  */
+static void ScheduleAck(INT32 i)
+{
+	tic_t due = ackpak[i].senttime + NODETIMEOUT + 1;
+	INT16 *bucket;
+
+	if (due <= ackwheeltic)
+		due = ackwheeltic + 1; // Overdue, resend on the next tick
+	ackpak[i].wheelbucket = (UINT8)(due % ACKWHEELSIZE);
+	bucket = &ackwheel[ackpak[i].wheelbucket];
+
+	ackpak[i].wheelprev = NOACKSLOT;
+	ackpak[i].wheelnext = *bucket;
+	if (*bucket != NOACKSLOT)
+		ackpak[*bucket].wheelprev = (INT16)i;
+	*bucket = (INT16)i;
+}
+
+static void UnscheduleAck(INT32 i)
+{
+	ackpak_t *a = &ackpak[i];
+
+	if (a->wheelprev == UNSCHEDULED)
+		return;
+
+	if (a->wheelprev != NOACKSLOT)
+		ackpak[a->wheelprev].wheelnext = a->wheelnext;
+	else
+		ackwheel[a->wheelbucket] = a->wheelnext;
+	if (a->wheelnext != NOACKSLOT)
+		ackpak[a->wheelnext].wheelprev = a->wheelprev;
+
+	a->wheelprev = a->wheelnext = UNSCHEDULED;
+}
+
+/** Returns an ack's slot to the free stack, forgetting the packet
+  */
+static void FreeAck(INT32 i)
+{
+	ackpak_t *a = &ackpak[i];
+	node_t *node = &nodes[a->destinationnode];
+
+	if (!a->acknum)
+		return;
+
+	UnscheduleAck(i);
+	node->ackslots[a->acknum] = 0;
+	node->numacks--;
+	a->acknum = 0;
+	freeacks[numfreeacks++] = (INT16)i;
+}
+
 /** Sets freeack to a free acknum and copies the netbuffer in the ackpak table
   *
   * \param freeack  The address to store the free acknum at
@@ -212,7 +296,6 @@ FUNCMATH static INT32 cmpack(UINT8 a, UINT8 b)
 static boolean GetFreeAcknum(UINT8 *freeack, boolean lowtimer)
 {
 	node_t *node = &nodes[doomcom->remotenode];
-	INT32 numfreeslot = 0;
 
 	if (cmpack((UINT8)((node->remotefirstack + MAXACKTOSEND) % 256), node->nextacknum) < 0)
 	{
@@ -220,43 +303,45 @@ static boolean GetFreeAcknum(UINT8 *freeack, boolean lowtimer)
 		return false;
 	}
 
-	for (INT32 i = 0; i < MAXACKPACKETS; i++)
-		if (!ackpak[i].acknum)
-		{
-			// For low priority packets, make sure to let freeslots so urgent packets can be sent
-			if (netbuffer->packettype >= PT_CANFAIL)
-			{
-				numfreeslot++;
-				if (numfreeslot <= URGENTFREESLOTNUM)
-					continue;
-			}
+	// For low priority packets, make sure to let freeslots so urgent packets can be sent
+	if (numfreeacks > (netbuffer->packettype >= PT_CANFAIL ? URGENTFREESLOTNUM : 0))
+	{
+		INT32 i = freeacks[--numfreeacks];
 
-			ackpak[i].acknum = node->nextacknum;
-			ackpak[i].nextacknum = node->nextacknum;
+		// An ack the node never returned, from a whole lap of acknums ago
+		if (node->ackslots[node->nextacknum])
+			FreeAck(node->ackslots[node->nextacknum] - 1);
+
+		ackpak[i].acknum = node->nextacknum;
+		ackpak[i].nextacknum = node->nextacknum;
+		node->nextacknum++;
+		if (!node->nextacknum)
 			node->nextacknum++;
-			if (!node->nextacknum)
-				node->nextacknum++;
-			ackpak[i].destinationnode = (UINT8)(node - nodes);
-			ackpak[i].length = doomcom->datalength;
-			if (lowtimer)
-			{
-				// Lowtime means can't be sent now so try it as soon as possible
-				ackpak[i].senttime = 0;
-				ackpak[i].resentnum = 1;
-			}
-			else
-			{
-				ackpak[i].senttime = I_GetTime();
-				ackpak[i].resentnum = 0;
-			}
-			M_Memcpy(ackpak[i].pak.raw, netbuffer, ackpak[i].length);
+		ackpak[i].destinationnode = (UINT8)(node - nodes);
+		ackpak[i].length = doomcom->datalength;
+		if (lowtimer)
+		{
+			// Lowtime means can't be sent now so try it as soon as possible
+			ackpak[i].senttime = 0;
+			ackpak[i].resentnum = 1;
+		}
+		else
+		{
+			ackpak[i].senttime = I_GetTime();
+			ackpak[i].resentnum = 0;
+		}
+		M_Memcpy(ackpak[i].pak.raw, netbuffer, ackpak[i].length);
 
-			*freeack = ackpak[i].acknum;
+		node->ackslots[ackpak[i].acknum] = (UINT8)(i + 1);
+		node->numacks++;
+		ScheduleAck(i);
 
-			sendackpacket++; // For stat
+		*freeack = ackpak[i].acknum;
 
-			return true;
-		}
+		sendackpacket++; // For stat
+
+		return true;
+	}
 #ifdef PARANOIA
 	CONS_Debug(DBG_NETPLAY, "No more free ackpacket\n");
 #endif
@@ -277,24 +362,10 @@ static boolean GetFreeAcknum(UINT8 *freeack, boolean lowtimer)
   */
 INT32 Net_GetFreeAcks(boolean urgent)
 {
-	INT32 numfreeslot = 0;
-	INT32 n = 0; // Number of free acks found
-
-	for (INT32 i = 0; i < MAXACKPACKETS; i++)
-		if (!ackpak[i].acknum)
-		{
-			// For low priority packets, make sure to let freeslots so urgent packets can be sent
-			if (!urgent)
-			{
-				numfreeslot++;
-				if (numfreeslot <= URGENTFREESLOTNUM)
-					continue;
-			}
-
-			n++;
-		}
-
-	return n;
+	// For low priority packets, make sure to let freeslots so urgent packets can be sent
+	if (urgent)
+		return numfreeacks;
+	return max(numfreeacks - URGENTFREESLOTNUM, 0);
 }
 
 // Get a ack to send in the queue of this node
@@ -308,7 +379,7 @@ static void RemoveAck(INT32 i)
 {
 	INT32 node = ackpak[i].destinationnode;
 	DEBFILE(va("Remove ack %d\n",ackpak[i].acknum));
-	ackpak[i].acknum = 0;
+	FreeAck(i);
 	if (nodes[node].flags & NF_CLOSE)
 		Net_CloseConnection(node);
 }
@@ -322,14 +393,16 @@ static int Processackpak(void)
 	// Received an ack return, so remove the ack in the list
 	if (netbuffer->ackreturn && cmpack(node->remotefirstack, netbuffer->ackreturn) < 0)
 	{
+		UINT8 ack = node->remotefirstack;
+
 		node->remotefirstack = netbuffer->ackreturn;
-		// Search the ackbuffer and free it
-		for (INT32 i = 0; i < MAXACKPACKETS; i++)
-			if (ackpak[i].acknum && ackpak[i].destinationnode == node - nodes
-				&& cmpack(ackpak[i].acknum, netbuffer->ackreturn) <= 0)
-			{
-				RemoveAck(i);
-			}
+		// Free the acks up to the one returned
+		do
+		{
+			ack = NextAck(ack);
+			if (node->ackslots[ack])
+				RemoveAck(node->ackslots[ack] - 1);
+		} while (ack != netbuffer->ackreturn);
 	}
 
 	// Received a packet with ack, queue it to send the ack back
@@ -435,23 +508,50 @@ void Net_SendAcks(INT32 node)
 
 static void GotAcks(void)
 {
+	node_t *node = &nodes[doomcom->remotenode];
+	UINT8 later[256]; // How many returned acks are this far or further past remotefirstack
+	INT32 ack;
+
+	memset(later, 0, sizeof (later));
 	for (INT32 j = 0; j < MAXACKTOSEND; j++)
-		if (netbuffer->u.textcmd[j])
-			for (INT32 i = 0; i < MAXACKPACKETS; i++)
-				if (ackpak[i].acknum && ackpak[i].destinationnode == doomcom->remotenode)
-				{
-					if (ackpak[i].acknum == netbuffer->u.textcmd[j])
-						RemoveAck(i);
-					// nextacknum is first equal to acknum, then when receiving bigger ack
-					// there is big chance the packet is lost
-					// When resent, nextacknum = nodes[node].nextacknum
-					// will redo the same but with different value
-					else if (cmpack(ackpak[i].nextacknum, netbuffer->u.textcmd[j]) <= 0
-							&& ackpak[i].senttime > 0)
-						{
-							ackpak[i].senttime--; // hurry up
-						}
-				}
+	{
+		UINT8 returned = netbuffer->u.textcmd[j];
+
+		if (!returned)
+			continue;
+
+		if (node->ackslots[returned])
+			RemoveAck(node->ackslots[returned] - 1);
+		if (cmpack(returned, node->remotefirstack) > 0)
+			later[(UINT8)(returned - node->remotefirstack)]++;
+	}
+
+	if (!node->numacks)
+		return;
+
+	for (ack = 254; ack >= 0; ack--)
+		later[ack] = (UINT8)min(later[ack] + later[ack + 1], UINT8_MAX);
+
+	// nextacknum is first equal to acknum, then when receiving bigger ack
+	// there is big chance the packet is lost
+	// When resent, nextacknum = nodes[node].nextacknum
+	// will redo the same but with different value
+	for (ack = 1; ack < 256; ack++)
+		if (node->ackslots[ack])
+		{
+			INT32 i = node->ackslots[ack] - 1;
+			UINT8 hurry;
+
+			if (cmpack(ackpak[i].nextacknum, node->remotefirstack) <= 0)
+				continue;
+			hurry = later[(UINT8)(ackpak[i].nextacknum - node->remotefirstack)];
+			if (hurry && ackpak[i].senttime > 0)
+			{
+				UnscheduleAck(i);
+				ackpak[i].senttime -= min(hurry, ackpak[i].senttime); // hurry up
+				ScheduleAck(i);
+			}
+		}
 }
 
 void Net_ConnectionTimeout(INT32 node)
@@ -478,28 +578,59 @@ void Net_ConnectionTimeout(INT32 node)
 // Resend the data if needed
 void Net_AckTicker(void)
 {
+	const tic_t now = I_GetTime();
+	tic_t t = ackwheeltic + 1;
 
-	for (INT32 i = 0; i < MAXACKPACKETS; i++)
+	// Only the buckets of the tics since the last call can hold acks that are due
+	if (now - ackwheeltic > ACKWHEELSIZE)
+		t = now - ACKWHEELSIZE + 1;
+
+	for (; t <= now && t > ackwheeltic; t++)
 	{
-		const INT32 nodei = ackpak[i].destinationnode;
-		node_t *node = &nodes[nodei];
-		if (ackpak[i].acknum && ackpak[i].senttime + NODETIMEOUT < I_GetTime())
+		INT16 due[MAXACKPACKETS];
+		INT32 numdue = 0;
+
+		// Take the bucket off the wheel first, as resending puts acks back
+		// and closing a connection frees them
+		while (ackwheel[t % ACKWHEELSIZE] != NOACKSLOT)
+		{
+			INT32 i = ackwheel[t % ACKWHEELSIZE];
+			due[numdue++] = (INT16)i;
+			UnscheduleAck(i);
+		}
+		ackwheeltic = t;
+
+		for (INT32 k = 0; k < numdue; k++)
 		{
+			const INT32 i = due[k];
+			const INT32 nodei = ackpak[i].destinationnode;
+			node_t *node = &nodes[nodei];
+
+			if (!ackpak[i].acknum)
+				continue;
+
+			if (ackpak[i].senttime + NODETIMEOUT >= now)
+			{
+				ScheduleAck(i); // Not due yet, or hurried into another bucket
+				continue;
+			}
+
 			if (ackpak[i].resentnum > 20 && (node->flags & NF_CLOSE))
 			{
 				DEBFILE(va("ack %d sent 20 times so connection is supposed lost: node %d\n",
 					i, nodei));
 				Net_CloseConnection(nodei | FORCECLOSE);
 
-				ackpak[i].acknum = 0;
+				FreeAck(i);
 				continue;
 			}
 			DEBFILE(va("Resend ack %d, %u<%d at %u\n", ackpak[i].acknum, ackpak[i].senttime,
-				NODETIMEOUT, I_GetTime()));
+				NODETIMEOUT, now));
 			M_Memcpy(netbuffer, ackpak[i].pak.raw, ackpak[i].length);
-			ackpak[i].senttime = I_GetTime();
+			ackpak[i].senttime = now;
 			ackpak[i].resentnum++;
 			ackpak[i].nextacknum = node->nextacknum;
+			ScheduleAck(i);
 			retransmit++; // For stat
 			HSendPacket((INT32)(node - nodes), false, ackpak[i].acknum,
 				(size_t)(ackpak[i].length - BASEPACKETSIZE));
@@ -569,11 +700,7 @@ void Net_UnAcknowledgePacket(INT32 node)
   */
 static boolean Net_AllAcksReceived(void)
 {
-	for (INT32 i = 0; i < MAXACKPACKETS; i++)
-		if (ackpak[i].acknum)
-			return false;
-
-	return true;
+	return numfreeacks == MAXACKPACKETS;
 }
 
 /** Waits for all ackreturns
@@ -606,13 +733,24 @@ static void InitNode(node_t *node)
 	node->firstacktosend = 0;
 	node->nextacknum = 1;
 	node->remotefirstack = 0;
+	memset(node->ackslots, 0, sizeof (node->ackslots));
+	node->numacks = 0;
 	node->flags = 0;
 }
 
 static void InitAck(void)
 {
-	for (INT32 i = 0; i < MAXACKPACKETS; i++)
+	numfreeacks = 0;
+	for (INT32 i = MAXACKPACKETS - 1; i >= 0; i--)
+	{
 		ackpak[i].acknum = 0;
+		ackpak[i].wheelprev = ackpak[i].wheelnext = UNSCHEDULED;
+		freeacks[numfreeacks++] = (INT16)i;
+	}
+
+	for (INT32 i = 0; i < ACKWHEELSIZE; i++)
+		ackwheel[i] = NOACKSLOT;
+	ackwheeltic = I_GetTime();
 
 	for (INT32 i = 0; i < MAXNETNODES; i++)
 		InitNode(&nodes[i]);
@@ -629,10 +767,161 @@ void Net_AbortPacketType(UINT8 packettype)
 		if (ackpak[i].acknum && (ackpak[i].pak.data.packettype == packettype
 			|| packettype == UINT8_MAX))
 		{
-			ackpak[i].acknum = 0;
+			FreeAck(i);
+		}
+}
+
+// Remote end of the ack benchmark: what each node received from us
+static UINT8 benchfirstack[MAXNETNODES];
+static boolean *benchreceived; // [MAXNETNODES][256]
+static boolean benchdirty[MAXNETNODES];
+static UINT32 benchseed, benchloss, benchdropped;
+
+#define BENCHRAND() (benchseed = benchseed * 1103515245 + 12345)
+
+static void AckBenchSend(void)
+{
+	INT32 node = doomcom->remotenode;
+	boolean *received = &benchreceived[node * 256];
+	UINT8 ack = netbuffer->ack;
+
+	if (!ack)
+		return;
+	if ((BENCHRAND() >> 16) % 100 < benchloss)
+	{
+		benchdropped++;
+		return;
+	}
+
+	// Duplicates are acknowledged again, like HGetPacket does
+	benchdirty[node] = true;
+	if (cmpack(ack, benchfirstack[node]) <= 0)
+		return;
+
+	received[ack] = true;
+	while (received[NextAck(benchfirstack[node])])
+	{
+		benchfirstack[node] = NextAck(benchfirstack[node]);
+		received[benchfirstack[node]] = false;
+	}
+	benchdirty[node] = true;
+}
+
+/** Sends reliable packets to many made up nodes through a lossy loopback,
+  * with the nodes returning acks the way real ones do, and checks that
+  * every ack is accounted for at the end.
+  * Usage: ackbench [nodes] [packets per node] [loss %]
+  */
+void Command_AckBench(void)
+{
+	void (*netsend)(void) = I_NetSend;
+	boolean (*netcansend)(void) = I_NetCanSend;
+	INT32 numnodes = 32, pernode = 1000, sent[MAXNETNODES];
+	UINT32 total, numsent = 0, resent;
+	INT32 n, j;
+	precise_t start;
+	tic_t deadline;
+	INT32 outstanding = 0;
+
+	if (netgame || !doomcom)
+	{
+		CONS_Printf("ackbench: can't run during a netgame\n");
+		return;
+	}
+
+	if (COM_Argc() > 1)
+		numnodes = min(max(atoi(COM_Argv(1)), 1), MAXNETNODES - 1);
+	if (COM_Argc() > 2)
+		pernode = max(atoi(COM_Argv(2)), 1);
+	benchloss = 0;
+	if (COM_Argc() > 3)
+		benchloss = (UINT32)min(max(atoi(COM_Argv(3)), 0), 90);
+
+	benchreceived = Z_Calloc(MAXNETNODES * 256 * sizeof (*benchreceived), PU_STATIC, NULL);
+	memset(benchfirstack, 0, sizeof (benchfirstack));
+	memset(benchdirty, 0, sizeof (benchdirty));
+	memset(sent, 0, sizeof (sent));
+	benchseed = 0x5EED;
+	benchdropped = 0;
+	total = (UINT32)numnodes * pernode;
+
+	I_NetSend = AckBenchSend;
+	I_NetCanSend = NULL;
+	netgame = true;
+	InitAck();
+	retransmit = 0;
+
+	CONS_Printf("Sending %u reliable packets to %d nodes, %u%% loss...\n", total, numnodes, benchloss);
+	start = I_GetPreciseTime();
+	deadline = I_GetTime() + 120*TICRATE;
+
+	while ((numsent < total || !Net_AllAcksReceived()) && I_GetTime() < deadline)
+	{
+		for (n = 1; n <= numnodes; n++)
+		{
+			if (sent[n] >= pernode)
+				continue;
+			netbuffer->packettype = PT_TEXTCMD;
+			memset(netbuffer->u.textcmd, n, 16);
+			if (HSendPacket(n, true, 0, 16))
+			{
+				sent[n]++;
+				numsent++;
+			}
 		}
+
+		// Nodes return acks for what they got, sometimes lost too
+		for (n = 1; n <= numnodes; n++)
+		{
+			boolean *received = &benchreceived[n * 256];
+			UINT8 ack;
+
+			if (!benchdirty[n])
+				continue;
+			benchdirty[n] = false;
+			if ((BENCHRAND() >> 16) % 100 < benchloss)
+				continue;
+
+			doomcom->remotenode = (INT16)n;
+			netbuffer->ack = 0;
+			netbuffer->ackreturn = benchfirstack[n];
+			netbuffer->packettype = PT_NOTHING;
+			memset(netbuffer->u.textcmd, 0, MAXACKTOSEND);
+			for (ack = NextAck(benchfirstack[n]), j = 0; j < MAXACKTOSEND; ack = NextAck(ack), j++)
+				if (received[ack])
+					netbuffer->u.textcmd[j] = ack;
+
+			Processackpak();
+			GotAcks();
+		}
+
+		Net_AckTicker();
+		if (numsent == total && benchloss)
+			I_Sleep(1);
+	}
+
+	resent = (UINT32)retransmit;
+	CONS_Printf("Done in %.3f s: %u sent, %u resent, %u lost\n",
+		(double)(I_GetPreciseTime() - start) / I_GetPrecisePrecision(), numsent, resent, benchdropped);
+
+	// Every slot in use must belong to a node
+	for (n = 0; n < MAXNETNODES; n++)
+		outstanding += nodes[n].numacks;
+	if (outstanding != MAXACKPACKETS - numfreeacks)
+		CONS_Printf("%d acks in use but %d known to nodes (LEAK)\n", MAXACKPACKETS - numfreeacks, outstanding);
+	if (numsent < total || outstanding)
+		CONS_Printf("Gave up with %u of %u sent and %d acks outstanding\n", numsent, total, outstanding);
+
+	InitAck();
+	netgame = false;
+	I_NetSend = netsend;
+	I_NetCanSend = netcansend;
+	Z_Free(benchreceived);
+	benchreceived = NULL;
 }
 
+#undef BENCHRAND
+
 // -----------------------------------------------------------------
 // end of acknowledge function
 // -----------------------------------------------------------------
@@ -669,14 +958,15 @@ void Net_CloseConnection(INT32 node)
 	}
 
 	// check if we are waiting for an ack from this node
-	for (INT32 i = 0; i < MAXACKPACKETS; i++)
-		if (ackpak[i].acknum && ackpak[i].destinationnode == node)
-		{
-			if (!forceclose)
-				return; // connection will be closed when ack is returned
-			else
-				ackpak[i].acknum = 0;
-		}
+	if (nodes[node].numacks)
+	{
+		if (!forceclose)
+			return; // connection will be closed when ack is returned
+
+		for (INT32 ack = 1; ack < 256; ack++)
+			if (nodes[node].ackslots[ack])
+				FreeAck(nodes[node].ackslots[ack] - 1);
+	}
 
 	InitNode(&nodes[node]);
 	SV_AbortSendFiles(node);
@@ -779,7 +1069,12 @@ static const char *packettypename[NUMPACKETTYPE] =
 	"LOGIN",
 	"TELLFILESNEEDED",
 	"MOREFILESNEEDED",
-	"PING"
+	"PING",
+
+	"FILESACKFRAGMENT",
+	"FILESACK",
+
+	"SERVERTICSDELTA"
 };
 
 static void DebugPrintpacket(const char *header)
@@ -817,6 +1112,10 @@ static void DebugPrintpacket(const char *header)
 			fprintf(debugfile, "\n");*/
 			break;
 		}
+		case PT_SERVERTICSDELTA:
+			fprintf(debugfile, "    firsttic %u ply %d tics %d\n",
+				(UINT32)netbuffer->u.serverpak.starttic, netbuffer->u.serverpak.numslots, netbuffer->u.serverpak.numtics);
+			break;
 		case PT_CLIENTCMD:
 		case PT_CLIENT2CMD:
 		case PT_CLIENTMIS:
@@ -858,6 +1157,7 @@ static void DebugPrintpacket(const char *header)
 			fprintf(debugfile, "    reason %s\n", netbuffer->u.serverrefuse.reason);
 			break;
 		case PT_FILEFRAGMENT:
+		case PT_FILESACKFRAGMENT:
 			fprintf(debugfile, "    fileid %d datasize %d position %u\n",
 				netbuffer->u.filetxpak.fileid, (UINT16)SHORT(netbuffer->u.filetxpak.size),
 				(UINT32)LONG(netbuffer->u.filetxpak.position));
@@ -1221,6 +1521,7 @@ boolean D_CheckNetGame(void)
 	I_NetGet = Internal_Get;
 	I_NetSend = Internal_Send;
 	I_NetCanSend = NULL;
+	I_NetFlush = NULL;
 	I_NetCloseSocket = NULL;
 	I_NetFreeNodenum = Internal_FreeNodenum;
 	I_NetMakeNodewPort = NULL;
@@ -1411,6 +1712,7 @@ void D_CloseConnection(void)
 		I_NetGet = Internal_Get;
 		I_NetSend = Internal_Send;
 		I_NetCanSend = NULL;
+		I_NetFlush = NULL;
 		I_NetCloseSocket = NULL;
 		I_NetFreeNodenum = Internal_FreeNodenum;
 		I_NetMakeNodewPort = NULL;
@@ -30,10 +30,12 @@
 
 // stat of net
 extern INT32 ticruned, ticmiss;
+extern INT32 ticrawbytes, ticsentbytes;
 extern INT32 getbps, sendbps;
-extern float lostpercent, duppercent, gamelostpercent;
+extern float lostpercent, duppercent, gamelostpercent, ticsavedpercent;
 extern INT32 packetheaderlength;
 boolean Net_GetNetStat(void);
+void Command_AckBench(void);
 extern INT32 getbytes;
 extern INT64 sendbytes; // Realtime updated
 
@@ -24,6 +24,7 @@
 #include "m_menu.h"
 #include "r_local.h"
 #include "r_skins.h"
+#include "r_fps.h" // Command_InterpBench_f
 #include "p_local.h"
 #include "p_setup.h"
 #include "s_sound.h"
@@ -611,6 +612,7 @@ void D_RegisterServerCommands(void)
 	CV_RegisterVar(&cv_maxsend);
 	CV_RegisterVar(&cv_noticedownload);
 	CV_RegisterVar(&cv_downloadspeed);
+	CV_RegisterVar(&cv_downloadpacing);
 	CV_RegisterVar(&cv_allownewplayer);
 	CV_RegisterVar(&cv_joinnextround);
 	CV_RegisterVar(&cv_showjoinaddress);
@@ -669,6 +671,16 @@ void D_RegisterClientCommands(void)
 
 	COM_AddCommand("numthinkers", Command_Numthinkers_f, COM_LUA);
 	COM_AddCommand("countmobjs", Command_CountMobjs_f, COM_LUA);
+	COM_AddCommand("collisionbench", Command_CollisionBench_f, 0);
+	COM_AddCommand("mobjbench", Command_MobjBench_f, 0);
+	COM_AddCommand("interpbench", Command_InterpBench_f, 0);
+#ifdef HAVE_THREADS
+	COM_AddCommand("jobbench", Command_JobBench_f, 0);
+#endif
+	COM_AddCommand("maploadtime", Command_MapLoadTime_f, 0);
+#ifdef DEVELOP
+	COM_AddCommand("textmapbench", Command_TextmapBench_f, 0);
+#endif
 
 	COM_AddCommand("changeteam", Command_Teamchange_f, COM_LUA);
 	COM_AddCommand("changeteam2", Command_Teamchange2_f, COM_LUA);
@@ -49,6 +49,8 @@
 #include "m_menu.h"
 #include "md5.h"
 #include "filesrch.h"
+#include "command.h"
+#include "i_threads.h"
 
 #include <errno.h>
 
@@ -72,6 +74,79 @@ typedef struct filetx_s
 	struct filetx_s *next; // Next file in the list
 } filetx_t;
 
+// A file being served, shared by every node downloading it
+typedef struct sendfile_s
+{
+	char *filename;
+	UINT8 *data; // The whole file, read into memory
+	UINT32 size;
+	time_t mtime;
+	long mtimensec; // 0 where stat has no sub-second times
+	INT32 refcount;
+	struct sendfile_s *next;
+} sendfile_t;
+static sendfile_t *sendfiles = NULL;
+
+// Send state of a fragment in a congestion controlled transfer
+typedef struct
+{
+	precise_t senttime; // Time of the latest transmission
+	UINT32 seq; // Send sequence number of the latest transmission
+	UINT8 flags;
+} fragmentstate_t;
+
+#define FRAG_INFLIGHT 1 // Sent and waiting for an acknowledgement
+#define FRAG_LOST     2 // Considered lost, to be sent again
+#define FRAG_RESENT   4 // Sent more than once, so useless for RTT samples
+
+#define BWSAMPLES 8
+
+// Congestion controlled transfer, used with FILETXCAP_SACK clients.
+// The window grows by one fragment per ack during slow start and by one
+// per window afterwards. Once per round trip with losses it is cut to 7/10,
+// but never below 5/4 of the measured bandwidth-delay product, so random
+// loss on a link that isn't congested doesn't starve the transfer; a timeout
+// drops it straight to that floor. Sends are paced over the round trip.
+typedef struct
+{
+	fragmentstate_t *fragments;
+	UINT32 numfragments;
+	UINT32 numacked;
+	UINT32 lowestunacked; // Every fragment before this one was acknowledged
+	UINT32 nextfragment; // Lowest fragment never sent
+	UINT32 inflight; // Fragments with FRAG_INFLIGHT
+	UINT32 lost; // Fragments with FRAG_LOST
+	UINT32 nextseq;
+	UINT32 highestackedseq;
+	UINT32 recoverseq; // Losses of fragments sent before this don't shrink the window again
+	UINT32 unreportedstart, unreportedend; // Fragments the last acknowledgement had no room for
+	fixed_t cwnd; // In fragments
+	fixed_t ssthresh;
+	precise_t srtt, rttvar; // Zero until the first sample
+	precise_t minrtt;
+	UINT8 rtobackoff;
+
+	// Delivery rate, in fragments per second, sampled about once per round trip
+	UINT32 bwsamples[BWSAMPLES];
+	UINT32 bwsample;
+	UINT32 delivered; // Fragments acknowledged since samplestart
+	UINT32 samplesent; // Value of sent at samplestart
+	precise_t samplestart;
+
+	// Statistics
+	UINT32 sent;
+	UINT32 retransmits;
+	UINT32 lossevents;
+} filewindow_t;
+
+#define INITCWND 4
+#define MINCWND 2
+#define MAXCWND 4096
+#define DUPTHRESH 3 // A fragment is lost once this many sent after it were acked
+
+#define SACKEVERY 8 // Acknowledge at least every this many fragments...
+#define SACKSCANLIMIT 8192 // ...reporting ranges up to this far past the cumulative ack
+
 // Current transfers (one for each node)
 typedef struct filetran_s
 {
@@ -81,8 +156,17 @@ typedef struct filetran_s
 	UINT32 position; // The current position in the file
 	boolean *ackedfragments;
 	UINT32 ackedsize;
-	FILE *currentfile; // The file currently being sent/received
+	boolean opened; // The current file has been opened for sending
+	sendfile_t *file; // The file currently being sent, if not sending RAM
 	tic_t dontsenduntil;
+	UINT8 caps; // FILETXCAP_ flags announced by the node
+	filewindow_t *window; // Congestion control state, NULL for iteration based transfers
+
+	// Adaptive pacing
+	INT32 rate; // Fragments per tic, 0 if not measured yet
+	UINT32 sent; // Fragments sent this sample
+	UINT32 acked; // New fragments acknowledged this sample
+	tic_t samplestart;
 } filetran_t;
 static filetran_t transfer[MAXNETNODES];
 
@@ -203,6 +287,12 @@ UINT8 *PutFileNeeded(UINT16 firstfile)
 	return p;
 }
 
+#ifdef HAVE_THREADS
+// Whether CL_CheckFiles and CL_LoadServerFiles have handed their files to the workers yet
+static boolean filesprehashed = false;
+static boolean filespreloaded = false;
+#endif
+
 void AllocFileNeeded(INT32 size)
 {
 	if (fileneeded == NULL)
@@ -213,6 +303,13 @@ void AllocFileNeeded(INT32 size)
 
 void FreeFileNeeded(void)
 {
+#ifdef HAVE_THREADS
+#ifndef NOMD5
+	W_FlushMD5Queue();
+#endif
+	W_ClearPreloads();
+	filesprehashed = filespreloaded = false;
+#endif
 	Z_Free(fileneeded);
 	fileneeded = NULL;
 }
@@ -232,6 +329,10 @@ void D_ParseFileneeded(INT32 fileneedednum_parm, UINT8 *fileneededstr, UINT16 fi
 	fileneedednum = firstfile + fileneedednum_parm;
 	p = (UINT8 *)fileneededstr;
 
+#ifdef HAVE_THREADS
+	filesprehashed = filespreloaded = false;
+#endif
+
 	AllocFileNeeded(fileneedednum);
 
 	for (i = firstfile; i < fileneedednum; i++)
@@ -399,6 +500,7 @@ boolean CL_SendFileRequest(void)
 		}
 
 	WRITEUINT8(p, 0xFF);
+	WRITEUINT8(p, FILETXCAP_SACK); // Ignored by older servers
 
 	I_GetDiskFreeSpace(&availablefreespace);
 	if (totalfreespaceneeded > availablefreespace)
@@ -416,13 +518,19 @@ boolean CL_SendFileRequest(void)
 boolean PT_RequestFile(INT32 node)
 {
 	UINT8 *p = netbuffer->u.textcmd;
+	UINT8 *end = netbuffer->u.textcmd + doomcom->datalength - BASEPACKETSIZE;
 	UINT8 id;
 
 	while (p < netbuffer->u.textcmd + MAXTEXTCMD-1) // Don't allow hacked client to overflow
 	{
 		id = READUINT8(p);
 		if (id == 0xFF)
+		{
+			// Newer clients follow the list with their capabilities
+			if (p < end)
+				SV_SetFileTransferCaps(node, READUINT8(p));
 			break;
+		}
 
 		if (!AddFileToSendQueue(node, id))
 		{
@@ -449,6 +557,7 @@ INT32 CL_CheckFiles(void)
 	char wadfilename[MAX_WADPATH];
 	size_t filestoload = 0;
 	boolean downloadrequired = false;
+	boolean checked = false, checkall = false;
 
 	// STAR STUFF: \return 5: you've autoloaded mods //
 	if (tsourdt3rd_local.autoloaded_mods)
@@ -488,6 +597,28 @@ INT32 CL_CheckFiles(void)
 		return 1;
 	}
 
+#if defined (HAVE_THREADS) && !defined (NOMD5)
+	// Hash every candidate for the files we still have to find on the
+	// worker threads first. The searches below then only hit the MD5
+	// cache, so they can all be done in one go.
+	if (!filesprehashed)
+	{
+		for (i = 0; i < fileneedednum; i++)
+			if (fileneeded[i].status == FS_NOTCHECKED && !fileneeded[i].folder)
+				findfileprehash(fileneeded[i].filename);
+		filesprehashed = true;
+	}
+
+	if (W_GetMD5QueueProgress(NULL, NULL))
+	{
+		// Lend a hand too, the workers may all be busy with something else
+		I_run_queued_job();
+		return 4;
+	}
+	W_FlushMD5Queue();
+	checkall = (I_worker_count() > 0);
+#endif
+
 	for (i = 0; i < fileneedednum; i++)
 	{
 		if (fileneeded[i].status == FS_NOTFOUND || fileneeded[i].status == FS_MD5SUMBAD)
@@ -510,19 +641,32 @@ INT32 CL_CheckFiles(void)
 			{
 				CONS_Debug(DBG_NETPLAY, "already loaded\n");
 				fileneeded[i].status = FS_OPEN;
-				return 4;
+				break;
 			}
 		}
 
+		checked = true;
+		if (fileneeded[i].status == FS_OPEN)
+		{
+			if (checkall)
+				continue;
+			return 4;
+		}
+
 		if (fileneeded[i].folder)
 			fileneeded[i].status = findfolder(fileneeded[i].filename);
 		else
 			fileneeded[i].status = findfile(fileneeded[i].filename, fileneeded[i].md5sum, true);
 
 		CONS_Debug(DBG_NETPLAY, "found %d\n", fileneeded[i].status);
-		return 4;
+		if (!checkall)
+			return 4;
 	}
 
+	// Count the files we just checked on the next call
+	if (checked)
+		return 4;
+
 	//now making it here means we've checked the entire list and no FS_NOTCHECKED files remain
 	if (numwadfiles+filestoload > MAX_WADFILES)
 		return 3;
@@ -537,12 +681,32 @@ boolean CL_LoadServerFiles(void)
 {
 	INT32 i;
 
+#ifdef HAVE_THREADS
+	// Read the directories of every file on the worker threads at once,
+	// only adding them to wadfiles is left to do one by one, in order.
+	if (!filespreloaded)
+	{
+		for (i = 0; i < fileneedednum; i++)
+			if (fileneeded[i].status == FS_FOUND && !fileneeded[i].folder)
+				W_PreloadFile(fileneeded[i].filename);
+		filespreloaded = true;
+	}
+#endif
+
 	for (i = 0; i < fileneedednum; i++)
 	{
 		if (fileneeded[i].status == FS_OPEN)
 			continue; // Already loaded
 		else if (fileneeded[i].status == FS_FOUND)
 		{
+#ifdef HAVE_THREADS
+			if (!fileneeded[i].folder && !W_PreloadDone(fileneeded[i].filename))
+			{
+				// Still being read, help out and try again next tic
+				I_run_queued_job();
+				return false;
+			}
+#endif
 			if (fileneeded[i].folder)
 				P_AddFolder(fileneeded[i].filename);
 			else
@@ -942,6 +1106,86 @@ boolean AddLuaFileToSendQueue(INT32 node, const char *filename)
 	return true;
 }
 
+/** Opens a file for sending, sharing the data with other transfers of the same file
+  *
+  * \param filename The path of the file
+  * \return The shared file
+  * \sa SV_CloseSendFile
+  *
+  */
+static sendfile_t *SV_OpenSendFile(const char *filename)
+{
+	sendfile_t *sf;
+	struct stat st;
+	FILE *handle;
+
+	if (stat(filename, &st) != 0)
+		I_Error("File %s does not exist", filename);
+
+	// Nobody wants to transfer a file bigger
+	// than 4GB!
+	if ((UINT64)st.st_size >= LONG_MAX)
+		I_Error("filesize of %s is too large", filename);
+
+	// Reuse the data if another node is already downloading this file,
+	// unless it was rewritten since (Lua files are, often within a second)
+	for (sf = sendfiles; sf; sf = sf->next)
+		if (!strcmp(sf->filename, filename) && sf->size == (UINT32)st.st_size
+			&& sf->mtime == st.st_mtime && sf->mtimensec == (long)STAT_MTIMENSEC(st))
+		{
+			sf->refcount++;
+			return sf;
+		}
+
+	sf = calloc(1, sizeof (*sf));
+	if (!sf || !(sf->filename = strdup(filename)))
+		I_Error("SV_OpenSendFile: No more memory\n");
+
+	sf->size = (UINT32)st.st_size;
+	sf->mtime = st.st_mtime;
+	sf->mtimensec = (long)STAT_MTIMENSEC(st);
+	sf->refcount = 1;
+
+	// Read rather than mapped, so the file being truncated
+	// or rewritten mid-transfer can't fault the server
+	handle = fopen(filename, "rb");
+	if (!handle)
+		I_Error("File %s does not exist", filename);
+
+	sf->data = malloc(sf->size ? sf->size : 1);
+	if (!sf->data)
+		I_Error("SV_OpenSendFile: No more memory\n");
+
+	if (fread(sf->data, 1, sf->size, handle) != sf->size)
+		I_Error("FileSendTicker: can't read %s because %s", filename, M_FileError(handle));
+	fclose(handle);
+
+	sf->next = sendfiles;
+	sendfiles = sf;
+	return sf;
+}
+
+/** Releases a file opened with SV_OpenSendFile, freeing it once nobody is sending it
+  *
+  * \param sf The shared file
+  *
+  */
+static void SV_CloseSendFile(sendfile_t *sf)
+{
+	sendfile_t **q;
+
+	if (--sf->refcount > 0)
+		return;
+
+	for (q = &sendfiles; *q != sf; q = &(*q)->next)
+		;
+	*q = sf->next;
+
+	free(sf->data);
+	free(sf->filename);
+	free(sf);
+}
+
 /** Stops sending a file for a node, and removes the file request from the list,
   * either because the file has been fully sent or because the node was disconnected
   *
@@ -959,8 +1203,8 @@ static void SV_EndFileSend(INT32 node)
 		case SF_FILE: // It's a file, close it and free its filename
 			if (cv_noticedownload.value)
 				CONS_Printf("Ending file transfer for node %d\n", node);
-			if (transfer[node].currentfile)
-				fclose(transfer[node].currentfile);
+			if (transfer[node].file)
+				SV_CloseSendFile(transfer[node].file);
 			free(p->id.filename);
 			break;
 		case SF_Z_RAM: // It's a memory block allocated with Z_Alloc or the likes, use Z_Free
@@ -977,7 +1221,14 @@ static void SV_EndFileSend(INT32 node)
 	free(p);
 
 	// Indicate that the transmission is over
-	transfer[node].currentfile = NULL;
+	if (transfer[node].window)
+	{
+		free(transfer[node].window->fragments);
+		free(transfer[node].window);
+		transfer[node].window = NULL;
+	}
+	transfer[node].opened = false;
+	transfer[node].file = NULL;
 	if (transfer[node].ackedfragments)
 		free(transfer[node].ackedfragments);
 	transfer[node].ackedfragments = NULL;
@@ -987,104 +1238,495 @@ static void SV_EndFileSend(INT32 node)
 
 #define FILEFRAGMENTSIZE (software_MAXPACKETLENGTH - (FILETXHEADER + BASEPACKETSIZE))
 
-/** Handles file transmission
+// Adaptive pacing: rates are re-evaluated every PACINGSAMPLE tics
+#define PACINGSAMPLE (TICRATE/2)
+#define PACINGMAXRATE 300
+
+/** Adjusts a node's send rate from the acknowledgements received
+  * during the last sample: grow while everything sent gets acked,
+  * fall back towards the measured delivery rate otherwise
+  *
+  * \param node The destination
+  * \return The number of fragments the node may be sent this tic
   *
   */
-void FileSendTicker(void)
+static INT32 SV_PaceNode(INT32 node)
 {
-	static INT32 currentnode = 0;
-	filetx_pak *p;
-	size_t fragmentsize;
-	filetx_t *f;
-	INT32 packetsent, ram, i, j;
+	filetran_t *t = &transfer[node];
+	tic_t now = I_GetTime();
 
-	// If someone is taking too long to download, kick them with a timeout
-	// to prevent blocking the rest of the server...
-	if (luafiletransfers)
+	if (!t->rate)
 	{
-		for (i = 1; i < MAXNETNODES; i++)
+		t->rate = cv_downloadspeed.value;
+		t->sent = t->acked = 0;
+		t->samplestart = now;
+	}
+	else if (now - t->samplestart >= PACINGSAMPLE)
+	{
+		if (t->sent)
 		{
-			luafiletransfernodestatus_t status = luafiletransfers->nodestatus[i];
+			if (t->acked * 8 >= t->sent * 7)
+				t->rate = min(t->rate + t->rate/4 + 1, PACINGMAXRATE);
+			else
+			{
+				INT32 delivered = (INT32)(t->acked / (now - t->samplestart));
+				t->rate = max((t->rate + delivered) / 2, 1);
+			}
+		}
 
-			if (status != LFTNS_NONE && status != LFTNS_WAITING && status != LFTNS_SENT
-				&& I_GetTime() > luafiletransfers->nodetimeouts[i])
+		t->sent = t->acked = 0;
+		t->samplestart = now;
+	}
+
+	return t->rate;
+}
+
+/** Sets up congestion control for a transfer
+  *
+  * \param w The window to initialise
+  * \param size The size of the file in bytes
+  *
+  */
+static void SV_InitWindow(filewindow_t *w, UINT32 size)
+{
+	memset(w, 0, sizeof (*w));
+	w->numfragments = size ? (size - 1) / FILEFRAGMENTSIZE + 1 : 1;
+	w->fragments = calloc(w->numfragments, sizeof (*w->fragments));
+	if (!w->fragments)
+		I_Error("FileSendTicker: No more memory\n");
+	w->cwnd = INITCWND*FRACUNIT;
+	w->ssthresh = MAXCWND*FRACUNIT;
+}
+
+/** Returns the retransmission timeout of a transfer
+  *
+  */
+static precise_t SV_WindowRTO(const filewindow_t *w)
+{
+	const precise_t second = I_GetPrecisePrecision();
+	precise_t rto;
+
+	if (!w->srtt)
+		rto = second;
+	else
+		rto = w->srtt + max(4*w->rttvar, second/5);
+
+	return min(rto << w->rtobackoff, 4*second);
+}
+
+/** Finds the fragment to send next, lost ones first
+  *
+  * \param w The transfer
+  * \param acked Which fragments were acknowledged
+  * \return The fragment number, or UINT32_MAX if the window is full
+  *
+  */
+static UINT32 SV_NextWindowFragment(filewindow_t *w, const boolean *acked)
+{
+	UINT32 i;
+
+	if (w->inflight >= (UINT32)(w->cwnd >> FRACBITS))
+		return UINT32_MAX;
+
+	if (w->lost)
+		for (i = w->lowestunacked; i < w->nextfragment; i++)
+			if (w->fragments[i].flags & FRAG_LOST)
+				return i;
+
+	while (w->nextfragment < w->numfragments && acked[w->nextfragment])
+		w->nextfragment++;
+
+	return w->nextfragment < w->numfragments ? w->nextfragment : UINT32_MAX;
+}
+
+/** Records that a fragment was sent
+  *
+  */
+static void SV_WindowSent(filewindow_t *w, UINT32 i, precise_t now)
+{
+	fragmentstate_t *frag = &w->fragments[i];
+
+	if (frag->flags & FRAG_LOST)
+	{
+		frag->flags &= ~FRAG_LOST;
+		frag->flags |= FRAG_RESENT;
+		w->lost--;
+		w->retransmits++;
+	}
+	else if (frag->flags & FRAG_INFLIGHT)
+		return; // Can't happen, but don't count it twice
+
+	if (!w->sent)
+	{
+		w->samplestart = now;
+		w->samplesent = 0;
+	}
+
+	frag->flags |= FRAG_INFLIGHT;
+	frag->senttime = now;
+	frag->seq = w->nextseq++;
+	w->inflight++;
+	w->sent++;
+
+	if (i == w->nextfragment)
+		w->nextfragment++;
+}
+
+/** Processes the acknowledgement of a fragment, growing the window
+  *
+  * \return True if the fragment wasn't acknowledged before
+  *
+  */
+static boolean SV_WindowAck(filewindow_t *w, boolean *acked, UINT32 i, precise_t now)
+{
+	fragmentstate_t *frag = &w->fragments[i];
+
+	if (acked[i])
+		return false;
+	acked[i] = true;
+	w->numacked++;
+	w->delivered++;
+
+	if (frag->flags & FRAG_INFLIGHT)
+		w->inflight--;
+	else if (frag->flags & FRAG_LOST) // Only late, not lost after all
+		w->lost--;
+
+	if (frag->flags & (FRAG_INFLIGHT|FRAG_LOST))
+	{
+		// RTT sample, only from fragments sent once (Karn)
+		if (!(frag->flags & FRAG_RESENT))
+		{
+			precise_t rtt = now - frag->senttime;
+
+			if (!w->minrtt || rtt < w->minrtt)
+				w->minrtt = max(rtt, 1);
+
+			if (!w->srtt)
 			{
-				Net_ConnectionTimeout(i);
+				w->srtt = rtt;
+				w->rttvar = rtt / 2;
+			}
+			else
+			{
+				precise_t delta = w->srtt > rtt ? w->srtt - rtt : rtt - w->srtt;
+				w->rttvar = (3*w->rttvar + delta) / 4;
+				w->srtt = (7*w->srtt + rtt) / 8;
 			}
 		}
+		w->rtobackoff = 0;
+
+		if (frag->seq >= w->highestackedseq)
+			w->highestackedseq = frag->seq;
 	}
+	frag->flags = 0;
 
-	if (!filestosend) // No file to send
+	// Grow the window, unless still recovering from a loss
+	if (w->highestackedseq >= w->recoverseq)
+	{
+		if (w->cwnd < w->ssthresh)
+			w->cwnd += FRACUNIT;
+		else
+			w->cwnd += FixedDiv(FRACUNIT, w->cwnd);
+		w->cwnd = min(w->cwnd, MAXCWND*FRACUNIT);
+	}
+
+	while (w->lowestunacked < w->numfragments && acked[w->lowestunacked])
+		w->lowestunacked++;
+
+	return true;
+}
+
+/** Records the delivery rate once a round trip has passed since the last sample
+  *
+  */
+static void SV_SampleDeliveryRate(filewindow_t *w, precise_t now)
+{
+	const precise_t second = I_GetPrecisePrecision();
+	precise_t interval = now - w->samplestart;
+	UINT32 delivered;
+
+	if (interval < max(w->srtt, second / TICRATE))
 		return;
 
-	packetsent = cv_downloadspeed.value;
+	// A retransmission filling a hole acknowledges many fragments at once;
+	// nothing can be delivered faster than it was sent
+	delivered = min(w->delivered, w->sent - w->samplesent);
 
-	netbuffer->packettype = PT_FILEFRAGMENT;
+	w->bwsamples[w->bwsample++ % BWSAMPLES] = (UINT32)((UINT64)delivered * second / interval);
+	w->delivered = 0;
+	w->samplesent = w->sent;
+	w->samplestart = now;
+}
 
-	// (((sendbytes-nowsentbyte)*TICRATE)/(I_GetTime()-starttime)<(UINT32)net_bandwidth)
-	while (packetsent-- && filestosend != 0)
+/** Returns the smallest window a loss can shrink a transfer to:
+  * a bit more than the best recent bandwidth times the shortest round trip
+  *
+  */
+static fixed_t SV_WindowFloor(const filewindow_t *w)
+{
+	UINT32 maxbw = 0, bdp, i;
+
+	for (i = 0; i < BWSAMPLES; i++)
+		maxbw = max(maxbw, w->bwsamples[i]);
+
+	bdp = (UINT32)((UINT64)maxbw * w->minrtt / I_GetPrecisePrecision());
+	bdp += bdp / 4;
+	return min(max(bdp, MINCWND), MAXCWND) * FRACUNIT;
+}
+
+/** Spreads a window over its round trip instead of sending it in one burst,
+  * with some headroom to let it grow
+  *
+  * \return How many fragments can be sent this tic
+  *
+  */
+static INT32 SV_WindowBudget(const filewindow_t *w)
+{
+	UINT32 budget;
+
+	if (!w->srtt)
+		return PACINGMAXRATE;
+
+	budget = (UINT32)((UINT64)(w->cwnd >> FRACBITS) * I_GetPrecisePrecision() / TICRATE / w->srtt);
+	if (w->cwnd < w->ssthresh)
+		budget *= 2; // Slow start doubles the window every round trip
+	else
+		budget += budget/4;
+
+	return (INT32)min(budget + 1, PACINGMAXRATE);
+}
+
+/** Marks the fragments that must have been lost, either because
+  * fragments sent after them were acknowledged or because they timed out,
+  * and shrinks the window once per round trip with losses
+  *
+  */
+static void SV_DetectLosses(filewindow_t *w, precise_t now)
+{
+	precise_t rto;
+	UINT32 i;
+
+	if (!w->inflight)
+		return;
+
+	rto = SV_WindowRTO(w);
+
+	for (i = w->lowestunacked; i < w->nextfragment; i++)
 	{
-		for (i = currentnode, j = 0; j < MAXNETNODES;
-			i = (i+1) % MAXNETNODES, j++)
+		fragmentstate_t *frag = &w->fragments[i];
+		boolean timedout;
+
+		if (!(frag->flags & FRAG_INFLIGHT))
+			continue;
+
+		timedout = (now - frag->senttime > rto);
+		if (!timedout && (frag->seq + DUPTHRESH > w->highestackedseq
+			|| (i >= w->unreportedstart && i < w->unreportedend)))
+			continue;
+
+		frag->flags &= ~FRAG_INFLIGHT;
+		frag->flags |= FRAG_LOST;
+		w->inflight--;
+		w->lost++;
+
+		if (frag->seq >= w->recoverseq) // New loss event
 		{
-			if (transfer[i].txlist)
-				break;
+			w->ssthresh = max(FixedMul(w->cwnd, 7*FRACUNIT/10), SV_WindowFloor(w));
+			w->cwnd = timedout ? SV_WindowFloor(w) : w->ssthresh;
+			w->recoverseq = w->nextseq;
+			w->lossevents++;
 		}
-		// no transfer to do
-		if (j >= MAXNETNODES)
-			I_Error("filestosend=%d but no file to send found\n", filestosend);
+		if (timedout)
+			w->rtobackoff = min(w->rtobackoff + 1, 4);
+	}
+}
 
-		currentnode = (i+1) % MAXNETNODES;
-		f = transfer[i].txlist;
-		ram = f->ram;
+/** Applies a selective acknowledgement to a transfer
+  *
+  * \param w The transfer
+  * \param acked Which fragments were acknowledged
+  * \param packet The acknowledgement, in network byte order
+  * \param numranges The number of ranges in the packet
+  * \param now The time it was received
+  * \return The number of newly acknowledged fragments, or -1 if the packet is invalid
+  *
+  */
+static INT32 SV_ProcessSack(filewindow_t *w, boolean *acked, const filesack_pak *packet, UINT8 numranges, precise_t now)
+{
+	UINT32 cumack = LONG(packet->cumack);
+	INT32 newlyacked = 0;
+	UINT32 i, j;
+
+	if (cumack > w->numfragments)
+		return -1;
+
+	for (i = w->lowestunacked; i < cumack; i++)
+		newlyacked += SV_WindowAck(w, acked, i, now);
+
+	for (i = 0; i < numranges; i++)
+	{
+		UINT32 start = LONG(packet->ranges[i].start);
+		UINT32 count = LONG(packet->ranges[i].count);
+
+		if (start > w->numfragments || count > w->numfragments - start)
+			return -1;
+
+		for (j = start; j < start + count; j++)
+			newlyacked += SV_WindowAck(w, acked, j, now);
+	}
+
+	// A full packet may have left out ranges between its lower and upper halves
+	if (numranges == MAXSACKRANGES)
+	{
+		w->unreportedstart = LONG(packet->ranges[MAXSACKRANGES/2 - 1].start) + LONG(packet->ranges[MAXSACKRANGES/2 - 1].count);
+		w->unreportedend = LONG(packet->ranges[MAXSACKRANGES/2].start);
+	}
+	else
+		w->unreportedstart = w->unreportedend = 0;
+
+	SV_SampleDeliveryRate(w, now);
+	SV_DetectLosses(w, now);
+	return newlyacked;
+}
+
+/** Builds a selective acknowledgement from the fragments received so far.
+  * When there are too many gaps, the lowest half of the ranges and the
+  * highest half are reported: the former are usually filled by resent
+  * fragments, the latter by new ones. Ranges are in ascending order.
+  *
+  * \param packet The packet to fill
+  * \param received Which fragments were received
+  * \param numfragments The number of fragments in the file
+  * \param cumack Every fragment before this one was received, updated
+  * \param highest The highest fragment that may have been received
+  * \return The size of the packet
+  *
+  */
+static size_t BuildSackPacket(filesack_pak *packet, const boolean *received, UINT32 numfragments, UINT32 *cumack, UINT32 highest)
+{
+	filesackrange_t *ranges = packet->ranges;
+	UINT32 i, top, lowend, first, last;
+
+	while (*cumack < numfragments && received[*cumack])
+		(*cumack)++;
 
-		// Open the file if it isn't open yet, or
-		if (!transfer[i].currentfile)
+	top = highest < numfragments ? highest + 1 : numfragments;
+	top = min(top, *cumack + SACKSCANLIMIT);
+	packet->cumack = LONG(*cumack);
+	packet->numranges = 0;
+
+	// Lowest ranges, upwards
+	for (i = *cumack; i < top && packet->numranges < MAXSACKRANGES/2;)
+	{
+		UINT32 start;
+
+		if (!received[i])
 		{
-			if (!ram) // Sending a file
-			{
-				long filesize;
+			i++;
+			continue;
+		}
 
-				transfer[i].currentfile =
-					fopen(f->id.filename, "rb");
+		for (start = i; i < top && received[i]; i++)
+			;
+		ranges[packet->numranges].start = LONG(start);
+		ranges[packet->numranges].count = LONG(i - start);
+		packet->numranges++;
+	}
+	lowend = i;
 
-				if (!transfer[i].currentfile)
-					I_Error("File %s does not exist",
-						f->id.filename);
+	// Highest ranges, downwards
+	first = packet->numranges;
+	for (i = top; i > lowend && packet->numranges < MAXSACKRANGES;)
+	{
+		UINT32 end;
 
-				fseek(transfer[i].currentfile, 0, SEEK_END);
-				filesize = ftell(transfer[i].currentfile);
+		if (!received[i - 1])
+		{
+			i--;
+			continue;
+		}
 
-				// Nobody wants to transfer a file bigger
-				// than 4GB!
-				if (filesize >= LONG_MAX)
-					I_Error("filesize of %s is too large", f->id.filename);
-				if (filesize == -1)
-					I_Error("Error getting filesize of %s", f->id.filename);
+		for (end = i; i > lowend && received[i - 1]; i--)
+			;
+		ranges[packet->numranges].start = LONG(i);
+		ranges[packet->numranges].count = LONG(end - i);
+		packet->numranges++;
+	}
 
-				f->size = (UINT32)filesize;
-				fseek(transfer[i].currentfile, 0, SEEK_SET);
-			}
-			else // Sending RAM
-				transfer[i].currentfile = (FILE *)1; // Set currentfile to a non-null value to indicate that it is open
+	// Put those back in ascending order
+	for (last = packet->numranges; first + 1 < last; first++, last--)
+	{
+		filesackrange_t swap = ranges[first];
+		ranges[first] = ranges[last - 1];
+		ranges[last - 1] = swap;
+	}
 
-			transfer[i].iteration = 1;
-			transfer[i].ackediteration = 0;
-			transfer[i].position = 0;
-			transfer[i].ackedsize = 0;
+	return sizeof (*packet) + packet->numranges * sizeof (*packet->ranges);
+}
 
-			transfer[i].ackedfragments = calloc(f->size / FILEFRAGMENTSIZE + 1, sizeof(*transfer[i].ackedfragments));
-			if (!transfer[i].ackedfragments)
-				I_Error("FileSendTicker: No more memory\n");
+/** Sends the next fragment of the current file to a node
+  *
+  * \param i The destination
+  * \return 1 if a fragment was sent, 0 if the node is waiting for acks,
+  *         -1 if the packet couldn't be sent
+  *
+  */
+static INT32 SV_SendFileFragment(INT32 i)
+{
+	filetx_pak *p;
+	size_t fragmentsize;
+	filetx_t *f = transfer[i].txlist;
+	filewindow_t *w;
+	INT32 ram = f->ram;
+	UINT32 position, fragment = 0;
+
+	// Open the file if it isn't open yet, or
+	if (!transfer[i].opened)
+	{
+		if (!ram) // Sending a file
+		{
+			transfer[i].file = SV_OpenSendFile(f->id.filename);
+			f->size = transfer[i].file->size;
+		}
+
+		transfer[i].opened = true;
+		transfer[i].iteration = 1;
+		transfer[i].ackediteration = 0;
+		transfer[i].position = 0;
+		transfer[i].ackedsize = 0;
 
-			transfer[i].dontsenduntil = 0;
+		transfer[i].ackedfragments = calloc(f->size / FILEFRAGMENTSIZE + 1, sizeof(*transfer[i].ackedfragments));
+		if (!transfer[i].ackedfragments)
+			I_Error("FileSendTicker: No more memory\n");
+
+		transfer[i].dontsenduntil = 0;
+
+		if (transfer[i].caps & FILETXCAP_SACK)
+		{
+			transfer[i].window = malloc(sizeof (filewindow_t));
+			if (!transfer[i].window)
+				I_Error("FileSendTicker: No more memory\n");
+			SV_InitWindow(transfer[i].window, f->size);
 		}
+	}
 
+	w = transfer[i].window;
+	if (w)
+	{
+		// Congestion controlled: the window decides
+		fragment = SV_NextWindowFragment(w, transfer[i].ackedfragments);
+		if (fragment == UINT32_MAX)
+			return 0;
+		position = fragment * FILEFRAGMENTSIZE;
+	}
+	else
+	{
 		// If the client hasn't acknowledged any fragment from the previous iteration,
 		// it is most likely because their acks haven't had enough time to reach the server
 		// yet, due to latency. In that case, we wait a little to avoid useless resend.
 		if (I_GetTime() < transfer[i].dontsenduntil)
-			continue;
+			return 0;
 
 		// Find the first non-acknowledged fragment
 		while (transfer[i].ackedfragments[transfer[i].position / FILEFRAGMENTSIZE])
@@ -1099,45 +1741,172 @@ void FileSendTicker(void)
 				transfer[i].iteration++;
 			}
 		}
+		position = transfer[i].position;
+	}
 
-		// Build a packet containing a file fragment
-		p = &netbuffer->u.filetxpak;
-		fragmentsize = FILEFRAGMENTSIZE;
-		if (f->size-transfer[i].position < fragmentsize)
-			fragmentsize = f->size-transfer[i].position;
-		if (ram)
-			M_Memcpy(p->data, &f->id.ram[transfer[i].position], fragmentsize);
-		else
+	// Build a packet containing a file fragment,
+	// straight from memory or the shared file data
+	netbuffer->packettype = w ? PT_FILESACKFRAGMENT : PT_FILEFRAGMENT;
+	p = &netbuffer->u.filetxpak;
+	fragmentsize = FILEFRAGMENTSIZE;
+	if (f->size-position < fragmentsize)
+		fragmentsize = f->size-position;
+	if (ram)
+		M_Memcpy(p->data, &f->id.ram[position], fragmentsize);
+	else
+		M_Memcpy(p->data, &transfer[i].file->data[position], fragmentsize);
+	p->iteration = w ? 0 : transfer[i].iteration;
+	p->position = LONG(position);
+	p->fileid = f->fileid;
+	p->filesize = LONG(f->size);
+	p->size = SHORT((UINT16)FILEFRAGMENTSIZE);
+
+	// Send the packet
+	if (!HSendPacket(i, false, 0, FILETXHEADER + fragmentsize)) // Don't use the default acknowledgement system
+		return -1;
+
+	transfer[i].sent++;
+	if (w)
+	{
+		SV_WindowSent(w, fragment, I_GetPreciseTime());
+		return 1;
+	}
+
+	transfer[i].position = (UINT32)(position + fragmentsize);
+	if (transfer[i].position >= f->size)
+	{
+		if (transfer[i].ackediteration < transfer[i].iteration)
+			transfer[i].dontsenduntil = I_GetTime() + TICRATE / 2;
+
+		transfer[i].position = 0;
+		transfer[i].iteration++;
+	}
+	return 1;
+}
+
+/** Checks if a node's current file is sent with congestion control
+  *
+  */
+static boolean SV_IsWindowed(INT32 node)
+{
+	if (transfer[node].opened)
+		return transfer[node].window != NULL;
+	return (transfer[node].caps & FILETXCAP_SACK) != 0;
+}
+
+/** Handles file transmission
+  *
+  */
+void FileSendTicker(void)
+{
+	static INT32 currentnode = 0;
+	INT32 budget[MAXNETNODES];
+	INT32 packetsent, i, j;
+	precise_t now = I_GetPreciseTime();
+	boolean windowed;
+
+	// If someone is taking too long to download, kick them with a timeout
+	// to prevent blocking the rest of the server...
+	if (luafiletransfers)
+	{
+		for (i = 1; i < MAXNETNODES; i++)
 		{
-			fseek(transfer[i].currentfile, transfer[i].position, SEEK_SET);
+			luafiletransfernodestatus_t status = luafiletransfers->nodestatus[i];
 
-			if (fread(p->data, 1, fragmentsize, transfer[i].currentfile) != fragmentsize)
-				I_Error("FileSendTicker: can't read %s byte on %s at %d because %s", sizeu1(fragmentsize), f->id.filename, transfer[i].position, M_FileError(transfer[i].currentfile));
+			if (status != LFTNS_NONE && status != LFTNS_WAITING && status != LFTNS_SENT
+				&& I_GetTime() > luafiletransfers->nodetimeouts[i])
+			{
+				Net_ConnectionTimeout(i);
+			}
 		}
-		p->iteration = transfer[i].iteration;
-		p->position = LONG(transfer[i].position);
-		p->fileid = f->fileid;
-		p->filesize = LONG(f->size);
-		p->size = SHORT((UINT16)FILEFRAGMENTSIZE);
-
-		// Send the packet
-		if (HSendPacket(i, false, 0, FILETXHEADER + fragmentsize)) // Don't use the default acknowledgement system
-		{ // Success
-			transfer[i].position = (UINT32)(transfer[i].position + fragmentsize);
-			if (transfer[i].position >= f->size)
+	}
+
+	if (!filestosend) // No file to send
+		return;
+
+	// Congestion controlled transfers are limited by their window,
+	// others get their own rate in adaptive mode
+	windowed = false;
+	for (i = 0; i < MAXNETNODES; i++)
+	{
+		budget[i] = 0;
+		if (!transfer[i].txlist)
+			continue;
+
+		if (SV_IsWindowed(i))
+		{
+			if (transfer[i].window)
 			{
-				if (transfer[i].ackediteration < transfer[i].iteration)
-					transfer[i].dontsenduntil = I_GetTime() + TICRATE / 2;
+				SV_DetectLosses(transfer[i].window, now);
+				budget[i] = SV_WindowBudget(transfer[i].window);
+			}
+			else
+				budget[i] = PACINGMAXRATE;
+			windowed = true;
+		}
+		else if (cv_downloadpacing.value)
+			budget[i] = SV_PaceNode(i);
+	}
 
-				transfer[i].position = 0;
-				transfer[i].iteration++;
+	if (windowed || cv_downloadpacing.value)
+	{
+		boolean sent = true;
+
+		// Interleave the nodes until everyone is out of budget
+		while (sent && filestosend != 0)
+		{
+			sent = false;
+			for (i = currentnode, j = 0; j < MAXNETNODES;
+				i = (i+1) % MAXNETNODES, j++)
+			{
+				if (!budget[i] || !transfer[i].txlist)
+					continue;
+
+				budget[i]--;
+				switch (SV_SendFileFragment(i))
+				{
+					case 1:
+						sent = true;
+						break;
+					case 0: // Waiting for acks, skip the node for this tic
+						budget[i] = 0;
+						break;
+					default: // Can't send this one so why should i send the next?
+						return;
+				}
 			}
 		}
-		else
-		{ // Not sent for some odd reason, retry at next call
-			// Exit the while (can't send this one so why should i send the next?)
+		currentnode = (currentnode+1) % MAXNETNODES;
+
+		if (cv_downloadpacing.value)
+			return;
+	}
+
+	packetsent = cv_downloadspeed.value;
+
+	// (((sendbytes-nowsentbyte)*TICRATE)/(I_GetTime()-starttime)<(UINT32)net_bandwidth)
+	while (packetsent-- && filestosend != 0)
+	{
+		for (i = currentnode, j = 0; j < MAXNETNODES;
+			i = (i+1) % MAXNETNODES, j++)
+		{
+			if (transfer[i].txlist && !SV_IsWindowed(i))
+				break;
+		}
+		// no transfer to do
+		if (j >= MAXNETNODES)
+		{
+			if (!windowed)
+				I_Error("filestosend=%d but no file to send found\n", filestosend);
 			break;
 		}
+
+		currentnode = (i+1) % MAXNETNODES;
+
+		// Not sent for some odd reason, retry at next call
+		// Exit the while (can't send this one so why should i send the next?)
+		if (SV_SendFileFragment(i) < 0)
+			break;
 	}
 }
 
@@ -1182,6 +1951,7 @@ void PT_FileAck(void)
 				{
 					trans->ackedfragments[LONG(segment->start) + j] = true;
 					trans->ackedsize += FILEFRAGMENTSIZE;
+					trans->acked++;
 
 					// If the last missing fragment was acked, finish!
 					if (trans->ackedsize == trans->txlist->size)
@@ -1194,6 +1964,50 @@ void PT_FileAck(void)
 	}
 }
 
+void PT_FileSack(void)
+{
+	filesack_pak *packet = &netbuffer->u.filesack;
+	INT32 node = doomcom->remotenode;
+	filetran_t *trans = &transfer[node];
+	INT32 newlyacked;
+
+	// Wrong file id? Ignore it, it's probably a late packet
+	if (!(trans->txlist && trans->window && packet->fileid == trans->txlist->fileid))
+		return;
+
+	if (packet->numranges > MAXSACKRANGES
+		|| packet->numranges * sizeof(*packet->ranges) != doomcom->datalength - BASEPACKETSIZE - sizeof(*packet))
+	{
+		Net_CloseConnection(node);
+		return;
+	}
+
+	newlyacked = SV_ProcessSack(trans->window, trans->ackedfragments, packet, packet->numranges, I_GetPreciseTime());
+	if (newlyacked < 0)
+	{
+		Net_CloseConnection(node);
+		return;
+	}
+
+	trans->acked += newlyacked;
+	trans->ackedsize = min(trans->window->numacked * FILEFRAGMENTSIZE, trans->txlist->size);
+
+	// If the last missing fragment was acked, finish!
+	if (trans->window->numacked == trans->window->numfragments)
+		SV_EndFileSend(node);
+}
+
+/** Sets the file transfer capabilities a node announced
+  *
+  * \param node The node
+  * \param caps FILETXCAP_ flags
+  *
+  */
+void SV_SetFileTransferCaps(INT32 node, UINT8 caps)
+{
+	transfer[node].caps = caps & FILETXCAP_SACK;
+}
+
 void PT_FileReceived(void)
 {
 	filetx_t *trans = transfer[doomcom->remotenode].txlist;
@@ -1249,6 +2063,28 @@ static void AddFragmentToAckPacket(fileack_pak *packet, UINT8 iteration, UINT32
 	segment->acks |= 1 << (fragmentpos - segment->start);
 }
 
+/** Acknowledges the fragments of a file received so far with a PT_FILESACK
+  *
+  * \param file The file being downloaded
+  * \param fileid Its index in the fileneeded table
+  *
+  */
+static void CL_SendSack(fileneeded_t *file, UINT8 fileid)
+{
+	filesack_pak *packet = &netbuffer->u.filesack;
+	UINT32 numfragments = file->totalsize ? (file->totalsize - 1) / file->fragmentsize + 1 : 1;
+	size_t packetsize;
+
+	packetsize = BuildSackPacket(packet, file->receivedfragments, numfragments, &file->sackcumack, file->sackhighest);
+	packet->fileid = fileid;
+
+	netbuffer->packettype = PT_FILESACK;
+	HSendPacket(servernode, false, 0, packetsize);
+
+	file->sackpending = 0;
+	file->lastsacktic = I_GetTime();
+}
+
 void FileReceiveTicker(void)
 {
 	INT32 i;
@@ -1257,7 +2093,12 @@ void FileReceiveTicker(void)
 	{
 		fileneeded_t *file = &fileneeded[i];
 
-		if (file->status == FS_DOWNLOADING)
+		if (file->status == FS_DOWNLOADING && file->sack)
+		{
+			if (file->sackpending)
+				CL_SendSack(file, i);
+		}
+		else if (file->status == FS_DOWNLOADING)
 		{
 			if (lasttimeackpacketsent - I_GetTime() > TICRATE / 2)
 				SendAckPacket(file->ackpacket, i);
@@ -1293,6 +2134,7 @@ void PT_FileFragment(void)
 	UINT16 fragmentsize = SHORT(netbuffer->u.filetxpak.size);
 	UINT16 boundedfragmentsize = doomcom->datalength - BASEPACKETSIZE - sizeof(netbuffer->u.filetxpak);
 	char *filename;
+	boolean finished = false;
 
 	if (!file)
 		return;
@@ -1365,6 +2207,12 @@ void PT_FileFragment(void)
 				I_Error("FileSendTicker: No more memory\n");
 		}
 
+		file->sack = false;
+		file->sackcumack = 0;
+		file->sackpending = 0;
+		// A resumed download may already have any fragment
+		file->sackhighest = file->ackresendposition == UINT32_MAX ? 0 : UINT32_MAX;
+
 		lasttimeackpacketsent = I_GetTime();
 	}
 
@@ -1373,6 +2221,12 @@ void PT_FileFragment(void)
 		if (fragmentpos >= file->totalsize)
 			I_Error("Invalid file fragment\n");
 
+		if (netbuffer->packettype == PT_FILESACKFRAGMENT)
+		{
+			file->sack = true;
+			file->ackresendposition = UINT32_MAX; // Resumed fragments are covered by the SACKs
+		}
+
 		file->iteration = max(file->iteration, netbuffer->u.filetxpak.iteration);
 
 		if (!file->receivedfragments[fragmentpos / fragmentsize]) // Not received yet
@@ -1385,7 +2239,13 @@ void PT_FileFragment(void)
 				I_Error("Can't write to %s: %s\n",filename, M_FileError(file->file));
 			file->currentsize += boundedfragmentsize;
 
-			AddFragmentToAckPacket(file->ackpacket, file->iteration, fragmentpos / fragmentsize, filenum);
+			if (file->sack)
+			{
+				file->sackhighest = max(file->sackhighest, fragmentpos / fragmentsize);
+				file->sackpending++;
+			}
+			else
+				AddFragmentToAckPacket(file->ackpacket, file->iteration, fragmentpos / fragmentsize, filenum);
 
 			// Finished?
 			if (file->currentsize == file->totalsize)
@@ -1411,14 +2271,22 @@ void PT_FileFragment(void)
 					HSendPacket(servernode, true, 0, 0);
 					FreeFileNeeded();
 				}
+				finished = true;
 			}
 		}
 		else // Already received
 		{
 			// If they are sending us the fragment again, it's probably because
 			// they missed our previous ack, so we must re-acknowledge it
-			AddFragmentToAckPacket(file->ackpacket, file->iteration, fragmentpos / fragmentsize, filenum);
+			if (file->sack)
+				file->sackpending++;
+			else
+				AddFragmentToAckPacket(file->ackpacket, file->iteration, fragmentpos / fragmentsize, filenum);
 		}
+
+		// Delayed acknowledgement: once per tic, or sooner when many fragments are pending
+		if (!finished && file->sack && (file->sackpending >= SACKEVERY || file->lastsacktic != I_GetTime()))
+			CL_SendSack(file, filenum);
 	}
 	else if (!file->justdownloaded)
 	{
@@ -1468,6 +2336,8 @@ void SV_AbortSendFiles(INT32 node)
 {
 	while (transfer[node].txlist)
 		SV_EndFileSend(node);
+	transfer[node].rate = 0;
+	transfer[node].caps = 0;
 }
 
 void CloseNetFile(void)
@@ -1541,10 +2411,166 @@ void Command_Downloads_f(void)
 			CONS_Printf("%2d  %c%s  ", node, ratecolor, name); // Node and file name
 			CONS_Printf("\x80%uK\x84/\x80%uK ", position / 1024, size / 1024); // Progress in kB
 			CONS_Printf("\x80(%c%u%%\x80)  ", ratecolor, (UINT32)(100.0 * position / size)); // Progress in %
+			if (transfer[node].window) // Congestion window and round trip time
+				CONS_Printf("\x80%d\x84w \x80%d\x84ms  ", transfer[node].window->cwnd >> FRACBITS,
+					(INT32)(transfer[node].window->srtt * 1000 / I_GetPrecisePrecision()));
+			else if (cv_downloadpacing.value)
+				CONS_Printf("\x80%dK/s  ", transfer[node].rate * TICRATE * (INT32)FILEFRAGMENTSIZE / 1024); // Current send rate
 			CONS_Printf("%s\n", I_GetNodeAddress(node)); // Address and newline
 		}
 }
 
+#define BENCHQUEUE 64 // Fragments the bottleneck link can queue
+#define BENCHFLIGHT 65536 // Fragments that can be on the wire at once
+#define BENCHACKS 1024 // Acknowledgements that can be on the wire at once
+#define BENCHSACKSIZE (sizeof (filesack_pak) + MAXSACKRANGES * sizeof (filesackrange_t))
+
+/** Simulates a download over a lossy bottleneck link, tic by tic, using the
+  * same congestion control and selective acknowledgement code as real
+  * transfers, and reports the goodput.
+  * Usage: filetxbench [size in KB] [loss %] [latency in ms] [bandwidth in KB/s]
+  */
+void Command_FileTxBench(void)
+{
+	const precise_t second = I_GetPrecisePrecision();
+	INT32 sizekb = 8192, loss = 2, latency = 100, bandwidth = 2048;
+	UINT32 size, highest = 0, pending = 0, cumack = 0, numreceived = 0;
+	UINT32 queuehead = 0, queuetail = 0, flighthead = 0, flighttail = 0, ackhead = 0, acktail = 0;
+	UINT32 randomdrops = 0, queuedrops = 0, ackdrops = 0;
+	UINT32 *queue, *flight;
+	tic_t *flightarrive, *ackarrive, t, delay, maxtics = 3600*TICRATE;
+	UINT8 *acks;
+	boolean *acked, *received;
+	fixed_t rate, credit = 0;
+	filewindow_t w;
+
+	if (COM_Argc() > 1)
+		sizekb = max(atoi(COM_Argv(1)), 1);
+	if (COM_Argc() > 2)
+		loss = min(max(atoi(COM_Argv(2)), 0), 99);
+	if (COM_Argc() > 3)
+		latency = max(atoi(COM_Argv(3)), 0);
+	if (COM_Argc() > 4)
+		bandwidth = max(atoi(COM_Argv(4)), 1);
+
+	size = (UINT32)min(sizekb, 1024*1024) * 1024;
+	delay = (tic_t)(latency * TICRATE / 2000); // One way
+	rate = FixedDiv(bandwidth * 1024 / TICRATE, FILEFRAGMENTSIZE); // Fragments per tic
+
+	SV_InitWindow(&w, size);
+	acked = calloc(w.numfragments, sizeof (*acked));
+	received = calloc(w.numfragments, sizeof (*received));
+	queue = malloc(BENCHQUEUE * sizeof (*queue));
+	flight = malloc(BENCHFLIGHT * sizeof (*flight));
+	flightarrive = malloc(BENCHFLIGHT * sizeof (*flightarrive));
+	ackarrive = malloc(BENCHACKS * sizeof (*ackarrive));
+	acks = malloc(BENCHACKS * BENCHSACKSIZE);
+	if (!(acked && received && queue && flight && flightarrive && ackarrive && acks))
+		I_Error("Command_FileTxBench: No more memory\n");
+
+	CONS_Printf("Sending %d KB over a %d KB/s link, %d ms round trip, %d%% loss...\n", sizekb, bandwidth, latency, loss);
+
+	for (t = 0; t < maxtics && w.numacked < w.numfragments; t++)
+	{
+		precise_t now = (precise_t)t * second / TICRATE;
+		INT32 n;
+
+		// Fragments reaching the client, acknowledged every SACKEVERY...
+		while (flighthead != flighttail && flightarrive[flighthead % BENCHFLIGHT] <= t)
+		{
+			UINT32 k = flight[flighthead++ % BENCHFLIGHT];
+
+			if (!received[k])
+			{
+				received[k] = true;
+				numreceived++;
+				highest = max(highest, k);
+			}
+
+			if (++pending >= SACKEVERY || flighthead == flighttail || flightarrive[flighthead % BENCHFLIGHT] > t)
+			{
+				// ...or at the end of the tic
+				filesack_pak *packet = (filesack_pak *)&acks[(acktail % BENCHACKS) * BENCHSACKSIZE];
+
+				BuildSackPacket(packet, received, w.numfragments, &cumack, highest);
+				pending = 0;
+				if (acktail - ackhead >= BENCHACKS || rand() % 100 < loss)
+					ackdrops++;
+				else
+					ackarrive[acktail++ % BENCHACKS] = t + delay;
+			}
+		}
+
+		// Acknowledgements reaching the server
+		while (ackhead != acktail && ackarrive[ackhead % BENCHACKS] <= t)
+		{
+			filesack_pak *packet = (filesack_pak *)&acks[(ackhead++ % BENCHACKS) * BENCHSACKSIZE];
+			SV_ProcessSack(&w, acked, packet, packet->numranges, now);
+		}
+		if (w.numacked == w.numfragments)
+			break;
+
+		// The bottleneck drains its queue...
+		credit += rate;
+		while (credit >= FRACUNIT && queuehead != queuetail && flighttail - flighthead < BENCHFLIGHT)
+		{
+			flightarrive[flighttail % BENCHFLIGHT] = t + delay;
+			flight[flighttail++ % BENCHFLIGHT] = queue[queuehead++ % BENCHQUEUE];
+			credit -= FRACUNIT;
+		}
+
+		// ...while the server sends what its window allows
+		SV_DetectLosses(&w, now);
+		for (n = SV_WindowBudget(&w); n > 0; n--)
+		{
+			UINT32 k = SV_NextWindowFragment(&w, acked);
+
+			if (k == UINT32_MAX)
+				break;
+			SV_WindowSent(&w, k, now);
+
+			if (rand() % 100 < loss)
+				randomdrops++;
+			else if (queuehead == queuetail && credit >= FRACUNIT && flighttail - flighthead < BENCHFLIGHT)
+			{
+				flightarrive[flighttail % BENCHFLIGHT] = t + delay;
+				flight[flighttail++ % BENCHFLIGHT] = k;
+				credit -= FRACUNIT;
+			}
+			else if (queuetail - queuehead >= BENCHQUEUE)
+				queuedrops++;
+			else
+				queue[queuetail++ % BENCHQUEUE] = k;
+		}
+
+		// Unused capacity is lost
+		if (queuehead == queuetail)
+			credit = min(credit, FRACUNIT);
+	}
+
+	if (w.numacked < w.numfragments)
+		CONS_Printf("Gave up after %d seconds, %u of %u fragments acknowledged\n", maxtics / TICRATE, w.numacked, w.numfragments);
+	else
+	{
+		double seconds = (double)max(t, 1) / TICRATE;
+		double goodput = size / 1024.0 / seconds;
+
+		CONS_Printf("Done in %.2f s: goodput %.0f KB/s, %.0f%% of the link\n", seconds, goodput, 100.0 * goodput / bandwidth);
+	}
+	CONS_Printf("%u fragments sent, %u resent, %u loss events\n", w.sent, w.retransmits, w.lossevents);
+	CONS_Printf("Dropped: %u randomly, %u by the full link queue, %u acknowledgements\n", randomdrops, queuedrops, ackdrops);
+	CONS_Printf("Final window %d fragments, smoothed round trip %d ms\n", w.cwnd >> FRACBITS, (INT32)(w.srtt * 1000 / second));
+
+	free(w.fragments);
+	free(acked);
+	free(received);
+	free(queue);
+	free(flight);
+	free(flightarrive);
+	free(ackarrive);
+	free(acks);
+}
+
 // Functions cut and pasted from Doomatic :)
 
 void nameonly(char *s)
@@ -1588,17 +2614,13 @@ filestatus_t checkfilemd5(char *filename, const UINT8 *wantedmd5sum)
 	(void)wantedmd5sum;
 	(void)filename;
 #else
-	FILE *fhandle;
 	UINT8 md5sum[16];
 
 	if (!wantedmd5sum)
 		return FS_FOUND;
 
-	fhandle = fopen(filename, "rb");
-	if (fhandle)
+	if (!W_MakeFileMD5(filename, md5sum))
 	{
-		md5_stream(fhandle,md5sum);
-		fclose(fhandle);
 		if (!memcmp(wantedmd5sum, md5sum, 16))
 			return FS_FOUND;
 		return FS_MD5SUMBAD;
@@ -1644,6 +2666,16 @@ filestatus_t findfile(char *filename, const UINT8 *wantedmd5sum, boolean complet
 	return (badmd5 ? FS_MD5SUMBAD : FS_NOTFOUND); // md5 sum bad or file not found
 }
 
+#if defined (HAVE_THREADS) && !defined (NOMD5)
+// Queues the MD5s a findfile for this file would make, see filesearchprehash.
+void findfileprehash(const char *filename)
+{
+	filesearchprehash(filename, srb2home, 10);
+	filesearchprehash(filename, srb2path, 10);
+	filesearchprehash(filename, ".", 10);
+}
+#endif
+
 // Searches for a folder.
 // This can be used with a full path, or an incomplete path.
 // In the latter case, the function will try to find folders in
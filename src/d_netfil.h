@@ -62,8 +62,18 @@ typedef struct
 	UINT32 currentsize;
 	UINT32 totalsize;
 	UINT32 ackresendposition; // Used when resuming downloads
+
+	// Used only for selectively acknowledged downloads
+	boolean sack; // The server sends PT_FILESACKFRAGMENT, answer with PT_FILESACK
+	UINT32 sackcumack; // Every fragment before this one was received
+	UINT32 sackhighest; // Highest fragment that may have been received
+	UINT32 sackpending; // Fragments received since the last PT_FILESACK
+	tic_t lastsacktic;
 } fileneeded_t;
 
+// File transfer capabilities, announced by the client in PT_REQUESTFILE and PT_CLIENTJOIN
+#define FILETXCAP_SACK 0x01 // Congestion controlled transfers with selective acknowledgements
+
 #define FILENEEDEDSIZE 23
 
 extern INT32 fileneedednum;
@@ -89,7 +99,9 @@ void AddRamToSendQueue(INT32 node, void *data, size_t size, freemethod_t freemet
 
 void FileSendTicker(void);
 void PT_FileAck(void);
+void PT_FileSack(void);
 void PT_FileReceived(void);
+void SV_SetFileTransferCaps(INT32 node, UINT8 caps);
 boolean SendingFile(INT32 node);
 
 void FileReceiveTicker(void);
@@ -143,6 +155,7 @@ void CloseNetFile(void);
 void CL_AbortDownloadResume(void);
 
 void Command_Downloads_f(void);
+void Command_FileTxBench(void);
 
 boolean fileexist(char *filename, time_t ptime);
 
@@ -150,6 +163,10 @@ boolean fileexist(char *filename, time_t ptime);
 filestatus_t findfile(char *filename, const UINT8 *wantedmd5sum,
 	boolean completepath);
 filestatus_t checkfilemd5(char *filename, const UINT8 *wantedmd5sum);
+#if defined (HAVE_THREADS) && !defined (NOMD5)
+// Hashes what findfile would check on the worker threads, see W_QueueFileMD5
+void findfileprehash(const char *filename);
+#endif
 
 // Searches for a folder
 filestatus_t findfolder(const char *path);
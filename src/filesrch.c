@@ -34,6 +34,8 @@
 #include <limits.h>
 #endif
 #include <string.h>
+#include <ctype.h>
+#include <time.h>
 
 #include "filesrch.h"
 #include "d_netfil.h"
@@ -41,6 +43,7 @@
 #include "z_zone.h"
 #include "m_menu.h" // Addons_option_Onchange
 #include "w_wad.h"
+#include "i_system.h"
 
 #if defined (_WIN32) && defined (_MSC_VER)
 
@@ -387,132 +390,451 @@ char *refreshdirname = NULL;
 
 #define isuptree(dirent) ((dirent)[0]=='.' && ((dirent)[1]=='\0' || ((dirent)[1]=='.' && (dirent)[2]=='\0')))
 
-filestatus_t filesearch(char *filename, const char *startpath, const UINT8 *wantedmd5sum, boolean completepath, int maxsearchdepth)
+//
+// File catalog
+//
+// filesearch used to walk the whole tree under startpath for every file it
+// was asked for. Instead, each (startpath, depth) pair gets a catalog of
+// every file under it, hashed by name. A catalog is refreshed at most once
+// per tic, and then only the directories whose modification time changed
+// are read again. Each file remembers its MD5 until its size or time change.
+//
+
+#define CATALOGBUCKETS 1024
+#define MAXCATALOGS 8
+
+typedef struct
 {
-	filestatus_t retval = FS_NOTFOUND;
-	DIR **dirhandle;
+	char *path; // NULL if the directory went away
+	time_t mtime, scantime;
+	int depthleft;
+	boolean scanned;
+} catalogdir_t;
+
+typedef struct
+{
+	char *path;
+	const char *name; // points into path
+	size_t dir;
+	INT64 size; // size and time of the file when md5sum was made
+	time_t mtime;
+	long mtimensec;
+	UINT8 md5sum[16];
+	boolean md5valid;
+	INT32 next; // next file in the same bucket, or -1
+} catalogfile_t;
+
+typedef struct
+{
+	char *startpath;
+	int maxsearchdepth;
+	catalogdir_t *dirs;
+	size_t numdirs, maxdirs;
+	catalogfile_t *files;
+	size_t numfiles, maxfiles;
+	INT32 buckets[CATALOGBUCKETS];
+	precise_t refreshtime;
+} filecatalog_t;
+
+static filecatalog_t catalogs[MAXCATALOGS];
+static size_t numcatalogs = 0;
+
+static UINT32 filenamehash(const char *name)
+{
+	UINT32 hash = 5381;
+
+	while (*name)
+		hash = (hash * 33) ^ (UINT8)tolower(*name++);
+
+	return hash;
+}
+
+static void catalogadddir(filecatalog_t *cat, const char *path, int depthleft)
+{
+	catalogdir_t *dir;
+
+	if (cat->numdirs == cat->maxdirs)
+	{
+		cat->maxdirs = cat->maxdirs ? cat->maxdirs * 2 : 16;
+		cat->dirs = realloc(cat->dirs, cat->maxdirs * sizeof (*cat->dirs));
+		if (!cat->dirs)
+			I_Error("catalogadddir(): out of memory");
+	}
+
+	dir = &cat->dirs[cat->numdirs++];
+	dir->path = strdup(path);
+	dir->mtime = dir->scantime = 0;
+	dir->depthleft = depthleft;
+	dir->scanned = false;
+}
+
+static void catalogaddfile(filecatalog_t *cat, const char *path, size_t namepos, size_t dirnum)
+{
+	catalogfile_t *file;
+
+	if (cat->numfiles == cat->maxfiles)
+	{
+		cat->maxfiles = cat->maxfiles ? cat->maxfiles * 2 : 64;
+		cat->files = realloc(cat->files, cat->maxfiles * sizeof (*cat->files));
+		if (!cat->files)
+			I_Error("catalogaddfile(): out of memory");
+	}
+
+	file = &cat->files[cat->numfiles++];
+	file->path = strdup(path);
+	file->name = file->path + namepos;
+	file->dir = dirnum;
+	file->md5valid = false;
+	file->next = -1;
+}
+
+// Reads the files in one directory, and adds subdirectories that aren't known yet.
+static void catalogscandir(filecatalog_t *cat, size_t dirnum, boolean initial)
+{
+	char searchpath[dirpathlen];
+	size_t pathlen, i;
 	struct dirent *dent;
 	struct stat fsstat;
-	int found = 0;
-	char *searchname = strdup(filename);
-	int depthleft = maxsearchdepth;
-	char searchpath[1024];
-	size_t *searchpathindex;
+	DIR *dirhandle;
+	int depthleft;
 
-	dirhandle = (DIR**) malloc(maxsearchdepth * sizeof (DIR*));
-	searchpathindex = (size_t *) malloc(maxsearchdepth * sizeof (size_t));
+	strlcpy(searchpath, cat->dirs[dirnum].path, sizeof searchpath);
+	depthleft = cat->dirs[dirnum].depthleft;
 
-	strcpy(searchpath,startpath);
-	searchpathindex[--depthleft] = strlen(searchpath) + 1;
+	if (!(dirhandle = opendir(searchpath)))
+		return;
 
-	dirhandle[depthleft] = opendir(searchpath);
+	cat->dirs[dirnum].scanned = true;
+	cat->dirs[dirnum].scantime = time(NULL);
 
-	if (dirhandle[depthleft] == NULL)
+	pathlen = strlen(searchpath);
+	if (pathlen && searchpath[pathlen-1] != PATHSEP[0] && pathlen + 1 < sizeof searchpath)
 	{
-		free(searchname);
-		free(dirhandle);
-		free(searchpathindex);
-		return FS_NOTFOUND;
+		searchpath[pathlen++] = PATHSEP[0];
+		searchpath[pathlen] = 0;
 	}
 
-	if (searchpath[searchpathindex[depthleft]-2] != PATHSEP[0])
+	while ((dent = readdir(dirhandle)) != NULL)
 	{
-		searchpath[searchpathindex[depthleft]-1] = PATHSEP[0];
-		searchpath[searchpathindex[depthleft]] = 0;
+		if (isuptree(dent->d_name))
+			continue; // we don't want to scan uptree
+
+		if (pathlen + strlen(dent->d_name) >= sizeof searchpath)
+			continue;
+		strcpy(&searchpath[pathlen], dent->d_name);
+
+#if defined(__linux__) || defined(__FreeBSD__)
+		// Linux and FreeBSD has a special field for file type on dirent, so use that to speed up lookups.
+		if (dent->d_type == DT_UNKNOWN || dent->d_type == DT_LNK)
+		{
+			if (stat(searchpath, &fsstat) < 0)
+				continue; // was the file (re)moved? can't stat it
+			if (S_ISDIR(fsstat.st_mode))
+				dent->d_type = DT_DIR;
+		}
+
+		if (dent->d_type != DT_DIR)
+#else
+		if (stat(searchpath, &fsstat) < 0) // do we want to follow symlinks? if not: change it to lstat
+			continue; // was the file (re)moved? can't stat it
+
+		if (!S_ISDIR(fsstat.st_mode))
+#endif
+		{
+			catalogaddfile(cat, searchpath, pathlen, dirnum);
+			continue;
+		}
+
+		if (!depthleft)
+			continue;
+
+		// Subdirectories that are already known are checked on their own
+		if (!initial)
+		{
+			for (i = 0; i < cat->numdirs; i++)
+				if (cat->dirs[i].path && !strcmp(cat->dirs[i].path, searchpath))
+					break;
+			if (i < cat->numdirs)
+				continue;
+		}
+
+		catalogadddir(cat, searchpath, depthleft - 1);
 	}
-	else
-		searchpathindex[depthleft]--;
 
-	while ((!found) && (depthleft < maxsearchdepth))
+	closedir(dirhandle);
+}
+
+// Rechains every file so that earlier files come first in their bucket.
+static void catalogrehash(filecatalog_t *cat)
+{
+	size_t i;
+
+	for (i = 0; i < CATALOGBUCKETS; i++)
+		cat->buckets[i] = -1;
+
+	for (i = cat->numfiles; i-- > 0;)
 	{
-		searchpath[searchpathindex[depthleft]]=0;
-		dent = readdir(dirhandle[depthleft]);
+		INT32 *bucket = &cat->buckets[filenamehash(cat->files[i].name) & (CATALOGBUCKETS-1)];
 
-		if (!dent)
+		cat->files[i].next = *bucket;
+		*bucket = (INT32)i;
+	}
+}
+
+// Drops the files of every directory marked for rescanning.
+static void catalogdropfiles(filecatalog_t *cat, const boolean *stale)
+{
+	size_t i, j;
+
+	for (i = j = 0; i < cat->numfiles; i++)
+	{
+		if (stale[cat->files[i].dir])
 		{
-			closedir(dirhandle[depthleft++]);
+			free(cat->files[i].path);
 			continue;
 		}
+		cat->files[j++] = cat->files[i];
+	}
 
-		if (isuptree(dent->d_name))
-		{
-			// we don't want to scan uptree
+	cat->numfiles = j;
+}
+
+static void refreshcatalog(filecatalog_t *cat)
+{
+	const boolean initial = !cat->numfiles && cat->numdirs == 1 && !cat->dirs[0].scanned;
+	boolean *stale = NULL;
+	boolean changed = false;
+	struct stat fsstat;
+	size_t i, numdirs = cat->numdirs;
+
+	// Find the directories that changed since they were last read
+	for (i = 0; i < numdirs; i++)
+	{
+		catalogdir_t *dir = &cat->dirs[i];
+		boolean gone;
+
+		if (!dir->path)
+			continue;
+
+		gone = (stat(dir->path, &fsstat) < 0 || !S_ISDIR(fsstat.st_mode));
+
+		// A directory changed in the same second it was read may hide more changes
+		if (!gone && dir->scanned && fsstat.st_mtime == dir->mtime && dir->mtime < dir->scantime)
 			continue;
+
+		if (!stale)
+		{
+			stale = calloc(numdirs, sizeof (*stale));
+			if (!stale)
+				I_Error("refreshcatalog(): out of memory");
 		}
 
-		// okay, now we actually want searchpath to incorporate d_name
-		strcpy(&searchpath[searchpathindex[depthleft]],dent->d_name);
+		stale[i] = true;
+		changed = true;
 
-#if defined(__linux__) || defined(__FreeBSD__)
-		if (dent->d_type == DT_UNKNOWN || dent->d_type == DT_LNK)
-			if (stat(searchpath,&fsstat) == 0 && S_ISDIR(fsstat.st_mode))
-				dent->d_type = DT_DIR;
+		// The start path is kept, so it's looked at again if it comes back
+		if (gone && i == 0)
+			dir->scanned = false;
+		else if (gone)
+		{
+			free(dir->path);
+			dir->path = NULL;
+		}
+		else
+			dir->mtime = fsstat.st_mtime;
+	}
 
-		// Linux and FreeBSD has a special field for file type on dirent, so use that to speed up lookups.
-		if (dent->d_type == DT_DIR && depthleft)
-#else
-		if (stat(searchpath,&fsstat) < 0) // do we want to follow symlinks? if not: change it to lstat
-			; // was the file (re)moved? can't stat it
-		else if (S_ISDIR(fsstat.st_mode) && depthleft)
-#endif
+	if (!changed)
+		return;
+
+	catalogdropfiles(cat, stale);
+
+	// Read them again, along with any new subdirectories they turn up
+	for (i = 0; i < cat->numdirs; i++)
+	{
+		if (i < numdirs && !stale[i])
+			continue;
+		if (!cat->dirs[i].path)
+			continue;
+
+		if (i >= numdirs)
 		{
-			searchpathindex[--depthleft] = strlen(searchpath) + 1;
-			dirhandle[depthleft] = opendir(searchpath);
-			if (!dirhandle[depthleft])
+			if (stat(cat->dirs[i].path, &fsstat) < 0)
 			{
-					// can't open it... maybe no read-permissions
-					// go back to previous dir
-					depthleft++;
+				free(cat->dirs[i].path);
+				cat->dirs[i].path = NULL;
+				continue;
 			}
+			cat->dirs[i].mtime = fsstat.st_mtime;
+		}
+
+		catalogscandir(cat, i, initial);
+	}
+
+	free(stale);
+	catalogrehash(cat);
+}
 
-			searchpath[searchpathindex[depthleft]-1]=PATHSEP[0];
-			searchpath[searchpathindex[depthleft]]=0;
+static filecatalog_t *getcatalog(const char *startpath, int maxsearchdepth)
+{
+	filecatalog_t *cat = NULL;
+	precise_t now = I_GetPreciseTime();
+	size_t i;
+
+	for (i = 0; i < numcatalogs; i++)
+	{
+		if (catalogs[i].maxsearchdepth == maxsearchdepth && !strcmp(catalogs[i].startpath, startpath))
+		{
+			cat = &catalogs[i];
+			break;
 		}
-		else if (!strcasecmp(searchname, dent->d_name))
+	}
+
+	if (!cat)
+	{
+		precise_t t = now;
+
+		// Out of catalogs? Reuse the last one, the earlier ones are the common search paths.
+		if (numcatalogs == MAXCATALOGS)
 		{
-#ifndef IGNORE_SYMLINKS
-			struct stat statbuf;
+			cat = &catalogs[MAXCATALOGS-1];
+			for (i = 0; i < cat->numfiles; i++)
+				free(cat->files[i].path);
+			for (i = 0; i < cat->numdirs; i++)
+				free(cat->dirs[i].path);
+			free(cat->startpath);
+			cat->numfiles = cat->numdirs = 0;
+		}
+		else
+			cat = &catalogs[numcatalogs++];
+
+		cat->startpath = strdup(startpath);
+		cat->maxsearchdepth = maxsearchdepth;
+		catalogadddir(cat, startpath, maxsearchdepth - 1);
+		refreshcatalog(cat);
+		cat->refreshtime = now;
+
+		CONS_Debug(DBG_SETUP, "Cataloged %s files in %s directories under %s in %f seconds\n",
+			sizeu1(cat->numfiles), sizeu2(cat->numdirs), startpath,
+			(double)(I_GetPreciseTime() - t) / I_GetPrecisePrecision());
+	}
+	else if ((now - cat->refreshtime) * TICRATE >= I_GetPrecisePrecision())
+	{
+		refreshcatalog(cat);
+		cat->refreshtime = now;
+	}
+
+	return cat;
+}
+
+// Like checkfilemd5, but remembers the digest for as long as the file stays the same.
+static filestatus_t checkcatalogmd5(catalogfile_t *file, const UINT8 *wantedmd5sum)
+{
+#ifdef NOMD5
+	(void)file;
+	(void)wantedmd5sum;
+#else
+	struct stat fsstat;
+
+	if (!wantedmd5sum)
+		return FS_FOUND;
+
+	if (stat(file->path, &fsstat) < 0)
+		return FS_NOTFOUND; // it's gone since the catalog was refreshed
+
+	if (!file->md5valid || (INT64)fsstat.st_size != file->size
+		|| fsstat.st_mtime != file->mtime || (long)STAT_MTIMENSEC(fsstat) != file->mtimensec)
+	{
+		if (W_MakeFileMD5(file->path, file->md5sum))
+			return FS_NOTFOUND;
+
+		file->size = (INT64)fsstat.st_size;
+		file->mtime = fsstat.st_mtime;
+		file->mtimensec = (long)STAT_MTIMENSEC(fsstat);
+		file->md5valid = true;
+	}
+
+	if (memcmp(wantedmd5sum, file->md5sum, 16))
+		return FS_MD5SUMBAD;
 #endif
-			switch (checkfilemd5(searchpath, wantedmd5sum))
+	return FS_FOUND;
+}
+
+filestatus_t filesearch(char *filename, const char *startpath, const UINT8 *wantedmd5sum, boolean completepath, int maxsearchdepth)
+{
+	filestatus_t retval = FS_NOTFOUND;
+	filecatalog_t *cat;
+	INT32 i;
+
+	if (maxsearchdepth < 1)
+		return FS_NOTFOUND;
+
+	cat = getcatalog(startpath, maxsearchdepth);
+
+	for (i = cat->buckets[filenamehash(filename) & (CATALOGBUCKETS-1)]; i != -1; i = cat->files[i].next)
+	{
+		catalogfile_t *file = &cat->files[i];
+
+		if (strcasecmp(filename, file->name))
+			continue;
+
+		switch (checkcatalogmd5(file, wantedmd5sum))
+		{
+			case FS_FOUND:
 			{
-				case FS_FOUND:
-					if (completepath)
-						strcpy(filename,searchpath);
-					else
-						strcpy(filename,dent->d_name);
 #ifndef IGNORE_SYMLINKS
-					if (lstat(filename, &statbuf) != -1)
+				struct stat statbuf;
+#endif
+				if (completepath)
+					strcpy(filename, file->path);
+				else
+					strcpy(filename, file->name);
+#ifndef IGNORE_SYMLINKS
+				if (lstat(filename, &statbuf) != -1)
+				{
+					if (S_ISLNK(statbuf.st_mode))
 					{
-						if (S_ISLNK(statbuf.st_mode))
-						{
-							char *tempbuf = realpath(filename, NULL);
-							if (!tempbuf)
-								I_Error("Error parsing link %s: %s", filename, strerror(errno));
-							strncpy(filename, tempbuf, MAX_WADPATH);
-							free(tempbuf);
-						}
+						char *tempbuf = realpath(filename, NULL);
+						if (!tempbuf)
+							I_Error("Error parsing link %s: %s", filename, strerror(errno));
+						strncpy(filename, tempbuf, MAX_WADPATH);
+						free(tempbuf);
 					}
+				}
 #endif
-					retval = FS_FOUND;
-					found = 1;
-					break;
-				case FS_MD5SUMBAD:
-					retval = FS_MD5SUMBAD;
-					break;
-				default: // prevent some compiler warnings
-					break;
+				return FS_FOUND;
 			}
+			case FS_MD5SUMBAD:
+				retval = FS_MD5SUMBAD;
+				break;
+			default: // prevent some compiler warnings
+				break;
 		}
 	}
 
-	for (; depthleft < maxsearchdepth; closedir(dirhandle[depthleft++]));
+	return retval;
+}
 
-	free(searchname);
-	free(searchpathindex);
-	free(dirhandle);
+#if defined (HAVE_THREADS) && !defined (NOMD5)
+// Queues an MD5 for every file filesearch would have to check for filename,
+// so a later filesearch with the same arguments only hits the cache.
+void filesearchprehash(const char *filename, const char *startpath, int maxsearchdepth)
+{
+	filecatalog_t *cat;
+	INT32 i;
 
-	return retval;
+	if (maxsearchdepth < 1)
+		return;
+
+	cat = getcatalog(startpath, maxsearchdepth);
+
+	for (i = cat->buckets[filenamehash(filename) & (CATALOGBUCKETS-1)]; i != -1; i = cat->files[i].next)
+	{
+		if (!strcasecmp(filename, cat->files[i].name))
+			W_QueueFileMD5(cat->files[i].path);
+	}
 }
+#endif
 
 #ifndef AVOID_ERRNO
 int direrror = 0;
@@ -917,6 +1239,34 @@ char exttable[NUM_EXT_TABLE][7] = { // maximum extension length (currently 4) pl
 	"\5.pk3", "\5.soc", "\5.lua"}; // addfile
 
 static char (*filenamebuf)[MAX_WADPATH];
+static UINT16 *filenamenext; // index+1 of the next loaded file in the same bucket, 0 ends
+static UINT16 filenamebuckets[64];
+
+// Hashes the names of the loaded files, so the menu can mark them without comparing against all of them.
+static void buildfilenameindex(void)
+{
+	size_t i;
+
+	filenamebuf = calloc(max(numwadfiles, 1), sizeof(char) * MAX_WADPATH);
+	filenamenext = calloc(max(numwadfiles, 1), sizeof (*filenamenext));
+	if (!filenamebuf || !filenamenext)
+		I_Error("preparefilemenu(): could not index loaded files.");
+
+	memset(filenamebuckets, 0, sizeof (filenamebuckets));
+
+	for (i = numwadfiles; i-- > 0;)
+	{
+		UINT16 *bucket;
+
+		strncpy(filenamebuf[i], wadfiles[i]->filename, MAX_WADPATH-1);
+		filenamebuf[i][MAX_WADPATH - 1] = '\0';
+		nameonly(filenamebuf[i]);
+
+		bucket = &filenamebuckets[filenamehash(filenamebuf[i]) & 63];
+		filenamenext[i] = *bucket;
+		*bucket = (UINT16)(i + 1);
+	}
+}
 
 static boolean filemenucmp(char *haystack, char *needle)
 {
@@ -1190,20 +1540,13 @@ boolean preparefilemenu(boolean samedepth)
 					size_t i;
 
 					if (filenamebuf == NULL)
-						filenamebuf = calloc(numwadfiles, sizeof(char) * MAX_WADPATH);
+						buildfilenameindex();
 
-					for (i = 0; i < numwadfiles; i++)
+					for (i = filenamebuckets[filenamehash(dent->d_name) & 63]; i; i = filenamenext[i-1])
 					{
-						if (!filenamebuf[i][0])
-						{
-							strncpy(filenamebuf[i], wadfiles[i]->filename, MAX_WADPATH-1);
-							filenamebuf[i][MAX_WADPATH - 1] = '\0';
-							nameonly(filenamebuf[i]);
-						}
-
-						if (strcmp(dent->d_name, filenamebuf[i]))
+						if (strcmp(dent->d_name, filenamebuf[i-1]))
 							continue;
-						if (cv_addons_md5.value && !checkfilemd5(menupath, wadfiles[i]->md5sum))
+						if (cv_addons_md5.value && !checkfilemd5(menupath, wadfiles[i-1]->md5sum))
 							continue;
 
 						ext |= EXT_LOADED;
@@ -1244,7 +1587,9 @@ boolean preparefilemenu(boolean samedepth)
 	if (filenamebuf)
 	{
 		free(filenamebuf);
+		free(filenamenext);
 		filenamebuf = NULL;
+		filenamenext = NULL;
 	}
 
 	closedir(dirhandle);
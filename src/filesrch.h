@@ -29,6 +29,10 @@ extern consvar_t cv_addons_option, cv_addons_folder, cv_addons_md5, cv_addons_sh
 filestatus_t filesearch(char *filename, const char *startpath, const UINT8 *wantedmd5sum,
 	boolean completepath, int maxsearchdepth);
 
+#if defined (HAVE_THREADS) && !defined (NOMD5)
+void filesearchprehash(const char *filename, const char *startpath, int maxsearchdepth);
+#endif
+
 INT32 pathisdirectory(const char *path);
 INT32 samepaths(const char *path1, const char *path2);
 INT32 concatpaths(const char *path, const char *startpath);
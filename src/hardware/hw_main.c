@@ -57,9 +57,9 @@ struct hwdriver_s hwdriver;
 //                                                                     PROTOS
 // ==========================================================================
 
-static void HWR_AddSprites(sector_t *sec);
+static void HWR_AddSprites(sector_t *sec, INT32 lightlevel);
 static void HWR_ProjectSprite(mobj_t *thing);
-static void HWR_ProjectPrecipitationSprite(precipmobj_t *thing);
+static void HWR_ProjectPrecipitationSprite(size_t i);
 static void HWR_ProjectBoundingBox(mobj_t *thing);
 
 void HWR_AddTransparentFloor(levelflat_t *levelflat, extrasubsector_t *xsub, boolean isceiling, fixed_t fixedheight, INT32 lightlevel, INT32 alpha, sector_t *FOFSector, FBITFIELD blend, boolean fogplane, extracolormap_t *planecolormap);
@@ -2589,15 +2589,8 @@ static void HWR_Subsector(size_t num)
 	{
 		// draw sprites first, coz they are clipped to the solidsegs of
 		// subsectors more 'in front'
-		HWR_AddSprites(gl_frontsector);
-
-		//Hurdler: at this point validcount must be the same, but is not because
-		//         gl_frontsector doesn't point anymore to sub->sector due to
-		//         the call gl_frontsector = R_FakeFlat(...)
-		//         if it's not done, the sprite is drawn more than once,
-		//         what looks really bad with translucency or dynamic light,
-		//         without talking about the overdraw of course.
-		sub->sector->validcount = validcount;/// \todo fix that in a better way
+		// gl_frontsector may be R_FakeFlat's copy, so only take its light
+		HWR_AddSprites(sub->sector, gl_frontsector->lightlevel);
 
 		while (count--)
 		{
@@ -2679,6 +2672,7 @@ static gl_vissprite_t *gl_visspritechunks[MAXVISSPRITES >> VISSPRITECHUNKBITS] =
 static void HWR_ClearSprites(void)
 {
 	gl_visspritecount = 0;
+	R_ClearPrecipProxies();
 }
 
 // --------------------------------------------------------------------------
@@ -4575,10 +4569,10 @@ static void HWR_DrawSprites(void)
 // During BSP traversal, this adds sprites by sector.
 // --------------------------------------------------------------------------
 static UINT8 sectorlight;
-static void HWR_AddSprites(sector_t *sec)
+static void HWR_AddSprites(sector_t *sec, INT32 lightlevel)
 {
 	mobj_t *thing;
-	precipmobj_t *precipthing;
+	size_t i, end; // precipitation drops
 	fixed_t limit_dist, hoop_limit_dist;
 
 	// BSP is traversed by subsector.
@@ -4592,7 +4586,7 @@ static void HWR_AddSprites(sector_t *sec)
 	sec->validcount = validcount;
 
 	// sprite lighting
-	sectorlight = sec->lightlevel & 0xff;
+	sectorlight = lightlevel & 0xff;
 
 	// Handle all things in sector.
 	// If a limit exists, handle things a tiny bit different.
@@ -4612,12 +4606,13 @@ static void HWR_AddSprites(sector_t *sec)
 	}
 
 	// no, no infinite draw distance for precipitation. this option at zero is supposed to turn it off
-	if ((limit_dist = (fixed_t)cv_drawdist_precip.value << FRACBITS))
+	if ((limit_dist = (fixed_t)cv_drawdist_precip.value << FRACBITS) && precipitation.block)
 	{
-		for (precipthing = sec->preciplist; precipthing; precipthing = precipthing->snext)
+		end = precipitation.sectorstart[sec - sectors + 1];
+		for (i = precipitation.sectorstart[sec - sectors]; i < end; i++)
 		{
-			if (R_PrecipThingVisible(precipthing, limit_dist))
-				HWR_ProjectPrecipitationSprite(precipthing);
+			if (R_PrecipDropVisible(i, limit_dist))
+				HWR_ProjectPrecipitationSprite(i);
 		}
 	}
 }
@@ -5135,9 +5130,12 @@ static void HWR_ProjectSprite(mobj_t *thing)
 }
 
 // Precipitation projector for hardware mode
-static void HWR_ProjectPrecipitationSprite(precipmobj_t *thing)
+static void HWR_ProjectPrecipitationSprite(size_t i)
 {
 	gl_vissprite_t *vis;
+	precipmobj_t *thing;
+	const spritenum_t sprite = states[precipitation.state[i]].sprite;
+	const UINT32 frame = precipitation.frame[i];
 	float tr_x, tr_y;
 	float tz;
 	float x1, x2;
@@ -5148,33 +5146,24 @@ static void HWR_ProjectPrecipitationSprite(precipmobj_t *thing)
 	size_t lumpoff;
 	unsigned rot = 0;
 	UINT8 flip;
-
-	if (!thing)
-		return;
+	fixed_t z;
 
 	// Visibility check by the blend mode.
-	if (thing->frame & FF_TRANSMASK)
+	if (frame & FF_TRANSMASK)
 	{
-		if (!R_BlendLevelVisible(thing->blendmode, (thing->frame & FF_TRANSMASK)>>FF_TRANSSHIFT))
+		if (!R_BlendLevelVisible(AST_COPY, (frame & FF_TRANSMASK)>>FF_TRANSSHIFT))
 			return;
 	}
 
-	// uncapped/interpolation
-	interpmobjstate_t interp = {0};
-
 	// do interpolation
 	if (R_UsingFrameInterpolation() && !paused)
-	{
-		R_InterpolatePrecipMobjState(thing, rendertimefrac, &interp);
-	}
+		z = R_InterpolatePrecipZ(i, rendertimefrac);
 	else
-	{
-		R_InterpolatePrecipMobjState(thing, FRACUNIT, &interp);
-	}
+		z = R_InterpolatePrecipZ(i, FRACUNIT);
 
 	// transform the origin point
-	tr_x = FIXED_TO_FLOAT(interp.x) - gl_viewx;
-	tr_y = FIXED_TO_FLOAT(interp.y) - gl_viewy;
+	tr_x = FIXED_TO_FLOAT(precipitation.x[i]) - gl_viewx;
+	tr_y = FIXED_TO_FLOAT(precipitation.y[i]) - gl_viewy;
 
 	// rotation around vertical axis
 	tz = (tr_x * gl_viewcos) + (tr_y * gl_viewsin);
@@ -5183,29 +5172,29 @@ static void HWR_ProjectPrecipitationSprite(precipmobj_t *thing)
 	if (tz < ZCLIP_PLANE)
 		return;
 
-	tr_x = FIXED_TO_FLOAT(interp.x);
-	tr_y = FIXED_TO_FLOAT(interp.y);
+	tr_x = FIXED_TO_FLOAT(precipitation.x[i]);
+	tr_y = FIXED_TO_FLOAT(precipitation.y[i]);
 
 	// decide which patch to use for sprite relative to player
-	if ((unsigned)thing->sprite >= numsprites)
+	if ((unsigned)sprite >= numsprites)
 #ifdef RANGECHECK
 		I_Error("HWR_ProjectPrecipitationSprite: invalid sprite number %i ",
-		        thing->sprite);
+		        sprite);
 #else
 		return;
 #endif
 
-	sprdef = &sprites[thing->sprite];
+	sprdef = &sprites[sprite];
 
-	if ((size_t)(thing->frame&FF_FRAMEMASK) >= sprdef->numframes)
+	if ((size_t)(frame&FF_FRAMEMASK) >= sprdef->numframes)
 #ifdef RANGECHECK
 		I_Error("HWR_ProjectPrecipitationSprite: invalid sprite frame %i : %i for %s",
-		        thing->sprite, thing->frame, sprnames[thing->sprite]);
+		        sprite, frame, sprnames[sprite]);
 #else
 		return;
 #endif
 
-	sprframe = &sprdef->spriteframes[thing->frame & FF_FRAMEMASK];
+	sprframe = &sprdef->spriteframes[frame & FF_FRAMEMASK];
 
 	// use single rotation for all views
 	lumpoff = sprframe->lumpid[0];
@@ -5229,6 +5218,10 @@ static void HWR_ProjectPrecipitationSprite(precipmobj_t *thing)
 	x1 = tr_x + x1 * rightcos;
 	x2 = tr_x - x2 * rightcos;
 
+	thing = R_GetPrecipProxy(i, z);
+	if (!thing)
+		return;
+
 	//
 	// store information in a vissprite
 	//
@@ -5247,21 +5240,11 @@ static void HWR_ProjectPrecipitationSprite(precipmobj_t *thing)
 	vis->colormap = NULL;
 
 	// set top/bottom coords
-	vis->gzt = FIXED_TO_FLOAT(interp.z + spritecachedinfo[lumpoff].topoffset);
+	vis->gzt = FIXED_TO_FLOAT(z + spritecachedinfo[lumpoff].topoffset);
 	vis->gz = vis->gzt - FIXED_TO_FLOAT(spritecachedinfo[lumpoff].height);
 
 	vis->precip = true;
 	vis->bbox = false;
-
-	// okay... this is a hack, but weather isn't networked, so it should be ok
-	if (!(thing->precipflags & PCF_THUNK))
-	{
-		if (thing->precipflags & PCF_RAIN)
-			P_RainThinker(thing);
-		else
-			P_SnowThinker(thing);
-		thing->precipflags |= PCF_THUNK;
-	}
 }
 
 static void HWR_ProjectBoundingBox(mobj_t *thing)
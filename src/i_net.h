@@ -99,6 +99,10 @@ extern void (*I_NetSend)(void);
 */
 extern boolean (*I_NetCanSend)(void);
 
+/**	\brief send any packets the driver has queued up
+*/
+extern void (*I_NetFlush)(void);
+
 /**	\brief	close a connection
 
 	\param	nodenum	node to be closed
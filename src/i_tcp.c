@@ -12,6 +12,13 @@
 ///        This is not really OS-dependent because all OSes have the same socket API.
 ///        Just use ifdef for OS-dependent parts.
 
+#if defined (__linux__) && !defined (NOMMSG)
+	#ifndef _GNU_SOURCE
+	#define _GNU_SOURCE // recvmmsg and sendmmsg
+	#endif
+	#define USE_MMSG
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -123,6 +130,7 @@ typedef union
 #include "d_netfil.h"
 #include "i_tcp.h"
 #include "m_argv.h"
+#include "command.h"
 #include "i_threads.h"
 
 #include "doomstat.h"
@@ -464,6 +472,198 @@ static boolean SOCK_cmpaddr(mysockaddr_t *a, mysockaddr_t *b, UINT8 mask)
 		return false;
 }
 
+//
+// Node and ban lookup
+//
+// Incoming datagrams are matched to their node through a hash of the source
+// address, and bans are kept in a binary trie of address prefixes, so that
+// neither check gets slower as more nodes connect or more addresses get banned.
+//
+#define NODEHASHSIZE 256
+
+typedef struct
+{
+	mysockaddr_t *addresses; // indexed by node
+	UINT8 buckets[NODEHASHSIZE]; // first node in each bucket, 0 if empty
+	UINT8 next[MAXNETNODES+1]; // next node in the same bucket, 0 ends
+	boolean hashed[MAXNETNODES+1];
+} nodetable_t;
+
+typedef struct
+{
+	UINT32 child[2]; // 0 if there is none, as the roots are nobody's child
+	boolean banned;
+} bannode_t;
+
+// nodes[0] is the root for IPv4 addresses and nodes[1] the one for IPv6
+typedef struct
+{
+	bannode_t *nodes;
+	size_t numnodes, maxnodes;
+} bantrie_t;
+
+static nodetable_t nodetable = {clientaddress, {0}, {0}, {false}};
+static bantrie_t bantrie = {NULL, 0, 0};
+
+// Gets the address bytes of a socket address, ignoring the port.
+static const UINT8 *SOCK_AddrBytes(const mysockaddr_t *addr, size_t *bits)
+{
+	if (addr->any.sa_family == AF_INET)
+	{
+		*bits = 32;
+		return (const UINT8 *)&addr->ip4.sin_addr;
+	}
+#ifdef HAVE_IPV6
+	else if (addr->any.sa_family == AF_INET6)
+	{
+		*bits = 128;
+		return (const UINT8 *)&addr->ip6.sin6_addr;
+	}
+#endif
+	*bits = 0;
+	return NULL;
+}
+
+// Ports are left out, so nodes that only differ by port share a bucket.
+static UINT32 SOCK_HashAddr(const mysockaddr_t *addr)
+{
+	UINT32 hash = 2166136261u;
+	size_t bits, i;
+	const UINT8 *p = SOCK_AddrBytes(addr, &bits);
+
+	for (i = 0; i < bits / 8; i++)
+		hash = (hash ^ p[i]) * 16777619u;
+
+	return hash;
+}
+
+static void SOCK_UnhashNode(nodetable_t *table, INT32 node)
+{
+	UINT8 *link;
+
+	if (!table->hashed[node])
+		return;
+
+	link = &table->buckets[SOCK_HashAddr(&table->addresses[node]) & (NODEHASHSIZE-1)];
+	while (*link && *link != node)
+		link = &table->next[*link];
+
+	if (*link)
+		*link = table->next[node];
+	table->hashed[node] = false;
+}
+
+static void SOCK_HashNode(nodetable_t *table, INT32 node)
+{
+	UINT8 *bucket;
+	size_t bits;
+
+	// Node 0 is ourself, which SOCK_Get never looks for
+	if (node < 1 || node > MAXNETNODES || !SOCK_AddrBytes(&table->addresses[node], &bits))
+		return;
+
+	bucket = &table->buckets[SOCK_HashAddr(&table->addresses[node]) & (NODEHASHSIZE-1)];
+	table->next[node] = *bucket;
+	*bucket = (UINT8)node;
+	table->hashed[node] = true;
+}
+
+// Returns the lowest node whose address matches, or -1 if there is none.
+static INT32 SOCK_FindNode(nodetable_t *table, mysockaddr_t *addr)
+{
+	INT32 found = -1;
+	UINT8 node;
+
+	for (node = table->buckets[SOCK_HashAddr(addr) & (NODEHASHSIZE-1)]; node; node = table->next[node])
+		if ((found == -1 || node < found) && SOCK_cmpaddr(addr, &table->addresses[node], 0))
+			found = node;
+
+	return found;
+}
+
+static void SOCK_SetNodeAddress(INT32 node, const void *addr, size_t addrlen)
+{
+	SOCK_UnhashNode(&nodetable, node);
+	memset(&clientaddress[node], 0, sizeof (clientaddress[node]));
+	if (addr)
+		M_Memcpy(&clientaddress[node], addr, min(addrlen, sizeof (clientaddress[node])));
+	SOCK_HashNode(&nodetable, node);
+}
+
+static void SOCK_ClearNodeAddresses(void)
+{
+	memset(clientaddress, 0, sizeof (clientaddress));
+	memset(nodetable.buckets, 0, sizeof (nodetable.buckets));
+	memset(nodetable.hashed, 0, sizeof (nodetable.hashed));
+}
+
+static UINT32 SOCK_NewBanNode(bantrie_t *trie)
+{
+	if (trie->numnodes == trie->maxnodes)
+	{
+		trie->maxnodes = trie->maxnodes ? trie->maxnodes * 2 : 64;
+		trie->nodes = Z_Realloc(trie->nodes, trie->maxnodes * sizeof (*trie->nodes), PU_STATIC, NULL);
+	}
+
+	memset(&trie->nodes[trie->numnodes], 0, sizeof (*trie->nodes));
+	return (UINT32)trie->numnodes++;
+}
+
+// Bans every address starting with the first maskbits bits of addr.
+// A mask of 0 bans just that address, as it always has.
+static void SOCK_AddBanPrefix(bantrie_t *trie, const mysockaddr_t *addr, UINT8 maskbits)
+{
+	size_t bits, i;
+	const UINT8 *p = SOCK_AddrBytes(addr, &bits);
+	UINT32 node;
+
+	if (!p)
+		return;
+
+	if (!trie->numnodes)
+	{
+		SOCK_NewBanNode(trie);
+		SOCK_NewBanNode(trie);
+	}
+
+	if (maskbits && maskbits < bits)
+		bits = maskbits;
+
+	node = (addr->any.sa_family == AF_INET) ? 0 : 1;
+	for (i = 0; i < bits && !trie->nodes[node].banned; i++)
+	{
+		const UINT8 bit = (p[i >> 3] >> (7 - (i & 7))) & 1;
+
+		if (!trie->nodes[node].child[bit])
+		{
+			const UINT32 child = SOCK_NewBanNode(trie); // may move trie->nodes
+			trie->nodes[node].child[bit] = child;
+		}
+		node = trie->nodes[node].child[bit];
+	}
+
+	trie->nodes[node].banned = true;
+}
+
+static boolean SOCK_IsAddrBanned(const bantrie_t *trie, const mysockaddr_t *addr)
+{
+	size_t bits, i;
+	const UINT8 *p = SOCK_AddrBytes(addr, &bits);
+	UINT32 node;
+
+	if (!p || !trie->numnodes)
+		return false;
+
+	node = (addr->any.sa_family == AF_INET) ? 0 : 1;
+	for (i = 0; !trie->nodes[node].banned; i++)
+	{
+		if (i == bits || !(node = trie->nodes[node].child[(p[i >> 3] >> (7 - (i & 7))) & 1]))
+			return false;
+	}
+
+	return true;
+}
+
 // This is a hack. For some reason, nodes aren't being freed properly.
 // This goes through and cleans up what nodes were supposed to be freed.
 /** \warning This function causes the file downloading to stop if someone joins.
@@ -544,68 +744,537 @@ void Command_Numnodes(void)
 }
 #endif
 
-// Returns true if a packet was received from a new node, false in all other cases
-static boolean SOCK_Get(void)
+#define NETBENCHBURST 64
+
+// Opens a non-blocking UDP socket on 127.0.0.1, and gets the port it was given.
+static SOCKET_TYPE SOCK_OpenBenchSocket(mysockaddr_t *addr)
 {
+	SOCKET_TYPE s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	socklen_t len = (socklen_t)sizeof(addr->ip4);
+#ifdef FIONBIO
+	unsigned long trueval = true;
+#endif
+
+	if (s == (SOCKET_TYPE)ERRSOCKET)
+		return (SOCKET_TYPE)ERRSOCKET;
+
+	memset(addr, 0, sizeof (*addr));
+	addr->ip4.sin_family = AF_INET;
+	addr->ip4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(s, &addr->any, len) != 0 || getsockname(s, &addr->any, &len) != 0
+#ifdef FIONBIO
+		|| ioctl(s, FIONBIO, &trueval) != 0
+#endif
+	)
+	{
+		close(s);
+		return (SOCKET_TYPE)ERRSOCKET;
+	}
+
+	return s;
+}
+
+// Sends count packets of the given size from tx to rx in bursts, and returns how many arrived per second.
+static double SOCK_BenchLoopback(SOCKET_TYPE tx, SOCKET_TYPE rx, mysockaddr_t *rxaddr, size_t count, size_t size, boolean batched)
+{
+	static char buffers[NETBENCHBURST][MAXPACKETLENGTH];
+	size_t sent = 0, received = 0;
+	precise_t start = I_GetPreciseTime();
+	double seconds;
+#ifdef USE_MMSG
+	struct mmsghdr msgs[NETBENCHBURST];
+	struct iovec iovs[NETBENCHBURST];
 	size_t i;
-	int j;
-	ssize_t c;
-	mysockaddr_t fromaddress;
-	socklen_t fromlen;
 
-	for (size_t n = 0; n < mysocketses; n++)
+	memset(msgs, 0, sizeof (msgs));
+	for (i = 0; i < NETBENCHBURST; i++)
 	{
-		fromlen = (socklen_t)sizeof(fromaddress);
-		c = recvfrom(mysockets[n], (char *)&doomcom->data, MAXPACKETLENGTH, 0,
-			(void *)&fromaddress, &fromlen);
-		if (c != ERRSOCKET)
+		iovs[i].iov_base = buffers[i];
+		iovs[i].iov_len = size;
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+#else
+	(void)batched;
+#endif
+
+	while (sent < count)
+	{
+		const size_t burst = min(count - sent, NETBENCHBURST);
+		size_t got = 0, tries = 0;
+
+#ifdef USE_MMSG
+		if (batched)
 		{
-			// STAR STUFF: check our sock packets please //
-			if (TSoURDt3rd_SOCK_Get(doomcom, c, clientaddress, mysockets))
+			for (i = 0; i < burst; i++)
+			{
+				msgs[i].msg_hdr.msg_name = &rxaddr->any;
+				msgs[i].msg_hdr.msg_namelen = (socklen_t)sizeof(rxaddr->ip4);
+			}
+			if (sendmmsg(tx, msgs, (unsigned int)burst, 0) < 0)
 				break;
-			// DONE! //
 
-			// find remote node number
-			for (j = 1; j <= MAXNETNODES; j++) //include LAN
+			// Drain whatever arrived; give up on the rest of the burst if it was dropped
+			while (got < burst && tries++ < 1000)
 			{
-				if (SOCK_cmpaddr(&fromaddress, &clientaddress[j], 0))
+				int r;
+
+				for (i = 0; i < burst - got; i++)
 				{
-					doomcom->remotenode = (INT16)j; // good packet from a game player
-					doomcom->datalength = (INT16)c;
-					nodesocket[j] = mysockets[n];
-					return false;
+					msgs[i].msg_hdr.msg_name = NULL;
+					msgs[i].msg_hdr.msg_namelen = 0;
 				}
+				r = recvmmsg(rx, msgs, (unsigned int)(burst - got), MSG_DONTWAIT, NULL);
+				if (r > 0)
+					got += r;
 			}
-			// not found
+		}
+		else
+#endif
+		{
+			size_t j;
+
+			for (j = 0; j < burst; j++)
+				sendto(tx, buffers[j], size, 0, &rxaddr->any, (socklen_t)sizeof(rxaddr->ip4));
 
-			// find a free slot
-			j = getfreenode();
-			if (j > 0)
+			while (got < burst && tries++ < 1000)
 			{
-				M_Memcpy(&clientaddress[j], &fromaddress, fromlen);
-				nodesocket[j] = mysockets[n];
-				DEBFILE(va("New node detected: node:%d address:%s\n", j,
-						SOCK_GetNodeAddress(j)));
-				doomcom->remotenode = (INT16)j; // good packet from a game player
-				doomcom->datalength = (INT16)c;
-
-				// check if it's a banned dude so we can send a refusal later
-				for (i = 0; i < numbans; i++)
+				if (recvfrom(rx, buffers[got], MAXPACKETLENGTH, 0, NULL, NULL) != ERRSOCKET)
+					got++;
+			}
+		}
+
+		sent += burst;
+		received += got;
+	}
+
+	seconds = (double)(I_GetPreciseTime() - start) / I_GetPrecisePrecision();
+	if (received < sent)
+		CONS_Printf("  %s of %s packets were dropped\n", sizeu1(sent - received), sizeu2(sent));
+	return seconds > 0.0 ? received / seconds : 0.0;
+}
+
+/** Measures UDP throughput over loopback, with one syscall per packet and,
+  * where the platform has recvmmsg/sendmmsg, batched.
+  * Usage: netbench [packets] [size]
+  */
+void Command_NetBench(void)
+{
+	size_t count = 100000, size = 256;
+	mysockaddr_t txaddr, rxaddr;
+	SOCKET_TYPE tx, rx;
+
+	if (COM_Argc() > 1)
+		count = (size_t)max(atoi(COM_Argv(1)), 1);
+	if (COM_Argc() > 2)
+		size = (size_t)min(max(atoi(COM_Argv(2)), 1), MAXPACKETLENGTH);
+
+	if (!I_InitTcpDriver())
+	{
+		CONS_Printf("netbench: no network driver\n");
+		return;
+	}
+
+	tx = SOCK_OpenBenchSocket(&txaddr);
+	rx = SOCK_OpenBenchSocket(&rxaddr);
+	if (tx == (SOCKET_TYPE)ERRSOCKET || rx == (SOCKET_TYPE)ERRSOCKET)
+	{
+		CONS_Printf("netbench: could not open loopback sockets\n");
+		if (tx != (SOCKET_TYPE)ERRSOCKET)
+			close(tx);
+		if (rx != (SOCKET_TYPE)ERRSOCKET)
+			close(rx);
+		return;
+	}
+
+	CONS_Printf("Sending %s packets of %s bytes over loopback...\n", sizeu1(count), sizeu2(size));
+	CONS_Printf("One per syscall: %.0f packets/s\n", SOCK_BenchLoopback(tx, rx, &rxaddr, count, size, false));
+#ifdef USE_MMSG
+	CONS_Printf("Batched:         %.0f packets/s\n", SOCK_BenchLoopback(tx, rx, &rxaddr, count, size, true));
+#endif
+
+	close(tx);
+	close(rx);
+}
+
+// Makes up an IPv4 address for the flood benchmark.
+static void SOCK_BenchAddr(mysockaddr_t *addr, UINT32 ip, UINT16 port)
+{
+	memset(addr, 0, sizeof (*addr));
+	addr->ip4.sin_family = AF_INET;
+	addr->ip4.sin_addr.s_addr = htonl(ip);
+	addr->ip4.sin_port = htons(port);
+}
+
+/** Floods made up datagrams through the node and ban lookups, comparing
+  * them with the linear searches they replaced as nodes and bans are added.
+  * Usage: nodebench [packets]
+  */
+void Command_NodeBench(void)
+{
+	static const INT32 nodecounts[] = {8, 32, 64, MAXNETNODES};
+	static const size_t bancounts[] = {16, 256, 4096};
+	static mysockaddr_t addresses[MAXNETNODES+1];
+	mysockaddr_t from, *bans;
+	UINT8 *masks;
+	size_t packets = 1000000, i, k;
+	UINT32 seed = 0x5EED, runseed;
+	INT32 j, n, hits;
+	precise_t t;
+
+	if (COM_Argc() > 1)
+		packets = (size_t)max(atoi(COM_Argv(1)), 1);
+
+#define BENCHRAND() (seed = seed * 1103515245 + 12345)
+#define BENCHNS(t) ((double)(I_GetPreciseTime() - (t)) * 1e9 / I_GetPrecisePrecision() / packets)
+
+	CONS_Printf("Node lookup, %s packets, half from unknown addresses:\n", sizeu1(packets));
+	for (k = 0; k < sizeof nodecounts / sizeof *nodecounts; k++)
+	{
+		nodetable_t table;
+		double linear, hashed;
+
+		memset(&table, 0, sizeof (table));
+		table.addresses = addresses;
+		memset(addresses, 0, sizeof (addresses));
+		for (n = 1; n <= nodecounts[k]; n++)
+		{
+			SOCK_BenchAddr(&addresses[n], 0x0A000000 | (BENCHRAND() & 0xFFFF), 5029);
+			SOCK_HashNode(&table, n);
+		}
+
+		hits = 0;
+		runseed = seed;
+		t = I_GetPreciseTime();
+		for (i = 0; i < packets; i++)
+		{
+			if (i & 1)
+				SOCK_BenchAddr(&from, 0xC0000000 | (BENCHRAND() & 0xFFFF), 5029);
+			else
+				from = addresses[1 + (i >> 1) % nodecounts[k]];
+			for (j = 1; j <= MAXNETNODES; j++)
+				if (SOCK_cmpaddr(&from, &addresses[j], 0))
 				{
-					if (SOCK_cmpaddr(&fromaddress, &banned[i], bannedmask[i]))
-					{
-						SOCK_bannednode[j] = true;
-						DEBFILE("This dude has been banned\n");
-						break;
-					}
+					hits++;
+					break;
 				}
-				if (i == numbans)
-					SOCK_bannednode[j] = false;
-				return true;
-			}
+		}
+		linear = BENCHNS(t);
+
+		seed = runseed;
+		t = I_GetPreciseTime();
+		for (i = 0; i < packets; i++)
+		{
+			if (i & 1)
+				SOCK_BenchAddr(&from, 0xC0000000 | (BENCHRAND() & 0xFFFF), 5029);
 			else
-				DEBFILE("New node detected: No more free slots\n");
+				from = addresses[1 + (i >> 1) % nodecounts[k]];
+			if (SOCK_FindNode(&table, &from) > 0)
+				hits--;
 		}
+		hashed = BENCHNS(t);
+
+		CONS_Printf("  %3d nodes: linear %6.1f ns, hashed %6.1f ns per packet%s\n",
+			nodecounts[k], linear, hashed, hits ? " (MISMATCH)" : "");
+	}
+
+	CONS_Printf("Ban check, %s packets:\n", sizeu1(packets));
+	for (k = 0; k < sizeof bancounts / sizeof *bancounts; k++)
+	{
+		bantrie_t trie = {NULL, 0, 0};
+		double linear, trielookup;
+
+		bans = Z_Malloc(bancounts[k] * sizeof (*bans), PU_STATIC, NULL);
+		masks = Z_Malloc(bancounts[k] * sizeof (*masks), PU_STATIC, NULL);
+		for (i = 0; i < bancounts[k]; i++)
+		{
+			SOCK_BenchAddr(&bans[i], BENCHRAND(), 0);
+			masks[i] = (i & 1) ? 24 : 32;
+			SOCK_AddBanPrefix(&trie, &bans[i], masks[i]);
+		}
+
+		hits = 0;
+		runseed = seed;
+		t = I_GetPreciseTime();
+		for (i = 0; i < packets; i++)
+		{
+			SOCK_BenchAddr(&from, BENCHRAND(), 5029);
+			for (j = 0; j < (INT32)bancounts[k]; j++)
+				if (SOCK_cmpaddr(&from, &bans[j], masks[j]))
+				{
+					hits++;
+					break;
+				}
+		}
+		linear = BENCHNS(t);
+
+		seed = runseed;
+		t = I_GetPreciseTime();
+		for (i = 0; i < packets; i++)
+		{
+			SOCK_BenchAddr(&from, BENCHRAND(), 5029);
+			if (SOCK_IsAddrBanned(&trie, &from))
+				hits--;
+		}
+		trielookup = BENCHNS(t);
+
+		CONS_Printf("  %4s bans: linear %7.1f ns, trie %6.1f ns per packet%s\n",
+			sizeu1(bancounts[k]), linear, trielookup, hits ? " (MISMATCH)" : "");
+
+		Z_Free(bans);
+		Z_Free(masks);
+		Z_Free(trie.nodes);
+	}
+
+#undef BENCHRAND
+#undef BENCHNS
+}
+
+#ifdef USE_MMSG
+//
+// Batched sockets
+//
+// On Linux, datagrams are read up to MMSGBATCH at a time with recvmmsg and
+// handed out one by one by SOCK_Get. Sends are queued, and go out with one
+// sendmmsg per socket when NetUpdate is done with the tic, when the queue
+// fills up, or before the sockets are read again.
+//
+#define MMSGBATCH 64
+
+typedef struct
+{
+	struct mmsghdr msgs[MMSGBATCH];
+	struct iovec iovs[MMSGBATCH];
+	mysockaddr_t addrs[MMSGBATCH];
+	SOCKET_TYPE sockets[MMSGBATCH];
+	INT32 nodes[MMSGBATCH]; // node to report send errors for, or -1
+	UINT8 data[MMSGBATCH][MAXPACKETLENGTH];
+	size_t head, count;
+} mmsgbuffer_t;
+
+static mmsgbuffer_t recvbuffer, sendbuffer;
+#endif
+
+static inline socklen_t SOCK_AddrLen(const mysockaddr_t *sockaddr)
+{
+	switch (sockaddr->any.sa_family)
+	{
+		case AF_INET:  return (socklen_t)sizeof(struct sockaddr_in);
+#ifdef HAVE_IPV6
+		case AF_INET6: return (socklen_t)sizeof(struct sockaddr_in6);
+#endif
+		default:       return (socklen_t)sizeof(mysockaddr_t);
+	}
+}
+
+static void SOCK_SendError(INT32 node, int e)
+{
+	if (e != ECONNREFUSED && e != EWOULDBLOCK)
+		I_Error("SOCK_Send, error sending to node %d (%s) #%u: %s", node,
+			SOCK_GetNodeAddress(node), e, strerror(e));
+}
+
+#ifdef USE_MMSG
+// Sends everything in the queue, one sendmmsg per socket.
+static void SOCK_Flush(void)
+{
+	struct mmsghdr msgs[MMSGBATCH];
+	size_t order[MMSGBATCH];
+	boolean flushed[MMSGBATCH] = {false};
+	size_t i, j;
+
+	for (i = 0; i < sendbuffer.count; i++)
+	{
+		const SOCKET_TYPE socket = sendbuffer.sockets[i];
+		size_t count = 0, sent = 0;
+
+		if (flushed[i])
+			continue;
+
+		for (j = i; j < sendbuffer.count; j++)
+		{
+			if (flushed[j] || sendbuffer.sockets[j] != socket)
+				continue;
+			msgs[count] = sendbuffer.msgs[j];
+			order[count++] = j;
+			flushed[j] = true;
+		}
+
+		while (sent < count)
+		{
+			int r = sendmmsg(socket, &msgs[sent], (unsigned int)(count - sent), MSG_DONTWAIT);
+			int e;
+
+			if (r > 0)
+			{
+				sent += r;
+				continue;
+			}
+
+			e = errno;
+			if (e == EINTR)
+				continue;
+			if (sendbuffer.nodes[order[sent]] != -1)
+				SOCK_SendError(sendbuffer.nodes[order[sent]], e);
+			if (e == EWOULDBLOCK)
+				break; // the rest won't fit either
+			sent++; // skip the one that failed
+		}
+	}
+
+	sendbuffer.count = 0;
+}
+
+// Copies the packet in doomcom into the send queue.
+static void SOCK_QueueToAddr(SOCKET_TYPE socket, mysockaddr_t *sockaddr, INT32 node)
+{
+	struct msghdr *hdr;
+	size_t i;
+
+	if (sendbuffer.count == MMSGBATCH)
+		SOCK_Flush();
+
+	i = sendbuffer.count++;
+	M_Memcpy(sendbuffer.data[i], &doomcom->data, doomcom->datalength);
+	M_Memcpy(&sendbuffer.addrs[i], sockaddr, sizeof (mysockaddr_t));
+	sendbuffer.sockets[i] = socket;
+	sendbuffer.nodes[i] = node;
+	sendbuffer.iovs[i].iov_base = sendbuffer.data[i];
+	sendbuffer.iovs[i].iov_len = doomcom->datalength;
+
+	hdr = &sendbuffer.msgs[i].msg_hdr;
+	memset(hdr, 0, sizeof (*hdr));
+	hdr->msg_name = &sendbuffer.addrs[i];
+	hdr->msg_namelen = SOCK_AddrLen(sockaddr);
+	hdr->msg_iov = &sendbuffer.iovs[i];
+	hdr->msg_iovlen = 1;
+}
+#endif
+
+// Reads the next datagram into doomcom->data from whichever socket has one,
+// starting with socket *next. Returns ERRSOCKET once they have all run dry.
+static ssize_t SOCK_Receive(size_t *next, SOCKET_TYPE *sock, mysockaddr_t *fromaddress, socklen_t *fromlen)
+{
+#ifdef USE_MMSG
+	struct mmsghdr *msg;
+	size_t i;
+
+	(void)next;
+
+	if (!recvbuffer.count)
+	{
+		// Replies to what was just read go out before reading more
+		SOCK_Flush();
+
+		recvbuffer.head = 0;
+		for (size_t n = 0; n < mysocketses && recvbuffer.count < MMSGBATCH; n++)
+		{
+			const size_t first = recvbuffer.count;
+			int r;
+
+			for (i = first; i < MMSGBATCH; i++)
+			{
+				struct msghdr *hdr = &recvbuffer.msgs[i].msg_hdr;
+
+				recvbuffer.iovs[i].iov_base = recvbuffer.data[i];
+				recvbuffer.iovs[i].iov_len = MAXPACKETLENGTH;
+				memset(hdr, 0, sizeof (*hdr));
+				hdr->msg_name = &recvbuffer.addrs[i];
+				hdr->msg_namelen = (socklen_t)sizeof(mysockaddr_t);
+				hdr->msg_iov = &recvbuffer.iovs[i];
+				hdr->msg_iovlen = 1;
+			}
+
+			r = recvmmsg(mysockets[n], &recvbuffer.msgs[first], (unsigned int)(MMSGBATCH - first), MSG_DONTWAIT, NULL);
+			if (r <= 0)
+				continue;
+
+			for (i = first; i < first + r; i++)
+				recvbuffer.sockets[i] = mysockets[n];
+			recvbuffer.count += r;
+		}
+
+		if (!recvbuffer.count)
+			return ERRSOCKET;
+	}
+
+	i = recvbuffer.head++;
+	recvbuffer.count--;
+	msg = &recvbuffer.msgs[i];
+
+	M_Memcpy(&doomcom->data, recvbuffer.data[i], msg->msg_len);
+	*fromlen = min(msg->msg_hdr.msg_namelen, (socklen_t)sizeof(mysockaddr_t));
+	M_Memcpy(fromaddress, &recvbuffer.addrs[i], *fromlen);
+	*sock = recvbuffer.sockets[i];
+	return (ssize_t)msg->msg_len;
+#else
+	while (*next < mysocketses)
+	{
+		const size_t n = (*next)++;
+		ssize_t c;
+
+		*fromlen = (socklen_t)sizeof(*fromaddress);
+		c = recvfrom(mysockets[n], (char *)&doomcom->data, MAXPACKETLENGTH, 0,
+			(void *)fromaddress, fromlen);
+		if (c != ERRSOCKET)
+		{
+			*sock = mysockets[n];
+			return c;
+		}
+	}
+
+	return ERRSOCKET;
+#endif
+}
+
+// Returns true if a packet was received from a new node, false in all other cases
+static boolean SOCK_Get(void)
+{
+	size_t next = 0;
+	int j;
+	ssize_t c;
+	mysockaddr_t fromaddress;
+	socklen_t fromlen;
+	SOCKET_TYPE sock;
+
+	while ((c = SOCK_Receive(&next, &sock, &fromaddress, &fromlen)) != ERRSOCKET)
+	{
+		// STAR STUFF: check our sock packets please //
+		if (TSoURDt3rd_SOCK_Get(doomcom, c, clientaddress, mysockets))
+			break;
+		// DONE! //
+
+		// find remote node number
+		j = SOCK_FindNode(&nodetable, &fromaddress); //include LAN
+		if (j > 0)
+		{
+			doomcom->remotenode = (INT16)j; // good packet from a game player
+			doomcom->datalength = (INT16)c;
+			nodesocket[j] = sock;
+			return false;
+		}
+		// not found
+
+		// find a free slot
+		j = getfreenode();
+		if (j > 0)
+		{
+			SOCK_SetNodeAddress(j, &fromaddress, fromlen);
+			nodesocket[j] = sock;
+			DEBFILE(va("New node detected: node:%d address:%s\n", j,
+					SOCK_GetNodeAddress(j)));
+			doomcom->remotenode = (INT16)j; // good packet from a game player
+			doomcom->datalength = (INT16)c;
+
+			// check if it's a banned dude so we can send a refusal later
+			SOCK_bannednode[j] = SOCK_IsAddrBanned(&bantrie, &fromaddress);
+			if (SOCK_bannednode[j])
+				DEBFILE("This dude has been banned\n");
+			return true;
+		}
+		else
+			DEBFILE("New node detected: No more free slots\n");
 	}
 
 	doomcom->remotenode = -1; // no packet
@@ -639,6 +1308,12 @@ static boolean SOCK_CanSend(void)
 	fd_set tset;
 	int wselect;
 
+#ifdef USE_MMSG
+	// The sockets were already found writable for what's in the queue
+	if (sendbuffer.count)
+		return true;
+#endif
+
 	if(!FD_CPY(&masterset, &tset, mysockets, mysocketses))
 		return false;
 	wselect = select(255, NULL, &tset, NULL, &timeval_for_select);
@@ -653,6 +1328,11 @@ static boolean SOCK_CanGet(void)
 	fd_set tset;
 	int rselect;
 
+#ifdef USE_MMSG
+	if (recvbuffer.count)
+		return true;
+#endif
+
 	if(!FD_CPY(&masterset, &tset, mysockets, mysocketses))
 		return false;
 	rselect = select(255, &tset, NULL, NULL, &timeval_for_select);
@@ -664,22 +1344,7 @@ static boolean SOCK_CanGet(void)
 
 static inline ssize_t SOCK_SendToAddr(SOCKET_TYPE socket, mysockaddr_t *sockaddr)
 {
-	socklen_t d4 = (socklen_t)sizeof(struct sockaddr_in);
-#ifdef HAVE_IPV6
-	socklen_t d6 = (socklen_t)sizeof(struct sockaddr_in6);
-#endif
-	socklen_t d, da = (socklen_t)sizeof(mysockaddr_t);
-
-	switch (sockaddr->any.sa_family)
-	{
-		case AF_INET:  d = d4; break;
-#ifdef HAVE_IPV6
-		case AF_INET6: d = d6; break;
-#endif
-		default:       d = da; break;
-	}
-
-	return sendto(socket, (char *)&doomcom->data, doomcom->datalength, 0, &sockaddr->any, d);
+	return sendto(socket, (char *)&doomcom->data, doomcom->datalength, 0, &sockaddr->any, SOCK_AddrLen(sockaddr));
 }
 
 static void SOCK_Send(void)
@@ -710,18 +1375,20 @@ static void SOCK_Send(void)
 		}
 		return;
 	}
+#ifdef USE_MMSG
+	else if (doomcom->datalength <= MAXPACKETLENGTH)
+	{
+		SOCK_QueueToAddr(nodesocket[doomcom->remotenode], &clientaddress[doomcom->remotenode], doomcom->remotenode);
+		return;
+	}
+#endif
 	else
 	{
 		c = SOCK_SendToAddr(nodesocket[doomcom->remotenode], &clientaddress[doomcom->remotenode]);
 	}
 
 	if (c == ERRSOCKET)
-	{
-		int e = errno; // save error code so it can't be modified later
-		if (e != ECONNREFUSED && e != EWOULDBLOCK)
-			I_Error("SOCK_Send, error sending to node %d (%s) #%u: %s", doomcom->remotenode,
-				SOCK_GetNodeAddress(doomcom->remotenode), e, strerror(e));
-	}
+		SOCK_SendError(doomcom->remotenode, errno);
 }
 
 static void SOCK_FreeNodenum(INT32 numnode)
@@ -736,7 +1403,7 @@ static void SOCK_FreeNodenum(INT32 numnode)
 	nodesocket[numnode] = ERRSOCKET;
 
 	// put invalid address
-	memset(&clientaddress[numnode], 0, sizeof (clientaddress[numnode]));
+	SOCK_SetNodeAddress(numnode, NULL, 0);
 }
 
 //
@@ -1005,7 +1672,7 @@ static boolean UDP_Socket(void)
 		runp = ai;
 		while (runp != NULL && s < MAXNETNODES+1)
 		{
-			memcpy(&clientaddress[s], runp->ai_addr, runp->ai_addrlen);
+			SOCK_SetNodeAddress(s, runp->ai_addr, runp->ai_addrlen);
 			s++;
 			runp = runp->ai_next;
 		}
@@ -1013,9 +1680,12 @@ static boolean UDP_Socket(void)
 	}
 	else
 	{
-		clientaddress[s].any.sa_family = AF_INET;
-		clientaddress[s].ip4.sin_port = htons(0);
-		clientaddress[s].ip4.sin_addr.s_addr = htonl(INADDR_LOOPBACK); //GetLocalAddress(); // my own ip
+		mysockaddr_t self;
+		memset(&self, 0, sizeof (self));
+		self.ip4.sin_family = AF_INET;
+		self.ip4.sin_port = htons(0);
+		self.ip4.sin_addr.s_addr = htonl(INADDR_LOOPBACK); //GetLocalAddress(); // my own ip
+		SOCK_SetNodeAddress(s, &self, sizeof (self.ip4));
 		s++;
 	}
 
@@ -1140,6 +1810,11 @@ boolean I_InitTcpDriver(void)
 
 static void SOCK_CloseSocket(void)
 {
+#ifdef USE_MMSG
+	SOCK_Flush();
+	recvbuffer.count = 0;
+#endif
+
 	for (size_t i=0; i < MAXNETNODES+1; i++)
 	{
 		if (mysockets[i] != (SOCKET_TYPE)ERRSOCKET
@@ -1207,7 +1882,7 @@ static SINT8 SOCK_NetMakeNodewPort(const char *address, const char *port)
 					sendto(mysockets[i], NULL, 0, 0,
 						runp->ai_addr, runp->ai_addrlen) == 0)
 			{
-				memcpy(&clientaddress[newnode], runp->ai_addr, runp->ai_addrlen);
+				SOCK_SetNodeAddress(newnode, runp->ai_addr, runp->ai_addrlen);
 				break;
 			}
 		}
@@ -1223,7 +1898,7 @@ static SINT8 SOCK_NetMakeNodewPort(const char *address, const char *port)
 
 static boolean SOCK_OpenSocket(void)
 {
-	memset(clientaddress, 0, sizeof (clientaddress));
+	SOCK_ClearNodeAddresses();
 
 	nodeconnected[0] = true; // always connected to self
 	for (size_t i = 1; i < MAXNETNODES; i++)
@@ -1234,6 +1909,9 @@ static boolean SOCK_OpenSocket(void)
 	I_NetCloseSocket = SOCK_CloseSocket;
 	I_NetFreeNodenum = SOCK_FreeNodenum;
 	I_NetMakeNodewPort = SOCK_NetMakeNodewPort;
+#ifdef USE_MMSG
+	I_NetFlush = SOCK_Flush;
+#endif
 
 #ifdef SELECTTEST
 	// seem like not work with libsocket : (
@@ -1268,6 +1946,7 @@ static boolean SOCK_Ban(INT32 node)
 		bannedmask[numbans] = 128;
 	}
 #endif
+	SOCK_AddBanPrefix(&bantrie, &banned[numbans], bannedmask[numbans]);
 	numbans++;
 	return true;
 }
@@ -1313,6 +1992,7 @@ static boolean SOCK_SetBanAddress(const char *address, const char *mask)
 		else if (bannedmask[numbans] > 128 && runp->ai_family == AF_INET6)
 			bannedmask[numbans] = 128;
 #endif
+		SOCK_AddBanPrefix(&bantrie, &banned[numbans], bannedmask[numbans]);
 		numbans++;
 		runp = runp->ai_next;
 	}
@@ -1329,6 +2009,9 @@ static void SOCK_ClearBans(void)
 	banned = NULL;
 	Z_Free(bannedmask);
 	bannedmask = NULL;
+	Z_Free(bantrie.nodes);
+	bantrie.nodes = NULL;
+	bantrie.numnodes = bantrie.maxnodes = 0;
 }
 
 boolean I_InitTcpNetwork(void)
@@ -15,10 +15,15 @@
 #define I_THREADS_H
 
 typedef void (*I_thread_fn)(void *userdata);
+typedef void (*I_range_fn)(size_t start, size_t end, void *userdata);
 
 typedef void * I_mutex;
 typedef void * I_cond;
 
+typedef struct I_job * I_job;
+
+#define I_MAX_WORKERS 16
+
 void      I_start_threads (void);
 void      I_stop_threads  (void);
 
@@ -35,5 +40,28 @@ void      I_hold_cond       (I_cond *, I_mutex);
 void      I_wake_one_cond   (I_cond *);
 void      I_wake_all_cond   (I_cond *);
 
+/*
+Worker pool, started along with the threads. Jobs run once all the jobs
+in deps have finished. Every handle must be waited on exactly once, and
+only after any job that lists it as a dependency has been scheduled.
+Waiting runs other queued jobs in the meantime, so it is fine to wait
+from inside a job.
+*/
+I_job     I_schedule_job    (I_thread_fn, void *userdata,
+                             const I_job *deps, size_t numdeps);
+void      I_wait_job        (I_job);
+/* runs one queued job on this thread, returns 0 if there was none */
+int       I_run_queued_job  (void);
+
+/* calls fn on [0, count) in chunks of grain items, returns when done */
+void      I_parallel_for    (size_t count, size_t grain,
+                             I_range_fn, void *userdata);
+
+int       I_worker_count    (void);
+
+/* time spent running jobs and sleeping since the last call */
+void      I_worker_stats    (int worker, precise_t *busy,
+                             precise_t *idle, UINT32 *jobs);
+
 #endif/*I_THREADS_H*/
 #endif/*HAVE_THREADS*/
@@ -2283,6 +2283,8 @@ static int ffloor_set(lua_State *L)
 	if (hook_cmd_running)
 		return luaL_error(L, "Do not alter ffloor_t in CMD building code!");
 
+	P_InvalidateSightMemo();
+
 	switch(field)
 	{
 	case ffloor_valid: // valid
@@ -2423,6 +2425,8 @@ static int slope_set(lua_State *L)
 	if (hook_cmd_running)
 		return luaL_error(L, "Do not alter pslope_t in CMD building code!");
 
+	P_InvalidateSightMemo();
+
 	switch(field) // todo: reorganize this shit
 	{
 	case slope_valid: // valid
@@ -354,6 +354,7 @@ static int polyobj_set(lua_State *L)
 		break;
 	case polyobj_flags:
 		polyobj->flags = luaL_checkinteger(L, 3);
+		P_InvalidateSightMemo(); // solidity and rendering flags affect sight
 		break;
 	case polyobj_translucency:
 		polyobj->translucency = luaL_checkinteger(L, 3);
@@ -68,16 +68,138 @@ static lua_CFunction liblist[] = {
 	NULL
 };
 
+// Lua's small objects (strings, tables, closures...) live in size-class
+// slab pools instead of getting a zone block each. Anything bigger than
+// the largest class still goes through Z_Realloc.
+// Lua always passes the old size of a block back to us, so the class of
+// a block is known without storing anything next to it.
+#define LUA_NUMSIZECLASSES 10
+#define LUA_MAXPOOLEDSIZE 512
+#define LUA_SLABSIZE 16384
+#define LUA_NOSIZECLASS UINT8_MAX
+
+static const UINT16 lua_sizeclasses[LUA_NUMSIZECLASSES] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512
+};
+
+// Size class of every size up to LUA_MAXPOOLEDSIZE, in steps of 16 bytes
+static UINT8 lua_sizeclassof[(LUA_MAXPOOLEDSIZE >> 4) + 1];
+
+typedef struct
+{
+	zpool_t pools[LUA_NUMSIZECLASSES];
+	size_t pooledbytes; // bytes Lua has asked for from the pools
+	size_t largebytes; // bytes in zone blocks
+} lua_heap_t;
+
+static lua_heap_t lua_mainheap; // gL
+static lua_heap_t lua_evalheap; // LUA_EvalMath
+
+static void LUA_InitHeap(lua_heap_t *heap)
+{
+	UINT8 i, cls;
+
+	if (!lua_sizeclassof[LUA_MAXPOOLEDSIZE >> 4])
+	{
+		for (i = 0, cls = 0; i <= (LUA_MAXPOOLEDSIZE >> 4); i++)
+		{
+			while (lua_sizeclasses[cls] < (i << 4))
+				cls++;
+			lua_sizeclassof[i] = cls;
+		}
+	}
+
+	for (i = 0; i < LUA_NUMSIZECLASSES; i++)
+		Z_PoolInit(&heap->pools[i], lua_sizeclasses[i], LUA_SLABSIZE / lua_sizeclasses[i], PU_LUA);
+	heap->pooledbytes = heap->largebytes = 0;
+}
+
+// Frees everything in the heap at once. The Lua state using it must
+// already be closed.
+static void LUA_ClearHeap(lua_heap_t *heap)
+{
+	UINT8 i;
+
+	for (i = 0; i < LUA_NUMSIZECLASSES; i++)
+		Z_PoolClear(&heap->pools[i]);
+	heap->pooledbytes = heap->largebytes = 0;
+}
+
+static inline UINT8 LUA_SizeClass(size_t size)
+{
+	if (size > LUA_MAXPOOLEDSIZE)
+		return LUA_NOSIZECLASS;
+	return lua_sizeclassof[(size + 15) >> 4];
+}
+
+void LUA_GetHeapStats(size_t *used, size_t *reserved, size_t *large)
+{
+	UINT8 i;
+
+	*used = lua_mainheap.pooledbytes;
+	*large = lua_mainheap.largebytes;
+	*reserved = 0;
+	for (i = 0; i < LUA_NUMSIZECLASSES; i++)
+		*reserved += Z_PoolReserved(&lua_mainheap.pools[i]);
+}
+
 // Lua asks for memory using this.
 static void *LUA_Alloc(void *ud, void *ptr, size_t osize, size_t nsize)
 {
-	(void)ud;
-	if (nsize == 0) {
-		if (osize != 0)
+	lua_heap_t *heap = ud;
+	UINT8 oldclass = (ptr ? LUA_SizeClass(osize) : LUA_NOSIZECLASS);
+	UINT8 newclass = (nsize ? LUA_SizeClass(nsize) : LUA_NOSIZECLASS);
+	void *newptr;
+
+	if (nsize == 0)
+	{
+		if (ptr == NULL)
+			return NULL;
+
+		if (oldclass != LUA_NOSIZECLASS)
+		{
+			Z_PoolFree(&heap->pools[oldclass], ptr);
+			heap->pooledbytes -= osize;
+		}
+		else
+		{
 			Z_Free(ptr);
+			heap->largebytes -= osize;
+		}
 		return NULL;
-	} else
-		return Z_Realloc(ptr, nsize, PU_LUA, NULL);
+	}
+
+	if (ptr && oldclass == newclass)
+	{
+		if (newclass == LUA_NOSIZECLASS)
+		{
+			heap->largebytes += nsize - osize;
+			return Z_Realloc(ptr, nsize, PU_LUA, NULL);
+		}
+
+		// Still fits in the same block
+		heap->pooledbytes += nsize - osize;
+		return ptr;
+	}
+
+	if (newclass != LUA_NOSIZECLASS)
+	{
+		newptr = Z_PoolAlloc(&heap->pools[newclass]);
+		heap->pooledbytes += nsize;
+	}
+	else
+	{
+		newptr = Z_Malloc(nsize, PU_LUA, NULL);
+		heap->largebytes += nsize;
+	}
+
+	if (ptr)
+	{
+		M_Memcpy(newptr, ptr, min(osize, nsize));
+		LUA_Alloc(ud, ptr, osize, 0);
+	}
+
+	return newptr;
 }
 
 // Panic function Lua calls when there's an unprotected error.
@@ -570,10 +692,14 @@ static void LUA_ClearState(void)
 		lua_close(gL);
 	gL = NULL;
 
+	// and give back all of its memory
+	LUA_ClearHeap(&lua_mainheap);
+	LUA_InitHeap(&lua_mainheap);
+
 	CONS_Printf(M_GetText("Pardon me while I initialize the Lua scripting interface...\n"));
 
 	// allocate state
-	L = lua_newstate(LUA_Alloc, NULL);
+	L = lua_newstate(LUA_Alloc, &lua_mainheap);
 	lua_atpanic(L, LUA_Panic);
 
 	// open base libraries
@@ -763,7 +889,8 @@ fixed_t LUA_EvalMath(const char *word)
 	{
 		// make a new state so SOC can't interefere with scripts
 		// allocate state
-		L = lua_newstate(LUA_Alloc, NULL);
+		LUA_InitHeap(&lua_evalheap);
+		L = lua_newstate(LUA_Alloc, &lua_evalheap);
 		lua_atpanic(L, LUA_Panic);
 
 		// open only enum lib
@@ -1014,6 +1141,10 @@ enum
 	ARCH_TEND=0xFF,
 };
 
+// Most an archived value can take up besides the characters of a string:
+// its type byte and a UINT32 (or two UINT16s, for ffloors)
+#define ARCHIVEVALUESIZE (1 + sizeof (UINT32))
+
 static const struct {
 	const char *meta;
 	UINT8 arch;
@@ -1066,6 +1197,13 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 {
 	if (myindex < 0)
 		myindex = lua_gettop(gL)+1+myindex;
+
+	// Make room before writing anything
+	if (lua_type(gL, myindex) == LUA_TSTRING)
+		P_SaveReserve(ARCHIVEVALUESIZE + lua_objlen(gL, myindex));
+	else
+		P_SaveReserve(ARCHIVEVALUESIZE);
+
 	switch (lua_type(gL, myindex))
 	{
 	case LUA_TNONE:
@@ -1423,6 +1561,7 @@ static void ArchiveExtVars(void *pointer, const char *ptype)
 	while (lua_next(gL, -2))
 	{
 		I_Assert(lua_type(gL, -2) == LUA_TSTRING);
+		P_SaveReserve(lua_objlen(gL, -2) + 1);
 		WRITESTRING(save_p, lua_tostring(gL, -2));
 		if (ArchiveValue(TABLESINDEX, -1) == 2)
 			CONS_Alert(CONS_ERROR, "Type of value for %s entry '%s' (%s) could not be archived!\n", ptype, lua_tostring(gL, -2), luaL_typename(gL, -1));
@@ -1472,6 +1611,7 @@ static void ArchiveTables(void)
 
 			lua_pop(gL, 1);
 		}
+		P_SaveReserve(1 + sizeof (UINT16));
 		WRITEUINT8(save_p, ARCH_TEND);
 
 		// Write metatable ID
@@ -50,6 +50,7 @@ void LUA_LoadLump(UINT16 wad, UINT16 lump, boolean noresults);
 void LUA_DumpFile(const char *filename);
 #endif
 fixed_t LUA_EvalMath(const char *word);
+void LUA_GetHeapStats(size_t *used, size_t *reserved, size_t *large);
 void LUA_Step(void);
 void LUA_Archive(void);
 void LUA_UnArchive(void);
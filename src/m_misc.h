@@ -59,6 +59,15 @@ void FIL_DefaultExtension (char *path, const char *extension);
 void FIL_ForceExtension(char *path, const char *extension);
 boolean FIL_CheckExtension(const char *in);
 
+// Nanoseconds part of a struct stat's modification time, 0 where there is none
+#if defined (__APPLE__)
+#define STAT_MTIMENSEC(st) ((st).st_mtimespec.tv_nsec)
+#elif defined (__linux__) || defined (__FreeBSD__) || defined (__OpenBSD__) || defined (__NetBSD__)
+#define STAT_MTIMENSEC(st) ((st).st_mtim.tv_nsec)
+#else
+#define STAT_MTIMENSEC(st) 0
+#endif
+
 #ifdef HAVE_PNG
 boolean M_SavePNG(const char *filename, void *data, int width, int height, const UINT8 *palette);
 #endif
@@ -18,6 +18,7 @@
 #include "z_zone.h"
 #include "p_local.h"
 #include "r_fps.h"
+#include "i_threads.h"
 
 #ifdef HWRENDER
 #include "hardware/hw_main.h"
@@ -51,6 +52,7 @@ ps_metric_t ps_playerthink_time = {0};
 ps_metric_t ps_thinkertime = {0};
 
 ps_metric_t ps_thlist_times[NUM_THINKERLISTS];
+ps_metric_t ps_precip_time = {0};
 
 static ps_metric_t ps_thinkercount = {0};
 static ps_metric_t ps_polythcount = {0};
@@ -64,6 +66,10 @@ static ps_metric_t ps_precipcount = {0};
 static ps_metric_t ps_removecount = {0};
 
 ps_metric_t ps_checkposition_calls = {0};
+static ps_metric_t ps_checksight_calls = {0};
+static ps_metric_t ps_sight_memohits = {0};
+static ps_metric_t ps_sight_rejected = {0};
+static ps_metric_t ps_sight_traces = {0};
 
 ps_metric_t ps_lua_prethinkframe_time = {0};
 ps_metric_t ps_lua_thinkframe_time = {0};
@@ -71,6 +77,14 @@ ps_metric_t ps_lua_postthinkframe_time = {0};
 
 ps_metric_t ps_lua_mobjhooks = {0};
 
+static ps_metric_t ps_lua_memory = {0};
+static ps_metric_t ps_lua_slabunused = {0};
+static ps_metric_t ps_precip_memory = {0};
+
+#ifdef HAVE_THREADS
+static ps_metric_t ps_worker_busy[I_MAX_WORKERS];
+#endif
+
 ps_metric_t ps_otherlogictime = {0};
 
 // Columns for perfstats pages.
@@ -106,6 +120,7 @@ perfstatrow_t rendertime_rows[] = {
 	{" portals", " Portals+Skybox:", &ps_sw_portaltime, PS_TIME|PS_LEVEL|PS_SW},
 	{" planes ", " R_DrawPlanes:  ", &ps_sw_planetime, PS_TIME|PS_LEVEL|PS_SW},
 	{" masked ", " R_DrawMasked:  ", &ps_sw_maskedtime, PS_TIME|PS_LEVEL|PS_SW},
+	{" sprsort", " Sprite sort:   ", &ps_sw_spritesorttime, PS_TIME|PS_LEVEL|PS_SW},
 	{" other  ", " Other:         ", &ps_otherrendertime, PS_TIME|PS_LEVEL|PS_SW},
 
 	{"ui     ", "UI render:     ", &ps_uitime, PS_TIME},
@@ -159,7 +174,7 @@ perfstatrow_t gamelogic_rows[] = {
 	{"  main   ", "  Main:           ", &ps_thlist_times[THINK_MAIN], PS_TIME|PS_LEVEL},
 	{"  mobjs  ", "  Mobjs:          ", &ps_thlist_times[THINK_MOBJ], PS_TIME|PS_LEVEL},
 	{"  dynslop", "  Dynamic slopes: ", &ps_thlist_times[THINK_DYNSLOPE], PS_TIME|PS_LEVEL},
-	{"  precip ", "  Precipitation:  ", &ps_thlist_times[THINK_PRECIP], PS_TIME|PS_LEVEL},
+	{"  precip ", "  Precipitation:  ", &ps_precip_time, PS_TIME|PS_LEVEL},
 	{" lprethinkf", " LUAh_PreThinkFrame:", &ps_lua_prethinkframe_time, PS_TIME|PS_LEVEL},
 	{" lthinkf", " LUAh_ThinkFrame:", &ps_lua_thinkframe_time, PS_TIME|PS_LEVEL},
 	{" lpostthinkf", " LUAh_PostThinkFrame:", &ps_lua_postthinkframe_time, PS_TIME|PS_LEVEL},
@@ -184,9 +199,26 @@ perfstatrow_t thinkercount_rows[] = {
 perfstatrow_t misc_calls_rows[] = {
 	{"lmhook", "Lua mobj hooks: ", &ps_lua_mobjhooks, PS_LEVEL},
 	{"chkpos", "P_CheckPosition:", &ps_checkposition_calls, PS_LEVEL},
+	{"chksght", "P_CheckSight:   ", &ps_checksight_calls, PS_LEVEL},
+	{" memo%", " Memo hit %:    ", &ps_sight_memohits, PS_LEVEL},
+	{" rjct%", " PVS reject %:  ", &ps_sight_rejected, PS_LEVEL},
+	{" traces", " BSP traces:    ", &ps_sight_traces, PS_LEVEL},
+	{0}
+};
+
+perfstatrow_t memory_rows[] = {
+	{"luamem", "Lua memory (KB):", &ps_lua_memory, 0},
+	{"luafrag", "Lua slab unused%:", &ps_lua_slabunused, 0},
+	{"precmem", "Precip mem (KB):", &ps_precip_memory, PS_LEVEL},
 	{0}
 };
 
+#ifdef HAVE_THREADS
+// Filled in by PS_UpdateWorkerStats once the worker count is known
+static char worker_labels[I_MAX_WORKERS][2][20];
+perfstatrow_t worker_rows[I_MAX_WORKERS + 1];
+#endif
+
 // Sample collection status for averaging.
 // Maximum of these two is shown to user if nonzero to tell that
 // the reported averages are not correct yet.
@@ -576,7 +608,7 @@ static void PS_CountThinkers(void)
 	ps_scenerycount.value.i = 0;
 	ps_nothinkcount.value.i = 0;
 	ps_dynslopethcount.value.i = 0;
-	ps_precipcount.value.i = 0;
+	ps_precipcount.value.i = (INT32)precipitation.numdrops;
 	ps_removecount.value.i = 0;
 
 	for (i = 0; i < NUM_THINKERLISTS; i++)
@@ -606,12 +638,58 @@ static void PS_CountThinkers(void)
 			}
 			else if (i == THINK_DYNSLOPE)
 				ps_dynslopethcount.value.i++;
-			else if (i == THINK_PRECIP)
-				ps_precipcount.value.i++;
 		}
 	}
 }
 
+// Turn this tic's sight counts into hit rates.
+static void PS_UpdateSightStats(void)
+{
+	const INT32 calls = sightcounts[SIGHT_CALLS];
+
+	ps_checksight_calls.value.i = calls;
+	ps_sight_memohits.value.i = calls ? sightcounts[SIGHT_MEMOHITS] * 100 / calls : 0;
+	ps_sight_rejected.value.i = calls ? sightcounts[SIGHT_REJECTED] * 100 / calls : 0;
+	ps_sight_traces.value.i = sightcounts[SIGHT_TRACES];
+}
+
+// Update memory usage counters.
+static void PS_UpdateMemoryStats(void)
+{
+	size_t luaused, luareserved, lualarge;
+
+	LUA_GetHeapStats(&luaused, &luareserved, &lualarge);
+	ps_lua_memory.value.i = (INT32)((luaused + lualarge) >> 10);
+	ps_lua_slabunused.value.i = luareserved ? (INT32)(100 - luaused * 100 / luareserved) : 0;
+	ps_precip_memory.value.i = (INT32)(precipitation.memory >> 10);
+}
+
+#ifdef HAVE_THREADS
+// Update the share of time each job worker spent running jobs.
+static void PS_UpdateWorkerStats(void)
+{
+	int i;
+
+	for (i = 0; i < I_worker_count(); i++)
+	{
+		precise_t busy, idle;
+		UINT32 jobs;
+
+		if (!worker_rows[i].lores_label)
+		{
+			snprintf(worker_labels[i][0], sizeof worker_labels[i][0], "wrk%d%%", i);
+			snprintf(worker_labels[i][1], sizeof worker_labels[i][1], "Worker %2d busy%%:", i);
+			worker_rows[i].lores_label = worker_labels[i][0];
+			worker_rows[i].hires_label = worker_labels[i][1];
+			worker_rows[i].metric = &ps_worker_busy[i];
+		}
+
+		I_worker_stats(i, &busy, &idle, &jobs);
+		ps_worker_busy[i].value.i = (busy + idle) ? (INT32)(busy * 100 / (busy + idle)) : 0;
+	}
+}
+#endif
+
 // Update all metrics that are calculated on every tick.
 void PS_UpdateTickStats(void)
 {
@@ -632,13 +710,23 @@ void PS_UpdateTickStats(void)
 				ps_lua_postthinkframe_time.value.p;
 
 			PS_CountThinkers();
+			PS_UpdateSightStats();
 		}
 
+		PS_UpdateMemoryStats();
+#ifdef HAVE_THREADS
+		PS_UpdateWorkerStats();
+#endif
+
 		if (cv_ps_samplesize.value > 1)
 		{
 			PS_UpdateRowHistories(gamelogic_rows, false);
 			PS_UpdateRowHistories(thinkercount_rows, false);
 			PS_UpdateRowHistories(misc_calls_rows, false);
+			PS_UpdateRowHistories(memory_rows, false);
+#ifdef HAVE_THREADS
+			PS_UpdateRowHistories(worker_rows, false);
+#endif
 		}
 	}
 	if (cv_ps_samplesize.value > 1)
@@ -773,7 +861,28 @@ static void PS_DrawGameLogicStats(void)
 
 	x = hires ? 216 : 170;
 	y = hires ? 15 : 10;
-	PS_DrawPerfRows(x, y, V_PURPLEMAP, misc_calls_rows);
+	y = PS_DrawPerfRows(x, y, V_PURPLEMAP, misc_calls_rows);
+
+	y += hires ? 5 : 4;
+	if (hires)
+	{
+		V_DrawSmallString(212, y, V_MONOSPACE | V_ALLOWLOWERCASE | V_GRAYMAP, "Memory:");
+		y += 5;
+	}
+	y = PS_DrawPerfRows(x, y, V_GRAYMAP, memory_rows);
+
+#ifdef HAVE_THREADS
+	if (I_worker_count())
+	{
+		y += hires ? 5 : 4;
+		if (hires)
+		{
+			V_DrawSmallString(212, y, V_MONOSPACE | V_ALLOWLOWERCASE | V_GRAYMAP, "Workers:");
+			y += 5;
+		}
+		PS_DrawPerfRows(x, y, V_GRAYMAP, worker_rows);
+	}
+#endif
 }
 
 static void draw_think_frame_stats(int hook_length, ps_hookinfo_t *hook)
@@ -943,3 +1052,164 @@ void PS_SampleSize_OnChange(void)
 	if (cv_ps_samplesize.value > 1)
 		PS_ClearHistory();
 }
+
+#ifdef HAVE_THREADS
+//
+// Job system check
+//
+
+#define JOBBENCH_ITEMS 65536
+#define JOBBENCH_LEAVES 64
+
+static UINT32 *jobbench_hits; // times parallel_for visited each item
+static UINT32 *jobbench_values;
+static UINT32 jobbench_leaves[JOBBENCH_LEAVES];
+static UINT32 jobbench_sum, jobbench_nestedsum;
+static boolean jobbench_early; // a merge job ran before one of its leaves
+static UINT32 jobbench_counter;
+static I_mutex jobbench_mutex;
+
+// Something for the jobs to chew on
+static UINT32 PS_JobBenchWork(UINT32 x)
+{
+	INT32 i;
+	for (i = 0; i < 64; i++)
+		x = x * 1664525 + 1013904223;
+	return x | 1;
+}
+
+static void PS_JobBenchRange(size_t start, size_t end, void *userdata)
+{
+	size_t i;
+	(void)userdata;
+	for (i = start; i < end; i++)
+	{
+		jobbench_hits[i]++;
+		jobbench_values[i] = PS_JobBenchWork((UINT32)i);
+	}
+}
+
+static void PS_JobBenchLeaf(void *userdata)
+{
+	UINT32 *leaf = userdata;
+
+	*leaf = PS_JobBenchWork((UINT32)(leaf - jobbench_leaves));
+
+	I_lock_mutex(&jobbench_mutex);
+	jobbench_counter++;
+	I_unlock_mutex(jobbench_mutex);
+}
+
+static void PS_JobBenchMerge(void *userdata)
+{
+	INT32 i;
+	(void)userdata;
+	jobbench_sum = 0;
+	for (i = 0; i < JOBBENCH_LEAVES; i++)
+	{
+		if (!jobbench_leaves[i])
+			jobbench_early = true;
+		jobbench_sum += jobbench_leaves[i];
+	}
+}
+
+// Schedules the leaves itself and waits for them from inside the pool
+static void PS_JobBenchNested(void *userdata)
+{
+	I_job leaves[JOBBENCH_LEAVES];
+	INT32 i;
+	(void)userdata;
+
+	for (i = 0; i < JOBBENCH_LEAVES; i++)
+		leaves[i] = I_schedule_job(PS_JobBenchLeaf, &jobbench_leaves[i], NULL, 0);
+	jobbench_nestedsum = 0;
+	for (i = 0; i < JOBBENCH_LEAVES; i++)
+	{
+		I_wait_job(leaves[i]);
+		jobbench_nestedsum += jobbench_leaves[i];
+	}
+}
+
+/** Checks that the job workers run every job and every parallel_for item
+  * exactly once and respect dependencies, also when waiting from inside a
+  * job, and times parallel_for against doing the same work on this thread.
+  * Usage: jobbench [rounds]
+  */
+void Command_JobBench_f(void)
+{
+	INT32 rounds = 100, round, errors = 0, i;
+	precise_t serialtime, paralleltime = 0, graphtime;
+	UINT32 expected = 0;
+
+	if (COM_Argc() > 1)
+		rounds = min(max(atoi(COM_Argv(1)), 1), 100000);
+
+	jobbench_hits = Z_Calloc(JOBBENCH_ITEMS * sizeof (*jobbench_hits), PU_STATIC, NULL);
+	jobbench_values = Z_Malloc(JOBBENCH_ITEMS * sizeof (*jobbench_values), PU_STATIC, NULL);
+
+	serialtime = I_GetPreciseTime();
+	for (i = 0; i < JOBBENCH_ITEMS; i++)
+		jobbench_values[i] = PS_JobBenchWork((UINT32)i);
+	serialtime = I_GetPreciseTime() - serialtime;
+
+	for (round = 0; round < rounds; round++)
+	{
+		precise_t start = I_GetPreciseTime();
+		I_parallel_for(JOBBENCH_ITEMS, 256, PS_JobBenchRange, NULL);
+		paralleltime += I_GetPreciseTime() - start;
+	}
+	paralleltime /= rounds;
+
+	for (i = 0; i < JOBBENCH_ITEMS; i++)
+	{
+		if (jobbench_hits[i] != (UINT32)rounds || jobbench_values[i] != PS_JobBenchWork((UINT32)i))
+			errors++;
+	}
+
+	for (i = 0; i < JOBBENCH_LEAVES; i++)
+		expected += PS_JobBenchWork((UINT32)i);
+
+	jobbench_counter = 0;
+	jobbench_early = false;
+	graphtime = I_GetPreciseTime();
+	for (round = 0; round < rounds; round++)
+	{
+		I_job leaves[JOBBENCH_LEAVES], merge, nested;
+
+		memset(jobbench_leaves, 0, sizeof (jobbench_leaves));
+		for (i = 0; i < JOBBENCH_LEAVES; i++)
+			leaves[i] = I_schedule_job(PS_JobBenchLeaf, &jobbench_leaves[i], NULL, 0);
+		merge = I_schedule_job(PS_JobBenchMerge, NULL, leaves, JOBBENCH_LEAVES);
+		for (i = 0; i < JOBBENCH_LEAVES; i++)
+			I_wait_job(leaves[i]);
+		I_wait_job(merge);
+		if (jobbench_sum != expected)
+			errors++;
+
+		memset(jobbench_leaves, 0, sizeof (jobbench_leaves));
+		nested = I_schedule_job(PS_JobBenchNested, NULL, NULL, 0);
+		I_wait_job(nested);
+		if (jobbench_nestedsum != expected)
+			errors++;
+	}
+	graphtime = I_GetPreciseTime() - graphtime;
+
+	if (jobbench_early)
+		errors++;
+	if (jobbench_counter != (UINT32)(rounds * JOBBENCH_LEAVES * 2))
+		errors++;
+
+	Z_Free(jobbench_values);
+	Z_Free(jobbench_hits);
+	jobbench_values = jobbench_hits = NULL;
+
+	CONS_Printf("%d workers, %d rounds\n", I_worker_count(), rounds);
+	CONS_Printf("parallel_for: %d us, on this thread %d us (%.2fx)\n",
+		(int)(paralleltime * 1000000 / I_GetPrecisePrecision()), (int)(serialtime * 1000000 / I_GetPrecisePrecision()),
+		paralleltime ? (double)serialtime / paralleltime : 0.0);
+	CONS_Printf("%d jobs in %d us\n", rounds * (JOBBENCH_LEAVES * 2 + 2),
+		(int)(graphtime * 1000000 / I_GetPrecisePrecision()));
+	if (errors)
+		CONS_Alert(CONS_WARNING, "%d job system checks failed!\n", errors);
+}
+#endif
@@ -40,6 +40,7 @@ extern ps_metric_t ps_playerthink_time;
 extern ps_metric_t ps_thinkertime;
 
 extern ps_metric_t ps_thlist_times[];
+extern ps_metric_t ps_precip_time;
 
 extern ps_metric_t ps_checkposition_calls;
 
@@ -61,4 +62,8 @@ void M_DrawPerfStats(void);
 void PS_PerfStats_OnChange(void);
 void PS_SampleSize_OnChange(void);
 
+#ifdef HAVE_THREADS
+void Command_JobBench_f(void);
+#endif
+
 #endif
@@ -1939,6 +1939,7 @@ void EV_CrumbleChain(sector_t *sec, ffloor_t *rover)
 	rover->fofflags &= ~FOF_EXISTS;
 	rover->master->frontsector->moved = true;
 	P_RecalcPrecipInSector(sec);
+	P_InvalidateSightMemo();
 }
 
 // Used for bobbing platforms on the water
@@ -2077,6 +2078,8 @@ void EV_MarioBlock(ffloor_t *rover, sector_t *sector, mobj_t *puncher)
 	if (!(rover->fofflags & FOF_SOLID))
 		rover->fofflags |= (FOF_SOLID|FOF_RENDERALL|FOF_CUTLEVEL);
 
+	P_InvalidateSightMemo();
+
 	// Find an item to pop out!
 	thing = SearchMarioNode(roversec->touching_thinglist);
 
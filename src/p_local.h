@@ -67,7 +67,6 @@ typedef enum
 	THINK_MAIN,
 	THINK_MOBJ,
 	THINK_DYNSLOPE,
-	THINK_PRECIP,
 	NUM_THINKERLISTS
 } thinklistnum_t; /**< Thinker lists. */
 extern thinker_t thlist[];
@@ -75,6 +74,7 @@ extern thinker_t thlist[];
 void P_InitThinkers(void);
 void P_AddThinker(const thinklistnum_t n, thinker_t *thinker);
 void P_RemoveThinker(thinker_t *thinker);
+void P_FreeThinker(thinker_t *thinker, const thinklistnum_t n);
 
 //
 // P_USER
@@ -408,11 +408,12 @@ extern line_t *ceilingline;
 extern line_t *blockingline;
 extern msecnode_t *sector_list;
 
-extern mprecipsecnode_t *precipsector_list;
 
 void P_UnsetThingPosition(mobj_t *thing);
 void P_SetThingPosition(mobj_t *thing);
 void P_SetUnderlayPosition(mobj_t *thing);
+void P_ClearBlockThings(void);
+void P_UpdateBlockRadius(mobj_t *thing);
 
 boolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y);
 boolean P_CheckCameraPosition(fixed_t x, fixed_t y, camera_t *thiscam);
@@ -425,12 +426,14 @@ boolean P_LineIsBlocking(mobj_t *mo, line_t *li);
 void P_SlideMove(mobj_t *mo);
 void P_BounceMove(mobj_t *mo);
 boolean P_CheckSight(mobj_t *t1, mobj_t *t2);
+void P_StartSightTic(void);
+void P_InvalidateSightMemo(void);
+void P_BuildSightPVS(void);
 void P_CheckHoopPosition(mobj_t *hoopthing, fixed_t x, fixed_t y, fixed_t z, fixed_t radius);
 
 boolean P_CheckSector(sector_t *sector, boolean crunch);
 
 void P_DelSeclist(msecnode_t *node);
-void P_DelPrecipSeclist(mprecipsecnode_t *node);
 
 void P_CreateSecNodeList(mobj_t *thing, fixed_t x, fixed_t y);
 void P_Initsecnode(void);
@@ -443,6 +446,17 @@ boolean PIT_PushableMoved(mobj_t *thing);
 
 boolean P_DoSpring(mobj_t *spring, mobj_t *object);
 
+typedef enum
+{
+	SIGHT_CALLS, // got past the trivial checks
+	SIGHT_REJECTED, // thrown out by REJECT or the PVS
+	SIGHT_MEMOHITS, // already checked this tic
+	SIGHT_TRACES, // went through the BSP
+	NUMSIGHTCOUNTS
+} sightcount_t;
+
+extern INT32 sightcounts[NUMSIGHTCOUNTS]; // reset every tic
+
 //
 // P_SETUP
 //
@@ -455,6 +469,18 @@ extern fixed_t bmaporgx;
 extern fixed_t bmaporgy; // origin of block map
 extern mobj_t **blocklinks; // for thing chains
 
+// Packed copy of a block's thing chain, oldest first
+typedef struct
+{
+	mobj_t **mobj;
+	fixed_t *x, *y, *radius; // as of linking
+	UINT32 *stamp;
+	UINT32 count, capacity;
+	fixed_t maxradius; // nothing in the block is bigger
+} blockthings_t;
+
+extern blockthings_t *blockthings;
+
 //
 // P_INTER
 //
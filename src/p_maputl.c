@@ -23,6 +23,10 @@
 #include "p_polyobj.h"
 #include "p_slopes.h"
 #include "z_zone.h"
+#include "g_game.h" // players
+#include "i_system.h" // I_GetPreciseTime
+#include "command.h" // COM_Argv
+#include "console.h"
 
 //
 // P_AproxDistance
@@ -685,6 +689,136 @@ void P_LineOpening(line_t *linedef, mobj_t *mobj)
 // THING POSITION SETTING
 //
 
+//
+// Packed block things
+//
+// Every block's thing chain is mirrored here as parallel arrays holding the
+// position and radius each thing was linked with, oldest first. Iterators
+// walk these instead of the chain, and the overlap tests in
+// P_BlockThingsIteratorNear only touch the arrays, so the mobjs themselves
+// are only read for things that are actually close.
+//
+// Only x, y and radius are kept: z, height and flags change all the time
+// without the thing being relinked, so they have to be read live anyway.
+//
+
+blockthings_t *blockthings;
+static UINT32 blockthingstamp;
+
+//
+// P_ClearBlockThings
+// Sets up empty blocks. Call whenever blocklinks is reallocated.
+//
+void P_ClearBlockThings(void)
+{
+	blockthings = Z_Calloc(sizeof (*blockthings) * bmapwidth * bmapheight, PU_LEVEL, NULL);
+	blockthingstamp = 0;
+}
+
+static void P_GrowBlockThings(blockthings_t *block)
+{
+	const UINT32 capacity = block->capacity ? block->capacity * 2 : 4;
+	mobj_t **mobj = Z_Malloc(capacity * (sizeof (mobj_t *) + 3*sizeof (fixed_t) + sizeof (UINT32)), PU_LEVEL, NULL);
+	fixed_t *x = (fixed_t *)(mobj + capacity);
+	fixed_t *y = x + capacity;
+	fixed_t *radius = y + capacity;
+	UINT32 *stamp = (UINT32 *)(radius + capacity);
+
+	if (block->count)
+	{
+		M_Memcpy(mobj, block->mobj, block->count * sizeof (*mobj));
+		M_Memcpy(x, block->x, block->count * sizeof (*x));
+		M_Memcpy(y, block->y, block->count * sizeof (*y));
+		M_Memcpy(radius, block->radius, block->count * sizeof (*radius));
+		M_Memcpy(stamp, block->stamp, block->count * sizeof (*stamp));
+	}
+
+	if (block->mobj)
+		Z_Free(block->mobj);
+
+	block->mobj = mobj;
+	block->x = x;
+	block->y = y;
+	block->radius = radius;
+	block->stamp = stamp;
+	block->capacity = capacity;
+}
+
+static void P_LinkBlockThing(mobj_t *thing, INT32 cell)
+{
+	blockthings_t *block = &blockthings[cell];
+	const UINT32 i = block->count;
+
+	if (i == block->capacity)
+		P_GrowBlockThings(block);
+
+	if (!++blockthingstamp) // 0 means unlinked
+		++blockthingstamp;
+
+	block->mobj[i] = thing;
+	block->x[i] = thing->x;
+	block->y[i] = thing->y;
+	block->radius[i] = thing->radius;
+	block->stamp[i] = blockthingstamp;
+	block->count++;
+
+	if (thing->radius > block->maxradius)
+		block->maxradius = thing->radius;
+
+	thing->blockcell = cell;
+	thing->blockstamp = blockthingstamp;
+}
+
+static void P_UnlinkBlockThing(mobj_t *thing)
+{
+	blockthings_t *block = &blockthings[thing->blockcell];
+	UINT32 i = block->count, n;
+
+	// Things that move a lot were usually linked last
+	while (i-- > 0)
+		if (block->stamp[i] == thing->blockstamp)
+			break;
+
+	thing->blockstamp = 0;
+
+	if (i >= block->count)
+		return;
+
+	n = block->count - i - 1;
+	memmove(&block->mobj[i], &block->mobj[i+1], n * sizeof (*block->mobj));
+	memmove(&block->x[i], &block->x[i+1], n * sizeof (*block->x));
+	memmove(&block->y[i], &block->y[i+1], n * sizeof (*block->y));
+	memmove(&block->radius[i], &block->radius[i+1], n * sizeof (*block->radius));
+	memmove(&block->stamp[i], &block->stamp[i+1], n * sizeof (*block->stamp));
+
+	// maxradius is only an upper bound, so it can stay until the block empties
+	if (!--block->count)
+		block->maxradius = 0;
+}
+
+//
+// P_UpdateBlockRadius
+// Call after changing the radius of a thing without relinking it.
+//
+void P_UpdateBlockRadius(mobj_t *thing)
+{
+	blockthings_t *block;
+	UINT32 i;
+
+	if (!thing->blockstamp)
+		return;
+
+	block = &blockthings[thing->blockcell];
+	for (i = block->count; i-- > 0;)
+		if (block->stamp[i] == thing->blockstamp)
+		{
+			block->radius[i] = thing->radius;
+			if (thing->radius > block->maxradius)
+				block->maxradius = thing->radius;
+			return;
+		}
+}
+
 //
 // P_UnsetThingPosition
 // Unlinks a thing from block map and sectors.
@@ -744,20 +878,11 @@ void P_UnsetThingPosition(mobj_t *thing)
 		mobj_t *bnext, **bprev = thing->bprev;
 		if (bprev && (*bprev = bnext = thing->bnext) != NULL)  // unlink from block map
 			bnext->bprev = bprev;
+		if (bprev && thing->blockstamp)
+			P_UnlinkBlockThing(thing);
 	}
 }
 
-void P_UnsetPrecipThingPosition(precipmobj_t *thing)
-{
-	precipmobj_t **sprev = thing->sprev;
-	precipmobj_t  *snext = thing->snext;
-	if ((*sprev = snext) != NULL)  // unlink from sector list
-		snext->sprev = sprev;
-
-	precipsector_list = thing->touching_sectorlist;
-	thing->touching_sectorlist = NULL; //to be restored by P_SetPrecipThingPosition
-}
-
 //
 // P_SetThingPosition
 // Links a thing into both a block and a subsector
@@ -829,6 +954,8 @@ void P_SetThingPosition(mobj_t *thing)
 				bnext->bprev = &thing->bnext;
 			thing->bprev = link;
 			*link = thing;
+
+			P_LinkBlockThing(thing, blocky*bmapwidth + blockx);
 		}
 		else // thing is off the map
 			thing->bnext = NULL, thing->bprev = NULL;
@@ -884,22 +1011,6 @@ void P_SetUnderlayPosition(mobj_t *thing)
 	sector_list = NULL; // clear for next time
 }
 
-void P_SetPrecipitationThingPosition(precipmobj_t *thing)
-{
-	subsector_t *ss = thing->subsector = R_PointInSubsector(thing->x, thing->y);
-
-	precipmobj_t **link = &ss->sector->preciplist;
-	precipmobj_t *snext = *link;
-	if ((thing->snext = snext) != NULL)
-		snext->sprev = &thing->snext;
-	thing->sprev = link;
-	*link = thing;
-
-	P_CreatePrecipSecNodeList(thing, thing->x, thing->y);
-	thing->touching_sectorlist = precipsector_list; // Attach to Thing's precipmobj_t
-	precipsector_list = NULL; // clear for next time
-}
-
 //
 // BLOCK MAP ITERATORS
 // For each line/thing in the given mapblock,
@@ -972,27 +1083,168 @@ boolean P_BlockLinesIterator(INT32 x, INT32 y, boolean (*func)(line_t *))
 }
 
 
+// Things to visit, copied out of the block before calling func so that
+// func can link and unlink things as it likes. Shared between nested
+// iterators, each using the part above where its caller stopped.
+typedef struct
+{
+	mobj_t *mobj;
+	mobj_t *next; // what came after it in the block, visited or not
+	UINT32 stamp;
+} blockvisit_t;
+
+static blockvisit_t *blockvisits;
+static size_t numblockvisits, maxblockvisits;
+
+static UINT8 *blockhits;
+static size_t maxblockhits;
+
+static boolean P_IterateBlockThings(INT32 x, INT32 y, boolean filter, fixed_t cx, fixed_t cy, fixed_t radius, boolean (*func)(mobj_t *))
+{
+	const blockthings_t *block;
+	const size_t base = numblockvisits;
+	size_t i, n, top;
+
+	if (x < 0 || y < 0 || x >= bmapwidth || y >= bmapheight)
+		return true;
+
+	block = &blockthings[y*bmapwidth + x];
+	n = block->count;
+	if (!n)
+		return true;
+
+	if (filter)
+	{
+		const INT64 reach = (INT64)block->maxradius + radius;
+		const INT64 left = bmaporgx + ((INT64)x << MAPBLOCKSHIFT);
+		const INT64 bottom = bmaporgy + ((INT64)y << MAPBLOCKSHIFT);
+
+		// Nothing in here is big enough to reach
+		if (cx + reach <= left || cx - reach >= left + MAPBLOCKSIZE
+			|| cy + reach <= bottom || cy - reach >= bottom + MAPBLOCKSIZE)
+			return true;
+
+		if (n > maxblockhits)
+		{
+			maxblockhits = max(n, maxblockhits * 2);
+			blockhits = Z_Realloc(blockhits, maxblockhits, PU_STATIC, NULL);
+		}
+
+		// Same test PIT_CheckThing starts with, done for the whole block
+		// in one go without branches
+		{
+			const fixed_t *bx = block->x, *by = block->y, *br = block->radius;
+			UINT8 *hits = blockhits;
+
+			for (i = 0; i < n; i++)
+			{
+				const fixed_t blockdist = br[i] + radius;
+				hits[i] = (abs(bx[i] - cx) < blockdist) & (abs(by[i] - cy) < blockdist);
+			}
+		}
+	}
+
+	if (numblockvisits + n > maxblockvisits)
+	{
+		maxblockvisits = max(numblockvisits + n, maxblockvisits * 2);
+		blockvisits = Z_Realloc(blockvisits, maxblockvisits * sizeof (*blockvisits), PU_STATIC, NULL);
+	}
+
+	// Newest first, the same order as the chain
+	for (i = n; i-- > 0;)
+	{
+		blockvisit_t *visit;
+
+		if (filter && !blockhits[i])
+			continue;
+
+		visit = &blockvisits[numblockvisits++];
+		visit->mobj = block->mobj[i];
+		visit->next = i ? block->mobj[i-1] : NULL;
+		visit->stamp = block->stamp[i];
+	}
+
+	top = numblockvisits;
+
+	for (i = base; i < top; i++)
+	{
+		// Copy it, func may grow blockvisits
+		const blockvisit_t visit = blockvisits[i];
+
+		// Left the block since, so the chain wouldn't have got to it
+		if (visit.mobj->blockstamp != visit.stamp)
+			continue;
+
+		if (!func(visit.mobj))
+		{
+			numblockvisits = base;
+			return false;
+		}
+		if (P_MobjWasRemoved(tmthing) // func just popped our tmthing, cannot continue.
+		|| (visit.next && P_MobjWasRemoved(visit.next))) // func just broke blockmap chain, cannot continue.
+		{
+			numblockvisits = base;
+			return true;
+		}
+	}
+
+	numblockvisits = base;
+	return true;
+}
+
 //
 // P_BlockThingsIterator
 //
 boolean P_BlockThingsIterator(INT32 x, INT32 y, boolean (*func)(mobj_t *))
+{
+	return P_IterateBlockThings(x, y, false, 0, 0, 0, func);
+}
+
+//
+// P_BlockThingsIteratorNear
+// Like P_BlockThingsIterator, but skips things whose square doesn't overlap
+// the square of the given radius around (cx, cy) where they were linked.
+// Only for funcs that ignore those things anyway, like PIT_CheckThing.
+//
+boolean P_BlockThingsIteratorNear(INT32 x, INT32 y, fixed_t cx, fixed_t cy, fixed_t radius, boolean (*func)(mobj_t *))
+{
+	return P_IterateBlockThings(x, y, true, cx, cy, radius, func);
+}
+
+static mobj_t *benchquery;
+static INT32 benchoverlaps;
+
+static boolean PIT_BenchOverlap(mobj_t *thing)
+{
+	fixed_t blockdist;
+
+	if (thing == benchquery)
+		return true;
+
+	blockdist = thing->radius + benchquery->radius;
+	if (abs(thing->x - benchquery->x) < blockdist && abs(thing->y - benchquery->y) < blockdist)
+		benchoverlaps++;
+
+	return true;
+}
+
+// How P_BlockThingsIterator used to walk a block
+static boolean P_BenchChainIterator(INT32 x, INT32 y, boolean (*func)(mobj_t *))
 {
 	mobj_t *mobj, *bnext = NULL;
 
 	if (x < 0 || y < 0 || x >= bmapwidth || y >= bmapheight)
 		return true;
 
-	// Check interaction with the objects in the blockmap.
 	for (mobj = blocklinks[y*bmapwidth + x]; mobj; mobj = bnext)
 	{
-		P_SetTarget(&bnext, mobj->bnext); // We want to note our reference to bnext here incase it is MF_NOTHINK and gets removed!
+		P_SetTarget(&bnext, mobj->bnext);
 		if (!func(mobj))
 		{
 			P_SetTarget(&bnext, NULL);
 			return false;
 		}
-		if (P_MobjWasRemoved(tmthing) // func just popped our tmthing, cannot continue.
-		|| (bnext && P_MobjWasRemoved(bnext))) // func just broke blockmap chain, cannot continue.
+		if (P_MobjWasRemoved(tmthing) || (bnext && P_MobjWasRemoved(bnext)))
 		{
 			P_SetTarget(&bnext, NULL);
 			return true;
@@ -1001,6 +1253,125 @@ boolean P_BlockThingsIterator(INT32 x, INT32 y, boolean (*func)(mobj_t *))
 	return true;
 }
 
+static INT32 P_BenchCollisions(mobj_t *crowd, INT32 numthings, boolean packed, precise_t *time)
+{
+	precise_t start = I_GetPreciseTime();
+	INT32 i;
+
+	benchoverlaps = 0;
+
+	for (i = 0; i < numthings; i++)
+	{
+		mobj_t *mo = &crowd[i];
+		INT32 bx, by, xl, xh, yl, yh;
+
+		xl = (unsigned)(mo->x - mo->radius - bmaporgx - MAXRADIUS)>>MAPBLOCKSHIFT;
+		xh = (unsigned)(mo->x + mo->radius - bmaporgx + MAXRADIUS)>>MAPBLOCKSHIFT;
+		yl = (unsigned)(mo->y - mo->radius - bmaporgy - MAXRADIUS)>>MAPBLOCKSHIFT;
+		yh = (unsigned)(mo->y + mo->radius - bmaporgy + MAXRADIUS)>>MAPBLOCKSHIFT;
+
+		BMBOUNDFIX(xl, xh, yl, yh);
+
+		P_SetTarget(&tmthing, mo);
+		benchquery = mo;
+
+		for (bx = xl; bx <= xh; bx++)
+			for (by = yl; by <= yh; by++)
+			{
+				if (packed)
+					P_BlockThingsIteratorNear(bx, by, mo->x, mo->y, mo->radius, PIT_BenchOverlap);
+				else
+					P_BenchChainIterator(bx, by, PIT_BenchOverlap);
+			}
+	}
+
+	P_SetTarget(&tmthing, NULL);
+	*time += I_GetPreciseTime() - start;
+	return benchoverlaps;
+}
+
+/** Links a crowd of made up rings and enemies into the blockmap around the
+  * console player, and times the same thing searches P_CheckPosition does
+  * for each of them, first walking the block chains and then through the
+  * packed bounds. The crowd never joins the thinker or sector lists, and is
+  * unlinked again afterwards.
+  * Usage: collisionbench [things] [passes]
+  */
+void Command_CollisionBench_f(void)
+{
+	INT32 numthings = 4000, passes = 10, pass, i;
+	INT32 chainoverlaps = 0, packedoverlaps = 0;
+	precise_t chaintime = 0, packedtime = 0;
+	UINT32 seed = 0x5EED;
+	fixed_t cx, cy, side;
+	mobj_t *crowd;
+
+	if (gamestate != GS_LEVEL || !blockthings || tmthing)
+	{
+		CONS_Printf(M_GetText("You must be in a level to use this.\n"));
+		return;
+	}
+
+	if (COM_Argc() > 1)
+		numthings = min(max(atoi(COM_Argv(1)), 1), 100000);
+	if (COM_Argc() > 2)
+		passes = max(atoi(COM_Argv(2)), 1);
+
+	if (players[consoleplayer].mo)
+	{
+		cx = players[consoleplayer].mo->x;
+		cy = players[consoleplayer].mo->y;
+	}
+	else
+	{
+		cx = bmaporgx + (bmapwidth << (MAPBLOCKSHIFT-1));
+		cy = bmaporgy + (bmapheight << (MAPBLOCKSHIFT-1));
+	}
+
+	// About one thing per 64x64 units
+	side = (fixed_t)(sqrt((double)numthings) * 64) << FRACBITS;
+	side = min(side, 16384*FRACUNIT);
+
+	crowd = Z_Calloc(numthings * sizeof (*crowd), PU_STATIC, NULL);
+
+	for (i = 0; i < numthings; i++)
+	{
+		mobj_t *mo = &crowd[i];
+
+		mo->thinker.function.acp1 = (actionf_p1)P_MobjThinker;
+		mo->type = (i & 1) ? MT_BLUECRAWLA : MT_RING;
+		mo->info = &mobjinfo[mo->type];
+		mo->radius = mo->info->radius;
+		mo->height = mo->info->height;
+		mo->flags = MF_NOSECTOR|MF_NOTHINK;
+		mo->scale = FRACUNIT;
+
+		seed = seed * 1103515245 + 12345;
+		mo->x = cx - side/2 + (fixed_t)((seed >> 8) % (UINT32)side);
+		seed = seed * 1103515245 + 12345;
+		mo->y = cy - side/2 + (fixed_t)((seed >> 8) % (UINT32)side);
+
+		P_SetThingPosition(mo);
+	}
+
+	for (pass = 0; pass < passes; pass++)
+	{
+		chainoverlaps = P_BenchCollisions(crowd, numthings, false, &chaintime);
+		packedoverlaps = P_BenchCollisions(crowd, numthings, true, &packedtime);
+	}
+
+	for (i = 0; i < numthings; i++)
+		P_UnsetThingPosition(&crowd[i]);
+	Z_Free(crowd);
+
+	CONS_Printf("%d things, %d searches each way, %d overlaps\n", numthings, numthings * passes, chainoverlaps);
+	CONS_Printf("Block chains:  %d us\n", (int)(chaintime * 1000000 / I_GetPrecisePrecision()));
+	CONS_Printf("Packed bounds: %d us (%.2fx)\n", (int)(packedtime * 1000000 / I_GetPrecisePrecision()),
+		packedtime ? (double)chaintime / packedtime : 0.0);
+	if (packedoverlaps != chainoverlaps)
+		CONS_Alert(CONS_WARNING, "Packed bounds found %d overlaps instead of %d!\n", packedoverlaps, chainoverlaps);
+}
+
 //
 // INTERCEPT ROUTINES
 //
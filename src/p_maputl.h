@@ -49,9 +49,6 @@ void P_MakeDivline(line_t *li, divline_t *dl);
 void P_CameraLineOpening(line_t *plinedef);
 fixed_t P_InterceptVector(divline_t *v2, divline_t *v1);
 INT32 P_BoxOnLineSide(fixed_t *tmbox, line_t *ld);
-void P_UnsetPrecipThingPosition(precipmobj_t *thing);
-void P_SetPrecipitationThingPosition(precipmobj_t *thing);
-void P_CreatePrecipSecNodeList(precipmobj_t *thing, fixed_t x,fixed_t y);
 boolean P_SceneryTryMove(mobj_t *thing, fixed_t x, fixed_t y);
 
 extern fixed_t opentop, openbottom, openrange, lowfloor, highceiling;
@@ -62,6 +59,9 @@ void P_LineOpening(line_t *plinedef, mobj_t *mobj);
 
 boolean P_BlockLinesIterator(INT32 x, INT32 y, boolean(*func)(line_t *));
 boolean P_BlockThingsIterator(INT32 x, INT32 y, boolean(*func)(mobj_t *));
+boolean P_BlockThingsIteratorNear(INT32 x, INT32 y, fixed_t cx, fixed_t cy, fixed_t radius, boolean(*func)(mobj_t *));
+
+void Command_CollisionBench_f(void);
 
 #define PT_ADDLINES     1
 #define PT_ADDTHINGS    2
@@ -30,6 +30,7 @@
 #include "m_cheat.h"
 #include "m_misc.h"
 #include "info.h"
+#include "i_system.h" // I_GetPreciseTime
 #include "i_video.h"
 #include "lua_hook.h"
 #include "b_bot.h"
@@ -667,25 +668,6 @@ boolean P_SetMobjStateNF(mobj_t *mobj, statenum_t state)
 	return true;
 }
 
-static boolean P_SetPrecipMobjState(precipmobj_t *mobj, statenum_t state)
-{
-	state_t *st;
-
-	if (state == S_NULL)
-	{ // Remove mobj
-		P_RemovePrecipMobj(mobj);
-		return false;
-	}
-	st = &states[state];
-	mobj->state = st;
-	mobj->tics = st->tics;
-	mobj->sprite = st->sprite;
-	mobj->frame = st->frame;
-	P_SetupStateAnimation((mobj_t*)mobj, st);
-
-	return true;
-}
-
 //
 // P_MobjFlip
 //
@@ -3531,6 +3513,7 @@ boolean P_CameraThinker(player_t *player, camera_t *thiscam, boolean resetcalled
 		{ // Never fails for 2D mode.
 			mobj_t dummy;
 			dummy.thinker.function.acp1 = (actionf_p1)P_MobjThinker;
+			dummy.type = MT_NULL; // keeps it out of the sight memo
 			dummy.subsector = thiscam->subsector;
 			dummy.x = thiscam->x;
 			dummy.y = thiscam->y;
@@ -3813,21 +3796,21 @@ animonly:
 	P_CyclePlayerMobjState(mobj);
 }
 
-static void CalculatePrecipFloor(precipmobj_t *mobj)
+//
+// Precipitation
+//
+precipsystem_t precipitation;
+
+static fixed_t P_PrecipFloorZ(const sector_t *sector, fixed_t x, fixed_t y)
 {
-	// recalculate floorz each time
-	const sector_t *mobjsecsubsec;
-	if (mobj && mobj->subsector && mobj->subsector->sector)
-		mobjsecsubsec = mobj->subsector->sector;
-	else
-		return;
-	mobj->floorz = P_GetSectorFloorZAt(mobjsecsubsec, mobj->x, mobj->y);
-	if (mobjsecsubsec->ffloors)
+	fixed_t floorz = P_GetSectorFloorZAt(sector, x, y);
+
+	if (sector->ffloors)
 	{
 		ffloor_t *rover;
 		fixed_t topheight;
 
-		for (rover = mobjsecsubsec->ffloors; rover; rover = rover->next)
+		for (rover = sector->ffloors; rover; rover = rover->next)
 		{
 			// If it exists, it'll get rained on.
 			if (!(rover->fofflags & FOF_EXISTS))
@@ -3836,90 +3819,164 @@ static void CalculatePrecipFloor(precipmobj_t *mobj)
 			if (!(rover->fofflags & FOF_BLOCKOTHERS) && !(rover->fofflags & FOF_SWIMMABLE))
 				continue;
 
-			topheight = P_GetFFloorTopZAt(rover, mobj->x, mobj->y);
-			if (topheight > mobj->floorz)
-				mobj->floorz = topheight;
+			topheight = P_GetFFloorTopZAt(rover, x, y);
+			if (topheight > floorz)
+				floorz = topheight;
 		}
 	}
+
+	return floorz;
 }
 
 void P_RecalcPrecipInSector(sector_t *sector)
 {
-	mprecipsecnode_t *psecnode;
+	size_t i, end, secnum;
 
 	if (!sector)
 		return;
 
 	sector->moved = true; // Recalc lighting and things too, maybe
 
-	for (psecnode = sector->touching_preciplist; psecnode; psecnode = psecnode->m_thinglist_next)
-		CalculatePrecipFloor(psecnode->m_thing);
+	if (!precipitation.block)
+		return;
+
+	secnum = sector - sectors;
+	end = precipitation.sectorstart[secnum + 1];
+	for (i = precipitation.sectorstart[secnum]; i < end; i++)
+		precipitation.floorz[i] = P_PrecipFloorZ(sector, precipitation.x[i], precipitation.y[i]);
+}
+
+static void P_SetupPrecipAnimation(size_t i, const state_t *st)
+{
+	if (!(st->frame & FF_ANIMATE))
+		return;
+
+	if (st->var1 <= 0 || st->var2 == 0)
+	{
+		precipitation.frame[i] &= ~FF_ANIMATE;
+		return; // Crash/stupidity prevention
+	}
+
+	precipitation.animtics[i] = (UINT16)st->var2;
+
+	if (st->frame & FF_GLOBALANIM)
+	{
+		if (!leveltime)
+			return;
+
+		precipitation.animtics[i] -= (leveltime + 2) % st->var2;
+		precipitation.frame[i] += ((leveltime + 2) / st->var2) % (st->var1 + 1);
+	}
+	else if (st->frame & FF_RANDOMANIM)
+	{
+		// Not synced, so don't touch P_Random
+		precipitation.frame[i] += M_RandomKey(st->var1 + 1);
+		precipitation.animtics[i] -= M_RandomKey(st->var2);
+	}
 }
 
 //
-// P_NullPrecipThinker
+// P_SetPrecipState
 //
-// For "Blank" precipitation
+// Rain only falls in S_RAIN1; everything else it does is a splash.
+// S_NULL leaves the drop around, but hidden and frozen.
 //
-void P_NullPrecipThinker(precipmobj_t *mobj)
+void P_SetPrecipState(size_t i, statenum_t state)
 {
-	//(void)mobj;
-	mobj->precipflags &= ~PCF_THUNK;
-	R_ResetPrecipitationMobjInterpolationState(mobj);
-}
+	const state_t *st = &states[state];
 
-void P_SnowThinker(precipmobj_t *mobj)
-{
-	P_CycleStateAnimation((mobj_t *)mobj);
+	precipitation.state[i] = (UINT16)state;
+	precipitation.tics[i] = st->tics;
+	precipitation.frame[i] = st->frame;
+	P_SetupPrecipAnimation(i, st);
 
-	// adjust height
-	if ((mobj->z += mobj->momz) <= mobj->floorz)
+	if (state == S_NULL)
 	{
-		mobj->z = mobj->ceilingz;
-		R_ResetPrecipitationMobjInterpolationState(mobj);
+		precipitation.flags[i] |= PCF_INVISIBLE;
+		precipitation.tics[i] = -1;
+		precipitation.vz[i] = 0;
 	}
+	else if ((precipitation.flags[i] & PCF_RAIN) && state != S_RAIN1)
+		precipitation.vz[i] = 0;
+	else
+		precipitation.vz[i] = precipitation.momz;
 }
 
-void P_RainThinker(precipmobj_t *mobj)
+static void P_PrecipLanded(size_t i)
 {
-	P_CycleStateAnimation((mobj_t *)mobj);
-
-	if (mobj->state != &states[S_RAIN1])
+	// Snow starts over, and there are no splashes on sky or bottomless pits
+	if (!(precipitation.flags[i] & PCF_RAIN) || (precipitation.flags[i] & PCF_PIT))
 	{
-		// cycle through states,
-		// calling action functions at transitions
-		if (mobj->tics <= 0)
-			return;
-
-		if (--mobj->tics)
-			return;
+		precipitation.z[i] = precipitation.oldz[i] = precipitation.ceilingz[i];
+		return;
+	}
 
-		if (!P_SetPrecipMobjState(mobj, mobj->state->nextstate))
-			return;
+	precipitation.z[i] = precipitation.floorz[i];
+	P_SetPrecipState(i, S_SPLASH1);
+}
 
-		if (mobj->state != &states[S_RAINRETURN])
-			return;
+static void P_PrecipNextState(size_t i)
+{
+	statenum_t state = states[precipitation.state[i]].nextstate;
 
-		mobj->z = mobj->ceilingz;
-		R_ResetPrecipitationMobjInterpolationState(mobj);
-		P_SetPrecipMobjState(mobj, S_RAIN1);
+	P_SetPrecipState(i, state);
 
+	if (state != S_RAINRETURN)
 		return;
-	}
 
-	// adjust height
-	if ((mobj->z += mobj->momz) > mobj->floorz)
+	precipitation.z[i] = precipitation.oldz[i] = precipitation.ceilingz[i];
+	P_SetPrecipState(i, S_RAIN1);
+}
+
+//
+// P_RunPrecipitation
+//
+// Moves every drop once. The fall itself is a branchless pass over the
+// z arrays so the compiler can vectorize it; landings, splashes and
+// animations are the rare case and get handled one drop at a time.
+// Weather isn't networked, so none of this touches P_Random.
+//
+void P_RunPrecipitation(void)
+{
+	fixed_t *z = precipitation.z;
+	fixed_t *oldz = precipitation.oldz;
+	const fixed_t *vz = precipitation.vz;
+	const fixed_t *floorz = precipitation.floorz;
+	size_t i, numdrops;
+
+	if (!precipitation.block)
 		return;
 
-	// no splashes on sky or bottomless pits
-	if (mobj->precipflags & PCF_PIT)
+	numdrops = precipitation.numdrops;
+
+	for (i = 0; i < numdrops; i++)
 	{
-		mobj->z = mobj->ceilingz;
-		return;
+		oldz[i] = z[i];
+		z[i] += vz[i];
 	}
 
-	mobj->z = mobj->floorz;
-	P_SetPrecipMobjState(mobj, S_SPLASH1);
+	for (i = 0; i < numdrops; i++)
+	{
+		if ((precipitation.frame[i] & FF_ANIMATE) && !--precipitation.animtics[i])
+		{
+			const state_t *st = &states[precipitation.state[i]];
+
+			precipitation.animtics[i] = (UINT16)st->var2;
+
+			// compare the current sprite frame to the one we started from
+			// if more than var1 away from it, swap back to the original
+			if (((++precipitation.frame[i]) & FF_FRAMEMASK) - (st->frame & FF_FRAMEMASK) > (UINT32)st->var1)
+				precipitation.frame[i] = (st->frame & FF_FRAMEMASK) | (precipitation.frame[i] & ~FF_FRAMEMASK);
+		}
+
+		if (vz[i])
+		{
+			if (z[i] <= floorz[i])
+				P_PrecipLanded(i);
+		}
+		else if (precipitation.tics[i] > 0 && !--precipitation.tics[i])
+			P_PrecipNextState(i);
+	}
 }
 
 static void P_KillRingsInLava(mobj_t *mo)
@@ -4594,6 +4651,7 @@ static void P_Boss4DestroyCage(mobj_t *mobj)
 						rover->fofflags &= ~FOF_EXISTS;
 						sector->moved = true;
 						rsec->moved = true;
+						P_InvalidateSightMemo();
 					}
 				}
 		}
@@ -6247,6 +6305,7 @@ void P_SetScale(mobj_t *mobj, fixed_t newscale)
 	mobj->scale = newscale;
 
 	mobj->radius = FixedMul(FixedDiv(mobj->radius, oldscale), newscale);
+	P_UpdateBlockRadius(mobj);
 	mobj->height = FixedMul(FixedDiv(mobj->height, oldscale), newscale);
 
 	player = mobj->player;
@@ -10495,6 +10554,166 @@ static fixed_t P_DefaultMobjShadowScale (mobj_t *thing)
 	}
 }
 
+//
+// Mobj pools
+//
+// Mobjs are carved out of PU_LEVEL slabs instead of
+// getting a zone block each, which keeps them close together in memory
+// and makes spawning and removing them cheap. The slabs are released
+// along with the rest of the level by Z_FreeTags in P_SetupLevel.
+//
+#define MOBJSPERSLAB 256
+
+static zpool_t mobjpool;
+
+//
+// P_InitMobjPools
+//
+// Forgets about the previous level's slabs and precipitation. Must only
+// be called once they have been freed.
+//
+void P_InitMobjPools(void)
+{
+	Z_PoolInit(&mobjpool, sizeof (mobj_t), MOBJSPERSLAB, PU_LEVEL);
+	memset(&precipitation, 0, sizeof (precipitation));
+}
+
+//
+// P_AllocMobj
+//
+// Returns a zeroed mobj from the level's pool.
+//
+mobj_t *P_AllocMobj(void)
+{
+	mobj_t *mobj;
+
+	if (!mobjpool.blocksize)
+		P_InitMobjPools();
+
+	mobj = Z_PoolAlloc(&mobjpool);
+	memset(mobj, 0, sizeof (*mobj));
+	return mobj;
+}
+
+void P_FreeMobj(mobj_t *mobj)
+{
+	Z_PoolFree(&mobjpool, mobj);
+}
+
+//
+// P_GetMobjPoolStats
+//
+// Reports how many mobjs are live, and how many the current slabs
+// have room for.
+//
+void P_GetMobjPoolStats(size_t *mobjs, size_t *mobjcap)
+{
+	*mobjs = mobjpool.numused;
+	*mobjcap = mobjpool.numslabs * mobjpool.blocksperslab;
+}
+
+// Spawns numobjs objects, walks them as P_RunThinkers would, then
+// replaces one at random rounds times for every object, and removes
+// them all, all with either zone blocks or a pool like the one above.
+static precise_t P_BenchMobjAlloc(INT32 numobjs, INT32 rounds, boolean pooled, fixed_t *sum)
+{
+	thinker_t head;
+	thinker_t **live = malloc(numobjs * sizeof (*live));
+	zpool_t pool;
+	precise_t start;
+	UINT32 seed = 0x5EED;
+	INT32 i;
+
+	if (!live)
+		I_Error("P_BenchMobjAlloc: No more memory\n");
+
+	Z_PoolInit(&pool, sizeof (mobj_t), MOBJSPERSLAB, PU_STATIC);
+	head.next = head.prev = &head;
+
+	start = I_GetPreciseTime();
+
+	for (i = 0; i < numobjs * (rounds + 1); i++)
+	{
+		INT32 slot = i;
+		thinker_t *th;
+
+		if (i >= numobjs)
+		{
+			// Go over everything once a round
+			if (!(i % numobjs))
+			{
+				for (th = head.next; th != &head; th = th->next)
+					*sum += ((mobj_t *)th)->x;
+			}
+
+			// Despawn an object and spawn one in its place
+			seed = seed * 1103515245 + 12345;
+			slot = (seed >> 8) % numobjs;
+			th = live[slot];
+			(th->next->prev = th->prev)->next = th->next;
+			if (pooled)
+				Z_PoolFree(&pool, th);
+			else
+				Z_Free(th);
+		}
+
+		if (pooled)
+		{
+			th = Z_PoolAlloc(&pool);
+			memset(th, 0, sizeof (mobj_t));
+		}
+		else
+			th = Z_Calloc(sizeof (mobj_t), PU_STATIC, NULL);
+
+		((mobj_t *)th)->x = i;
+		th->prev = head.prev;
+		th->next = &head;
+		head.prev = head.prev->next = th;
+		live[slot] = th;
+	}
+
+	for (i = 0; i < numobjs; i++)
+	{
+		if (pooled)
+			Z_PoolFree(&pool, live[i]);
+		else
+			Z_Free(live[i]);
+	}
+
+	start = I_GetPreciseTime() - start;
+
+	Z_PoolClear(&pool);
+	free(live);
+	return start;
+}
+
+/** Compares spawning and despawning objects from a pool against giving
+  * each its own zone block, the way P_SpawnMobj and P_RemoveMobj did.
+  * Only the memory side of it is timed; no actual objects are spawned.
+  * Usage: mobjbench [objects] [rounds]
+  */
+void Command_MobjBench_f(void)
+{
+	INT32 numobjs = 4000, rounds = 20;
+	fixed_t zonesum = 0, poolsum = 0;
+	precise_t zonetime, pooltime;
+
+	if (COM_Argc() > 1)
+		numobjs = min(max(atoi(COM_Argv(1)), 1), 1000000);
+	if (COM_Argc() > 2)
+		rounds = min(max(atoi(COM_Argv(2)), 0), 1000);
+
+	zonetime = P_BenchMobjAlloc(numobjs, rounds, false, &zonesum);
+	pooltime = P_BenchMobjAlloc(numobjs, rounds, true, &poolsum);
+
+	CONS_Printf("%d objects, %d spawns and despawns\n", numobjs, numobjs * (rounds + 1));
+	CONS_Printf("Zone blocks: %d us\n", (int)(zonetime * 1000000 / I_GetPrecisePrecision()));
+	CONS_Printf("Pool:        %d us (%.2fx)\n", (int)(pooltime * 1000000 / I_GetPrecisePrecision()),
+		pooltime ? (double)zonetime / pooltime : 0.0);
+	if (zonesum != poolsum)
+		CONS_Alert(CONS_WARNING, "The pool walked different objects than the zone did!\n");
+}
+
 //
 // P_SpawnMobj
 //
@@ -10520,7 +10739,7 @@ mobj_t *P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type)
 		type = MT_RAY;
 	}
 
-	mobj = Z_Calloc(sizeof (*mobj), PU_LEVEL, NULL);
+	mobj = P_AllocMobj();
 
 	// this is officially a mobj, declared as soon as possible.
 	mobj->thinker.function.acp1 = (actionf_p1)P_MobjThinker;
@@ -10949,70 +11168,6 @@ mobj_t *P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type)
 	return mobj;
 }
 
-static precipmobj_t *P_SpawnPrecipMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type)
-{
-	state_t *st;
-	precipmobj_t *mobj = Z_Calloc(sizeof (*mobj), PU_LEVEL, NULL);
-	fixed_t starting_floorz;
-
-	mobj->x = x;
-	mobj->y = y;
-	mobj->flags = mobjinfo[type].flags;
-
-	// do not set the state with P_SetMobjState,
-	// because action routines can not be called yet
-	st = &states[mobjinfo[type].spawnstate];
-
-	mobj->state = st;
-	mobj->tics = st->tics;
-	mobj->sprite = st->sprite;
-	mobj->frame = st->frame; // FF_FRAMEMASK for frame, and other bits..
-	P_SetupStateAnimation((mobj_t*)mobj, st);
-
-	// set subsector and/or block links
-	P_SetPrecipitationThingPosition(mobj);
-
-	mobj->floorz   = starting_floorz = P_GetSectorFloorZAt  (mobj->subsector->sector, x, y);
-	mobj->ceilingz                   = P_GetSectorCeilingZAt(mobj->subsector->sector, x, y);
-
-	mobj->floorrover = NULL;
-	mobj->ceilingrover = NULL;
-
-	mobj->z = z;
-	mobj->momz = mobjinfo[type].speed;
-
-	mobj->thinker.function.acp1 = (actionf_p1)P_NullPrecipThinker;
-	P_AddThinker(THINK_PRECIP, &mobj->thinker);
-
-	CalculatePrecipFloor(mobj);
-
-	if (mobj->floorz != starting_floorz)
-		mobj->precipflags |= PCF_FOF;
-	else if (mobj->subsector->sector->damagetype == SD_DEATHPITNOTILT
-	 || mobj->subsector->sector->damagetype == SD_DEATHPITTILT
-	 || mobj->subsector->sector->floorpic == skyflatnum)
-		mobj->precipflags |= PCF_PIT;
-
-	R_ResetPrecipitationMobjInterpolationState(mobj);
-
-	return mobj;
-}
-
-static inline precipmobj_t *P_SpawnRainMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type)
-{
-	precipmobj_t *mo = P_SpawnPrecipMobj(x,y,z,type);
-	mo->precipflags |= PCF_RAIN;
-	//mo->thinker.function.acp1 = (actionf_p1)P_RainThinker;
-	return mo;
-}
-
-static inline precipmobj_t *P_SpawnSnowMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type)
-{
-	precipmobj_t *mo = P_SpawnPrecipMobj(x,y,z,type);
-	//mo->thinker.function.acp1 = (actionf_p1)P_SnowThinker;
-	return mo;
-}
-
 void *P_CreateFloorSpriteSlope(mobj_t *mobj)
 {
 	if (mobj->floorspriteslope)
@@ -11116,7 +11271,7 @@ void P_RemoveMobj(mobj_t *mobj)
 		INT32 prevreferences;
 		if (!mobj->thinker.references)
 		{
-			Z_Free(mobj); // No refrrences? Can be removed immediately! :D
+			P_FreeMobj(mobj); // No refrrences? Can be removed immediately! :D
 			return;
 		}
 
@@ -11148,51 +11303,23 @@ boolean P_MobjWasRemoved(mobj_t *mobj)
 	return true;
 }
 
-void P_RemovePrecipMobj(precipmobj_t *mobj)
-{
-	// unlink from sector and block lists
-	P_UnsetPrecipThingPosition(mobj);
-
-	if (precipsector_list)
-	{
-		P_DelPrecipSeclist(precipsector_list);
-		precipsector_list = NULL;
-	}
-
-	// free block
-	P_RemoveThinker((thinker_t *)mobj);
-}
-
 // Clearing out stuff for savegames
 void P_RemoveSavegameMobj(mobj_t *mobj)
 {
 	// unlink from sector and block lists
-	if (((thinker_t *)mobj)->function.acp1 == (actionf_p1)P_NullPrecipThinker)
-	{
-		P_UnsetPrecipThingPosition((precipmobj_t *)mobj);
+	P_UnsetThingPosition(mobj);
 
-		if (precipsector_list)
-		{
-			P_DelPrecipSeclist(precipsector_list);
-			precipsector_list = NULL;
-		}
-	}
-	else
+	// Remove touching_sectorlist from mobj.
+	if (sector_list)
 	{
-		// unlink from sector and block lists
-		P_UnsetThingPosition(mobj);
-
-		// Remove touching_sectorlist from mobj.
-		if (sector_list)
-		{
-			P_DelSeclist(sector_list);
-			sector_list = NULL;
-		}
+		P_DelSeclist(sector_list);
+		sector_list = NULL;
 	}
 
+	R_RemoveMobjInterpolator(mobj);
+
 	// stop any playing sound
 	S_StopSound(mobj);
-	R_RemoveMobjInterpolator(mobj);
 
 	// free block
 	// Here we use the same code as R_RemoveThinkerDelayed, but without reference counting (we're removing everything so it shouldn't matter) and without touching currentthinker since we aren't in P_RunThinkers
@@ -11200,7 +11327,7 @@ void P_RemoveSavegameMobj(mobj_t *mobj)
 		thinker_t *thinker = (thinker_t *)mobj;
 		thinker_t *next = thinker->next;
 		(next->prev = thinker->prev)->next = next;
-		Z_Free(thinker);
+		P_FreeMobj(mobj);
 	}
 }
 
@@ -11210,16 +11337,79 @@ consvar_t cv_itemrespawn = CVAR_INIT ("respawnitem", "On", CV_SAVE|CV_NETVAR|CV_
 static CV_PossibleValue_t flagtime_cons_t[] = {{0, "MIN"}, {300, "MAX"}, {0, NULL}};
 consvar_t cv_flagtime = CVAR_INIT ("flagtime", "30", CV_SAVE|CV_NETVAR|CV_CHEAT|CV_ALLOWLUA, flagtime_cons_t, NULL);
 
+//
+// P_ClearPrecipitation
+//
+// Gets rid of every drop.
+//
+void P_ClearPrecipitation(void)
+{
+	if (precipitation.block)
+		Z_Free(precipitation.block);
+	memset(&precipitation, 0, sizeof (precipitation));
+}
+
+//
+// P_LayoutPrecipitation
+//
+// Carves the drop arrays out of base, or only works out how big base
+// has to be if it's NULL.
+//
+static size_t P_LayoutPrecipitation(UINT8 *base, size_t numdrops)
+{
+	size_t size = 0;
+
+#define CARVE(field, count) \
+	if (base) \
+		precipitation.field = (void *)(base + size); \
+	size += ((count) * sizeof (*precipitation.field) + 7) & ~(size_t)7;
+
+	CARVE(x, numdrops)
+	CARVE(y, numdrops)
+	CARVE(z, numdrops)
+	CARVE(oldz, numdrops)
+	CARVE(vz, numdrops)
+	CARVE(floorz, numdrops)
+	CARVE(ceilingz, numdrops)
+	CARVE(frame, numdrops)
+	CARVE(tics, numdrops)
+	CARVE(state, numdrops)
+	CARVE(animtics, numdrops)
+	CARVE(flags, numdrops)
+	CARVE(subsector, numdrops)
+	CARVE(sectorstart, numsectors + 1)
+
+#undef CARVE
+
+	return size;
+}
+
+typedef struct
+{
+	fixed_t x, y;
+	subsector_t *subsector;
+} precipspawn_t;
+
 void P_SpawnPrecipitation(void)
 {
 	INT32 i, mrand;
-	fixed_t basex, basey, x, y, height;
+	fixed_t basex, basey, x, y;
 	subsector_t *precipsector = NULL;
-	precipmobj_t *rainmo = NULL;
+	precipspawn_t *spawns;
+	size_t *cursor;
+	size_t numdrops = 0, d;
+	const boolean snow = (curWeather == PRECIP_SNOW);
+	const mobjtype_t type = snow ? MT_SNOWFLAKE : MT_RAIN;
+
+	P_ClearPrecipitation();
 
 	if (dedicated || !(cv_drawdist_precip.value) || curWeather == PRECIP_NONE || curWeather == PRECIP_STORM_NORAIN)
 		return;
 
+	spawns = malloc(bmapwidth * bmapheight * sizeof (*spawns));
+	if (!spawns)
+		return;
+
 	// Use the blockmap to narrow down our placing patterns
 	for (i = 0; i < bmapwidth*bmapheight; ++i)
 	{
@@ -11240,37 +11430,94 @@ void P_SpawnPrecipitation(void)
 		if (!(precipsector->sector->floorheight <= precipsector->sector->ceilingheight - (32<<FRACBITS)))
 			continue;
 
-		// Don't set height yet...
-		height = precipsector->sector->ceilingheight;
-
-		if (curWeather == PRECIP_SNOW)
+		if (snow)
 		{
 			// Not in a sector with visible sky -- exception for NiGHTS.
 			if ((!(maptol & TOL_NIGHTS) && (precipsector->sector->ceilingpic != skyflatnum)) == !(precipsector->sector->flags & MSF_INVERTPRECIP))
 				continue;
-
-			rainmo = P_SpawnSnowMobj(x, y, height, MT_SNOWFLAKE);
-			mrand = M_RandomByte();
-			if (mrand < 64)
-				P_SetPrecipMobjState(rainmo, S_SNOW3);
-			else if (mrand < 144)
-				P_SetPrecipMobjState(rainmo, S_SNOW2);
 		}
 		else // everything else.
 		{
 			// Not in a sector with visible sky.
 			if ((precipsector->sector->ceilingpic != skyflatnum) == !(precipsector->sector->flags & MSF_INVERTPRECIP))
 				continue;
+		}
+
+		spawns[numdrops].x = x;
+		spawns[numdrops].y = y;
+		spawns[numdrops].subsector = precipsector;
+		numdrops++;
+	}
+
+	cursor = calloc(numsectors, sizeof (*cursor));
+	if (!numdrops || !cursor)
+	{
+		free(cursor);
+		free(spawns);
+		return;
+	}
+
+	precipitation.memory = P_LayoutPrecipitation(NULL, numdrops);
+	Z_Calloc(precipitation.memory, PU_LEVEL, &precipitation.block);
+	P_LayoutPrecipitation(precipitation.block, numdrops);
+	precipitation.numdrops = numdrops;
+	precipitation.momz = mobjinfo[type].speed;
+
+	// Sort the drops by sector, so every sector owns one range of them
+	for (d = 0; d < numdrops; d++)
+		precipitation.sectorstart[spawns[d].subsector->sector - sectors + 1]++;
+	for (d = 0; d < numsectors; d++)
+	{
+		precipitation.sectorstart[d + 1] += precipitation.sectorstart[d];
+		cursor[d] = precipitation.sectorstart[d];
+	}
+
+	for (d = 0; d < numdrops; d++)
+	{
+		sector_t *sector = spawns[d].subsector->sector;
+		size_t n = cursor[sector - sectors]++;
+		fixed_t floorz;
+
+		x = spawns[d].x;
+		y = spawns[d].y;
 
-			rainmo = P_SpawnRainMobj(x, y, height, MT_RAIN);
+		precipitation.x[n] = x;
+		precipitation.y[n] = y;
+		precipitation.subsector[n] = spawns[d].subsector;
+		precipitation.ceilingz[n] = P_GetSectorCeilingZAt(sector, x, y);
+		precipitation.floorz[n] = floorz = P_PrecipFloorZ(sector, x, y);
+
+		if (floorz != P_GetSectorFloorZAt(sector, x, y))
+			precipitation.flags[n] |= PCF_FOF;
+		else if (sector->damagetype == SD_DEATHPITNOTILT
+		 || sector->damagetype == SD_DEATHPITTILT
+		 || sector->floorpic == skyflatnum)
+			precipitation.flags[n] |= PCF_PIT;
+
+		if (snow)
+		{
+			mrand = M_RandomByte();
+			if (mrand < 64)
+				P_SetPrecipState(n, S_SNOW3);
+			else if (mrand < 144)
+				P_SetPrecipState(n, S_SNOW2);
+			else
+				P_SetPrecipState(n, mobjinfo[type].spawnstate);
+		}
+		else
+		{
+			precipitation.flags[n] |= PCF_RAIN;
 			if (curWeather == PRECIP_BLANK)
-				rainmo->precipflags |= PCF_INVISIBLE;
+				precipitation.flags[n] |= PCF_INVISIBLE;
+			P_SetPrecipState(n, mobjinfo[type].spawnstate);
 		}
 
 		// Randomly assign a height, now that floorz is set.
-		rainmo->z = M_RandomRange(rainmo->floorz>>FRACBITS, rainmo->ceilingz>>FRACBITS)<<FRACBITS;
+		precipitation.z[n] = precipitation.oldz[n] = M_RandomRange(floorz>>FRACBITS, precipitation.ceilingz[n]>>FRACBITS)<<FRACBITS;
 	}
 
+	free(cursor);
+	free(spawns);
 }
 
 //
@@ -11558,6 +11805,7 @@ void P_SpawnPlayer(INT32 playernum)
 
 	// Set bounds accurately.
 	mobj->radius = FixedMul(skins[p->skin].radius, mobj->scale);
+	P_UpdateBlockRadius(mobj);
 	mobj->height = P_GetPlayerHeight(p);
 
 	if (!leveltime && !p->spectator && ((maptol & TOL_NIGHTS) == TOL_NIGHTS) != (G_IsSpecialStage(gamemap))) // non-special NiGHTS stage or special non-NiGHTS stage
@@ -12501,7 +12749,10 @@ static boolean P_SetupNiGHTSDrone(mapthing_t *mthing, mobj_t *mobj)
 		mobj->health = timelimit;
 
 	if (hitboxradius > 0)
+	{
 		mobj->radius = hitboxradius;
+		P_UpdateBlockRadius(mobj);
+	}
 
 	if (hitboxheight > 0)
 		mobj->height = hitboxheight;
@@ -12999,6 +13250,7 @@ static boolean P_SetupSpawnedMapThing(mapthing_t *mthing, mobj_t *mobj, boolean
 			mobj->flags2 |= MF2_AMBUSH;
 
 		mobj->radius = abs(mthing->args[2]) << FRACBITS;
+		P_UpdateBlockRadius(mobj);
 		// FALLTHRU
 	case MT_AXISTRANSFER:
 	case MT_AXISTRANSFERLINE:
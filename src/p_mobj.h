@@ -269,8 +269,6 @@ typedef enum {
 	PCF_MOVINGFOF = 8,
 	// Is rain.
 	PCF_RAIN = 16,
-	// Ran the thinker this tic.
-	PCF_THUNK = 32,
 } precipflag_t;
 
 // Map Object definition.
@@ -341,6 +339,8 @@ typedef struct mobj_s
 	// Links in blocks (if needed).
 	struct mobj_s *bnext;
 	struct mobj_s **bprev; // killough 8/11/98: change to ptr-to-ptr
+	INT32 blockcell; // block its packed bounds are in
+	UINT32 blockstamp; // 0 if not in blockthings
 
 	// Additional pointers for NiGHTS hoops
 	struct mobj_s *hnext;
@@ -398,6 +398,7 @@ typedef struct mobj_s
 	struct pslope_s *standingslope; // The slope that the object is standing on (shouldn't need synced in savegames, right?)
 
 	boolean resetinterp; // if true, some fields should not be interpolated (see R_InterpolateMobjState implementation)
+	size_t interpindex; // position in the interpolated mobj list (see R_AddMobjInterpolator)
 	boolean colorized; // Whether the mobj uses the rainbow colormap
 	boolean mirrored; // The object's rotations will be mirrored left to right, e.g., see frame AL from the right and AR from the left
 	fixed_t shadowscale; // If this object casts a shadow, and the size relative to radius
@@ -409,6 +410,9 @@ typedef struct mobj_s
 //
 // For precipitation
 //
+// Drops are not thinkers. They live in the parallel arrays of
+// precipitation below, and a precipmobj_t is only filled in by the
+// renderers for the drops that make it into a vissprite.
 // Sometimes this is casted to a mobj_t,
 // so please keep the start of the
 // structure the same.
@@ -445,7 +449,7 @@ typedef struct precipmobj_s
 	fixed_t old_spritexoffset, old_spriteyoffset;
 	struct pslope_s *floorspriteslope; // The slope that the floorsprite is rotated by
 
-	struct mprecipsecnode_s *touching_sectorlist; // a linked list of sectors where this object appears
+	void *touching_sectorlist; // unused, keeps the layout of mobj_t
 
 	struct subsector_s *subsector; // Subsector the mobj resides in.
 
@@ -468,6 +472,35 @@ typedef struct precipmobj_s
 	INT32 flags; // flags from mobjinfo tables
 } precipmobj_t;
 
+//
+// Precipitation drops, one array per field.
+// Drops are sorted by the sector they fall in, so the drops of sector s
+// are the indices sectorstart[s] up to sectorstart[s+1]. Everything is
+// one PU_LEVEL block; block goes back to NULL when the level is freed.
+//
+typedef struct
+{
+	void *block;
+	size_t numdrops;
+	size_t memory; // bytes in block
+
+	fixed_t momz; // fall speed of the current weather
+
+	fixed_t *x, *y, *z;
+	fixed_t *oldz; // z on the previous tic, for interpolation
+	fixed_t *vz; // momz while falling, 0 while splashing
+	fixed_t *floorz, *ceilingz;
+	UINT32 *frame;
+	INT32 *tics;
+	UINT16 *state;
+	UINT16 *animtics;
+	UINT8 *flags; // PCF_ flags
+	struct subsector_s **subsector;
+	size_t *sectorstart; // numsectors+1 entries
+} precipsystem_t;
+
+extern precipsystem_t precipitation;
+
 typedef struct actioncache_s
 {
 	struct actioncache_s *next;
@@ -506,10 +539,14 @@ void P_RemoveFloorSpriteSlope(mobj_t *mobj);
 boolean P_BossTargetPlayer(mobj_t *actor, boolean closest);
 boolean P_SupermanLook4Players(mobj_t *actor);
 void P_DestroyRobots(void);
-void P_SnowThinker(precipmobj_t *mobj);
-void P_RainThinker(precipmobj_t *mobj);
-void P_NullPrecipThinker(precipmobj_t *mobj);
-void P_RemovePrecipMobj(precipmobj_t *mobj);
+void P_ClearPrecipitation(void);
+void P_SetPrecipState(size_t i, statenum_t state);
+void P_RunPrecipitation(void);
+void P_InitMobjPools(void);
+mobj_t *P_AllocMobj(void);
+void P_FreeMobj(mobj_t *mobj);
+void P_GetMobjPoolStats(size_t *mobjs, size_t *mobjcap);
+void Command_MobjBench_f(void);
 void P_SetScale(mobj_t *mobj, fixed_t newscale);
 void P_XYMovement(mobj_t *mo);
 void P_RingXYMovement(mobj_t *mo);
@@ -16,6 +16,7 @@
 #include "d_main.h"
 #include "doomstat.h"
 #include "g_game.h"
+#include "i_system.h"
 #include "m_random.h"
 #include "m_misc.h"
 #include "p_local.h"
@@ -42,6 +43,87 @@
 savedata_t savedata;
 UINT8 *save_p;
 
+// Savegame streaming. While a stream is open, save_p points into a fixed
+// chunk which is handed to the stream callback each time it fills up, so
+// netgame saves have no upper size limit. P_SaveReserve makes room for
+// an item before it is written; archive loops that call it with 0 between
+// fixed-size records must write no more than SAVECHUNKSLACK bytes per call.
+#define SAVECHUNKSIZE (64*1024)
+#define SAVECHUNKSLACK (64*1024)
+
+static savechunkfunc_t savechunkfunc = NULL;
+static void *savechunkdata = NULL;
+static UINT8 *savechunk = NULL;
+static size_t savechunkcapacity = 0;
+static size_t savestreamlength = 0;
+
+static void P_FlushSaveChunk(void)
+{
+	size_t used = save_p - savechunk;
+
+	if (used > savechunkcapacity)
+		I_Error("Savegame buffer overrun");
+
+	if (used)
+		savechunkfunc(savechunk, used, savechunkdata);
+
+	savestreamlength += used;
+	save_p = savechunk;
+}
+
+boolean P_BeginSaveStream(savechunkfunc_t func, void *userdata)
+{
+	I_Assert(savechunkfunc == NULL);
+
+	savechunk = malloc(SAVECHUNKSIZE + SAVECHUNKSLACK);
+	if (!savechunk)
+		return false;
+
+	savechunkcapacity = SAVECHUNKSIZE + SAVECHUNKSLACK;
+	savechunkfunc = func;
+	savechunkdata = userdata;
+	savestreamlength = 0;
+	save_p = savechunk;
+	return true;
+}
+
+void P_SaveReserve(size_t length)
+{
+	if (!savechunkfunc) // plain buffer, nothing to do
+		return;
+
+	if ((size_t)(save_p - savechunk) + length <= SAVECHUNKSIZE)
+		return;
+
+	P_FlushSaveChunk(); // also catches anything written past the end without reserving
+
+	// Oversized single items (long Lua strings) get a bigger chunk.
+	if (length + SAVECHUNKSLACK > savechunkcapacity)
+	{
+		UINT8 *newchunk = realloc(savechunk, length + SAVECHUNKSLACK);
+		if (!newchunk)
+			I_Error("No more free memory for savegame");
+		save_p = savechunk = newchunk;
+		savechunkcapacity = length + SAVECHUNKSLACK;
+	}
+}
+
+size_t P_EndSaveStream(void)
+{
+	size_t length;
+
+	P_FlushSaveChunk();
+	length = savestreamlength;
+
+	free(savechunk);
+	savechunk = NULL;
+	savechunkcapacity = 0;
+	savechunkfunc = NULL;
+	savechunkdata = NULL;
+	save_p = NULL;
+	return length;
+}
+
 // Block UINT32s to attempt to ensure that the correct data is
 // being sent and received
 #define ARCHIVEBLOCK_MISC       0x7FEEDEED
@@ -136,6 +218,7 @@ static void P_NetArchivePlayers(void)
 
 	for (i = 0; i < MAXPLAYERS; i++)
 	{
+		P_SaveReserve(0);
 		WRITESINT8(save_p, (SINT8)adminplayers[i]);
 
 		if (!playeringame[i])
@@ -684,6 +767,7 @@ static void P_NetArchiveColormaps(void)
 		if (!exc)
 			exc = R_CreateDefaultColormap(false);
 
+		P_SaveReserve(0);
 		WRITEUINT8(save_p, exc->fadestart);
 		WRITEUINT8(save_p, exc->fadeend);
 		WRITEUINT8(save_p, exc->flags);
@@ -812,6 +896,7 @@ static void P_NetArchiveWaypoints(void)
 
 	for (i = 0; i < NUMWAYPOINTSEQUENCES; i++)
 	{
+		P_SaveReserve(sizeof(UINT32) * numwaypoints[i]);
 		WRITEUINT16(save_p, numwaypoints[i]);
 		for (j = 0; j < numwaypoints[i]; j++)
 			WRITEUINT32(save_p, waypoints[i][j] ? waypoints[i][j]->mobjnum : 0);
@@ -1015,6 +1100,7 @@ static void ArchiveSectors(void)
 
 	for (i = 0; i < numsectors; i++, ss++, spawnss++)
 	{
+		P_SaveReserve(0);
 		diff = diff2 = diff3 = diff4 = 0;
 		if (ss->floorheight != spawnss->floorheight)
 			diff |= SD_FLOORHT;
@@ -1288,6 +1374,7 @@ static void ArchiveLines(void)
 
 	for (i = 0; i < numlines; i++, spawnli++, li++)
 	{
+		P_SaveReserve(0);
 		diff = diff2 = 0;
 
 		if (li->special != spawnli->special)
@@ -1388,6 +1475,7 @@ static void ArchiveLines(void)
 					}
 
 					len = strlen(li->stringargs[j]);
+					P_SaveReserve(len);
 					WRITEINT32(save_p, len);
 					for (k = 0; k < len; k++)
 						WRITECHAR(save_p, li->stringargs[j][k]);
@@ -2508,18 +2596,16 @@ static void P_NetArchiveThinkers(void)
 		// save off the current thinkers
 		for (th = thlist[i].next; th != &thlist[i]; th = th->next)
 		{
-			if (!(th->function.acp1 == (actionf_p1)P_RemoveThinkerDelayed
-			 || th->function.acp1 == (actionf_p1)P_NullPrecipThinker))
+			if (th->function.acp1 != (actionf_p1)P_RemoveThinkerDelayed)
 				numsaved++;
 
+			P_SaveReserve(0);
+
 			if (th->function.acp1 == (actionf_p1)P_MobjThinker)
 			{
 				SaveMobjThinker(th, tc_mobj);
 				continue;
 			}
-	#ifdef PARANOIA
-			else if (th->function.acp1 == (actionf_p1)P_NullPrecipThinker);
-	#endif
 			else if (th->function.acp1 == (actionf_p1)T_MoveCeiling)
 			{
 				SaveCeilingThinker(th, tc_ceiling);
@@ -2736,11 +2822,82 @@ static void P_NetArchiveThinkers(void)
 // relink to this; the savegame contains the old position in the pointer
 // field copyed in the info field temporarily, but finally we just search
 // for the old position and relink to it.
+
+// While a netgame is being loaded, the search goes through this
+// open-addressed mobjnum -> mobj table instead of the thinker list,
+// so relinking stays linear in the number of mobjs.
+static mobj_t **mobjnumtable = NULL;
+static UINT32 mobjnumtablemask = 0;
+
+static inline UINT32 P_MobjNumHash(UINT32 mobjnum)
+{
+	// Knuth's multiplicative hash; mobjnums are sequential
+	return (mobjnum * 2654435761u) & mobjnumtablemask;
+}
+
+static void P_ClearMobjNumTable(void)
+{
+	if (mobjnumtable)
+		Z_Free(mobjnumtable);
+	mobjnumtable = NULL;
+	mobjnumtablemask = 0;
+}
+
+static void P_BuildMobjNumTable(void)
+{
+	thinker_t *th;
+	mobj_t *mobj;
+	UINT32 count = 0, size = 16, slot;
+
+	P_ClearMobjNumTable();
+
+	for (th = thlist[THINK_MOBJ].next; th != &thlist[THINK_MOBJ]; th = th->next)
+		if (th->function.acp1 != (actionf_p1)P_RemoveThinkerDelayed)
+			count++;
+
+	// Keep the load factor at or under one half
+	while (size < count * 2)
+		size <<= 1;
+
+	mobjnumtable = Z_Calloc(size * sizeof (*mobjnumtable), PU_STATIC, NULL);
+	mobjnumtablemask = size - 1;
+
+	for (th = thlist[THINK_MOBJ].next; th != &thlist[THINK_MOBJ]; th = th->next)
+	{
+		if (th->function.acp1 == (actionf_p1)P_RemoveThinkerDelayed)
+			continue;
+
+		mobj = (mobj_t *)th;
+
+		// First in thinker order wins, same as the linear search
+		for (slot = P_MobjNumHash(mobj->mobjnum); mobjnumtable[slot]; slot = (slot + 1) & mobjnumtablemask)
+			if (mobjnumtable[slot]->mobjnum == mobj->mobjnum)
+				break;
+
+		if (!mobjnumtable[slot])
+			mobjnumtable[slot] = mobj;
+	}
+}
+
 mobj_t *P_FindNewPosition(UINT32 oldposition)
 {
 	thinker_t *th;
 	mobj_t *mobj;
 
+	if (mobjnumtable)
+	{
+		UINT32 slot;
+
+		for (slot = P_MobjNumHash(oldposition); (mobj = mobjnumtable[slot]); slot = (slot + 1) & mobjnumtablemask)
+		{
+			if (mobj->mobjnum == oldposition)
+				return mobj;
+		}
+
+		CONS_Debug(DBG_GAMELOGIC, "mobj not found\n");
+		return NULL;
+	}
+
 	for (th = thlist[THINK_MOBJ].next; th != &thlist[THINK_MOBJ]; th = th->next)
 	{
 		if (th->function.acp1 == (actionf_p1)P_RemoveThinkerDelayed)
@@ -2838,13 +2995,13 @@ static thinker_t* LoadMobjThinker(actionf_p1 thinker)
 			return NULL;
 		}
 
-		mobj = Z_Calloc(sizeof (*mobj), PU_LEVEL, NULL);
+		mobj = P_AllocMobj();
 
 		mobj->spawnpoint = &mapthings[spawnpointnum];
 		mapthings[spawnpointnum].mobj = mobj;
 	}
 	else
-		mobj = Z_Calloc(sizeof (*mobj), PU_LEVEL, NULL);
+		mobj = P_AllocMobj();
 
 	// declare this as a valid mobj as soon as possible.
 	mobj->thinker.function.acp1 = thinker;
@@ -3725,13 +3882,13 @@ static void P_NetUnArchiveThinkers(void)
 		{
 			next = currentthinker->next;
 
-			if (currentthinker->function.acp1 == (actionf_p1)P_MobjThinker || currentthinker->function.acp1 == (actionf_p1)P_NullPrecipThinker)
+			if (currentthinker->function.acp1 == (actionf_p1)P_MobjThinker)
 				P_RemoveSavegameMobj((mobj_t *)currentthinker); // item isn't saved, don't remove it
 			else
 			{
 				(next->prev = currentthinker->prev)->next = next;
 				R_DestroyLevelInterpolators(currentthinker);
-				Z_Free(currentthinker);
+				P_FreeThinker(currentthinker, i);
 			}
 		}
 	}
@@ -3938,6 +4095,10 @@ static void P_NetUnArchiveThinkers(void)
 	skyboxmo[0] = skyboxviewpnts[0];
 	skyboxmo[1] = skyboxcenterpnts[0];
 
+	// Every mobj is loaded now, index them for pointer relinking.
+	// Freed again at the end of P_LoadNetGame.
+	P_BuildMobjNumTable();
+
 	if (restoreNum)
 	{
 		executor_t *delay = NULL;
@@ -4028,7 +4189,10 @@ static inline void P_ArchivePolyObjects(void)
 	WRITEINT32(save_p, numPolyObjects);
 
 	for (i = 0; i < numPolyObjects; ++i)
+	{
+		P_SaveReserve(0);
 		P_ArchivePolyObj(&PolyObjects[i]);
+	}
 }
 
 static inline void P_UnArchivePolyObjects(void)
@@ -4853,6 +5017,9 @@ boolean P_LoadGame(INT16 mapoverride)
 
 boolean P_LoadNetGame(boolean reloading)
 {
+	precise_t loadtime[4] = {0};
+	precise_t starttime;
+
 	CV_LoadNetVars(&save_p);
 	if (!P_NetUnArchiveMisc(reloading))
 		return false;
@@ -4862,14 +5029,30 @@ boolean P_LoadNetGame(boolean reloading)
 	{
 		P_NetUnArchiveWorld();
 		P_UnArchivePolyObjects();
+		starttime = I_GetPreciseTime();
 		P_NetUnArchiveThinkers();
+		loadtime[0] = I_GetPreciseTime() - starttime;
 		P_NetUnArchiveSpecials();
 		P_NetUnArchiveColormaps();
+		starttime = I_GetPreciseTime();
 		P_NetUnArchiveWaypoints();
 		P_RelinkPointers();
+		loadtime[1] = I_GetPreciseTime() - starttime;
+		starttime = I_GetPreciseTime();
 		P_FinishMobjs();
+		loadtime[2] = I_GetPreciseTime() - starttime;
 	}
+	starttime = I_GetPreciseTime();
 	LUA_UnArchive();
+	loadtime[3] = I_GetPreciseTime() - starttime;
+
+	P_ClearMobjNumTable();
+
+	CONS_Debug(DBG_GAMELOGIC, "P_LoadNetGame: thinkers %s us, relink %s us, finish mobjs %s us, lua %s us\n",
+		sizeu1((size_t)(loadtime[0] * 1000000 / I_GetPrecisePrecision())),
+		sizeu2((size_t)(loadtime[1] * 1000000 / I_GetPrecisePrecision())),
+		sizeu3((size_t)(loadtime[2] * 1000000 / I_GetPrecisePrecision())),
+		sizeu4((size_t)(loadtime[3] * 1000000 / I_GetPrecisePrecision())));
 
 	// This is stupid and hacky, but maybe it'll work!
 	P_SetRandSeed(P_GetInitSeed());
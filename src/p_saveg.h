@@ -28,6 +28,14 @@ void P_SaveNetGame(boolean resending);
 boolean P_LoadGame(INT16 mapoverride);
 boolean P_LoadNetGame(boolean reloading);
 
+// Streamed saving: the archive is handed to func in chunks instead of
+// being written to one preallocated buffer.
+typedef void (*savechunkfunc_t)(const UINT8 *data, size_t length, void *userdata);
+
+boolean P_BeginSaveStream(savechunkfunc_t func, void *userdata);
+void P_SaveReserve(size_t length);
+size_t P_EndSaveStream(void);
+
 mobj_t *P_FindNewPosition(UINT32 oldposition);
 
 typedef struct
@@ -26,6 +26,7 @@
 #include "i_video.h" // for I_FinishUpdate()..
 #include "r_sky.h"
 #include "i_system.h"
+#include "i_threads.h"
 
 #include "r_data.h"
 #include "r_things.h" // for R_AddSpriteDefs
@@ -534,6 +535,45 @@ size_t numlevelflats;
 levelflat_t *levelflats;
 levelflat_t *foundflats;
 
+// Name index over the level's flats, so that every sector doesn't have
+// to scan all of them. Entries are flat numbers plus one; zero ends a chain.
+#define LEVELFLATBUCKETS 256
+static size_t levelflatbuckets[LEVELFLATBUCKETS];
+static size_t *levelflatnext = NULL;
+static size_t levelflatnextsize = 0;
+
+static void P_ClearLevelFlatIndex(void)
+{
+	memset(levelflatbuckets, 0, sizeof levelflatbuckets);
+}
+
+static void P_IndexLevelFlat(size_t num, const char *flatname)
+{
+	const UINT32 bucket = quickncasehash(flatname, 8) & (LEVELFLATBUCKETS - 1);
+
+	if (num >= levelflatnextsize)
+	{
+		levelflatnextsize = max(levelflatnextsize * 2, MAXLEVELFLATS);
+		levelflatnext = Z_Realloc(levelflatnext, levelflatnextsize * sizeof (*levelflatnext), PU_STATIC, NULL);
+	}
+
+	levelflatnext[num] = levelflatbuckets[bucket];
+	levelflatbuckets[bucket] = num + 1;
+}
+
+// Returns the number of the flat with the given name in levelflat,
+// or numlevelflats if there isn't one.
+static size_t P_FindLevelFlat(const levelflat_t *levelflat, const char *flatname)
+{
+	size_t i;
+
+	for (i = levelflatbuckets[quickncasehash(flatname, 8) & (LEVELFLATBUCKETS - 1)]; i; i = levelflatnext[i - 1])
+		if (strnicmp(levelflat[i - 1].name, flatname, 8) == 0)
+			return i - 1;
+
+	return numlevelflats;
+}
+
 //SoM: Other files want this info.
 size_t P_PrecacheLevelFlats(void)
 {
@@ -573,12 +613,9 @@ Ploadflat (levelflat_t *levelflat, const char *flatname, boolean resize)
 
 	size_t i;
 
-	// Scan through the already found flats, return if it matches.
-	for (i = 0; i < numlevelflats; i++)
-	{
-		if (strnicmp(levelflat[i].name, flatname, 8) == 0)
-			return i;
-	}
+	// Look through the already found flats, return if it matches.
+	if (( i = P_FindLevelFlat(levelflat, flatname) ) < numlevelflats)
+		return i;
 
 	if (resize)
 	{
@@ -655,6 +692,8 @@ flatfound:
 	CONS_Debug(DBG_SETUP, "flat #%03d: %s\n", atoi(sizeu1(numlevelflats)), levelflat->name);
 #endif
 
+	P_IndexLevelFlat(numlevelflats, levelflat->name);
+
 	return ( numlevelflats++ );
 }
 
@@ -679,15 +718,7 @@ INT32 P_AddLevelFlatRuntime(const char *flatname)
 //
 INT32 P_CheckLevelFlat(const char *flatname)
 {
-	size_t i;
-	levelflat_t *levelflat = levelflats;
-
-	//
-	//  scan through the already found flats
-	//
-	for (i = 0; i < numlevelflats; i++, levelflat++)
-		if (strnicmp(levelflat->name,flatname,8)==0)
-			break;
+	const size_t i = P_FindLevelFlat(levelflats, flatname);
 
 	if (i == numlevelflats)
 		return 0; // ??? flat was not found, this should not happen!
@@ -1022,9 +1053,6 @@ static void P_InitializeSector(sector_t *ss)
 
 	ss->floorspeed = ss->ceilspeed = 0;
 
-	ss->preciplist = NULL;
-	ss->touching_preciplist = NULL;
-
 	ss->f_slope = NULL;
 	ss->c_slope = NULL;
 	ss->hasslope = false;
@@ -1537,18 +1565,465 @@ static void P_LoadThings(UINT8 *data)
 	}
 }
 
-// Stores positions for relevant map data spread through a TEXTMAP.
-UINT32 mapthingsPos[UINT16_MAX];
-UINT32 linesPos[UINT16_MAX];
-UINT32 sidesPos[UINT16_MAX];
-UINT32 vertexesPos[UINT16_MAX];
-UINT32 sectorsPos[UINT16_MAX];
+// Every key the TEXTMAP parsers know of, across all block types
+typedef enum
+{
+	// Shared
+	TMK_ID,
+	TMK_MOREIDS,
+	TMK_X,
+	TMK_Y,
+
+	// Vertices
+	TMK_ZFLOOR,
+	TMK_ZCEILING,
+
+	// Sectors
+	TMK_HEIGHTFLOOR,
+	TMK_HEIGHTCEILING,
+	TMK_TEXTUREFLOOR,
+	TMK_TEXTURECEILING,
+	TMK_LIGHTLEVEL,
+	TMK_LIGHTFLOOR,
+	TMK_LIGHTFLOORABSOLUTE,
+	TMK_LIGHTCEILING,
+	TMK_LIGHTCEILINGABSOLUTE,
+	TMK_XPANNINGFLOOR,
+	TMK_YPANNINGFLOOR,
+	TMK_XPANNINGCEILING,
+	TMK_YPANNINGCEILING,
+	TMK_ROTATIONFLOOR,
+	TMK_ROTATIONCEILING,
+	TMK_FLOORPLANE_A,
+	TMK_FLOORPLANE_B,
+	TMK_FLOORPLANE_C,
+	TMK_FLOORPLANE_D,
+	TMK_CEILINGPLANE_A,
+	TMK_CEILINGPLANE_B,
+	TMK_CEILINGPLANE_C,
+	TMK_CEILINGPLANE_D,
+	TMK_LIGHTCOLOR,
+	TMK_LIGHTALPHA,
+	TMK_FADECOLOR,
+	TMK_FADEALPHA,
+	TMK_FADESTART,
+	TMK_FADEEND,
+	TMK_COLORMAPFOG,
+	TMK_COLORMAPFADESPRITES,
+	TMK_COLORMAPPROTECTED,
+	TMK_FLIPSPECIAL_NOFLOOR,
+	TMK_FLIPSPECIAL_CEILING,
+	TMK_TRIGGERSPECIAL_TOUCH,
+	TMK_TRIGGERSPECIAL_HEADBUMP,
+	TMK_TRIGGERLINE_PLANE,
+	TMK_TRIGGERLINE_MOBJ,
+	TMK_INVERTPRECIP,
+	TMK_GRAVITYFLIP,
+	TMK_HEATWAVE,
+	TMK_NOCLIPCAMERA,
+	TMK_OUTERSPACE,
+	TMK_DOUBLESTEPUP,
+	TMK_NOSTEPDOWN,
+	TMK_SPEEDPAD,
+	TMK_STARPOSTACTIVATOR,
+	TMK_EXIT,
+	TMK_SPECIALSTAGEPIT,
+	TMK_RETURNFLAG,
+	TMK_REDTEAMBASE,
+	TMK_BLUETEAMBASE,
+	TMK_FAN,
+	TMK_SUPERTRANSFORM,
+	TMK_FORCESPIN,
+	TMK_ZOOMTUBESTART,
+	TMK_ZOOMTUBEEND,
+	TMK_FINISHLINE,
+	TMK_ROPEHANG,
+	TMK_JUMPFLIP,
+	TMK_GRAVITYOVERRIDE,
+	TMK_FRICTION,
+	TMK_GRAVITY,
+	TMK_DAMAGETYPE,
+	TMK_TRIGGERTAG,
+	TMK_TRIGGERER,
+
+	// Sidedefs
+	TMK_OFFSETX,
+	TMK_OFFSETY,
+	TMK_OFFSETX_TOP,
+	TMK_OFFSETX_MID,
+	TMK_OFFSETX_BOTTOM,
+	TMK_OFFSETY_TOP,
+	TMK_OFFSETY_MID,
+	TMK_OFFSETY_BOTTOM,
+	TMK_TEXTURETOP,
+	TMK_TEXTUREBOTTOM,
+	TMK_TEXTUREMIDDLE,
+	TMK_SECTOR,
+	TMK_REPEATCNT,
+
+	// Linedefs
+	TMK_SPECIAL,
+	TMK_V1,
+	TMK_V2,
+	TMK_SIDEFRONT,
+	TMK_SIDEBACK,
+	TMK_ALPHA,
+	TMK_BLENDMODE,
+	TMK_RENDERSTYLE,
+	TMK_EXECUTORDELAY,
+	TMK_BLOCKING,
+	TMK_BLOCKMONSTERS,
+	TMK_TWOSIDED,
+	TMK_DONTPEGTOP,
+	TMK_DONTPEGBOTTOM,
+	TMK_SKEWTD,
+	TMK_NOCLIMB,
+	TMK_NOSKEW,
+	TMK_MIDPEG,
+	TMK_MIDSOLID,
+	TMK_WRAPMIDTEX,
+	TMK_NONET,
+	TMK_NETONLY,
+	TMK_BOUNCY,
+	TMK_TRANSFER,
+
+	// Things
+	TMK_HEIGHT,
+	TMK_ANGLE,
+	TMK_PITCH,
+	TMK_ROLL,
+	TMK_TYPE,
+	TMK_SCALE,
+	TMK_SCALEX,
+	TMK_SCALEY,
+	TMK_MOBJSCALE,
+	TMK_FLIP,
+	TMK_ABSOLUTEZ,
+
+	NUMTEXTMAPKEYS,
+	TMK_NONE = NUMTEXTMAPKEYS // arg# and stringarg# end up here
+} textmapkey_t;
+
+static const char *const textmapkeynames[NUMTEXTMAPKEYS] = {
+	"id", "moreids", "x", "y",
+
+	"zfloor", "zceiling",
+
+	"heightfloor", "heightceiling", "texturefloor", "textureceiling",
+	"lightlevel", "lightfloor", "lightfloorabsolute", "lightceiling", "lightceilingabsolute",
+	"xpanningfloor", "ypanningfloor", "xpanningceiling", "ypanningceiling",
+	"rotationfloor", "rotationceiling",
+	"floorplane_a", "floorplane_b", "floorplane_c", "floorplane_d",
+	"ceilingplane_a", "ceilingplane_b", "ceilingplane_c", "ceilingplane_d",
+	"lightcolor", "lightalpha", "fadecolor", "fadealpha", "fadestart", "fadeend",
+	"colormapfog", "colormapfadesprites", "colormapprotected",
+	"flipspecial_nofloor", "flipspecial_ceiling", "triggerspecial_touch", "triggerspecial_headbump",
+	"triggerline_plane", "triggerline_mobj", "invertprecip", "gravityflip", "heatwave", "noclipcamera",
+	"outerspace", "doublestepup", "nostepdown", "speedpad", "starpostactivator", "exit",
+	"specialstagepit", "returnflag", "redteambase", "blueteambase", "fan", "supertransform",
+	"forcespin", "zoomtubestart", "zoomtubeend", "finishline", "ropehang", "jumpflip",
+	"gravityoverride", "friction", "gravity", "damagetype", "triggertag", "triggerer",
+
+	"offsetx", "offsety", "offsetx_top", "offsetx_mid", "offsetx_bottom",
+	"offsety_top", "offsety_mid", "offsety_bottom",
+	"texturetop", "texturebottom", "texturemiddle", "sector", "repeatcnt",
+
+	"special", "v1", "v2", "sidefront", "sideback", "alpha", "blendmode", "renderstyle",
+	"executordelay", "blocking", "blockmonsters", "twosided", "dontpegtop", "dontpegbottom",
+	"skewtd", "noclimb", "noskew", "midpeg", "midsolid", "wrapmidtex", "nonet", "netonly",
+	"bouncy", "transfer",
+
+	"height", "angle", "pitch", "roll", "type", "scale", "scalex", "scaley", "mobjscale",
+	"flip", "absolutez",
+};
+
+// Key lookup is a collision-free hash table over the names above. The
+// seed that makes it collision-free is searched for once, on first use.
+#define TEXTMAPHASHBITS 12
+
+static UINT8 textmapkeyhash[1<<TEXTMAPHASHBITS]; // key + 1, or 0 if unused
+static UINT8 textmapkeylen[NUMTEXTMAPKEYS];
+static UINT32 textmapkeyseed;
+static boolean textmapkeysready = false;
+
+static UINT32 TextmapHashKey(const char *key, size_t len, UINT32 seed)
+{
+	UINT32 hash = 2166136261u ^ seed;
+
+	while (len--)
+	{
+		hash ^= (UINT8)*key++;
+		hash *= 16777619u;
+	}
+
+	return (hash ^ (hash >> TEXTMAPHASHBITS)) & ((1<<TEXTMAPHASHBITS) - 1);
+}
+
+static void TextmapInitKeyHash(void)
+{
+	INT32 i;
+
+	for (i = 0; i < NUMTEXTMAPKEYS; i++)
+		textmapkeylen[i] = (UINT8)strlen(textmapkeynames[i]);
+
+	for (textmapkeyseed = 0;; textmapkeyseed++)
+	{
+		memset(textmapkeyhash, 0, sizeof (textmapkeyhash));
+
+		for (i = 0; i < NUMTEXTMAPKEYS; i++)
+		{
+			UINT32 slot = TextmapHashKey(textmapkeynames[i], textmapkeylen[i], textmapkeyseed);
+			if (textmapkeyhash[slot])
+				break;
+			textmapkeyhash[slot] = (UINT8)(i + 1);
+		}
+
+		if (i == NUMTEXTMAPKEYS)
+			break;
+	}
+
+	textmapkeysready = true;
+}
+
+static textmapkey_t TextmapFindKey(const char *key, size_t len)
+{
+	INT32 k = textmapkeyhash[TextmapHashKey(key, len, textmapkeyseed)] - 1;
+
+	if (k < 0 || textmapkeylen[k] != len || memcmp(textmapkeynames[k], key, len))
+		return TMK_NONE;
+	return (textmapkey_t)k;
+}
+
+// One "key = value;" from a block, kept as spans of the lump
+typedef struct
+{
+	UINT32 key, val;
+	UINT32 vallen;
+	UINT16 keylen;
+	UINT16 id; // textmapkey_t
+} textmappair_t;
+
+typedef struct
+{
+	UINT32 first, count; // range of textmapscan.pairs
+} textmapblock_t;
+
+enum
+{
+	TEXTMAP_THING,
+	TEXTMAP_LINEDEF,
+	TEXTMAP_SIDEDEF,
+	TEXTMAP_VERTEX,
+	TEXTMAP_SECTOR,
+	NUMTEXTMAPBLOCKS
+};
+
+static const char *const textmapblocknames[NUMTEXTMAPBLOCKS] = {
+	"thing", "linedef", "sidedef", "vertex", "sector"
+};
+
+// The TEXTMAP lump is read in one pass, straight out of the lump, into
+// the blocks of each type and their pairs. The tokens are the same ones
+// M_TokenizerRead returns, down to how comments and quotes are handled.
+static struct
+{
+	char *data;
+	UINT32 len; // up to the first NUL, like the tokenizer
+	UINT32 pos;
+	UINT8 incomment; // 0 = not in comment, 1 = // Single-line, 2 = /* Multi-line */
+	UINT32 start, end; // last token read
+
+	textmappair_t *pairs;
+	size_t numpairs, maxpairs;
+
+	textmapblock_t *blocks[NUMTEXTMAPBLOCKS];
+	size_t numblocks[NUMTEXTMAPBLOCKS], maxblocks[NUMTEXTMAPBLOCKS];
+} textmapscan;
+
+static boolean TextmapIsBlank(char c)
+{
+	switch (c)
+	{
+		case ' ': case '\t': case '\r': case '\n': case '\0':
+		case '=': case ';': // UDMF TEXTMAP.
+			return true;
+		default:
+			return false;
+	}
+}
+
+static boolean TextmapEndsToken(char c)
+{
+	switch (c)
+	{
+		case ' ': case '\t': case '\r': case '\n':
+		case ',': case '{': case '}':
+		case '=': case ';': // UDMF TEXTMAP.
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Reads the next token into textmapscan.start/end, or returns false at the end
+static boolean TextmapReadToken(void)
+{
+	const char *in = textmapscan.data;
+	const UINT32 len = textmapscan.len;
+	UINT32 pos = textmapscan.pos;
+	UINT8 incomment = textmapscan.incomment;
+
+	if (pos >= len)
+		return false;
+
+	// Find the first char outside of whitespace and comments
+	for (; pos < len; pos++)
+	{
+		const char c = in[pos];
+
+		if (incomment == 1)
+		{
+			if (c == '\n')
+				incomment = 0; // End of line for a single-line comment
+		}
+		else if (incomment == 2)
+		{
+			if (c == '*' && pos + 1 < len && in[pos+1] == '/')
+			{
+				// End of multi-line comment
+				incomment = 0;
+				pos++;
+			}
+		}
+		else if (c == '/' && pos + 1 < len && (in[pos+1] == '/' || in[pos+1] == '*'))
+			incomment = (in[pos+1] == '/') ? 1 : 2;
+		else if (!TextmapIsBlank(c))
+			break;
+	}
+
+	textmapscan.incomment = incomment;
+
+	if (pos >= len)
+	{
+		textmapscan.pos = len;
+		return false;
+	}
+
+	if (in[pos] == ',' || in[pos] == '{' || in[pos] == '}')
+	{
+		textmapscan.start = pos;
+		textmapscan.end = textmapscan.pos = pos + 1;
+	}
+	// Entire string within quotes, except without the quotes.
+	else if (in[pos] == '"')
+	{
+		textmapscan.start = textmapscan.end = pos + 1;
+		while (textmapscan.end < len && in[textmapscan.end] != '"')
+			textmapscan.end++;
+		textmapscan.pos = textmapscan.end + 1;
+	}
+	else
+	{
+		UINT32 end = pos + 1;
+
+		while (end < len && !TextmapEndsToken(in[end]))
+		{
+			end++;
+
+			// If it's in a comment, we don't want it in this token
+			if (end + 1 < len && in[end] == '/' && (in[end+1] == '/' || in[end+1] == '*'))
+			{
+				textmapscan.incomment = (in[end+1] == '/') ? 1 : 2;
+				break;
+			}
+		}
+
+		textmapscan.start = pos;
+		textmapscan.end = textmapscan.pos = end;
+	}
+
+	return true;
+}
+
+static boolean TextmapTokenIs(const char *s)
+{
+	const size_t len = strlen(s);
+	return textmapscan.end - textmapscan.start == len && !memcmp(textmapscan.data + textmapscan.start, s, len);
+}
+
+static void *TextmapGrow(void *array, size_t *max, size_t size)
+{
+	*max = *max ? *max * 2 : 1024;
+	array = realloc(array, *max * size);
+	if (!array)
+		I_Error("Ran out of memory while reading TEXTMAP\n");
+	return array;
+}
+
+static void TextmapFree(void)
+{
+	INT32 i;
+
+	free(textmapscan.pairs);
+	for (i = 0; i < NUMTEXTMAPBLOCKS; i++)
+		free(textmapscan.blocks[i]);
+	memset(&textmapscan, 0, sizeof (textmapscan));
+}
+
+// Reads the pairs of a block whose "{" was just read. Returns false if the
+// lump ends before its "}".
+static boolean TextmapReadBlock(textmapblock_t *block, size_t size)
+{
+	block->first = (UINT32)textmapscan.numpairs;
+
+	while (TextmapReadToken() && textmapscan.end < size)
+	{
+		textmappair_t *pair;
+		textmapkey_t key;
+
+		if (TextmapTokenIs("}"))
+			return true;
+
+		if (textmapscan.numpairs == textmapscan.maxpairs)
+			textmapscan.pairs = TextmapGrow(textmapscan.pairs, &textmapscan.maxpairs, sizeof (*textmapscan.pairs));
+
+		pair = &textmapscan.pairs[textmapscan.numpairs];
+		pair->key = textmapscan.start;
+		pair->keylen = (UINT16)min(textmapscan.end - textmapscan.start, UINT16_MAX);
+		key = TextmapFindKey(textmapscan.data + textmapscan.start, textmapscan.end - textmapscan.start);
+		pair->id = (UINT16)key;
+
+		if (!TextmapReadToken() || textmapscan.end >= size)
+			break;
+
+		pair->val = textmapscan.start;
+		pair->vallen = textmapscan.end - textmapscan.start;
+		textmapscan.numpairs++;
+		block->count++;
+
+		// A key with nothing after it takes the "}" as its value,
+		// and the block ends there.
+		if (TextmapTokenIs("}"))
+			return true;
+	}
+
+	return false;
+}
 
 // Determine total amount of map data in TEXTMAP.
-static boolean TextmapCount(size_t size)
+static boolean TextmapCount(UINT8 *data, size_t size)
 {
-	const char *tkn = M_TokenizerRead(0);
+	const UINT8 *nul = memchr(data, 0, size);
+	boolean reread = false;
 	UINT8 brackets = 0;
+	INT32 type;
+
+	if (!textmapkeysready)
+		TextmapInitKeyHash();
+
+	memset(&textmapscan, 0, sizeof (textmapscan));
+	textmapscan.data = (char *)data;
+	textmapscan.len = (UINT32)(nul ? (size_t)(nul - data) : size);
 
 	nummapthings = 0;
 	numlines = 0;
@@ -1556,47 +2031,82 @@ static boolean TextmapCount(size_t size)
 	numvertexes = 0;
 	numsectors = 0;
 
-	if(!tkn)
+	if (!TextmapReadToken())
 	{
 		CONS_Alert(CONS_ERROR, "No text in lump!\n");
 		return true;
 	}
 
 	// Look for namespace at the beginning.
-	if (!fastcmp(tkn, "namespace"))
+	if (!TextmapTokenIs("namespace"))
 	{
 		CONS_Alert(CONS_ERROR, "No namespace at beginning of lump!\n");
 		return false;
 	}
 
 	// Check if namespace is valid.
-	tkn = M_TokenizerRead(0);
-	if (!fastcmp(tkn, "srb2"))
-		CONS_Alert(CONS_WARNING, "Invalid namespace '%s', only 'srb2' is supported.\n", tkn);
+	if (!TextmapReadToken())
+		CONS_Alert(CONS_WARNING, "Invalid namespace '', only 'srb2' is supported.\n");
+	else if (!TextmapTokenIs("srb2"))
+		CONS_Alert(CONS_WARNING, "Invalid namespace '%.*s', only 'srb2' is supported.\n",
+			(int)(textmapscan.end - textmapscan.start), textmapscan.data + textmapscan.start);
 
-	while ((tkn = M_TokenizerRead(0)) && M_TokenizerGetEndPos() < size)
+	while ((reread || TextmapReadToken()) && textmapscan.end < size)
 	{
+		reread = false;
+
 		// Avoid anything inside bracketed stuff, only look for external keywords.
 		if (brackets)
 		{
-			if (fastcmp(tkn, "}"))
+			if (TextmapTokenIs("}"))
 				brackets--;
+			continue;
 		}
-		else if (fastcmp(tkn, "{"))
+		else if (TextmapTokenIs("{"))
+		{
 			brackets++;
+			continue;
+		}
+
 		// Check for valid fields.
-		else if (fastcmp(tkn, "thing"))
-			mapthingsPos[nummapthings++] = M_TokenizerGetEndPos();
-		else if (fastcmp(tkn, "linedef"))
-			linesPos[numlines++] = M_TokenizerGetEndPos();
-		else if (fastcmp(tkn, "sidedef"))
-			sidesPos[numsides++] = M_TokenizerGetEndPos();
-		else if (fastcmp(tkn, "vertex"))
-			vertexesPos[numvertexes++] = M_TokenizerGetEndPos();
-		else if (fastcmp(tkn, "sector"))
-			sectorsPos[numsectors++] = M_TokenizerGetEndPos();
-		else
-			CONS_Alert(CONS_NOTICE, "Unknown field '%s'.\n", tkn);
+		for (type = 0; type < NUMTEXTMAPBLOCKS; type++)
+			if (TextmapTokenIs(textmapblocknames[type]))
+				break;
+
+		if (type == NUMTEXTMAPBLOCKS)
+		{
+			CONS_Alert(CONS_NOTICE, "Unknown field '%.*s'.\n",
+				(int)(textmapscan.end - textmapscan.start), textmapscan.data + textmapscan.start);
+			continue;
+		}
+
+		{
+			textmapblock_t *block;
+
+			if (textmapscan.numblocks[type] == textmapscan.maxblocks[type])
+				textmapscan.blocks[type] = TextmapGrow(textmapscan.blocks[type], &textmapscan.maxblocks[type], sizeof (*block));
+
+			block = &textmapscan.blocks[type][textmapscan.numblocks[type]++];
+			block->first = block->count = 0;
+
+			if (!TextmapReadToken())
+			{
+				CONS_Alert(CONS_WARNING, "Invalid UDMF data capsule!\n");
+				break;
+			}
+
+			if (!TextmapTokenIs("{"))
+			{
+				// Left for the keyword loop to look at
+				CONS_Alert(CONS_WARNING, "Invalid UDMF data capsule!\n");
+				reread = true;
+			}
+			else if (textmapscan.end >= size || !TextmapReadBlock(block, size))
+			{
+				brackets++;
+				break;
+			}
+		}
 	}
 
 	if (brackets)
@@ -1605,24 +2115,47 @@ static boolean TextmapCount(size_t size)
 		return false;
 	}
 
+	nummapthings = textmapscan.numblocks[TEXTMAP_THING];
+	numlines = textmapscan.numblocks[TEXTMAP_LINEDEF];
+	numsides = textmapscan.numblocks[TEXTMAP_SIDEDEF];
+	numvertexes = textmapscan.numblocks[TEXTMAP_VERTEX];
+	numsectors = textmapscan.numblocks[TEXTMAP_SECTOR];
+
 	return true;
 }
 
-static void ParseTextmapVertexParameter(UINT32 i, const char *param, const char *val)
+// Parses "arg#" and "stringarg#", the keys that aren't in the table
+static boolean TextmapArgKey(const textmappair_t *pair, const char *prefix, size_t *argnum)
 {
-	if (fastcmp(param, "x"))
-		vertexes[i].x = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "y"))
-		vertexes[i].y = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "zfloor"))
-	{
-		vertexes[i].floorz = FLOAT_TO_FIXED(atof(val));
-		vertexes[i].floorzset = true;
-	}
-	else if (fastcmp(param, "zceiling"))
+	const size_t len = strlen(prefix);
+
+	if (pair->keylen <= len || memcmp(textmapscan.data + pair->key, prefix, len))
+		return false;
+
+	*argnum = atol(textmapscan.data + pair->key + len);
+	return true;
+}
+
+static void ParseTextmapVertexParameter(UINT32 i, const textmappair_t *pair, const char *val)
+{
+	switch (pair->id)
 	{
-		vertexes[i].ceilingz = FLOAT_TO_FIXED(atof(val));
-		vertexes[i].ceilingzset = true;
+		case TMK_X:
+			vertexes[i].x = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_Y:
+			vertexes[i].y = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_ZFLOOR:
+			vertexes[i].floorz = FLOAT_TO_FIXED(atof(val));
+			vertexes[i].floorzset = true;
+			break;
+		case TMK_ZCEILING:
+			vertexes[i].ceilingz = FLOAT_TO_FIXED(atof(val));
+			vertexes[i].ceilingzset = true;
+			break;
+		default:
+			break;
 	}
 }
 
@@ -1655,36 +2188,692 @@ typedef struct textmap_plane_s {
 textmap_plane_t textmap_planefloor = {0, 0, 0, 0, 0};
 textmap_plane_t textmap_planeceiling = {0, 0, 0, 0, 0};
 
-static void ParseTextmapSectorParameter(UINT32 i, const char *param, const char *val)
+// Sector keys that only set a flag when "true"
+static const struct
 {
-	if (fastcmp(param, "heightfloor"))
-		sectors[i].floorheight = atol(val) << FRACBITS;
-	else if (fastcmp(param, "heightceiling"))
-		sectors[i].ceilingheight = atol(val) << FRACBITS;
-	if (fastcmp(param, "texturefloor"))
-		sectors[i].floorpic = P_AddLevelFlat(val, foundflats);
-	else if (fastcmp(param, "textureceiling"))
-		sectors[i].ceilingpic = P_AddLevelFlat(val, foundflats);
-	else if (fastcmp(param, "lightlevel"))
-		sectors[i].lightlevel = atol(val);
-	else if (fastcmp(param, "lightfloor"))
-		sectors[i].floorlightlevel = atol(val);
-	else if (fastcmp(param, "lightfloorabsolute") && fastcmp("true", val))
-		sectors[i].floorlightabsolute = true;
-	else if (fastcmp(param, "lightceiling"))
-		sectors[i].ceilinglightlevel = atol(val);
-	else if (fastcmp(param, "lightceilingabsolute") && fastcmp("true", val))
-		sectors[i].ceilinglightabsolute = true;
-	else if (fastcmp(param, "id"))
-		Tag_FSet(&sectors[i].tags, atol(val));
-	else if (fastcmp(param, "moreids"))
+	UINT8 key;
+	boolean special; // specialflags rather than flags
+	UINT32 flag;
+} textmapsectorflags[] = {
+	{TMK_FLIPSPECIAL_CEILING,     false, MSF_FLIPSPECIAL_CEILING},
+	{TMK_TRIGGERSPECIAL_TOUCH,    false, MSF_TRIGGERSPECIAL_TOUCH},
+	{TMK_TRIGGERSPECIAL_HEADBUMP, false, MSF_TRIGGERSPECIAL_HEADBUMP},
+	{TMK_TRIGGERLINE_PLANE,       false, MSF_TRIGGERLINE_PLANE},
+	{TMK_TRIGGERLINE_MOBJ,        false, MSF_TRIGGERLINE_MOBJ},
+	{TMK_INVERTPRECIP,            false, MSF_INVERTPRECIP},
+	{TMK_GRAVITYFLIP,             false, MSF_GRAVITYFLIP},
+	{TMK_HEATWAVE,                false, MSF_HEATWAVE},
+	{TMK_NOCLIPCAMERA,            false, MSF_NOCLIPCAMERA},
+	{TMK_OUTERSPACE,              true,  SSF_OUTERSPACE},
+	{TMK_DOUBLESTEPUP,            true,  SSF_DOUBLESTEPUP},
+	{TMK_NOSTEPDOWN,              true,  SSF_NOSTEPDOWN},
+	{TMK_SPEEDPAD,                true,  SSF_SPEEDPAD},
+	{TMK_STARPOSTACTIVATOR,       true,  SSF_STARPOSTACTIVATOR},
+	{TMK_EXIT,                    true,  SSF_EXIT},
+	{TMK_SPECIALSTAGEPIT,         true,  SSF_SPECIALSTAGEPIT},
+	{TMK_RETURNFLAG,              true,  SSF_RETURNFLAG},
+	{TMK_REDTEAMBASE,             true,  SSF_REDTEAMBASE},
+	{TMK_BLUETEAMBASE,            true,  SSF_BLUETEAMBASE},
+	{TMK_FAN,                     true,  SSF_FAN},
+	{TMK_SUPERTRANSFORM,          true,  SSF_SUPERTRANSFORM},
+	{TMK_FORCESPIN,               true,  SSF_FORCESPIN},
+	{TMK_ZOOMTUBESTART,           true,  SSF_ZOOMTUBESTART},
+	{TMK_ZOOMTUBEEND,             true,  SSF_ZOOMTUBEEND},
+	{TMK_FINISHLINE,              true,  SSF_FINISHLINE},
+	{TMK_ROPEHANG,                true,  SSF_ROPEHANG},
+	{TMK_JUMPFLIP,                true,  SSF_JUMPFLIP},
+	{TMK_GRAVITYOVERRIDE,         true,  SSF_GRAVITYOVERRIDE},
+};
+
+static void ParseTextmapSectorParameter(UINT32 i, const textmappair_t *pair, const char *val)
+{
+	size_t j;
+
+	switch (pair->id)
 	{
-		const char* id = val;
-		while (id)
+		case TMK_HEIGHTFLOOR:
+			sectors[i].floorheight = atol(val) << FRACBITS;
+			break;
+		case TMK_HEIGHTCEILING:
+			sectors[i].ceilingheight = atol(val) << FRACBITS;
+			break;
+		case TMK_TEXTUREFLOOR:
+			sectors[i].floorpic = P_AddLevelFlat(val, foundflats);
+			break;
+		case TMK_TEXTURECEILING:
+			sectors[i].ceilingpic = P_AddLevelFlat(val, foundflats);
+			break;
+		case TMK_LIGHTLEVEL:
+			sectors[i].lightlevel = atol(val);
+			break;
+		case TMK_LIGHTFLOOR:
+			sectors[i].floorlightlevel = atol(val);
+			break;
+		case TMK_LIGHTFLOORABSOLUTE:
+			if (fastcmp("true", val))
+				sectors[i].floorlightabsolute = true;
+			break;
+		case TMK_LIGHTCEILING:
+			sectors[i].ceilinglightlevel = atol(val);
+			break;
+		case TMK_LIGHTCEILINGABSOLUTE:
+			if (fastcmp("true", val))
+				sectors[i].ceilinglightabsolute = true;
+			break;
+		case TMK_ID:
+			Tag_FSet(&sectors[i].tags, atol(val));
+			break;
+		case TMK_MOREIDS:
 		{
-			Tag_Add(&sectors[i].tags, atol(id));
-			if ((id = strchr(id, ' ')))
-				id++;
+			const char* id = val;
+			while (id)
+			{
+				Tag_Add(&sectors[i].tags, atol(id));
+				if ((id = strchr(id, ' ')))
+					id++;
+			}
+			break;
+		}
+		case TMK_XPANNINGFLOOR:
+			sectors[i].floorxoffset = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_YPANNINGFLOOR:
+			sectors[i].flooryoffset = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_XPANNINGCEILING:
+			sectors[i].ceilingxoffset = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_YPANNINGCEILING:
+			sectors[i].ceilingyoffset = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_ROTATIONFLOOR:
+			sectors[i].floorangle = FixedAngle(FLOAT_TO_FIXED(atof(val)));
+			break;
+		case TMK_ROTATIONCEILING:
+			sectors[i].ceilingangle = FixedAngle(FLOAT_TO_FIXED(atof(val)));
+			break;
+		case TMK_FLOORPLANE_A:
+			textmap_planefloor.defined |= PD_A;
+			textmap_planefloor.a = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_FLOORPLANE_B:
+			textmap_planefloor.defined |= PD_B;
+			textmap_planefloor.b = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_FLOORPLANE_C:
+			textmap_planefloor.defined |= PD_C;
+			textmap_planefloor.c = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_FLOORPLANE_D:
+			textmap_planefloor.defined |= PD_D;
+			textmap_planefloor.d = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_CEILINGPLANE_A:
+			textmap_planeceiling.defined |= PD_A;
+			textmap_planeceiling.a = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_CEILINGPLANE_B:
+			textmap_planeceiling.defined |= PD_B;
+			textmap_planeceiling.b = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_CEILINGPLANE_C:
+			textmap_planeceiling.defined |= PD_C;
+			textmap_planeceiling.c = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_CEILINGPLANE_D:
+			textmap_planeceiling.defined |= PD_D;
+			textmap_planeceiling.d = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_LIGHTCOLOR:
+			textmap_colormap.used = true;
+			textmap_colormap.lightcolor = atol(val);
+			break;
+		case TMK_LIGHTALPHA:
+			textmap_colormap.used = true;
+			textmap_colormap.lightalpha = atol(val);
+			break;
+		case TMK_FADECOLOR:
+			textmap_colormap.used = true;
+			textmap_colormap.fadecolor = atol(val);
+			break;
+		case TMK_FADEALPHA:
+			textmap_colormap.used = true;
+			textmap_colormap.fadealpha = atol(val);
+			break;
+		case TMK_FADESTART:
+			textmap_colormap.used = true;
+			textmap_colormap.fadestart = atol(val);
+			break;
+		case TMK_FADEEND:
+			textmap_colormap.used = true;
+			textmap_colormap.fadeend = atol(val);
+			break;
+		case TMK_COLORMAPFOG:
+			if (fastcmp("true", val))
+			{
+				textmap_colormap.used = true;
+				textmap_colormap.flags |= CMF_FOG;
+			}
+			break;
+		case TMK_COLORMAPFADESPRITES:
+			if (fastcmp("true", val))
+			{
+				textmap_colormap.used = true;
+				textmap_colormap.flags |= CMF_FADEFULLBRIGHTSPRITES;
+			}
+			break;
+		case TMK_COLORMAPPROTECTED:
+			if (fastcmp("true", val))
+				sectors[i].colormap_protected = true;
+			break;
+		case TMK_FLIPSPECIAL_NOFLOOR:
+			if (fastcmp("true", val))
+				sectors[i].flags &= ~MSF_FLIPSPECIAL_FLOOR;
+			break;
+		case TMK_FRICTION:
+			sectors[i].friction = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_GRAVITY:
+			sectors[i].gravity = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_DAMAGETYPE:
+			if (fastcmp(val, "Generic"))
+				sectors[i].damagetype = SD_GENERIC;
+			if (fastcmp(val, "Water"))
+				sectors[i].damagetype = SD_WATER;
+			if (fastcmp(val, "Fire"))
+				sectors[i].damagetype = SD_FIRE;
+			if (fastcmp(val, "Lava"))
+				sectors[i].damagetype = SD_LAVA;
+			if (fastcmp(val, "Electric"))
+				sectors[i].damagetype = SD_ELECTRIC;
+			if (fastcmp(val, "Spike"))
+				sectors[i].damagetype = SD_SPIKE;
+			if (fastcmp(val, "DeathPitTilt"))
+				sectors[i].damagetype = SD_DEATHPITTILT;
+			if (fastcmp(val, "DeathPitNoTilt"))
+				sectors[i].damagetype = SD_DEATHPITNOTILT;
+			if (fastcmp(val, "Instakill"))
+				sectors[i].damagetype = SD_INSTAKILL;
+			if (fastcmp(val, "SpecialStage"))
+				sectors[i].damagetype = SD_SPECIALSTAGE;
+			break;
+		case TMK_TRIGGERTAG:
+			sectors[i].triggertag = atol(val);
+			break;
+		case TMK_TRIGGERER:
+			if (fastcmp(val, "Player"))
+				sectors[i].triggerer = TO_PLAYER;
+			if (fastcmp(val, "AllPlayers"))
+				sectors[i].triggerer = TO_ALLPLAYERS;
+			if (fastcmp(val, "Mobj"))
+				sectors[i].triggerer = TO_MOBJ;
+			break;
+		default:
+			if (!fastcmp("true", val))
+				break;
+			for (j = 0; j < sizeof (textmapsectorflags) / sizeof (*textmapsectorflags); j++)
+			{
+				if (textmapsectorflags[j].key != pair->id)
+					continue;
+				if (textmapsectorflags[j].special)
+					sectors[i].specialflags |= textmapsectorflags[j].flag;
+				else
+					sectors[i].flags |= textmapsectorflags[j].flag;
+				break;
+			}
+			break;
+	}
+}
+
+static void ParseTextmapSidedefParameter(UINT32 i, const textmappair_t *pair, const char *val)
+{
+	switch (pair->id)
+	{
+		case TMK_OFFSETX:
+			sides[i].textureoffset = atol(val)<<FRACBITS;
+			break;
+		case TMK_OFFSETY:
+			sides[i].rowoffset = atol(val)<<FRACBITS;
+			break;
+		case TMK_OFFSETX_TOP:
+			sides[i].offsetx_top = atol(val) << FRACBITS;
+			break;
+		case TMK_OFFSETX_MID:
+			sides[i].offsetx_mid = atol(val) << FRACBITS;
+			break;
+		case TMK_OFFSETX_BOTTOM:
+			sides[i].offsetx_bot = atol(val) << FRACBITS;
+			break;
+		case TMK_OFFSETY_TOP:
+			sides[i].offsety_top = atol(val) << FRACBITS;
+			break;
+		case TMK_OFFSETY_MID:
+			sides[i].offsety_mid = atol(val) << FRACBITS;
+			break;
+		case TMK_OFFSETY_BOTTOM:
+			sides[i].offsety_bot = atol(val) << FRACBITS;
+			break;
+		case TMK_TEXTURETOP:
+			sides[i].toptexture = R_TextureNumForName(val);
+			break;
+		case TMK_TEXTUREBOTTOM:
+			sides[i].bottomtexture = R_TextureNumForName(val);
+			break;
+		case TMK_TEXTUREMIDDLE:
+			sides[i].midtexture = R_TextureNumForName(val);
+			break;
+		case TMK_SECTOR:
+			P_SetSidedefSector(i, atol(val));
+			break;
+		case TMK_REPEATCNT:
+			sides[i].repeatcnt = atol(val);
+			break;
+		default:
+			break;
+	}
+}
+
+static void ParseTextmapLinedefParameter(UINT32 i, const textmappair_t *pair, const char *val)
+{
+	size_t argnum;
+
+	switch (pair->id)
+	{
+		case TMK_ID:
+			Tag_FSet(&lines[i].tags, atol(val));
+			break;
+		case TMK_MOREIDS:
+		{
+			const char* id = val;
+			while (id)
+			{
+				Tag_Add(&lines[i].tags, atol(id));
+				if ((id = strchr(id, ' ')))
+					id++;
+			}
+			break;
+		}
+		case TMK_SPECIAL:
+			lines[i].special = atol(val);
+			break;
+		case TMK_V1:
+			P_SetLinedefV1(i, atol(val));
+			break;
+		case TMK_V2:
+			P_SetLinedefV2(i, atol(val));
+			break;
+		case TMK_SIDEFRONT:
+			lines[i].sidenum[0] = atol(val);
+			break;
+		case TMK_SIDEBACK:
+			lines[i].sidenum[1] = atol(val);
+			break;
+		case TMK_ALPHA:
+			lines[i].alpha = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_BLENDMODE:
+		case TMK_RENDERSTYLE:
+			if (fastcmp(val, "translucent"))
+				lines[i].blendmode = AST_COPY;
+			else if (fastcmp(val, "add"))
+				lines[i].blendmode = AST_ADD;
+			else if (fastcmp(val, "subtract"))
+				lines[i].blendmode = AST_SUBTRACT;
+			else if (fastcmp(val, "reversesubtract"))
+				lines[i].blendmode = AST_REVERSESUBTRACT;
+			else if (fastcmp(val, "modulate"))
+				lines[i].blendmode = AST_MODULATE;
+			if (fastcmp(val, "fog"))
+				lines[i].blendmode = AST_FOG;
+			break;
+		case TMK_EXECUTORDELAY:
+			lines[i].executordelay = atol(val);
+			break;
+
+		// Flags
+		case TMK_BLOCKING:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_IMPASSIBLE;
+			break;
+		case TMK_BLOCKMONSTERS:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_BLOCKMONSTERS;
+			break;
+		case TMK_TWOSIDED:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_TWOSIDED;
+			break;
+		case TMK_DONTPEGTOP:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_DONTPEGTOP;
+			break;
+		case TMK_DONTPEGBOTTOM:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_DONTPEGBOTTOM;
+			break;
+		case TMK_SKEWTD:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_SKEWTD;
+			break;
+		case TMK_NOCLIMB:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_NOCLIMB;
+			break;
+		case TMK_NOSKEW:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_NOSKEW;
+			break;
+		case TMK_MIDPEG:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_MIDPEG;
+			break;
+		case TMK_MIDSOLID:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_MIDSOLID;
+			break;
+		case TMK_WRAPMIDTEX:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_WRAPMIDTEX;
+			break;
+		/*case TMK_EFFECT6:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_EFFECT6;
+			break;*/
+		case TMK_NONET:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_NONET;
+			break;
+		case TMK_NETONLY:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_NETONLY;
+			break;
+		case TMK_BOUNCY:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_BOUNCY;
+			break;
+		case TMK_TRANSFER:
+			if (fastcmp("true", val))
+				lines[i].flags |= ML_TFERLINE;
+			break;
+
+		default:
+			if (TextmapArgKey(pair, "stringarg", &argnum))
+			{
+				if (argnum >= NUMLINESTRINGARGS)
+					return;
+				lines[i].stringargs[argnum] = Z_Malloc(strlen(val) + 1, PU_LEVEL, NULL);
+				M_Memcpy(lines[i].stringargs[argnum], val, strlen(val) + 1);
+			}
+			else if (TextmapArgKey(pair, "arg", &argnum))
+			{
+				if (argnum >= NUMLINEARGS)
+					return;
+				lines[i].args[argnum] = atol(val);
+			}
+			break;
+	}
+}
+
+static void ParseTextmapThingParameter(UINT32 i, const textmappair_t *pair, const char *val)
+{
+	size_t argnum;
+
+	switch (pair->id)
+	{
+		case TMK_ID:
+			Tag_FSet(&mapthings[i].tags, atol(val));
+			break;
+		case TMK_MOREIDS:
+		{
+			const char* id = val;
+			while (id)
+			{
+				Tag_Add(&mapthings[i].tags, atol(id));
+				if ((id = strchr(id, ' ')))
+					id++;
+			}
+			break;
+		}
+		case TMK_X:
+			mapthings[i].x = atol(val);
+			break;
+		case TMK_Y:
+			mapthings[i].y = atol(val);
+			break;
+		case TMK_HEIGHT:
+			mapthings[i].z = atol(val);
+			break;
+		case TMK_ANGLE:
+			mapthings[i].angle = atol(val);
+			break;
+		case TMK_PITCH:
+			mapthings[i].pitch = atol(val);
+			break;
+		case TMK_ROLL:
+			mapthings[i].roll = atol(val);
+			break;
+		case TMK_TYPE:
+			mapthings[i].type = atol(val);
+			break;
+		case TMK_SCALE:
+			mapthings[i].spritexscale = mapthings[i].spriteyscale = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_SCALEX:
+			mapthings[i].spritexscale = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_SCALEY:
+			mapthings[i].spriteyscale = FLOAT_TO_FIXED(atof(val));
+			break;
+		case TMK_MOBJSCALE:
+			mapthings[i].scale = FLOAT_TO_FIXED(atof(val));
+			break;
+		// Flags
+		case TMK_FLIP:
+			if (fastcmp("true", val))
+				mapthings[i].options |= MTF_OBJECTFLIP;
+			break;
+		case TMK_ABSOLUTEZ:
+			if (fastcmp("true", val))
+				mapthings[i].options |= MTF_ABSOLUTEZ;
+			break;
+
+		default:
+			if (TextmapArgKey(pair, "stringarg", &argnum))
+			{
+				if (argnum >= NUMMAPTHINGSTRINGARGS)
+					return;
+				mapthings[i].stringargs[argnum] = Z_Malloc(strlen(val) + 1, PU_LEVEL, NULL);
+				M_Memcpy(mapthings[i].stringargs[argnum], val, strlen(val) + 1);
+			}
+			else if (TextmapArgKey(pair, "arg", &argnum))
+			{
+				if (argnum >= NUMMAPTHINGARGS)
+					return;
+				mapthings[i].args[argnum] = atol(val);
+			}
+			break;
+	}
+}
+
+/** Runs a parser function through the pairs of a {}-encapsuled block.
+  * Each value is NUL-terminated in place while its parser looks at it.
+  *
+  * \param Block type (TEXTMAP_THING, ...).
+  * \param Structure number (mapthings, sectors, ...).
+  * \param Parser function pointer.
+  */
+static void TextmapParse(INT32 type, size_t num, void (*parser)(UINT32, const textmappair_t *, const char *))
+{
+	const textmapblock_t *block = &textmapscan.blocks[type][num];
+	const textmappair_t *pair = &textmapscan.pairs[block->first];
+	UINT32 i;
+
+	for (i = 0; i < block->count; i++, pair++)
+	{
+		char *val = textmapscan.data + pair->val;
+		char end = val[pair->vallen];
+
+		val[pair->vallen] = '\0';
+		parser((UINT32)num, pair, val);
+		val[pair->vallen] = end;
+	}
+}
+
+#ifdef DEVELOP
+//
+// Reference TEXTMAP parser
+//
+// The parser TEXTMAP loading used before the one above, kept as it was so
+// that textmapbench can check the two against each other. It finds every
+// block with M_TokenizerRead, then seeks back to each one and matches its
+// keys by string comparison.
+//
+static UINT32 *reftextmappos[NUMTEXTMAPBLOCKS]; // set up by textmapbench
+static boolean textmapreference = false; // P_LoadTextmap uses the parsers below
+static boolean textmapbenching = false; // keeps P_LoadTextmap quiet
+
+// Remembers where a block starts. The position tables hold up to UINT16_MAX
+// blocks of each type, as they always did.
+static boolean RefTextmapMark(INT32 type, size_t *num)
+{
+	if (*num >= UINT16_MAX)
+	{
+		CONS_Alert(CONS_ERROR, "Too many %s blocks for the reference parser.\n", textmapblocknames[type]);
+		return false;
+	}
+
+	reftextmappos[type][(*num)++] = M_TokenizerGetEndPos();
+	return true;
+}
+
+// Determine total amount of map data in TEXTMAP.
+static boolean RefTextmapCount(size_t size)
+{
+	const char *tkn = M_TokenizerRead(0);
+	UINT8 brackets = 0;
+
+	nummapthings = 0;
+	numlines = 0;
+	numsides = 0;
+	numvertexes = 0;
+	numsectors = 0;
+
+	if(!tkn)
+	{
+		CONS_Alert(CONS_ERROR, "No text in lump!\n");
+		return true;
+	}
+
+	// Look for namespace at the beginning.
+	if (!fastcmp(tkn, "namespace"))
+	{
+		CONS_Alert(CONS_ERROR, "No namespace at beginning of lump!\n");
+		return false;
+	}
+
+	// Check if namespace is valid.
+	tkn = M_TokenizerRead(0);
+	if (!fastcmp(tkn, "srb2"))
+		CONS_Alert(CONS_WARNING, "Invalid namespace '%s', only 'srb2' is supported.\n", tkn);
+
+	while ((tkn = M_TokenizerRead(0)) && M_TokenizerGetEndPos() < size)
+	{
+		// Avoid anything inside bracketed stuff, only look for external keywords.
+		if (brackets)
+		{
+			if (fastcmp(tkn, "}"))
+				brackets--;
+		}
+		else if (fastcmp(tkn, "{"))
+			brackets++;
+		// Check for valid fields.
+		else if (fastcmp(tkn, "thing"))
+		{
+			if (!RefTextmapMark(TEXTMAP_THING, &nummapthings))
+				return false;
+		}
+		else if (fastcmp(tkn, "linedef"))
+		{
+			if (!RefTextmapMark(TEXTMAP_LINEDEF, &numlines))
+				return false;
+		}
+		else if (fastcmp(tkn, "sidedef"))
+		{
+			if (!RefTextmapMark(TEXTMAP_SIDEDEF, &numsides))
+				return false;
+		}
+		else if (fastcmp(tkn, "vertex"))
+		{
+			if (!RefTextmapMark(TEXTMAP_VERTEX, &numvertexes))
+				return false;
+		}
+		else if (fastcmp(tkn, "sector"))
+		{
+			if (!RefTextmapMark(TEXTMAP_SECTOR, &numsectors))
+				return false;
+		}
+		else
+			CONS_Alert(CONS_NOTICE, "Unknown field '%s'.\n", tkn);
+	}
+
+	if (brackets)
+	{
+		CONS_Alert(CONS_ERROR, "Unclosed brackets detected in textmap lump.\n");
+		return false;
+	}
+
+	return true;
+}
+
+static void RefParseTextmapVertexParameter(UINT32 i, const char *param, const char *val)
+{
+	if (fastcmp(param, "x"))
+		vertexes[i].x = FLOAT_TO_FIXED(atof(val));
+	else if (fastcmp(param, "y"))
+		vertexes[i].y = FLOAT_TO_FIXED(atof(val));
+	else if (fastcmp(param, "zfloor"))
+	{
+		vertexes[i].floorz = FLOAT_TO_FIXED(atof(val));
+		vertexes[i].floorzset = true;
+	}
+	else if (fastcmp(param, "zceiling"))
+	{
+		vertexes[i].ceilingz = FLOAT_TO_FIXED(atof(val));
+		vertexes[i].ceilingzset = true;
+	}
+}
+
+static void RefParseTextmapSectorParameter(UINT32 i, const char *param, const char *val)
+{
+	if (fastcmp(param, "heightfloor"))
+		sectors[i].floorheight = atol(val) << FRACBITS;
+	else if (fastcmp(param, "heightceiling"))
+		sectors[i].ceilingheight = atol(val) << FRACBITS;
+	if (fastcmp(param, "texturefloor"))
+		sectors[i].floorpic = P_AddLevelFlat(val, foundflats);
+	else if (fastcmp(param, "textureceiling"))
+		sectors[i].ceilingpic = P_AddLevelFlat(val, foundflats);
+	else if (fastcmp(param, "lightlevel"))
+		sectors[i].lightlevel = atol(val);
+	else if (fastcmp(param, "lightfloor"))
+		sectors[i].floorlightlevel = atol(val);
+	else if (fastcmp(param, "lightfloorabsolute") && fastcmp("true", val))
+		sectors[i].floorlightabsolute = true;
+	else if (fastcmp(param, "lightceiling"))
+		sectors[i].ceilinglightlevel = atol(val);
+	else if (fastcmp(param, "lightceilingabsolute") && fastcmp("true", val))
+		sectors[i].ceilinglightabsolute = true;
+	else if (fastcmp(param, "id"))
+		Tag_FSet(&sectors[i].tags, atol(val));
+	else if (fastcmp(param, "moreids"))
+	{
+		const char* id = val;
+		while (id)
+		{
+			Tag_Add(&sectors[i].tags, atol(id));
+			if ((id = strchr(id, ' ')))
+				id++;
 		}
 	}
 	else if (fastcmp(param, "xpanningfloor"))
@@ -1879,7 +3068,7 @@ static void ParseTextmapSectorParameter(UINT32 i, const char *param, const char
 	}
 }
 
-static void ParseTextmapSidedefParameter(UINT32 i, const char *param, const char *val)
+static void RefParseTextmapSidedefParameter(UINT32 i, const char *param, const char *val)
 {
 	if (fastcmp(param, "offsetx"))
 		sides[i].textureoffset = atol(val)<<FRACBITS;
@@ -1909,7 +3098,7 @@ static void ParseTextmapSidedefParameter(UINT32 i, const char *param, const char
 		sides[i].repeatcnt = atol(val);
 }
 
-static void ParseTextmapLinedefParameter(UINT32 i, const char *param, const char *val)
+static void RefParseTextmapLinedefParameter(UINT32 i, const char *param, const char *val)
 {
 	if (fastcmp(param, "id"))
 		Tag_FSet(&lines[i].tags, atol(val));
@@ -2003,7 +3192,7 @@ static void ParseTextmapLinedefParameter(UINT32 i, const char *param, const char
 		lines[i].flags |= ML_TFERLINE;
 }
 
-static void ParseTextmapThingParameter(UINT32 i, const char *param, const char *val)
+static void RefParseTextmapThingParameter(UINT32 i, const char *param, const char *val)
 {
 	if (fastcmp(param, "id"))
 		Tag_FSet(&mapthings[i].tags, atol(val));
@@ -2064,15 +3253,15 @@ static void ParseTextmapThingParameter(UINT32 i, const char *param, const char *
 
 /** From a given position table, run a specified parser function through a {}-encapsuled text.
   *
-  * \param Position of the data to parse, in the textmap.
+  * \param Block type (TEXTMAP_THING, ...).
   * \param Structure number (mapthings, sectors, ...).
   * \param Parser function pointer.
   */
-static void TextmapParse(UINT32 dataPos, size_t num, void (*parser)(UINT32, const char *, const char *))
+static void RefTextmapParse(INT32 type, size_t num, void (*parser)(UINT32, const char *, const char *))
 {
 	const char *param, *val;
 
-	M_TokenizerSetEndPos(dataPos);
+	M_TokenizerSetEndPos(reftextmappos[type][num]);
 	param = M_TokenizerRead(0);
 	if (!fastcmp(param, "{"))
 	{
@@ -2089,6 +3278,7 @@ static void TextmapParse(UINT32 dataPos, size_t num, void (*parser)(UINT32, cons
 		parser(num, param, val);
 	}
 }
+#endif
 
 /** Provides a fix to the flat alignment coordinate transform from standard Textmaps.
  */
@@ -2865,7 +4055,10 @@ static void P_LoadTextmap(void)
 	side_t     *sd;
 	mapthing_t *mt;
 
-	CONS_Alert(CONS_NOTICE, "UDMF support is still a work-in-progress; its specs and features are prone to change until it is fully implemented.\n");
+#ifdef DEVELOP
+	if (!textmapbenching)
+#endif
+		CONS_Alert(CONS_NOTICE, "UDMF support is still a work-in-progress; its specs and features are prone to change until it is fully implemented.\n");
 
 	/// Given the UDMF specs, some fields are given a default value.
 	/// If an element's field has a default value set, it is omitted
@@ -2879,7 +4072,12 @@ static void P_LoadTextmap(void)
 		vt->floorzset = vt->ceilingzset = false;
 		vt->floorz = vt->ceilingz = 0;
 
-		TextmapParse(vertexesPos[i], i, ParseTextmapVertexParameter);
+#ifdef DEVELOP
+		if (textmapreference)
+			RefTextmapParse(TEXTMAP_VERTEX, i, RefParseTextmapVertexParameter);
+		else
+#endif
+			TextmapParse(TEXTMAP_VERTEX, i, ParseTextmapVertexParameter);
 
 		if (vt->x == INT32_MAX)
 			I_Error("P_LoadTextmap: vertex %s has no x value set!\n", sizeu1(i));
@@ -2933,7 +4131,12 @@ static void P_LoadTextmap(void)
 		textmap_planefloor.defined = 0;
 		textmap_planeceiling.defined = 0;
 
-		TextmapParse(sectorsPos[i], i, ParseTextmapSectorParameter);
+#ifdef DEVELOP
+		if (textmapreference)
+			RefTextmapParse(TEXTMAP_SECTOR, i, RefParseTextmapSectorParameter);
+		else
+#endif
+			TextmapParse(TEXTMAP_SECTOR, i, ParseTextmapSectorParameter);
 
 		P_InitializeSector(sc);
 		if (textmap_colormap.used)
@@ -2973,7 +4176,12 @@ static void P_LoadTextmap(void)
 		ld->sidenum[0] = 0xffff;
 		ld->sidenum[1] = 0xffff;
 
-		TextmapParse(linesPos[i], i, ParseTextmapLinedefParameter);
+#ifdef DEVELOP
+		if (textmapreference)
+			RefTextmapParse(TEXTMAP_LINEDEF, i, RefParseTextmapLinedefParameter);
+		else
+#endif
+			TextmapParse(TEXTMAP_LINEDEF, i, ParseTextmapLinedefParameter);
 
 		if (!ld->v1)
 			I_Error("P_LoadTextmap: linedef %s has no v1 value set!\n", sizeu1(i));
@@ -2998,7 +4206,12 @@ static void P_LoadTextmap(void)
 		sd->sector = NULL;
 		sd->repeatcnt = 0;
 
-		TextmapParse(sidesPos[i], i, ParseTextmapSidedefParameter);
+#ifdef DEVELOP
+		if (textmapreference)
+			RefTextmapParse(TEXTMAP_SIDEDEF, i, RefParseTextmapSidedefParameter);
+		else
+#endif
+			TextmapParse(TEXTMAP_SIDEDEF, i, ParseTextmapSidedefParameter);
 
 		if (!sd->sector)
 			I_Error("P_LoadTextmap: sidedef %s has no sector value set!\n", sizeu1(i));
@@ -3022,7 +4235,12 @@ static void P_LoadTextmap(void)
 		memset(mt->stringargs, 0x00, NUMMAPTHINGSTRINGARGS*sizeof(*mt->stringargs));
 		mt->mobj = NULL;
 
-		TextmapParse(mapthingsPos[i], i, ParseTextmapThingParameter);
+#ifdef DEVELOP
+		if (textmapreference)
+			RefTextmapParse(TEXTMAP_THING, i, RefParseTextmapThingParameter);
+		else
+#endif
+			TextmapParse(TEXTMAP_THING, i, ParseTextmapThingParameter);
 	}
 }
 
@@ -3111,10 +4329,9 @@ static boolean P_LoadMapData(const virtres_t *virt)
 			CONS_Alert(CONS_ERROR, "Emtpy TEXTMAP Lump!\n");
 			return false;
 		}
-		M_TokenizerOpen((char *)textmap->data, textmap->size);
-		if (!TextmapCount(textmap->size))
+		if (!TextmapCount(textmap->data, textmap->size))
 		{
-			M_TokenizerClose();
+			TextmapFree();
 			return false;
 		}
 	}
@@ -3167,12 +4384,16 @@ static boolean P_LoadMapData(const virtres_t *virt)
 		I_Error("Ran out of memory while loading sectors\n");
 
 	numlevelflats = 0;
+	P_ClearLevelFlatIndex();
+
+	// Colormaps made while loading get their light tables generated together afterwards
+	R_BeginLightTableBatch();
 
 	// Load map data.
 	if (udmf)
 	{
 		P_LoadTextmap();
-		M_TokenizerClose();
+		TextmapFree();
 	}
 	else
 	{
@@ -3185,6 +4406,8 @@ static boolean P_LoadMapData(const virtres_t *virt)
 
 	P_ProcessLinedefsAfterSidedefs();
 
+	R_FinishLightTableBatch();
+
 	R_ClearTextureNumCache(true);
 
 	// set the sky flat num
@@ -3692,6 +4915,7 @@ static boolean P_LoadBlockMap(UINT8 *data, size_t count)
 	// clear out mobj chains
 	count = sizeof (*blocklinks)* bmapwidth*bmapheight;
 	blocklinks = Z_Calloc(count, PU_LEVEL, NULL);
+	P_ClearBlockThings();
 	blockmap = blockmaplump+4;
 
 	// haleyjd 2/22/06: setup polyobject blockmap
@@ -3751,6 +4975,235 @@ static boolean LineInBlock(fixed_t cx1, fixed_t cy1, fixed_t cx2, fixed_t cy2, f
 	return P_BoxOnLineSide(bbox, &testline) == -1;
 }
 
+typedef struct
+{
+	INT32 n, nalloc;
+	INT32 *list;
+} bmap_t; // blocklist structure
+
+#define BMAPMAXBANDS 64
+
+// A run of whole blockmap rows, built on its own
+typedef struct
+{
+	size_t start, end; // block numbers covered
+	bmap_t *bmap;
+	size_t words; // list words the band adds to the lump
+	boolean failed;
+	precise_t time;
+} bmapband_t;
+
+static struct
+{
+	fixed_t minx, miny;
+	INT32 numbands;
+	bmapband_t bands[BMAPMAXBANDS];
+	INT32 *lump;
+	size_t count;
+	boolean pending;
+	precise_t time; // summed over every job
+#ifdef HAVE_THREADS
+	I_job jobs[BMAPMAXBANDS];
+	I_job merge;
+#endif
+} bmapbuild;
+
+// How many rows a block column outside the map shifts a block number by
+static inline INT32 P_BlockRowWrap(INT32 blockx)
+{
+	return (blockx < 0 ? blockx - bmapwidth + 1 : blockx) / bmapwidth;
+}
+
+//
+// Adds every linedef touching the band's blocks to their lists, in the
+// same order the old single pass over the whole map did. Runs on the
+// worker threads, so it sticks to malloc and reports failure instead of
+// calling I_Error.
+//
+static void P_BuildBlockMapBand(void *userdata)
+{
+	bmapband_t *band = userdata;
+	const fixed_t minx = bmapbuild.minx, miny = bmapbuild.miny;
+	const size_t tot = bmapwidth * bmapheight; // size of blockmap
+	const INT32 firstrow = (INT32)(band->start / bmapwidth);
+	const INT32 lastrow = (INT32)((band->end - 1) / bmapwidth);
+	precise_t t = I_GetPreciseTime();
+	boolean straight;
+	size_t i;
+
+	band->bmap = calloc(band->end - band->start, sizeof (*band->bmap));
+	band->words = 0;
+	band->failed = (band->bmap == NULL);
+
+	for (i = 0; i < numlines && !band->failed; i++)
+	{
+		// starting coordinates
+		INT32 x = (lines[i].v1->x>>FRACBITS) - minx;
+		INT32 y = (lines[i].v1->y>>FRACBITS) - miny;
+		INT32 bxstart, bxend, bystart, byend, v2x, v2y, curblockx, curblocky;
+
+		v2x = lines[i].v2->x>>FRACBITS;
+		v2y = lines[i].v2->y>>FRACBITS;
+
+		// Draw a "box" around the line.
+		bxstart = (x >> MAPBTOFRAC);
+		bystart = (y >> MAPBTOFRAC);
+
+		v2x -= minx;
+		v2y -= miny;
+
+		bxend = ((v2x) >> MAPBTOFRAC);
+		byend = ((v2y) >> MAPBTOFRAC);
+
+		if (bxend < bxstart)
+		{
+			INT32 temp = bxstart;
+			bxstart = bxend;
+			bxend = temp;
+		}
+
+		if (byend < bystart)
+		{
+			INT32 temp = bystart;
+			bystart = byend;
+			byend = temp;
+		}
+
+		// Catch straight lines
+		// This fixes the error where straight lines
+		// directly on a blockmap boundary would not
+		// be included in the proper blocks.
+		if (lines[i].v1->y == lines[i].v2->y)
+		{
+			straight = true;
+			bystart--;
+			byend++;
+		}
+		else if (lines[i].v1->x == lines[i].v2->x)
+		{
+			straight = true;
+			bxstart--;
+			bxend++;
+		}
+		else
+			straight = false;
+
+		// Blocks past the left or right edge wrap into the rows below
+		// or above, so widen the rows looked at by as many as that.
+		bystart = max(bystart, firstrow - P_BlockRowWrap(bxend));
+		byend = min(byend, lastrow - P_BlockRowWrap(bxstart));
+
+		// Now we simply iterate block-by-block until we reach the end block.
+		for (curblockx = bxstart; curblockx <= bxend; curblockx++)
+		for (curblocky = bystart; curblocky <= byend; curblocky++)
+		{
+			size_t b = curblocky * bmapwidth + curblockx;
+			bmap_t *bp;
+
+			if (b >= tot || b < band->start || b >= band->end)
+				continue;
+
+			if (!straight && !(LineInBlock((fixed_t)x, (fixed_t)y, (fixed_t)v2x, (fixed_t)v2y, (fixed_t)(curblockx << MAPBTOFRAC), (fixed_t)(curblocky << MAPBTOFRAC))))
+				continue;
+
+			bp = &band->bmap[b - band->start];
+
+			// Increase size of allocated list if necessary
+			if (bp->n >= bp->nalloc)
+			{
+				INT32 *list = realloc(bp->list, (bp->nalloc ? bp->nalloc * 2 : 8) * sizeof (*bp->list));
+
+				if (!list)
+				{
+					band->failed = true;
+					break;
+				}
+
+				bp->list = list;
+				bp->nalloc = bp->nalloc ? bp->nalloc * 2 : 8;
+			}
+
+			// Add linedef to end of list
+			if (!bp->n)
+				band->words += 2; // 1 header word + 1 trailer word
+			bp->list[bp->n++] = (INT32)i;
+			band->words++;
+		}
+	}
+
+	band->time = I_GetPreciseTime() - t;
+}
+
+//
+// Compresses the finished bands into one lump. Runs once every band is
+// done; the lump is moved into the zone on the main thread afterwards.
+//
+static void P_MergeBlockMapBands(void *userdata)
+{
+	const size_t tot = bmapwidth * bmapheight;
+	precise_t t = I_GetPreciseTime();
+	size_t count = tot + 6; // we need at least 1 word per block, plus reserved's
+	size_t ndx = tot + 4; // Advance index to start of linedef lists
+	size_t i;
+	INT32 j;
+
+	(void)userdata;
+
+	for (j = 0; j < bmapbuild.numbands; j++)
+	{
+		if (bmapbuild.bands[j].failed)
+			break;
+		count += bmapbuild.bands[j].words;
+	}
+
+	// 4 words, unused if this routine is called, are reserved at the start.
+	bmapbuild.lump = (j == bmapbuild.numbands) ? calloc(count, sizeof (*bmapbuild.lump)) : NULL;
+	bmapbuild.count = count;
+
+	if (bmapbuild.lump)
+	{
+		INT32 *lump = bmapbuild.lump;
+
+		lump[ndx++] = 0; // Store an empty blockmap list at start
+		lump[ndx++] = -1; // (Used for compression)
+
+		for (j = 0; j < bmapbuild.numbands; j++)
+		{
+			bmapband_t *band = &bmapbuild.bands[j];
+			bmap_t *bp = band->bmap; // Start of uncompressed band
+
+			for (i = band->start + 4; i < band->end + 4; i++, bp++)
+				if (bp->n) // Non-empty blocklist
+				{
+					lump[lump[i] = (INT32)(ndx++)] = 0; // Store index & header
+					do
+						lump[ndx++] = bp->list[--bp->n]; // Copy linedef list
+					while (bp->n);
+					lump[ndx++] = -1; // Store trailer
+				}
+				else // Empty blocklist: point to reserved empty blocklist
+					lump[i] = (INT32)(tot + 4);
+		}
+	}
+
+	for (j = 0; j < bmapbuild.numbands; j++)
+	{
+		bmapband_t *band = &bmapbuild.bands[j];
+
+		if (band->bmap)
+		{
+			for (i = 0; i < band->end - band->start; i++)
+				free(band->bmap[i].list); // Free linedef list
+			free(band->bmap); // Free uncompressed band
+		}
+
+		band->bmap = NULL;
+		bmapbuild.time += band->time;
+	}
+
+	bmapbuild.time += I_GetPreciseTime() - t;
+}
+
 //
 // killough 10/98:
 //
@@ -3762,10 +5215,16 @@ static boolean LineInBlock(fixed_t cx1, fixed_t cy1, fixed_t cx2, fixed_t cy2, f
 //
 // Please note: This section of code is not interchangable with TeamTNT's
 // code which attempts to fix the same problem.
+//
+// The blockmap rows are split into bands that are built on the worker
+// threads while the rest of the map loads; P_FinishBlockMap collects the
+// result before anything is spawned.
 static void P_CreateBlockMap(void)
 {
 	register size_t i;
 	fixed_t minx = INT32_MAX, miny = INT32_MAX, maxx = INT32_MIN, maxy = INT32_MIN;
+	size_t tot, rows;
+	INT32 numbands = 1;
 	// First find limits of map
 
 	for (i = 0; i < numvertexes; i++)
@@ -3803,156 +5262,93 @@ static void P_CreateBlockMap(void)
 	//     Move to an adjacent block by moving towards the ending block in
 	//     either the x or y direction, to the block which contains the linedef.
 
-	{
-		typedef struct
-		{
-			INT32 n, nalloc;
-			INT32 *list;
-		} bmap_t; // blocklist structure
-
-		size_t tot = bmapwidth * bmapheight; // size of blockmap
-		bmap_t *bmap = calloc(tot, sizeof (*bmap)); // array of blocklists
-		boolean straight;
-
-		if (bmap == NULL) I_Error("%s: Out of memory making blockmap", "P_CreateBlockMap");
-
-		for (i = 0; i < numlines; i++)
-		{
-			// starting coordinates
-			INT32 x = (lines[i].v1->x>>FRACBITS) - minx;
-			INT32 y = (lines[i].v1->y>>FRACBITS) - miny;
-			INT32 bxstart, bxend, bystart, byend, v2x, v2y, curblockx, curblocky;
-
-			v2x = lines[i].v2->x>>FRACBITS;
-			v2y = lines[i].v2->y>>FRACBITS;
-
-			// Draw a "box" around the line.
-			bxstart = (x >> MAPBTOFRAC);
-			bystart = (y >> MAPBTOFRAC);
-
-			v2x -= minx;
-			v2y -= miny;
+	bmapbuild.minx = minx;
+	bmapbuild.miny = miny;
 
-			bxend = ((v2x) >> MAPBTOFRAC);
-			byend = ((v2y) >> MAPBTOFRAC);
+	tot = bmapwidth * bmapheight;
+	rows = bmapheight;
 
-			if (bxend < bxstart)
-			{
-				INT32 temp = bxstart;
-				bxstart = bxend;
-				bxend = temp;
-			}
-
-			if (byend < bystart)
-			{
-				INT32 temp = bystart;
-				bystart = byend;
-				byend = temp;
-			}
-
-			// Catch straight lines
-			// This fixes the error where straight lines
-			// directly on a blockmap boundary would not
-			// be included in the proper blocks.
-			if (lines[i].v1->y == lines[i].v2->y)
-			{
-				straight = true;
-				bystart--;
-				byend++;
-			}
-			else if (lines[i].v1->x == lines[i].v2->x)
-			{
-				straight = true;
-				bxstart--;
-				bxend++;
-			}
-			else
-				straight = false;
-
-			// Now we simply iterate block-by-block until we reach the end block.
-			for (curblockx = bxstart; curblockx <= bxend; curblockx++)
-			for (curblocky = bystart; curblocky <= byend; curblocky++)
-			{
-				size_t b = curblocky * bmapwidth + curblockx;
-
-				if (b >= tot)
-					continue;
-
-				if (!straight && !(LineInBlock((fixed_t)x, (fixed_t)y, (fixed_t)v2x, (fixed_t)v2y, (fixed_t)(curblockx << MAPBTOFRAC), (fixed_t)(curblocky << MAPBTOFRAC))))
-					continue;
-
-				// Increase size of allocated list if necessary
-				if (bmap[b].n >= bmap[b].nalloc)
-				{
-					// Graue 02-29-2004: make code more readable, don't realloc a null pointer
-					// (because it crashes for me, and because the comp.lang.c FAQ says so)
-					if (bmap[b].nalloc == 0)
-						bmap[b].nalloc = 8;
-					else
-						bmap[b].nalloc *= 2;
-					bmap[b].list = Z_Realloc(bmap[b].list, bmap[b].nalloc * sizeof (*bmap->list), PU_CACHE, &bmap[b].list);
-					if (!bmap[b].list)
-						I_Error("Out of Memory in P_CreateBlockMap");
-				}
-
-				// Add linedef to end of list
-				bmap[b].list[bmap[b].n++] = (INT32)i;
-			}
-		}
-
-		// Compute the total size of the blockmap.
-		//
-		// Compression of empty blocks is performed by reserving two offset words
-		// at tot and tot+1.
-		//
-		// 4 words, unused if this routine is called, are reserved at the start.
-		{
-			size_t count = tot + 6; // we need at least 1 word per block, plus reserved's
-
-			for (i = 0; i < tot; i++)
-				if (bmap[i].n)
-					count += bmap[i].n + 2; // 1 header word + 1 trailer word + blocklist
-
-			// Allocate blockmap lump with computed count
-			blockmaplump = Z_Calloc(sizeof (*blockmaplump) * count, PU_LEVEL, NULL);
-		}
+#ifdef HAVE_THREADS
+	// A few bands per thread, since the lines are rarely spread evenly
+	if (I_worker_count())
+		numbands = (INT32)min(rows, (size_t)min(4 * (I_worker_count() + 1), BMAPMAXBANDS));
+#endif
 
-		// Now compress the blockmap.
-		{
-			size_t ndx = tot += 4; // Advance index to start of linedef lists
-			bmap_t *bp = bmap; // Start of uncompressed blockmap
+	bmapbuild.numbands = numbands;
+	for (i = 0; i < (size_t)numbands; i++)
+	{
+		bmapbuild.bands[i].start = (rows * i / numbands) * bmapwidth;
+		bmapbuild.bands[i].end = (rows * (i + 1) / numbands) * bmapwidth;
+	}
 
-			blockmaplump[ndx++] = 0; // Store an empty blockmap list at start
-			blockmaplump[ndx++] = -1; // (Used for compression)
+#ifdef HAVE_THREADS
+	if (numbands > 1)
+	{
+		for (i = 0; i < (size_t)numbands; i++)
+			bmapbuild.jobs[i] = I_schedule_job(P_BuildBlockMapBand, &bmapbuild.bands[i], NULL, 0);
+		bmapbuild.merge = I_schedule_job(P_MergeBlockMapBands, NULL, bmapbuild.jobs, numbands);
+	}
+	else
+#endif
+	{
+		P_BuildBlockMapBand(&bmapbuild.bands[0]);
+		P_MergeBlockMapBands(NULL);
+	}
 
-			for (i = 4; i < tot; i++, bp++)
-				if (bp->n) // Non-empty blocklist
-				{
-					blockmaplump[blockmaplump[i] = (INT32)(ndx++)] = 0; // Store index & header
-					do
-						blockmaplump[ndx++] = bp->list[--bp->n]; // Copy linedef list
-					while (bp->n);
-					blockmaplump[ndx++] = -1; // Store trailer
-					Z_Free(bp->list); // Free linedef list
-				}
-				else // Empty blocklist: point to reserved empty blocklist
-					blockmaplump[i] = (INT32)tot;
+	bmapbuild.pending = true;
+	blockmaplump = NULL;
+	blockmap = NULL;
 
-			free(bmap); // Free uncompressed blockmap
-		}
-	}
 	{
-		size_t count = sizeof (*blocklinks) * bmapwidth * bmapheight;
+		size_t count = sizeof (*blocklinks) * tot;
 		// clear out mobj chains (copied from from P_LoadBlockMap)
 		blocklinks = Z_Calloc(count, PU_LEVEL, NULL);
-		blockmap = blockmaplump + 4;
+		P_ClearBlockThings();
 
 		// haleyjd 2/22/06: setup polyobject blockmap
-		count = sizeof(*polyblocklinks) * bmapwidth * bmapheight;
+		count = sizeof(*polyblocklinks) * tot;
 		polyblocklinks = Z_Calloc(count, PU_LEVEL, NULL);
 	}
 }
 
+//
+// Waits for P_CreateBlockMap's jobs, if there are any left,
+// and moves the finished blockmap into the zone.
+//
+static void P_FinishBlockMap(void)
+{
+#ifdef HAVE_THREADS
+	INT32 i;
+#endif
+
+	if (!bmapbuild.pending)
+		return;
+
+#ifdef HAVE_THREADS
+	if (bmapbuild.numbands > 1)
+	{
+		I_wait_job(bmapbuild.merge);
+		for (i = 0; i < bmapbuild.numbands; i++)
+			I_wait_job(bmapbuild.jobs[i]);
+	}
+#endif
+
+	bmapbuild.pending = false;
+
+	if (!bmapbuild.lump)
+		I_Error("Out of Memory in P_CreateBlockMap");
+
+	blockmaplump = Z_Malloc(sizeof (*blockmaplump) * bmapbuild.count, PU_LEVEL, NULL);
+	M_Memcpy(blockmaplump, bmapbuild.lump, sizeof (*blockmaplump) * bmapbuild.count);
+	free(bmapbuild.lump);
+	bmapbuild.lump = NULL;
+
+	blockmap = blockmaplump + 4;
+
+	CONS_Debug(DBG_SETUP, "Built blockmap of %dx%d blocks in %d bands\n",
+		bmapwidth, bmapheight, bmapbuild.numbands);
+}
+
 // PK3 version
 // -- Monster Iestyn 09/01/18
 static void P_LoadReject(UINT8 *data, size_t count)
@@ -6790,187 +8186,946 @@ static void P_ConvertBinaryThingTypes(void)
 			mapthings[i].args[0] = mapthings[i].extrainfo;
 			mapthings[i].args[1] = mapthings[i].options;
 			break;
-		case 1703: //Ideya drone
-			mapthings[i].args[0] = mapthings[i].angle & 0xFFF;
-			mapthings[i].args[1] = mapthings[i].extrainfo*32;
-			mapthings[i].args[2] = ((mapthings[i].angle & 0xF000) >> 12)*32;
-			if ((mapthings[i].options & (MTF_OBJECTSPECIAL|MTF_EXTRA)) == (MTF_OBJECTSPECIAL|MTF_EXTRA))
-				mapthings[i].args[3] = TMDA_BOTTOM;
-			else if ((mapthings[i].options & (MTF_OBJECTSPECIAL|MTF_EXTRA)) == MTF_OBJECTSPECIAL)
-				mapthings[i].args[3] = TMDA_TOP;
-			else if ((mapthings[i].options & (MTF_OBJECTSPECIAL|MTF_EXTRA)) == MTF_EXTRA)
-				mapthings[i].args[3] = TMDA_MIDDLE;
-			else
-				mapthings[i].args[3] = TMDA_BOTTOMOFFSET;
-			mapthings[i].args[4] = !!(mapthings[i].options & MTF_AMBUSH);
+		case 1703: //Ideya drone
+			mapthings[i].args[0] = mapthings[i].angle & 0xFFF;
+			mapthings[i].args[1] = mapthings[i].extrainfo*32;
+			mapthings[i].args[2] = ((mapthings[i].angle & 0xF000) >> 12)*32;
+			if ((mapthings[i].options & (MTF_OBJECTSPECIAL|MTF_EXTRA)) == (MTF_OBJECTSPECIAL|MTF_EXTRA))
+				mapthings[i].args[3] = TMDA_BOTTOM;
+			else if ((mapthings[i].options & (MTF_OBJECTSPECIAL|MTF_EXTRA)) == MTF_OBJECTSPECIAL)
+				mapthings[i].args[3] = TMDA_TOP;
+			else if ((mapthings[i].options & (MTF_OBJECTSPECIAL|MTF_EXTRA)) == MTF_EXTRA)
+				mapthings[i].args[3] = TMDA_MIDDLE;
+			else
+				mapthings[i].args[3] = TMDA_BOTTOMOFFSET;
+			mapthings[i].args[4] = !!(mapthings[i].options & MTF_AMBUSH);
+			break;
+		case 1704: //NiGHTS bumper
+			mapthings[i].pitch = 30 * (((mapthings[i].options & 15) + 9) % 12);
+			mapthings[i].options &= ~0xF;
+			break;
+		case 1705: //Hoop
+		case 1713: //Hoop (Customizable)
+		{
+			UINT16 oldangle = mapthings[i].angle;
+			mapthings[i].angle = (mapthings[i].extrainfo == 1) ? oldangle - 90  : ((oldangle >> 8)*360)/256;
+			mapthings[i].pitch = (mapthings[i].extrainfo == 1) ? oldangle / 360 : ((oldangle & 255)*360)/256;
+			mapthings[i].args[0] = (mapthings[i].type == 1705) ? 96 : (mapthings[i].options & 0xF)*16 + 32;
+			mapthings[i].options &= ~0xF;
+			mapthings[i].type = 1713;
+			break;
+		}
+		case 1710: //Ideya capture
+			mapthings[i].args[0] = mapthings[i].extrainfo;
+			mapthings[i].args[1] = mapthings[i].angle;
+			break;
+		case 1714: //Ideya anchor point
+			mapthings[i].args[0] = mapthings[i].extrainfo;
+			break;
+		case 1806: //King Bowser
+			mapthings[i].args[0] = LE_KOOPA;
+			break;
+		case 1807: //Axe
+			mapthings[i].args[0] = LE_AXE;
+			break;
+		case 2000: //Smashing spikeball
+			mapthings[i].args[0] = mapthings[i].angle;
+			break;
+		case 2006: //Jack-o'-lantern 1
+		case 2007: //Jack-o'-lantern 2
+		case 2008: //Jack-o'-lantern 3
+			mapthings[i].args[0] = !!(mapthings[i].options & MTF_EXTRA);
+			break;
+		default:
+			break;
+		}
+		
+		// Clear binary thing height hacks, to prevent interfering with UDMF-only flags
+		mapthings[i].options &= 0xF;
+	}
+}
+
+static void P_ConvertBinaryLinedefFlags(void)
+{
+	size_t i;
+
+	for (i = 0; i < numlines; i++)
+	{
+		if (!!(lines[i].flags & ML_DONTPEGBOTTOM) ^ !!(lines[i].flags & ML_MIDPEG))
+			lines[i].flags |= ML_MIDPEG;
+		else
+			lines[i].flags &= ~ML_MIDPEG;
+
+		if (lines[i].special >= 100 && lines[i].special < 300)
+		{
+			if (lines[i].flags & ML_DONTPEGTOP)
+				lines[i].flags |= ML_SKEWTD;
+			else
+				lines[i].flags &= ~ML_SKEWTD;
+
+			if ((lines[i].flags & ML_TFERLINE) && lines[i].frontsector)
+			{
+				size_t j;
+
+				for (j = 0; j < lines[i].frontsector->linecount; j++)
+				{
+					if (lines[i].frontsector->lines[j]->flags & ML_DONTPEGTOP)
+						lines[i].frontsector->lines[j]->flags |= ML_SKEWTD;
+					else
+						lines[i].frontsector->lines[j]->flags &= ~ML_SKEWTD;
+				}
+			}
+		}
+
+	}
+}
+
+//For maps in binary format, converts setup of specials to UDMF format.
+static void P_ConvertBinaryMap(void)
+{
+	contextdrift = false;
+	P_ConvertBinaryLinedefTypes();
+	P_ConvertBinarySectorTypes();
+	P_ConvertBinaryThingTypes();
+	P_ConvertBinaryLinedefFlags();
+	if (M_CheckParm("-writetextmap"))
+		P_WriteTextmap();
+}
+
+/** Compute MD5 message digest for bytes read from memory source
+  *
+  * The resulting message digest number will be written into the 16 bytes
+  * beginning at RESBLOCK.
+  *
+  * \param filename path of file
+  * \param resblock resulting MD5 checksum
+  * \return 0 if MD5 checksum was made, and is at resblock, 1 if error was found
+  */
+static INT32 P_MakeBufferMD5(const char *buffer, size_t len, void *resblock)
+{
+#ifdef NOMD5
+	(void)buffer;
+	(void)len;
+	memset(resblock, 0x00, 16);
+	return 1;
+#else
+	if (md5_buffer(buffer, len, resblock) == NULL)
+		return 1;
+	return 0;
+#endif
+}
+
+static void P_MakeMapMD5(virtres_t *virt, void *dest)
+{
+	unsigned char resmd5[16];
+
+	if (udmf)
+	{
+		virtlump_t *textmap = vres_Find(virt, "TEXTMAP");
+		P_MakeBufferMD5((char*)textmap->data, textmap->size, resmd5);
+	}
+	else
+	{
+		unsigned char linemd5[16];
+		unsigned char sectormd5[16];
+		unsigned char thingmd5[16];
+		unsigned char sidedefmd5[16];
+		UINT8 i;
+
+		// Create a hash for the current map
+		// get the actual lumps!
+		virtlump_t* virtlines   = vres_Find(virt, "LINEDEFS");
+		virtlump_t* virtsectors = vres_Find(virt, "SECTORS");
+		virtlump_t* virtmthings = vres_Find(virt, "THINGS");
+		virtlump_t* virtsides   = vres_Find(virt, "SIDEDEFS");
+
+		P_MakeBufferMD5((char*)virtlines->data,   virtlines->size, linemd5);
+		P_MakeBufferMD5((char*)virtsectors->data, virtsectors->size,  sectormd5);
+		P_MakeBufferMD5((char*)virtmthings->data, virtmthings->size,   thingmd5);
+		P_MakeBufferMD5((char*)virtsides->data,   virtsides->size, sidedefmd5);
+
+		for (i = 0; i < 16; i++)
+			resmd5[i] = (linemd5[i] + sectormd5[i] + thingmd5[i] + sidedefmd5[i]) & 0xFF;
+	}
+
+	M_Memcpy(dest, &resmd5, 16);
+}
+
+static precise_t mapmd5time;
+
+// Hashes the map lumps while the rest of the map loads
+static void P_MapMD5Job(void *userdata)
+{
+	precise_t t = I_GetPreciseTime();
+	P_MakeMapMD5(userdata, &mapmd5);
+	mapmd5time = I_GetPreciseTime() - t;
+}
+
+typedef enum
+{
+	LOADTIME_MAPDATA,
+	LOADTIME_BSP,
+	LOADTIME_LUT,
+	LOADTIME_LINK,
+	LOADTIME_CONVERT,
+	LOADTIME_MD5,
+	LOADTIME_SLOPES,
+	LOADTIME_BLOCKMAP,
+	LOADTIME_THINGS,
+	LOADTIME_SPECIALS,
+	LOADTIME_SIGHT,
+	NUMLOADTIMES
+} loadtime_t;
+
+static const char *const loadtimenames[NUMLOADTIMES] = {
+	"Map data:      ",
+	"Nodes:         ",
+	"Reject/blocks: ",
+	"Sector links:  ",
+	"Conversion:    ",
+	"MD5 wait:      ",
+	"Slopes:        ",
+	"Blockmap wait: ",
+	"Map things:    ",
+	"Specials:      ",
+	"Sight PVS:     ",
+};
+
+static precise_t maploadtimes[NUMLOADTIMES];
+static precise_t maploadmark;
+
+// Charges the time since the last mark to the given phase
+static void P_MarkLoadTime(loadtime_t phase)
+{
+	precise_t now = I_GetPreciseTime();
+	maploadtimes[phase] = now - maploadmark;
+	maploadmark = now;
+}
+
+/** Shows how long each step of loading the current map took on the main
+  * thread, along with the time the blockmap and MD5 jobs spent on the
+  * worker threads. The two "wait" rows are whatever was left of those jobs
+  * once the main thread got to needing their results.
+  * Usage: maploadtime
+  */
+void Command_MapLoadTime_f(void)
+{
+	precise_t total = 0;
+	INT32 i;
+
+	if (gamestate != GS_LEVEL)
+	{
+		CONS_Printf(M_GetText("You must be in a level to use this.\n"));
+		return;
+	}
+
+	CONS_Printf("Loading %s (%s):\n", G_BuildMapName(gamemap), udmf ? "UDMF" : "binary");
+
+	for (i = 0; i < NUMLOADTIMES; i++)
+	{
+		CONS_Printf(" %s%d us\n", loadtimenames[i], (int)(maploadtimes[i] * 1000000 / I_GetPrecisePrecision()));
+		total += maploadtimes[i];
+	}
+
+	CONS_Printf(" Total:         %d us\n", (int)(total * 1000000 / I_GetPrecisePrecision()));
+	CONS_Printf("Worker time:\n");
+	if (bmapbuild.numbands)
+		CONS_Printf(" Blockmap:      %d us in %d bands\n", (int)(bmapbuild.time * 1000000 / I_GetPrecisePrecision()), bmapbuild.numbands);
+	else
+		CONS_Printf(" Blockmap:      loaded from lump\n");
+	CONS_Printf(" MD5:           %d us\n", (int)(mapmd5time * 1000000 / I_GetPrecisePrecision()));
+}
+
+#ifdef DEVELOP
+// One parser's results for one TEXTMAP, for textmapbench to compare
+typedef struct
+{
+	boolean ok;
+	precise_t time;
+	size_t numvertexes, numsectors, numsides, numlines, nummapthings, numlevelflats;
+	vertex_t *vertexes;
+	sector_t *sectors;
+	side_t *sides;
+	line_t *lines;
+	mapthing_t *mapthings;
+	levelflat_t *flats;
+	pslope_t *slopes;
+	UINT16 numslopes;
+} textmapresult_t;
+
+static void P_GetTextmapResult(textmapresult_t *res)
+{
+	res->numvertexes = numvertexes;
+	res->numsectors = numsectors;
+	res->numsides = numsides;
+	res->numlines = numlines;
+	res->nummapthings = nummapthings;
+	res->numlevelflats = numlevelflats;
+	res->vertexes = vertexes;
+	res->sectors = sectors;
+	res->sides = sides;
+	res->lines = lines;
+	res->mapthings = mapthings;
+	res->flats = foundflats;
+	res->slopes = slopelist;
+	res->numslopes = slopecount;
+}
+
+static void P_SetTextmapResult(const textmapresult_t *res)
+{
+	numvertexes = res->numvertexes;
+	numsectors = res->numsectors;
+	numsides = res->numsides;
+	numlines = res->numlines;
+	nummapthings = res->nummapthings;
+	numlevelflats = res->numlevelflats;
+	vertexes = res->vertexes;
+	sectors = res->sectors;
+	sides = res->sides;
+	lines = res->lines;
+	mapthings = res->mapthings;
+	foundflats = res->flats;
+	slopelist = res->slopes;
+	slopecount = res->numslopes;
+}
+
+// Loads the vertices, sectors, sides, lines and things of a TEXTMAP the
+// way P_LoadMapData does, with either parser, and keeps them in res.
+static void P_BenchTextmapLoad(UINT8 *data, size_t size, boolean reference, textmapresult_t *res)
+{
+	precise_t t = I_GetPreciseTime();
+	boolean ok;
+
+	numlevelflats = 0;
+	P_ClearLevelFlatIndex();
+	slopelist = NULL;
+	slopecount = 0;
+
+	foundflats = calloc(MAXLEVELFLATS, sizeof (*foundflats));
+	if (!foundflats)
+		I_Error("Command_TextmapBench_f: No more memory\n");
+
+	if (reference)
+	{
+		M_TokenizerOpen((char *)data, size);
+		ok = RefTextmapCount(size);
+	}
+	else
+		ok = TextmapCount(data, size);
+
+	// P_LoadMapData gives up on these
+	if (!numvertexes || !numsectors || !numsides || !numlines)
+		ok = false;
+
+	if (ok)
+	{
+		vertexes  = Z_Calloc(numvertexes * sizeof (*vertexes), PU_STATIC, NULL);
+		sectors   = Z_Calloc(numsectors * sizeof (*sectors), PU_STATIC, NULL);
+		sides     = Z_Calloc(numsides * sizeof (*sides), PU_STATIC, NULL);
+		lines     = Z_Calloc(numlines * sizeof (*lines), PU_STATIC, NULL);
+		mapthings = Z_Calloc(nummapthings * sizeof (*mapthings), PU_STATIC, NULL);
+
+		textmapreference = reference;
+		P_LoadTextmap();
+		textmapreference = false;
+	}
+	else
+	{
+		vertexes = NULL;
+		sectors = NULL;
+		sides = NULL;
+		lines = NULL;
+		mapthings = NULL;
+		numvertexes = numsectors = numsides = numlines = nummapthings = 0;
+	}
+
+	if (reference)
+		M_TokenizerClose();
+	else
+		TextmapFree();
+
+	P_GetTextmapResult(res);
+	res->ok = ok;
+	res->time = I_GetPreciseTime() - t;
+}
+
+// Colormaps are left in the level's list, like any other made while loading.
+static void P_FreeTextmapResult(textmapresult_t *res)
+{
+	pslope_t *slope, *next;
+	size_t i;
+	INT32 j;
+
+	for (i = 0; i < res->numsectors; i++)
+		Z_Free(res->sectors[i].tags.tags);
+
+	for (i = 0; i < res->numlines; i++)
+	{
+		Z_Free(res->lines[i].tags.tags);
+		for (j = 0; j < NUMLINESTRINGARGS; j++)
+			Z_Free(res->lines[i].stringargs[j]);
+	}
+
+	for (i = 0; i < res->nummapthings; i++)
+	{
+		Z_Free(res->mapthings[i].tags.tags);
+		for (j = 0; j < NUMMAPTHINGSTRINGARGS; j++)
+			Z_Free(res->mapthings[i].stringargs[j]);
+	}
+
+	for (slope = res->slopes; slope; slope = next)
+	{
+		next = slope->next;
+		Z_Free(slope);
+	}
+
+	Z_Free(res->vertexes);
+	Z_Free(res->sectors);
+	Z_Free(res->sides);
+	Z_Free(res->lines);
+	Z_Free(res->mapthings);
+	free(res->flats);
+	memset(res, 0, sizeof (*res));
+}
+
+static boolean P_SameTextmapTags(const taglist_t *a, const taglist_t *b)
+{
+	return a->count == b->count && (!a->count || !memcmp(a->tags, b->tags, a->count * sizeof (*a->tags)));
+}
+
+static boolean P_SameTextmapString(const char *a, const char *b)
+{
+	return (a && b) ? !strcmp(a, b) : a == b;
+}
+
+static boolean P_SameTextmapSlope(const pslope_t *a, const pslope_t *b)
+{
+	pslope_t copy;
+
+	if (!a || !b)
+		return a == b;
+
+	memcpy(&copy, a, sizeof (copy));
+	copy.next = b->next;
+	return !memcmp(&copy, b, sizeof (copy));
+}
+
+// Compares two parsers' results, everything that points at other map data
+// by the number of what it points at. Returns what differs, or NULL.
+static const char *P_CompareTextmapResults(const textmapresult_t *a, const textmapresult_t *b, size_t *num)
+{
+	size_t i;
+	INT32 j;
+
+	*num = 0;
+
+	if (a->ok != b->ok)
+		return "success";
+
+	if (a->numvertexes != b->numvertexes || a->numsectors != b->numsectors || a->numsides != b->numsides
+		|| a->numlines != b->numlines || a->nummapthings != b->nummapthings)
+		return "count";
+
+	if (a->numlevelflats != b->numlevelflats || memcmp(a->flats, b->flats, a->numlevelflats * sizeof (*a->flats)))
+		return "flats";
+
+	for (i = 0; i < a->numvertexes; i++)
+		if (memcmp(&a->vertexes[i], &b->vertexes[i], sizeof (*a->vertexes)))
+			break;
+	if ((*num = i) < a->numvertexes)
+		return "vertex";
+
+	for (i = 0; i < a->numsectors; i++)
+	{
+		const sector_t *sb = &b->sectors[i];
+		sector_t sa;
+
+		memcpy(&sa, &a->sectors[i], sizeof (sa));
+		if (!P_SameTextmapTags(&sa.tags, &sb->tags)
+			|| !P_SameTextmapSlope(sa.f_slope, sb->f_slope)
+			|| !P_SameTextmapSlope(sa.c_slope, sb->c_slope))
 			break;
-		case 1704: //NiGHTS bumper
-			mapthings[i].pitch = 30 * (((mapthings[i].options & 15) + 9) % 12);
-			mapthings[i].options &= ~0xF;
+
+		sa.tags = sb->tags;
+		sa.f_slope = sb->f_slope;
+		sa.c_slope = sb->c_slope;
+		if (memcmp(&sa, sb, sizeof (sa)))
 			break;
-		case 1705: //Hoop
-		case 1713: //Hoop (Customizable)
-		{
-			UINT16 oldangle = mapthings[i].angle;
-			mapthings[i].angle = (mapthings[i].extrainfo == 1) ? oldangle - 90  : ((oldangle >> 8)*360)/256;
-			mapthings[i].pitch = (mapthings[i].extrainfo == 1) ? oldangle / 360 : ((oldangle & 255)*360)/256;
-			mapthings[i].args[0] = (mapthings[i].type == 1705) ? 96 : (mapthings[i].options & 0xF)*16 + 32;
-			mapthings[i].options &= ~0xF;
-			mapthings[i].type = 1713;
+	}
+	if ((*num = i) < a->numsectors)
+		return "sector";
+
+	for (i = 0; i < a->numsides; i++)
+	{
+		const side_t *sb = &b->sides[i];
+		side_t sa;
+
+		memcpy(&sa, &a->sides[i], sizeof (sa));
+		if (sa.sector - a->sectors != sb->sector - b->sectors
+			|| sa.line - a->lines != sb->line - b->lines)
 			break;
-		}
-		case 1710: //Ideya capture
-			mapthings[i].args[0] = mapthings[i].extrainfo;
-			mapthings[i].args[1] = mapthings[i].angle;
+
+		sa.sector = sb->sector;
+		sa.line = sb->line;
+		if (memcmp(&sa, sb, sizeof (sa)))
 			break;
-		case 1714: //Ideya anchor point
-			mapthings[i].args[0] = mapthings[i].extrainfo;
+	}
+	if ((*num = i) < a->numsides)
+		return "sidedef";
+
+	for (i = 0; i < a->numlines; i++)
+	{
+		const line_t *lb = &b->lines[i];
+		line_t la;
+
+		memcpy(&la, &a->lines[i], sizeof (la));
+		if (la.v1 - a->vertexes != lb->v1 - b->vertexes
+			|| la.v2 - a->vertexes != lb->v2 - b->vertexes
+			|| !P_SameTextmapTags(&la.tags, &lb->tags))
 			break;
-		case 1806: //King Bowser
-			mapthings[i].args[0] = LE_KOOPA;
+
+		for (j = 0; j < NUMLINESTRINGARGS; j++)
+		{
+			if (!P_SameTextmapString(la.stringargs[j], lb->stringargs[j]))
+				break;
+			la.stringargs[j] = lb->stringargs[j];
+		}
+		if (j < NUMLINESTRINGARGS)
 			break;
-		case 1807: //Axe
-			mapthings[i].args[0] = LE_AXE;
+
+		la.v1 = lb->v1;
+		la.v2 = lb->v2;
+		la.tags = lb->tags;
+		if (memcmp(&la, lb, sizeof (la)))
 			break;
-		case 2000: //Smashing spikeball
-			mapthings[i].args[0] = mapthings[i].angle;
+	}
+	if ((*num = i) < a->numlines)
+		return "linedef";
+
+	for (i = 0; i < a->nummapthings; i++)
+	{
+		const mapthing_t *tb = &b->mapthings[i];
+		mapthing_t ta;
+
+		memcpy(&ta, &a->mapthings[i], sizeof (ta));
+		if (!P_SameTextmapTags(&ta.tags, &tb->tags))
 			break;
-		case 2006: //Jack-o'-lantern 1
-		case 2007: //Jack-o'-lantern 2
-		case 2008: //Jack-o'-lantern 3
-			mapthings[i].args[0] = !!(mapthings[i].options & MTF_EXTRA);
+
+		for (j = 0; j < NUMMAPTHINGSTRINGARGS; j++)
+		{
+			if (!P_SameTextmapString(ta.stringargs[j], tb->stringargs[j]))
+				break;
+			ta.stringargs[j] = tb->stringargs[j];
+		}
+		if (j < NUMMAPTHINGSTRINGARGS)
 			break;
-		default:
+
+		ta.tags = tb->tags;
+		if (memcmp(&ta, tb, sizeof (ta)))
 			break;
-		}
-		
-		// Clear binary thing height hacks, to prevent interfering with UDMF-only flags
-		mapthings[i].options &= 0xF;
 	}
+	if ((*num = i) < a->nummapthings)
+		return "thing";
+
+	return NULL;
 }
 
-static void P_ConvertBinaryLinedefFlags(void)
+// Runs both parsers over one TEXTMAP, adding their times to the totals.
+// Returns false if their results differ.
+static boolean P_BenchTextmap(const char *name, UINT8 *data, size_t size, precise_t *reftime, precise_t *curtime)
 {
-	size_t i;
+	textmapresult_t ref, cur;
+	const char *differs;
+	size_t num;
 
-	for (i = 0; i < numlines; i++)
+	// Untimed, so that neither timed run pays for first finding the
+	// textures and flats, or making the colormaps
+	P_BenchTextmapLoad(data, size, false, &cur);
+	P_FreeTextmapResult(&cur);
+
+	P_BenchTextmapLoad(data, size, true, &ref);
+	P_BenchTextmapLoad(data, size, false, &cur);
+
+	*reftime += ref.time;
+	*curtime += cur.time;
+
+	differs = P_CompareTextmapResults(&ref, &cur, &num);
+	if (differs)
+		CONS_Alert(CONS_WARNING, "%s: %s %s differs between the parsers!\n", name, differs, sizeu1(num));
+
+	P_FreeTextmapResult(&ref);
+	P_FreeTextmapResult(&cur);
+	return !differs;
+}
+
+// Made up TEXTMAPs, using every key the parsers know in every block type,
+// with the spacing and comments between tokens varied
+static struct
+{
+	char *data;
+	size_t len, max;
+	UINT32 seed;
+} textmapgen;
+
+static UINT32 P_TextmapGenRandom(UINT32 range)
+{
+	textmapgen.seed = textmapgen.seed * 1103515245 + 12345;
+	return (textmapgen.seed >> 8) % range;
+}
+
+static void P_TextmapGenPut(const char *s)
+{
+	const size_t len = strlen(s);
+
+	if (textmapgen.len + len + 1 > textmapgen.max)
 	{
-		if (!!(lines[i].flags & ML_DONTPEGBOTTOM) ^ !!(lines[i].flags & ML_MIDPEG))
-			lines[i].flags |= ML_MIDPEG;
-		else
-			lines[i].flags &= ~ML_MIDPEG;
+		textmapgen.max = max(textmapgen.max * 2, textmapgen.len + len + 1);
+		textmapgen.data = realloc(textmapgen.data, textmapgen.max);
+		if (!textmapgen.data)
+			I_Error("Command_TextmapBench_f: No more memory\n");
+	}
 
-		if (lines[i].special >= 100 && lines[i].special < 300)
-		{
-			if (lines[i].flags & ML_DONTPEGTOP)
-				lines[i].flags |= ML_SKEWTD;
-			else
-				lines[i].flags &= ~ML_SKEWTD;
+	memcpy(textmapgen.data + textmapgen.len, s, len + 1);
+	textmapgen.len += len;
+}
 
-			if ((lines[i].flags & ML_TFERLINE) && lines[i].frontsector)
-			{
-				size_t j;
+static void P_TextmapGenSpace(void)
+{
+	static const char *const spaces[] = {
+		" ", " ", " ", "\n", "\t", "\r\n", "\n\n\t", " /* a { comment } */ ", " // a comment\n", "/**/"
+	};
+	P_TextmapGenPut(spaces[P_TextmapGenRandom(sizeof (spaces) / sizeof (*spaces))]);
+}
 
-				for (j = 0; j < lines[i].frontsector->linecount; j++)
-				{
-					if (lines[i].frontsector->lines[j]->flags & ML_DONTPEGTOP)
-						lines[i].frontsector->lines[j]->flags |= ML_SKEWTD;
-					else
-						lines[i].frontsector->lines[j]->flags &= ~ML_SKEWTD;
-				}
+static void P_TextmapGenPair(const char *key, const char *val)
+{
+	static const char *const equals[] = {" = ", "=", " =\t", "= "};
+
+	P_TextmapGenPut(key);
+	P_TextmapGenPut(equals[P_TextmapGenRandom(sizeof (equals) / sizeof (*equals))]);
+	P_TextmapGenPut(val);
+	P_TextmapGenPut(";");
+	P_TextmapGenSpace();
+}
+
+static const char *P_TextmapGenPick(const char *const *list, size_t count)
+{
+	return list[P_TextmapGenRandom((UINT32)count)];
+}
+#define PICK(list) P_TextmapGenPick(list, sizeof (list) / sizeof (*list))
+
+static const char *P_TextmapGenValue(textmapkey_t key, size_t nv, size_t ns, size_t nd)
+{
+	static const char *const texturenames[] = {"\"-\"", "\"GFZROCK\"", "\"GFZFLR01\"", "\"GFZWALL\"", "\"F_SKY1\"", "\"NOTATEXTURE\""};
+	static const char *const damagetypes[] = {"\"Generic\"", "\"Water\"", "\"Fire\"", "\"Lava\"", "\"Spike\"", "\"DeathPitTilt\"", "\"Instakill\"", "\"Unknown\""};
+	static const char *const triggerers[] = {"\"Player\"", "\"AllPlayers\"", "\"Mobj\"", "\"Unknown\""};
+	static const char *const blendmodes[] = {"\"translucent\"", "\"add\"", "\"subtract\"", "\"reversesubtract\"", "\"modulate\"", "\"fog\""};
+	static const char *const planes[] = {"0.0", "0.25", "-0.5", "1.0", "16"};
+	static const char *const colors[] = {"0", "16711680"};
+	static const char *const alphas[] = {"25", "10"};
+
+	switch (key)
+	{
+		case TMK_V1: case TMK_V2:
+			return va("%u", P_TextmapGenRandom((UINT32)nv));
+		case TMK_SIDEFRONT: case TMK_SIDEBACK:
+			return va("%u", P_TextmapGenRandom((UINT32)nd));
+		case TMK_SECTOR:
+			return va("%u", P_TextmapGenRandom((UINT32)ns));
+		case TMK_TEXTUREFLOOR: case TMK_TEXTURECEILING:
+		case TMK_TEXTURETOP: case TMK_TEXTUREBOTTOM: case TMK_TEXTUREMIDDLE:
+			return PICK(texturenames);
+		case TMK_MOREIDS:
+			return va("\"%u %u\"", P_TextmapGenRandom(100), P_TextmapGenRandom(100));
+		case TMK_DAMAGETYPE:
+			return PICK(damagetypes);
+		case TMK_TRIGGERER:
+			return PICK(triggerers);
+		case TMK_BLENDMODE: case TMK_RENDERSTYLE:
+			return PICK(blendmodes);
+		case TMK_FLOORPLANE_C: case TMK_CEILINGPLANE_C:
+			return P_TextmapGenRandom(2) ? "1.0" : "-2.0";
+		case TMK_FLOORPLANE_A: case TMK_FLOORPLANE_B: case TMK_FLOORPLANE_D:
+		case TMK_CEILINGPLANE_A: case TMK_CEILINGPLANE_B: case TMK_CEILINGPLANE_D:
+			return PICK(planes);
+		// Few enough that the colormaps made stay few
+		case TMK_LIGHTCOLOR: case TMK_FADECOLOR:
+			return PICK(colors);
+		case TMK_LIGHTALPHA: case TMK_FADEALPHA:
+			return PICK(alphas);
+		case TMK_FADESTART:
+			return "0";
+		case TMK_FADEEND:
+			return "31";
+		default:
+			switch (P_TextmapGenRandom(5))
+			{
+				case 0: return P_TextmapGenRandom(2) ? "true" : "false";
+				case 1: return va("%d.%02u", (INT32)P_TextmapGenRandom(2000) - 1000, P_TextmapGenRandom(100));
+				case 2: return va("\"some text %u\"", P_TextmapGenRandom(100));
+				default: return va("%d", (INT32)P_TextmapGenRandom(2000) - 1000);
 			}
+	}
+}
+#undef PICK
+
+static void P_TextmapGenBlock(INT32 type, size_t nv, size_t ns, size_t nd)
+{
+	UINT32 extra = P_TextmapGenRandom(8);
+
+	P_TextmapGenPut(textmapblocknames[type]);
+	P_TextmapGenSpace();
+	P_TextmapGenPut("{");
+	P_TextmapGenSpace();
+
+	// What P_LoadTextmap can't do without
+	switch (type)
+	{
+		case TEXTMAP_VERTEX:
+			P_TextmapGenPair("x", P_TextmapGenValue(TMK_X, nv, ns, nd));
+			P_TextmapGenPair("y", P_TextmapGenValue(TMK_Y, nv, ns, nd));
+			break;
+		case TEXTMAP_LINEDEF:
+			P_TextmapGenPair("v1", P_TextmapGenValue(TMK_V1, nv, ns, nd));
+			P_TextmapGenPair("v2", P_TextmapGenValue(TMK_V2, nv, ns, nd));
+			P_TextmapGenPair("sidefront", P_TextmapGenValue(TMK_SIDEFRONT, nv, ns, nd));
+			break;
+		case TEXTMAP_SIDEDEF:
+			P_TextmapGenPair("sector", P_TextmapGenValue(TMK_SECTOR, nv, ns, nd));
+			break;
+	}
+
+	while (extra--)
+	{
+		textmapkey_t key = TMK_NONE;
+		char name[32]; // not in va's buffer, which the value is about to use
+
+		switch (P_TextmapGenRandom(10))
+		{
+			case 0:
+				snprintf(name, sizeof (name), "arg%u", P_TextmapGenRandom(12));
+				break;
+			case 1:
+				snprintf(name, sizeof (name), "stringarg%u", P_TextmapGenRandom(3));
+				break;
+			case 2:
+				strlcpy(name, "comment", sizeof (name));
+				break;
+			default:
+				key = P_TextmapGenRandom(NUMTEXTMAPKEYS);
+				strlcpy(name, textmapkeynames[key], sizeof (name));
+				break;
 		}
 
+		P_TextmapGenPair(name, P_TextmapGenValue(key, nv, ns, nd));
 	}
+
+	P_TextmapGenPut("}");
+	P_TextmapGenSpace();
 }
 
-//For maps in binary format, converts setup of specials to UDMF format.
-static void P_ConvertBinaryMap(void)
+static void P_TextmapGenerate(void)
 {
-	contextdrift = false;
-	P_ConvertBinaryLinedefTypes();
-	P_ConvertBinarySectorTypes();
-	P_ConvertBinaryThingTypes();
-	P_ConvertBinaryLinedefFlags();
-	if (M_CheckParm("-writetextmap"))
-		P_WriteTextmap();
+	size_t left[NUMTEXTMAPBLOCKS], total = 0;
+	size_t nv, ns, nd;
+	INT32 type;
+
+	left[TEXTMAP_VERTEX] = nv = 3 + P_TextmapGenRandom(300);
+	left[TEXTMAP_SECTOR] = ns = 1 + P_TextmapGenRandom(60);
+	left[TEXTMAP_SIDEDEF] = nd = 1 + P_TextmapGenRandom(300);
+	left[TEXTMAP_LINEDEF] = 1 + P_TextmapGenRandom(300);
+	left[TEXTMAP_THING] = P_TextmapGenRandom(150);
+
+	for (type = 0; type < NUMTEXTMAPBLOCKS; type++)
+		total += left[type];
+
+	textmapgen.len = 0;
+	P_TextmapGenPut("namespace = \"srb2\";\n");
+
+	// The blocks of each type in order, but the types mixed together
+	while (total--)
+	{
+		do
+			type = P_TextmapGenRandom(NUMTEXTMAPBLOCKS);
+		while (!left[type]);
+
+		left[type]--;
+		P_TextmapGenBlock(type, nv, ns, nd);
+	}
 }
 
-/** Compute MD5 message digest for bytes read from memory source
-  *
-  * The resulting message digest number will be written into the 16 bytes
-  * beginning at RESBLOCK.
-  *
-  * \param filename path of file
-  * \param resblock resulting MD5 checksum
-  * \return 0 if MD5 checksum was made, and is at resblock, 1 if error was found
+/** Checks the TEXTMAP parser against the one it replaced. Every map with a
+  * TEXTMAP in the loaded files, and then the given number of made up ones,
+  * are loaded with both, and what they loaded compared; the times are for
+  * loading the vertices, sectors, sides, lines and things. Nothing else of
+  * the maps is loaded, so this can only be used from the title screen,
+  * and only exists in DEVELOP builds.
+  * Usage: textmapbench [generated lumps] [seed]
   */
-static INT32 P_MakeBufferMD5(const char *buffer, size_t len, void *resblock)
+void Command_TextmapBench_f(void)
 {
-#ifdef NOMD5
-	(void)buffer;
-	(void)len;
-	memset(resblock, 0x00, 16);
-	return 1;
-#else
-	tic_t t = I_GetTime();
-	CONS_Debug(DBG_SETUP, "Making MD5\n");
-	if (md5_buffer(buffer, len, resblock) == NULL)
-		return 1;
-	CONS_Debug(DBG_SETUP, "MD5 calc took %f seconds\n", (float)(I_GetTime() - t)/NEWTICRATE);
-	return 0;
-#endif
-}
+	precise_t realref = 0, realcur = 0, genref = 0, gencur = 0;
+	INT32 numreal = 0, numgen = 100, mismatches = 0, i;
+	textmapresult_t saved;
+	size_t savedbuckets[LEVELFLATBUCKETS], *savednext = NULL, savednextsize = levelflatnextsize;
+	extracolormap_t *savedcolormaps = extra_colormaps, *lastcolormap = extra_colormaps, *exc, *next;
 
-static void P_MakeMapMD5(virtres_t *virt, void *dest)
-{
-	unsigned char resmd5[16];
+	if (!(gamestate == GS_TITLESCREEN || gamestate == GS_NULL) || titlemapinaction)
+	{
+		CONS_Printf(M_GetText("You can't use this while a level is loaded.\n"));
+		return;
+	}
 
-	if (udmf)
+	if (COM_Argc() > 1)
+		numgen = max(atoi(COM_Argv(1)), 0);
+	textmapgen.seed = (COM_Argc() > 2) ? (UINT32)atoi(COM_Argv(2)) : 0x5EED;
+
+	for (i = 0; i < NUMTEXTMAPBLOCKS; i++)
 	{
-		virtlump_t *textmap = vres_Find(virt, "TEXTMAP");
-		P_MakeBufferMD5((char*)textmap->data, textmap->size, resmd5);
+		reftextmappos[i] = malloc(UINT16_MAX * sizeof (*reftextmappos[i]));
+		if (!reftextmappos[i])
+			I_Error("Command_TextmapBench_f: No more memory\n");
 	}
-	else
+
+	if (!textmapkeysready)
+		TextmapInitKeyHash();
+
+	// Loading the maps adds to the flat index and the colormap list,
+	// so keep what was there to put back afterwards.
+	P_GetTextmapResult(&saved);
+	M_Memcpy(savedbuckets, levelflatbuckets, sizeof (savedbuckets));
+	if (savednextsize)
 	{
-		unsigned char linemd5[16];
-		unsigned char sectormd5[16];
-		unsigned char thingmd5[16];
-		unsigned char sidedefmd5[16];
-		UINT8 i;
+		savednext = malloc(savednextsize * sizeof (*savednext));
+		if (!savednext)
+			I_Error("Command_TextmapBench_f: No more memory\n");
+		M_Memcpy(savednext, levelflatnext, savednextsize * sizeof (*savednext));
+	}
+	while (lastcolormap && lastcolormap->next)
+		lastcolormap = lastcolormap->next;
+	textmapbenching = true;
 
-		// Create a hash for the current map
-		// get the actual lumps!
-		virtlump_t* virtlines   = vres_Find(virt, "LINEDEFS");
-		virtlump_t* virtsectors = vres_Find(virt, "SECTORS");
-		virtlump_t* virtmthings = vres_Find(virt, "THINGS");
-		virtlump_t* virtsides   = vres_Find(virt, "SIDEDEFS");
+	for (i = 1; i <= NUMMAPS; i++)
+	{
+		char name[9];
+		lumpnum_t lumpnum;
+		virtres_t *virt;
+		virtlump_t *textmap;
 
-		P_MakeBufferMD5((char*)virtlines->data,   virtlines->size, linemd5);
-		P_MakeBufferMD5((char*)virtsectors->data, virtsectors->size,  sectormd5);
-		P_MakeBufferMD5((char*)virtmthings->data, virtmthings->size,   thingmd5);
-		P_MakeBufferMD5((char*)virtsides->data,   virtsides->size, sidedefmd5);
+		strlcpy(name, G_BuildMapName(i), sizeof (name));
+		lumpnum = W_CheckNumForMap(name);
+		if (lumpnum == LUMPERROR)
+			continue;
 
-		for (i = 0; i < 16; i++)
-			resmd5[i] = (linemd5[i] + sectormd5[i] + thingmd5[i] + sidedefmd5[i]) & 0xFF;
+		virt = vres_GetMap(lumpnum);
+		textmap = vres_Find(virt, "TEXTMAP");
+		if (textmap && textmap->size)
+		{
+			precise_t ref = 0, cur = 0;
+
+			if (!P_BenchTextmap(name, textmap->data, textmap->size, &ref, &cur))
+				mismatches++;
+
+			CONS_Printf("%s: %d us, was %d us\n", name,
+				(int)(cur * 1000000 / I_GetPrecisePrecision()), (int)(ref * 1000000 / I_GetPrecisePrecision()));
+			realref += ref;
+			realcur += cur;
+			numreal++;
+		}
+		vres_Free(virt);
 	}
 
-	M_Memcpy(dest, &resmd5, 16);
+	for (i = 0; i < numgen; i++)
+	{
+		char name[32];
+
+		snprintf(name, sizeof (name), "Generated lump %d", i);
+		P_TextmapGenerate();
+		if (!P_BenchTextmap(name, (UINT8 *)textmapgen.data, textmapgen.len, &genref, &gencur))
+			mismatches++;
+	}
+
+	textmapbenching = false;
+	P_SetTextmapResult(&saved);
+
+	M_Memcpy(levelflatbuckets, savedbuckets, sizeof (savedbuckets));
+	if (savednext)
+	{
+		M_Memcpy(levelflatnext, savednext, savednextsize * sizeof (*savednext));
+		free(savednext);
+	}
+
+#ifdef COLORMAPREVERSELIST
+	for (exc = extra_colormaps; exc && exc != savedcolormaps; exc = next)
+#else
+	for (exc = lastcolormap ? lastcolormap->next : extra_colormaps; exc; exc = next)
+#endif
+	{
+		next = exc->next;
+		if (exc->colormap)
+			Z_Free(exc->colormap);
+		Z_Free(exc);
+	}
+#ifdef COLORMAPREVERSELIST
+	if (savedcolormaps)
+		savedcolormaps->prev = NULL;
+#else
+	if (lastcolormap)
+		lastcolormap->next = NULL;
+#endif
+	extra_colormaps = savedcolormaps;
+
+	free(textmapgen.data);
+	memset(&textmapgen, 0, sizeof (textmapgen));
+	for (i = 0; i < NUMTEXTMAPBLOCKS; i++)
+	{
+		free(reftextmappos[i]);
+		reftextmappos[i] = NULL;
+	}
+
+	CONS_Printf("%d real lumps:      %d us, was %d us (%.2fx)\n", numreal,
+		(int)(realcur * 1000000 / I_GetPrecisePrecision()), (int)(realref * 1000000 / I_GetPrecisePrecision()),
+		realcur ? (double)realref / realcur : 0.0);
+	CONS_Printf("%d generated lumps: %d us, was %d us (%.2fx)\n", numgen,
+		(int)(gencur * 1000000 / I_GetPrecisePrecision()), (int)(genref * 1000000 / I_GetPrecisePrecision()),
+		gencur ? (double)genref / gencur : 0.0);
+	if (mismatches)
+		CONS_Alert(CONS_WARNING, "%d lumps loaded differently!\n", mismatches);
 }
+#endif
 
 static boolean P_LoadMapFromFile(void)
 {
 	virtres_t *virt = vres_GetMap(lastloadedmaplumpnum);
 	virtlump_t *textmap = vres_Find(virt, "TEXTMAP");
 	size_t i;
+#ifdef HAVE_THREADS
+	I_job md5job = NULL;
+#endif
 	udmf = textmap != NULL;
 
+	memset(maploadtimes, 0, sizeof (maploadtimes));
+	memset(&bmapbuild, 0, sizeof (bmapbuild));
+	mapmd5time = 0;
+	maploadmark = I_GetPreciseTime();
+
 	if (!P_LoadMapData(virt))
 		return false;
+	P_MarkLoadTime(LOADTIME_MAPDATA);
+
+	// Nothing below touches the raw lumps, so they can be hashed alongside
+#ifdef HAVE_THREADS
+	if (I_worker_count())
+		md5job = I_schedule_job(P_MapMD5Job, virt, NULL, 0);
+#endif
+
 	P_LoadMapBSP(virt);
+	P_MarkLoadTime(LOADTIME_BSP);
 	P_LoadMapLUT(virt);
+	P_MarkLoadTime(LOADTIME_LUT);
 
 	P_LinkMapData();
+	P_MarkLoadTime(LOADTIME_LINK);
 
 	if (!udmf)
 		P_AddBinaryMapTags();
@@ -6992,8 +9147,15 @@ static boolean P_LoadMapFromFile(void)
 	for (i = 0; i < numsectors; i++)
 		if (sectors[i].tags.count)
 			spawnsectors[i].tags.tags = memcpy(Z_Malloc(sectors[i].tags.count*sizeof(mtag_t), PU_LEVEL, NULL), sectors[i].tags.tags, sectors[i].tags.count*sizeof(mtag_t));
+	P_MarkLoadTime(LOADTIME_CONVERT);
 
-	P_MakeMapMD5(virt, &mapmd5);
+#ifdef HAVE_THREADS
+	if (md5job)
+		I_wait_job(md5job);
+	else
+#endif
+		P_MapMD5Job(virt);
+	P_MarkLoadTime(LOADTIME_MD5);
 
 	vres_Free(virt);
 	return true;
@@ -7838,6 +10000,7 @@ boolean P_LoadLevel(boolean fromnetsave, boolean reloadinggamestate)
 	Patch_FreeTag(PU_PATCH_LOWPRIORITY);
 	Patch_FreeTag(PU_PATCH_ROTATED);
 	Z_FreeTags(PU_LEVEL, PU_PURGELEVEL - 1);
+	P_InitMobjPools();
 
 	R_InitializeLevelInterpolators();
 
@@ -7872,8 +10035,14 @@ boolean P_LoadLevel(boolean fromnetsave, boolean reloadinggamestate)
 	P_InitSpecials();
 
 	P_SpawnSlopes(fromnetsave);
+	P_MarkLoadTime(LOADTIME_SLOPES);
+
+	// Nothing before this needs the blockmap
+	P_FinishBlockMap();
+	P_MarkLoadTime(LOADTIME_BLOCKMAP);
 
 	P_SpawnMapThings(!fromnetsave);
+	P_MarkLoadTime(LOADTIME_THINGS);
 	skyboxmo[0] = skyboxviewpnts[0];
 	skyboxmo[1] = skyboxcenterpnts[0];
 
@@ -7883,6 +10052,11 @@ boolean P_LoadLevel(boolean fromnetsave, boolean reloadinggamestate)
 
 	// set up world state
 	P_SpawnSpecials(fromnetsave);
+	P_MarkLoadTime(LOADTIME_SPECIALS);
+
+	// after the polyobjects, which it has to leave out
+	P_BuildSightPVS();
+	P_MarkLoadTime(LOADTIME_SIGHT);
 
 	if (!fromnetsave) //  ugly hack for P_NetUnArchiveMisc (and P_LoadNetGame)
 		P_SpawnPrecipitation();
@@ -99,6 +99,10 @@ void P_ScanThings(INT16 mapnum, INT16 wadnum, INT16 lumpnum);
 #endif
 void P_RespawnThings(void);
 boolean P_LoadLevel(boolean fromnetsave, boolean reloadinggamestate);
+void Command_MapLoadTime_f(void);
+#ifdef DEVELOP
+void Command_TextmapBench_f(void);
+#endif
 #ifdef HWRENDER
 void HWR_LoadLevel(void);
 #endif
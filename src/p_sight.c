@@ -17,6 +17,15 @@
 #include "p_slopes.h"
 #include "r_main.h"
 #include "r_state.h"
+#include "d_main.h" // srb2home
+#include "i_system.h"
+#include "i_threads.h"
+#include "m_misc.h"
+#include "p_setup.h" // mapmd5
+#include "byteptr.h"
+#include "lzf.h"
+#include "lua_hud.h" // hud_running
+#include "z_zone.h"
 
 //
 // P_CheckSight
@@ -31,7 +40,7 @@ typedef struct {
 	fixed_t bbox[4];
 } los_t;
 
-static INT32 sightcounts[2];
+INT32 sightcounts[NUMSIGHTCOUNTS];
 
 //
 // P_DivlineSide
@@ -372,50 +381,681 @@ static boolean P_CrossBSPNode(INT32 bspnum, register los_t *los)
 }
 
 //
-// P_CheckSight
+// Sight memo
 //
-// Returns true if a straight line between t1 and t2 is unobstructed.
-// Uses REJECT.
+// The same pair is often checked more than once in a tic, by different
+// actions of the same object or by both objects looking at each other.
+// Entries only match if neither object has moved at all, and the memo is
+// forgotten at the start of every tic, and whenever planes, FOFs, slopes
+// or polyobjects change (see P_InvalidateSightMemo).
 //
-boolean P_CheckSight(mobj_t *t1, mobj_t *t2)
+
+#define SIGHTMEMOSIZE 1024
+
+typedef struct
 {
-	const sector_t *s1, *s2;
-	size_t pnum;
-	los_t los;
+	mobj_t *t1, *t2;
+	subsector_t *ss1, *ss2;
+	fixed_t x1, y1, z1, h1;
+	fixed_t x2, y2, z2, h2;
+	UINT32 tic;
+	boolean visible;
+} sightmemo_t;
+
+static sightmemo_t sightmemo[SIGHTMEMOSIZE];
+static UINT32 sightmemotic = 1;
+
+// Slots come from the objects' positions and types rather than their
+// addresses, so which entries collide is the same on every machine.
+// An entry can only match while neither object moves anyway.
+static inline sightmemo_t *P_SightMemoSlot(const mobj_t *t1, const mobj_t *t2)
+{
+	UINT32 h = (UINT32)t1->x ^ ((UINT32)t1->y * 31) ^ ((UINT32)t1->z * 961) ^ (UINT32)t1->type;
+	h = h * 2654435761u ^ (UINT32)t2->x ^ ((UINT32)t2->y * 31) ^ ((UINT32)t2->z * 961) ^ ((UINT32)t2->type << 16);
+	h *= 2654435761u;
+	return &sightmemo[(h >> 16) & (SIGHTMEMOSIZE-1)];
+}
 
-	// First check for trivial rejection.
-	if (!t1 || !t2)
+static inline boolean P_SightMemoMatches(const sightmemo_t *m, const mobj_t *t1, const mobj_t *t2)
+{
+	return m->tic == sightmemotic && m->t1 == t1 && m->t2 == t2
+		&& m->ss1 == t1->subsector && m->ss2 == t2->subsector
+		&& m->x1 == t1->x && m->y1 == t1->y && m->z1 == t1->z && m->h1 == t1->height
+		&& m->x2 == t2->x && m->y2 == t2->y && m->z2 == t2->z && m->h2 == t2->height;
+}
+
+static inline void P_SightMemoStore(sightmemo_t *m, mobj_t *t1, mobj_t *t2, boolean visible)
+{
+	m->tic = sightmemotic;
+	m->t1 = t1;
+	m->t2 = t2;
+	m->ss1 = t1->subsector;
+	m->ss2 = t2->subsector;
+	m->x1 = t1->x; m->y1 = t1->y; m->z1 = t1->z; m->h1 = t1->height;
+	m->x2 = t2->x; m->y2 = t2->y; m->z2 = t2->z; m->h2 = t2->height;
+	m->visible = visible;
+}
+
+//
+// P_StartSightTic
+//
+// Forgets the memo and the counts from the previous tic.
+//
+void P_StartSightTic(void)
+{
+	memset(sightcounts, 0, sizeof sightcounts);
+	sightmemotic++;
+}
+
+//
+// P_InvalidateSightMemo
+//
+// Forgets the memo mid-tic. Call after changing anything a sight trace
+// looks at, other than the two objects themselves.
+//
+void P_InvalidateSightMemo(void)
+{
+	sightmemotic++;
+}
+
+//
+// Potentially visible sets
+//
+// Built once per map after the polyobjects are spawned. Each sector gets a
+// row of bits saying which sectors a straight line out of it could reach
+// through two-sided lines, ignoring heights. Flow starts at each portal of
+// the source sector and only continues into portals that still lie inside
+// the region a line through the source portal and the last portal can
+// sweep, so anything behind a solid wall is left out.
+//
+// Every test keeps a map unit of slack on the keep side, so rounding can
+// only ever make a row bigger. Sectors that the model cannot describe -
+// unclosed sectors, lines without segs, polyobjects - see everything.
+//
+
+#define PVSCACHEVERSION 1
+#define PVSMAXSECTORS 8192 // 8 MB of bits; leave anything bigger to REJECT
+#define PVSMAXDEPTH 256
+#define PVSWORKLIMIT (1<<15) // clips per source sector before falling back to a flood
+#define PVSEPSILON 1.0
+
+static UINT8 *sightpvs;
+static size_t pvsrowbytes;
+
+typedef struct
+{
+	double nx, ny, d; // keeps points where nx*x + ny*y >= d
+} pvsplane_t;
+
+typedef struct
+{
+	double x1, y1, x2, y2;
+} pvsseg_t;
+
+// One side of a portal, as seen from the sector it leads out of
+typedef struct
+{
+	UINT32 portal;
+	UINT32 to;
+	pvsplane_t beyond; // the side that "to" is on
+} pvsref_t;
+
+typedef struct
+{
+	UINT32 sector;
+	UINT32 next; // next ref of sector to try
+	UINT32 portal; // came in through this
+	pvsseg_t pass;
+	pvsplane_t passfar;
+	pvsplane_t seps[4];
+	UINT8 numseps;
+} pvsframe_t;
+
+static struct
+{
+	size_t numsectors;
+	pvsseg_t *portals;
+	pvsref_t *refs;
+	UINT32 *refstart; // [numsectors+1]
+	UINT8 *leaky;
+	UINT8 *rows;
+	boolean outofmemory; // set by PVS_BuildRows, checked once it is done
+} pvs;
+
+// Keeps the part of seg on the kept side of plane. Returns false if
+// nothing is left.
+static boolean PVS_Clip(pvsseg_t *seg, const pvsplane_t *plane)
+{
+	const double d1 = plane->nx*seg->x1 + plane->ny*seg->y1 - plane->d + PVSEPSILON;
+	const double d2 = plane->nx*seg->x2 + plane->ny*seg->y2 - plane->d + PVSEPSILON;
+	double frac;
+
+	if (d1 >= 0 && d2 >= 0)
+		return true;
+	if (d1 < 0 && d2 < 0)
 		return false;
 
-	I_Assert(!P_MobjWasRemoved(t1));
-	I_Assert(!P_MobjWasRemoved(t2));
+	frac = d1 / (d1 - d2);
+	if (d1 < 0)
+	{
+		seg->x1 += frac * (seg->x2 - seg->x1);
+		seg->y1 += frac * (seg->y2 - seg->y1);
+	}
+	else
+	{
+		seg->x2 = seg->x1 + frac * (seg->x2 - seg->x1);
+		seg->y2 = seg->y1 + frac * (seg->y2 - seg->y1);
+	}
+	return true;
+}
 
-	if (!t1->subsector || !t2->subsector
-	|| !t1->subsector->sector || !t2->subsector->sector)
+// Finds the lines through an end of src and an end of pass that have the
+// rest of src and the rest of pass on opposite sides. Anything seen from
+// src through pass is on pass's side of all of them.
+static UINT8 PVS_Separators(const pvsseg_t *src, const pvsseg_t *pass, pvsplane_t *seps)
+{
+	const double sx[2] = {src->x1, src->x2}, sy[2] = {src->y1, src->y2};
+	const double px[2] = {pass->x1, pass->x2}, py[2] = {pass->y1, pass->y2};
+	UINT8 i, j, n = 0;
+
+	for (i = 0; i < 2; i++)
+		for (j = 0; j < 2; j++)
+		{
+			const double dx = px[j] - sx[i], dy = py[j] - sy[i];
+			const double len = sqrt(dx*dx + dy*dy);
+			double nx, ny, d, so, po;
+
+			if (len < 1e-6)
+				continue;
+
+			nx = -dy / len;
+			ny = dx / len;
+			d = nx*sx[i] + ny*sy[i];
+			so = nx*sx[i^1] + ny*sy[i^1] - d;
+			po = nx*px[j^1] + ny*py[j^1] - d;
+
+			// Only a true separator if the other ends straddle it.
+			// Anything close to the line is skipped rather than guessed.
+			if (!((so < -PVSEPSILON && po > PVSEPSILON) || (so > PVSEPSILON && po < -PVSEPSILON)))
+				continue;
+
+			if (po < 0)
+				nx = -nx, ny = -ny, d = -d;
+
+			seps[n].nx = nx;
+			seps[n].ny = ny;
+			seps[n].d = d;
+			n++;
+		}
+
+	return n;
+}
+
+// Marks every sector connected to source at all. Used when the clipped flow
+// gives up, so the row is still safe to reject with.
+static void PVS_Flood(size_t source, UINT8 *row, UINT32 *queue)
+{
+	size_t head = 0, tail = 0;
+
+	memset(row, 0, pvsrowbytes);
+	row[source>>3] |= 1 << (source&7);
+	queue[tail++] = (UINT32)source;
+
+	while (head < tail)
+	{
+		const UINT32 s = queue[head++];
+		UINT32 r;
+
+		for (r = pvs.refstart[s]; r < pvs.refstart[s+1]; r++)
+		{
+			const UINT32 to = pvs.refs[r].to;
+
+			if (row[to>>3] & (1 << (to&7)))
+				continue;
+
+			if (pvs.leaky[to])
+			{
+				memset(row, 0xff, pvsrowbytes);
+				return;
+			}
+
+			row[to>>3] |= 1 << (to&7);
+			queue[tail++] = to;
+		}
+	}
+}
+
+// Fills in the row for one sector. Returns false if it ran out of work or
+// stack, in which case the row is unfinished.
+static boolean PVS_FlowSector(size_t source, UINT8 *row, UINT8 *onstack, pvsframe_t *stack)
+{
+	size_t work = 0;
+	UINT32 r;
+
+	memset(row, 0, pvsrowbytes);
+	row[source>>3] |= 1 << (source&7);
+
+	for (r = pvs.refstart[source]; r < pvs.refstart[source+1]; r++)
+	{
+		const pvsref_t *first = &pvs.refs[r];
+		const pvsseg_t *src = &pvs.portals[first->portal];
+		size_t depth = 1;
+
+		row[first->to>>3] |= 1 << (first->to&7);
+		if (pvs.leaky[first->to])
+		{
+			memset(row, 0xff, pvsrowbytes);
+			return true;
+		}
+
+		stack[0].sector = first->to;
+		stack[0].next = pvs.refstart[first->to];
+		stack[0].portal = first->portal;
+		stack[0].pass = *src;
+		stack[0].passfar = first->beyond;
+		stack[0].numseps = 0;
+		onstack[first->portal] = 1;
+
+		while (depth)
+		{
+			pvsframe_t *f = &stack[depth-1];
+			const pvsref_t *q;
+			pvsseg_t seg;
+			UINT8 i;
+
+			if (f->next == pvs.refstart[f->sector+1])
+			{
+				onstack[f->portal] = 0;
+				depth--;
+				continue;
+			}
+
+			q = &pvs.refs[f->next++];
+			if (onstack[q->portal])
+				continue;
+
+			if (++work > PVSWORKLIMIT)
+				goto giveup;
+
+			seg = pvs.portals[q->portal];
+			if (!PVS_Clip(&seg, &first->beyond) || !PVS_Clip(&seg, &f->passfar))
+				continue;
+			for (i = 0; i < f->numseps; i++)
+				if (!PVS_Clip(&seg, &f->seps[i]))
+					break;
+			if (i < f->numseps)
+				continue;
+
+			row[q->to>>3] |= 1 << (q->to&7);
+			if (pvs.leaky[q->to])
+			{
+				memset(row, 0xff, pvsrowbytes);
+				for (; depth; depth--)
+					onstack[stack[depth-1].portal] = 0;
+				return true;
+			}
+
+			if (depth == PVSMAXDEPTH)
+				goto giveup;
+
+			f = &stack[depth++];
+			f->sector = q->to;
+			f->next = pvs.refstart[q->to];
+			f->portal = q->portal;
+			f->pass = seg;
+			f->passfar = q->beyond;
+			f->numseps = PVS_Separators(src, &seg, f->seps);
+			onstack[q->portal] = 1;
+		}
+		continue;
+
+giveup:
+		for (; depth; depth--)
+			onstack[stack[depth-1].portal] = 0;
 		return false;
+	}
 
-	s1 = t1->subsector->sector;
-	s2 = t2->subsector->sector;
-	pnum = (s1-sectors)*numsectors + (s2-sectors);
+	return true;
+}
 
-	if (rejectmatrix != NULL)
+// Also runs on the job workers, so it only touches pvs and malloc, and
+// leaves reporting failure to P_BuildSightPVS.
+static void PVS_BuildRows(size_t start, size_t end, void *userdata)
+{
+	UINT8 *onstack = calloc(pvs.refstart[pvs.numsectors] / 2 + 1, 1);
+	pvsframe_t *stack = malloc(PVSMAXDEPTH * sizeof (*stack));
+	UINT32 *queue = malloc(pvs.numsectors * sizeof (*queue));
+	size_t i;
+
+	(void)userdata;
+
+	if (!onstack || !stack || !queue)
 	{
-		// Check in REJECT table.
-		if (rejectmatrix[pnum>>3] & (1 << (pnum&7))) // can't possibly be connected
-			return false;
+		// Everything visible is always correct, just slower
+		memset(pvs.rows + start*pvsrowbytes, 0xff, (end - start) * pvsrowbytes);
+		pvs.outofmemory = true;
+		free(onstack);
+		free(stack);
+		free(queue);
+		return;
 	}
 
-	// killough 11/98: shortcut for melee situations
-	// same subsector? obviously visible
-	// haleyjd 02/23/06: can't do this if there are polyobjects in the subsec
-	if (!t1->subsector->polyList &&
-		t1->subsector == t2->subsector)
-		return true;
+	for (i = start; i < end; i++)
+	{
+		UINT8 *row = pvs.rows + i*pvsrowbytes;
+
+		if (pvs.leaky[i])
+			memset(row, 0xff, pvsrowbytes);
+		else if (!PVS_FlowSector(i, row, onstack, stack))
+			PVS_Flood(i, row, queue);
+	}
+
+	free(onstack);
+	free(stack);
+	free(queue);
+}
+
+// Works out which sectors the flow can't model and lists the portals.
+// Returns a hash of everything the rows depend on.
+static UINT32 PVS_Prepare(void)
+{
+	UINT8 *hasseg = calloc(numlines, 1);
+	INT32 *winding = calloc(numvertexes, sizeof (*winding));
+	UINT32 *numrefs;
+	UINT32 hash = 2166136261u;
+	size_t i, j, numportals = 0;
+
+#define HASH(v) (hash = (hash ^ (UINT32)(v)) * 16777619u)
+
+	pvs.numsectors = numsectors;
+	pvs.leaky = calloc(numsectors, 1);
+	pvs.refstart = calloc(numsectors + 1, sizeof (*pvs.refstart));
+	if (!hasseg || !winding || !pvs.leaky || !pvs.refstart)
+		I_Error("PVS_Prepare: out of memory");
+
+	// P_CrossSubsector only ever looks at lines through their segs
+	for (i = 0; i < numsegs; i++)
+		if (!segs[i].glseg && segs[i].linedef)
+			hasseg[segs[i].linedef - lines] = 1;
+
+	HASH(numsectors);
+	HASH(numlines);
+
+	for (i = 0; i < numlines; i++)
+	{
+		const line_t *ld = &lines[i];
+		const boolean twosided = (ld->flags & ML_TWOSIDED) != 0;
+
+		HASH(ld->v1->x); HASH(ld->v1->y);
+		HASH(ld->v2->x); HASH(ld->v2->y);
+		HASH(ld->frontsector ? (UINT32)(ld->frontsector - sectors) : UINT32_MAX);
+		HASH(ld->backsector ? (UINT32)(ld->backsector - sectors) : UINT32_MAX);
+		HASH(twosided | (ld->polyobj != NULL)<<1 | hasseg[i]<<2);
+
+		if (ld->polyobj || !hasseg[i] || (twosided && (!ld->frontsector || !ld->backsector)))
+		{
+			if (ld->frontsector)
+				pvs.leaky[ld->frontsector - sectors] = 1;
+			if (ld->backsector)
+				pvs.leaky[ld->backsector - sectors] = 1;
+			continue;
+		}
+
+		if (twosided && ld->frontsector != ld->backsector)
+		{
+			pvs.refstart[ld->frontsector - sectors]++;
+			pvs.refstart[ld->backsector - sectors]++;
+			numportals++;
+		}
+	}
+
+	// A sector whose sides don't join up into loops has holes that a
+	// trace can walk through without crossing a line.
+	for (i = 0; i < numsectors; i++)
+	{
+		const sector_t *sec = &sectors[i];
+
+		if (pvs.leaky[i])
+			continue;
+
+		for (j = 0; j < sec->linecount; j++)
+		{
+			const line_t *ld = sec->lines[j];
+			if (ld->frontsector == sec)
+				winding[ld->v1 - vertexes]++, winding[ld->v2 - vertexes]--;
+			if (ld->backsector == sec)
+				winding[ld->v2 - vertexes]++, winding[ld->v1 - vertexes]--;
+		}
+
+		for (j = 0; j < sec->linecount; j++)
+		{
+			const line_t *ld = sec->lines[j];
+			if (winding[ld->v1 - vertexes] || winding[ld->v2 - vertexes])
+				pvs.leaky[i] = 1;
+			winding[ld->v1 - vertexes] = winding[ld->v2 - vertexes] = 0;
+		}
+	}
+
+	for (i = 0; i < numsectors; i++)
+		HASH(pvs.leaky[i]);
+
+	// Counts to offsets
+	for (i = 0, j = 0; i <= numsectors; i++)
+	{
+		const UINT32 n = pvs.refstart[i];
+		pvs.refstart[i] = (UINT32)j;
+		j += n;
+	}
+
+	pvs.portals = malloc((numportals + 1) * sizeof (*pvs.portals));
+	pvs.refs = malloc((2*numportals + 1) * sizeof (*pvs.refs));
+	numrefs = calloc(numsectors, sizeof (*numrefs));
+	if (!pvs.portals || !pvs.refs || !numrefs)
+		I_Error("PVS_Prepare: out of memory");
+
+	for (i = 0, numportals = 0; i < numlines; i++)
+	{
+		const line_t *ld = &lines[i];
+		pvsseg_t *seg;
+		pvsplane_t back;
+		pvsref_t *ref;
+		size_t front, rear;
+		double len;
+
+		if (!(ld->flags & ML_TWOSIDED) || ld->polyobj || !hasseg[i]
+			|| !ld->frontsector || !ld->backsector || ld->frontsector == ld->backsector)
+			continue;
+
+		seg = &pvs.portals[numportals];
+		seg->x1 = (double)ld->v1->x / FRACUNIT;
+		seg->y1 = (double)ld->v1->y / FRACUNIT;
+		seg->x2 = (double)ld->v2->x / FRACUNIT;
+		seg->y2 = (double)ld->v2->y / FRACUNIT;
+
+		// The front sector is on the right going from v1 to v2
+		len = sqrt((seg->x2 - seg->x1)*(seg->x2 - seg->x1) + (seg->y2 - seg->y1)*(seg->y2 - seg->y1));
+		if (len < 1e-6)
+			len = 1e-6;
+		back.nx = (seg->y1 - seg->y2) / len;
+		back.ny = (seg->x2 - seg->x1) / len;
+		back.d = back.nx*seg->x1 + back.ny*seg->y1;
+
+		front = ld->frontsector - sectors;
+		rear = ld->backsector - sectors;
+
+		ref = &pvs.refs[pvs.refstart[front] + numrefs[front]++];
+		ref->portal = (UINT32)numportals;
+		ref->to = (UINT32)rear;
+		ref->beyond = back;
+
+		ref = &pvs.refs[pvs.refstart[rear] + numrefs[rear]++];
+		ref->portal = (UINT32)numportals;
+		ref->to = (UINT32)front;
+		ref->beyond.nx = -back.nx;
+		ref->beyond.ny = -back.ny;
+		ref->beyond.d = -back.d;
+
+		numportals++;
+	}
+
+#undef HASH
+
+	free(numrefs);
+	free(winding);
+	free(hasseg);
+	return hash;
+}
+
+static void PVS_Release(void)
+{
+	free(pvs.portals);
+	free(pvs.refs);
+	free(pvs.refstart);
+	free(pvs.leaky);
+	memset(&pvs, 0, sizeof pvs);
+}
+
+static const char *PVS_CacheName(void)
+{
+	char hex[33];
+	size_t i;
+
+	for (i = 0; i < 16; i++)
+		snprintf(&hex[i*2], 3, "%02x", mapmd5[i]);
+
+	return va("%s"PATHSEP"pvs"PATHSEP"%s.pvs", srb2home, hex);
+}
+
+static boolean PVS_LoadCache(UINT32 hash)
+{
+	const size_t size = numsectors * pvsrowbytes;
+	UINT8 *buffer, *p;
+	size_t length;
+	boolean ok = false;
+
+	length = FIL_ReadFile(PVS_CacheName(), &buffer);
+	if (!length)
+		return false;
+
+	p = buffer;
+	if (length >= 28 && !memcmp(p, "SRB2PVS", 8))
+	{
+		UINT32 version, count, filehash, rawsize, compsize;
+
+		p += 8;
+		version = READUINT32(p);
+		count = READUINT32(p);
+		filehash = READUINT32(p);
+		rawsize = READUINT32(p);
+		compsize = READUINT32(p);
+
+		if (version == PVSCACHEVERSION && count == numsectors && filehash == hash && rawsize == size)
+		{
+			if (!compsize)
+			{
+				if (length - 28 >= size)
+				{
+					READMEM(p, sightpvs, size);
+					ok = true;
+				}
+			}
+			else if (length - 28 >= compsize)
+				ok = (lzf_decompress(p, compsize, sightpvs, size) == size);
+		}
+	}
+
+	Z_Free(buffer);
+	return ok;
+}
+
+static void PVS_SaveCache(UINT32 hash)
+{
+	const size_t size = numsectors * pvsrowbytes;
+	UINT8 *buffer = malloc(28 + size), *p;
+	size_t compsize;
+
+	if (!buffer)
+		return;
+
+	p = buffer;
+	WRITEMEM(p, "SRB2PVS", 8);
+	WRITEUINT32(p, PVSCACHEVERSION);
+	WRITEUINT32(p, (UINT32)numsectors);
+	WRITEUINT32(p, hash);
+	WRITEUINT32(p, (UINT32)size);
+
+	// Most rows are long runs of zeroes
+	compsize = lzf_compress(sightpvs, size, p + 4, size - 1);
+	WRITEUINT32(p, (UINT32)compsize);
+	if (!compsize)
+	{
+		memcpy(p, sightpvs, size);
+		compsize = size;
+	}
+
+	I_mkdir(va("%s"PATHSEP"pvs", srb2home), 0755);
+	FIL_WriteFile(PVS_CacheName(), buffer, 28 + compsize);
+	free(buffer);
+}
+
+//
+// P_BuildSightPVS
+//
+// Sets up the sector PVS for the current map, from the cache in srb2home
+// if the map hasn't changed since it was last built.
+//
+void P_BuildSightPVS(void)
+{
+	precise_t t = I_GetPreciseTime();
+	boolean cached;
+	UINT32 hash;
+
+	memset(sightmemo, 0, sizeof sightmemo);
+	sightpvs = NULL;
+
+	if (!numsectors || numsectors > PVSMAXSECTORS)
+		return;
+
+	pvsrowbytes = (numsectors + 7) / 8;
+	hash = PVS_Prepare();
+	Z_Malloc(numsectors * pvsrowbytes, PU_LEVEL, &sightpvs);
+
+	cached = PVS_LoadCache(hash);
+	if (!cached)
+	{
+		pvs.rows = sightpvs;
+		pvs.outofmemory = false;
+
+#ifdef HAVE_THREADS
+		if (I_worker_count())
+			I_parallel_for(numsectors, 16, PVS_BuildRows, NULL);
+		else
+#endif
+			PVS_BuildRows(0, numsectors, NULL);
+
+		if (pvs.outofmemory)
+			CONS_Alert(CONS_WARNING, "P_BuildSightPVS: out of memory, sight checks will be slower\n");
+		else
+			PVS_SaveCache(hash);
+	}
+
+	PVS_Release();
+
+	CONS_Debug(DBG_SETUP, "%s sight PVS for %s sectors in %d us\n", cached ? "Loaded" : "Built",
+		sizeu1(numsectors), (int)((I_GetPreciseTime() - t) * 1000000 / I_GetPrecisePrecision()));
+}
+
+//
+// P_TraceSight
+//
+// Follows the line from t1's eyes to t2 through the BSP.
+//
+static boolean P_TraceSight(mobj_t *t1, mobj_t *t2, const sector_t *s1, const sector_t *s2)
+{
+	los_t los;
 
 	// An unobstructed LOS is possible.
 	// Now look from eyes of t1 to any part of t2.
-	sightcounts[1]++;
-
 	validcount++;
 
 	los.topslope =
@@ -496,3 +1136,82 @@ boolean P_CheckSight(mobj_t *t1, mobj_t *t2)
 	// the head node is the last node output
 	return P_CrossBSPNode((INT32)numnodes - 1, &los);
 }
+
+//
+// P_CheckSight
+//
+// Returns true if a straight line between t1 and t2 is unobstructed.
+// Uses REJECT and the sector PVS.
+//
+boolean P_CheckSight(mobj_t *t1, mobj_t *t2)
+{
+	const sector_t *s1, *s2;
+	size_t pnum;
+	sightmemo_t *memo = NULL;
+	boolean visible;
+
+	// First check for trivial rejection.
+	if (!t1 || !t2)
+		return false;
+
+	I_Assert(!P_MobjWasRemoved(t1));
+	I_Assert(!P_MobjWasRemoved(t2));
+
+	if (!t1->subsector || !t2->subsector
+	|| !t1->subsector->sector || !t2->subsector->sector)
+		return false;
+
+	sightcounts[SIGHT_CALLS]++;
+
+	s1 = t1->subsector->sector;
+	s2 = t2->subsector->sector;
+	pnum = (s1-sectors)*numsectors + (s2-sectors);
+
+	if (rejectmatrix != NULL)
+	{
+		// Check in REJECT table.
+		if (rejectmatrix[pnum>>3] & (1 << (pnum&7))) // can't possibly be connected
+		{
+			sightcounts[SIGHT_REJECTED]++;
+			return false;
+		}
+	}
+
+	if (sightpvs != NULL)
+	{
+		// No straight line out of s1 gets to s2
+		pnum = s2-sectors;
+		if (!(sightpvs[(s1-sectors)*pvsrowbytes + (pnum>>3)] & (1 << (pnum&7))))
+		{
+			sightcounts[SIGHT_REJECTED]++;
+			return false;
+		}
+	}
+
+	// killough 11/98: shortcut for melee situations
+	// same subsector? obviously visible
+	// haleyjd 02/23/06: can't do this if there are polyobjects in the subsec
+	if (!t1->subsector->polyList &&
+		t1->subsector == t2->subsector)
+		return true;
+
+	// The chase camera's stand-in and HUD hooks only run on this client,
+	// so keep them out of the memo or it would fill differently everywhere.
+	if (!hud_running && t1->type != MT_NULL)
+	{
+		memo = P_SightMemoSlot(t1, t2);
+		if (P_SightMemoMatches(memo, t1, t2))
+		{
+			sightcounts[SIGHT_MEMOHITS]++;
+			return memo->visible;
+		}
+	}
+
+	sightcounts[SIGHT_TRACES]++;
+	visible = P_TraceSight(t1, t2, s1, s2);
+
+	if (memo)
+		P_SightMemoStore(memo, t1, t2, visible);
+
+	return visible;
+}
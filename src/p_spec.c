@@ -2092,52 +2092,30 @@ void P_SwitchWeather(INT32 weathernum)
 		purge = false;
 
 	if (purge)
-	{
-		thinker_t *think;
-		precipmobj_t *precipmobj;
-
-		for (think = thlist[THINK_PRECIP].next; think != &thlist[THINK_PRECIP]; think = think->next)
-		{
-			if (think->function.acp1 != (actionf_p1)P_NullPrecipThinker)
-				continue; // not a precipmobj thinker
-
-			precipmobj = (precipmobj_t *)think;
-
-			P_RemovePrecipMobj(precipmobj);
-		}
-	}
+		P_ClearPrecipitation();
 	else // Rather than respawn all that crap, reuse it!
 	{
-		thinker_t *think;
-		precipmobj_t *precipmobj;
-		state_t *st;
+		size_t i;
 
-		for (think = thlist[THINK_PRECIP].next; think != &thlist[THINK_PRECIP]; think = think->next)
+		if (weathernum == PRECIP_RAIN || weathernum == PRECIP_STORM || weathernum == PRECIP_STORM_NOSTRIKES) // Snow To Rain
 		{
-			if (think->function.acp1 != (actionf_p1)P_NullPrecipThinker)
-				continue; // not a precipmobj thinker
-			precipmobj = (precipmobj_t *)think;
+			precipitation.momz = mobjinfo[MT_RAIN].speed;
 
-			if (weathernum == PRECIP_RAIN || weathernum == PRECIP_STORM || weathernum == PRECIP_STORM_NOSTRIKES) // Snow To Rain
+			for (i = 0; i < precipitation.numdrops; i++)
 			{
-				precipmobj->flags = mobjinfo[MT_RAIN].flags;
-				st = &states[mobjinfo[MT_RAIN].spawnstate];
-				precipmobj->state = st;
-				precipmobj->tics = st->tics;
-				precipmobj->sprite = st->sprite;
-				precipmobj->frame = st->frame;
-				precipmobj->momz = mobjinfo[MT_RAIN].speed;
-
-				precipmobj->precipflags &= ~PCF_INVISIBLE;
-
-				precipmobj->precipflags |= PCF_RAIN;
-				//think->function.acp1 = (actionf_p1)P_RainThinker;
+				precipitation.flags[i] &= ~PCF_INVISIBLE;
+				precipitation.flags[i] |= PCF_RAIN;
+				P_SetPrecipState(i, mobjinfo[MT_RAIN].spawnstate);
 			}
-			else if (weathernum == PRECIP_SNOW) // Rain To Snow
-			{
-				INT32 z;
+		}
+		else if (weathernum == PRECIP_SNOW) // Rain To Snow
+		{
+			INT32 z;
 
-				precipmobj->flags = mobjinfo[MT_SNOWFLAKE].flags;
+			precipitation.momz = mobjinfo[MT_SNOWFLAKE].speed;
+
+			for (i = 0; i < precipitation.numdrops; i++)
+			{
 				z = M_RandomByte();
 
 				if (z < 64)
@@ -2147,24 +2125,15 @@ void P_SwitchWeather(INT32 weathernum)
 				else
 					z = 0;
 
-				st = &states[mobjinfo[MT_SNOWFLAKE].spawnstate+z];
-				precipmobj->state = st;
-				precipmobj->tics = st->tics;
-				precipmobj->sprite = st->sprite;
-				precipmobj->frame = st->frame;
-				precipmobj->momz = mobjinfo[MT_SNOWFLAKE].speed;
-
-				precipmobj->precipflags &= ~(PCF_INVISIBLE|PCF_RAIN);
-
-				//think->function.acp1 = (actionf_p1)P_SnowThinker;
-			}
-			else // Remove precip, but keep it around for reuse.
-			{
-				//think->function.acp1 = (actionf_p1)P_NullPrecipThinker;
-
-				precipmobj->precipflags |= PCF_INVISIBLE;
+				precipitation.flags[i] &= ~(PCF_INVISIBLE|PCF_RAIN);
+				P_SetPrecipState(i, mobjinfo[MT_SNOWFLAKE].spawnstate+z);
 			}
 		}
+		else // Remove precip, but keep it around for reuse.
+		{
+			for (i = 0; i < precipitation.numdrops; i++)
+				precipitation.flags[i] |= PCF_INVISIBLE;
+		}
 	}
 
 	switch (weathernum)
@@ -2298,6 +2267,9 @@ static void P_ProcessLineSpecial(line_t *line, mobj_t *mo, sector_t *callsec)
 	if (mo && mo->player && botingame)
 		bot = players[secondarydisplayplayer].mo;
 
+	// Most of these change planes, FOFs or polyobjects
+	P_InvalidateSightMemo();
+
 	// note: only commands with linedef types >= 400 && < 500 can be used
 	switch (line->special)
 	{
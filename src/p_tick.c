@@ -72,9 +72,7 @@ void Command_Numthinkers_f(void)
 		CONS_Printf(M_GetText("numthinkers <#>: Count number of thinkers\n"));
 		CONS_Printf(
 			"\t1: P_MobjThinker\n"
-			/*"\t2: P_RainThinker\n"
-			"\t3: P_SnowThinker\n"*/
-			"\t2: P_NullPrecipThinker\n"
+			"\t2: Precipitation\n"
 			"\t3: T_Friction\n"
 			"\t4: T_Pusher\n"
 			"\t5: P_RemoveThinkerDelayed\n");
@@ -90,19 +88,10 @@ void Command_Numthinkers_f(void)
 			action = (actionf_p1)P_MobjThinker;
 			CONS_Printf(M_GetText("Number of %s: "), "P_MobjThinker");
 			break;
-		/*case 2:
-			action = (actionf_p1)P_RainThinker;
-			CONS_Printf(M_GetText("Number of %s: "), "P_RainThinker");
-			break;
-		case 3:
-			action = (actionf_p1)P_SnowThinker;
-			CONS_Printf(M_GetText("Number of %s: "), "P_SnowThinker");
-			break;*/
 		case 2:
-			start = end = THINK_PRECIP;
-			action = (actionf_p1)P_NullPrecipThinker;
-			CONS_Printf(M_GetText("Number of %s: "), "P_NullPrecipThinker");
-			break;
+			// Not thinkers, see P_RunPrecipitation
+			CONS_Printf(M_GetText("Number of %s: %s\n"), "precipitation drops", sizeu1(precipitation.numdrops));
+			return;
 		case 3:
 			start = end = THINK_MAIN;
 			action = (actionf_p1)T_Friction;
@@ -194,6 +183,13 @@ void Command_CountMobjs_f(void)
 		if (count > 0) // Don't bother displaying if there are none of this type!
 			CONS_Printf(" * %d: %d\n", i, count);
 	}
+
+	{
+		size_t mobjs, mobjcap;
+		P_GetMobjPoolStats(&mobjs, &mobjcap);
+		CONS_Printf(M_GetText("Pool usage: %s/%s objects\n"), sizeu1(mobjs), sizeu2(mobjcap));
+		CONS_Printf(M_GetText("Precipitation: %s drops, %s KB\n"), sizeu1(precipitation.numdrops), sizeu2(precipitation.memory >> 10));
+	}
 }
 
 //
@@ -219,6 +215,7 @@ void P_AddThinker(const thinklistnum_t n, thinker_t *thinker)
 	thlist[n].prev = thinker;
 
 	thinker->references = 0;    // killough 11/98: init reference counter to 0
+	thinker->interpolators = NULL;
 
 #ifdef PARANOIA
 	thinker->debug_mobjtype = MT_NULL;
@@ -268,8 +265,10 @@ static const char *MobjThinkerName(const mobj_t *mobj)
 //
 // Make currentthinker external, so that P_RemoveThinkerDelayed
 // can adjust currentthinker when thinkers self-remove.
+// currentthinklist tells it which allocator the thinker came from.
 
 static thinker_t *currentthinker;
+static thinklistnum_t currentthinklist;
 
 //
 // P_RemoveThinkerDelayed()
@@ -322,7 +321,22 @@ void P_RemoveThinkerDelayed(thinker_t *thinker)
 	(next->prev = currentthinker = thinker->prev)->next = next;
 
 	R_DestroyLevelInterpolators(thinker);
-	Z_Free(thinker);
+	P_FreeThinker(thinker, currentthinklist);
+}
+
+//
+// P_FreeThinker
+//
+// Releases the memory of a thinker that has already been unlinked from
+// list n. Mobjs live in their own pool (see P_InitMobjPools);
+// everything else is a plain zone block.
+//
+void P_FreeThinker(thinker_t *thinker, const thinklistnum_t n)
+{
+	if (n == THINK_MOBJ)
+		P_FreeMobj((mobj_t *)thinker);
+	else
+		Z_Free(thinker);
 }
 
 //
@@ -424,6 +438,7 @@ static inline void P_RunThinkers(void)
 	size_t i;
 	for (i = 0; i < NUM_THINKERLISTS; i++)
 	{
+		currentthinklist = i;
 		PS_START_TIMING(ps_thlist_times[i]);
 		for (currentthinker = thlist[i].next; currentthinker != &thlist[i]; currentthinker = currentthinker->next)
 		{
@@ -433,8 +448,15 @@ static inline void P_RunThinkers(void)
 			currentthinker->function.acp1(currentthinker);
 		}
 		PS_STOP_TIMING(ps_thlist_times[i]);
+
+		// Polyobjects, sector movers and dynamic slopes change what can be seen
+		if (i != THINK_MOBJ)
+			P_InvalidateSightMemo();
 	}
 
+	PS_START_TIMING(ps_precip_time);
+	P_RunPrecipitation();
+	PS_STOP_TIMING(ps_precip_time);
 }
 
 //
@@ -782,6 +804,7 @@ void P_Ticker(boolean run)
 
 		ps_lua_mobjhooks.value.i = 0;
 		ps_checkposition_calls.value.i = 0;
+		P_StartSightTic();
 
 		LUA_HOOK(PreThinkFrame);
 
@@ -941,6 +964,7 @@ void P_PreTicker(INT32 frames)
 	for (framecnt = 0; framecnt < frames; ++framecnt)
 	{
 		P_MapStart();
+		P_StartSightTic();
 
 		R_UpdateMobjInterpolators();
 
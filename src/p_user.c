@@ -11475,6 +11475,7 @@ void P_DoTailsOverlay(player_t *player, mobj_t *tails)
 	P_SetScale(tails, player->mo->scale);
 	tails->destscale = player->mo->destscale;
 	tails->radius = player->mo->radius;
+	P_UpdateBlockRadius(tails);
 	tails->height = player->mo->height;
 	zoffs = FixedMul(zoffs, tails->scale);
 
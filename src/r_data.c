@@ -12,7 +12,10 @@
 /// \brief Preparation of data for rendering, generation of lookups, caching, retrieval by name
 
 #include "doomdef.h"
+#include "d_main.h" // srb2home
 #include "g_game.h"
+#include "i_system.h"
+#include "i_threads.h"
 #include "i_video.h"
 #include "r_local.h"
 #include "r_sky.h"
@@ -690,33 +693,224 @@ extracolormap_t *R_ColormapForName(char *name)
 #endif
 
 //
-// R_CreateColormapFromLinedef
+// Light table cache
 //
-// This is a more GL friendly way of doing colormaps: Specify colormap
-// data in a special linedef's texture areas and use that to generate
-// custom colormaps at runtime. NOTE: For GL mode, we only need to color
-// data and not the colormap data.
+// Light tables only depend on their colormap's colors, fade range and the
+// palette, so they are kept on disk between sessions, keyed by those.
+// The least recently used tables make way once the cache is full.
 //
-static double deltas[256][3], map[256][3];
+#define LIGHTTABLESIZE (256 * 34)
+#define LIGHTTABLECACHESIZE 256
+#define LIGHTTABLECACHEFILE "lighttables.dat"
+#define LIGHTTABLECACHEVERSION 1
+#define LIGHTTABLECACHEHEADERSIZE (8 + 4 + 4) // magic, version, count
+#define LIGHTTABLECACHEENTRYSIZE (18 + LIGHTTABLESIZE)
+
+typedef struct
+{
+	INT32 rgba, fadergba;
+	UINT8 fadestart, fadeend;
+	UINT32 palettehash;
+} lighttablekey_t;
 
-lighttable_t *R_CreateLightTable(extracolormap_t *extra_colormap)
+typedef struct
+{
+	lighttablekey_t key;
+	UINT32 lastused;
+	UINT8 table[LIGHTTABLESIZE];
+} lighttablecache_t;
+
+static lighttablecache_t *lighttablecache = NULL;
+static size_t numlighttablecache = 0, maxlighttablecache = 0;
+static UINT32 lighttablecacheclock = 0;
+static boolean lighttablecacheloaded = false, lighttablecachedirty = false;
+static UINT32 lighttablecachehits = 0, lighttablecachemisses = 0;
+
+// Light tables waiting to be generated by R_FinishLightTableBatch
+typedef struct
+{
+	lighttable_t *table;
+	lighttablekey_t key;
+} lighttablejob_t;
+
+static lighttablejob_t *lighttablejobs = NULL;
+static size_t numlighttablejobs = 0, maxlighttablejobs = 0;
+static boolean lighttablebatching = false;
+
+static UINT32 R_HashPalette(void)
+{
+	UINT32 hash = 5381;
+	INT32 i;
+
+	for (i = 0; i < 256; i++)
+	{
+		hash = (hash * 33) ^ pMasterPalette[i].s.red;
+		hash = (hash * 33) ^ pMasterPalette[i].s.green;
+		hash = (hash * 33) ^ pMasterPalette[i].s.blue;
+	}
+
+	return hash;
+}
+
+static void R_LoadLightTableCache(void)
+{
+	UINT8 *buffer, *p;
+	size_t length;
+
+	lighttablecacheloaded = true;
+	numlighttablecache = 0;
+
+	length = FIL_ReadFile(va(pandf, srb2home, LIGHTTABLECACHEFILE), &buffer);
+	if (!length)
+		return;
+
+	p = buffer;
+	if (length >= LIGHTTABLECACHEHEADERSIZE && !memcmp(p, "SRB2LTC", 8))
+	{
+		UINT32 version, count;
+
+		p += 8;
+		version = READUINT32(p);
+		count = READUINT32(p);
+
+		if (version == LIGHTTABLECACHEVERSION && count && count <= (length - LIGHTTABLECACHEHEADERSIZE) / LIGHTTABLECACHEENTRYSIZE)
+		{
+			maxlighttablecache = min(count, LIGHTTABLECACHESIZE);
+			lighttablecache = Z_Realloc(lighttablecache, maxlighttablecache * sizeof (*lighttablecache), PU_STATIC, NULL);
+
+			for (; count-- && numlighttablecache < LIGHTTABLECACHESIZE; numlighttablecache++)
+			{
+				lighttablecache_t *entry = &lighttablecache[numlighttablecache];
+
+				entry->key.rgba = READINT32(p);
+				entry->key.fadergba = READINT32(p);
+				entry->key.fadestart = READUINT8(p);
+				entry->key.fadeend = READUINT8(p);
+				entry->key.palettehash = READUINT32(p);
+				entry->lastused = READUINT32(p);
+				READMEM(p, entry->table, LIGHTTABLESIZE);
+
+				lighttablecacheclock = max(lighttablecacheclock, entry->lastused);
+			}
+		}
+	}
+
+	Z_Free(buffer);
+	CONS_Debug(DBG_RENDER, "Loaded %s cached light tables\n", sizeu1(numlighttablecache));
+}
+
+static void R_SaveLightTableCache(void)
 {
+	const size_t length = LIGHTTABLECACHEHEADERSIZE + numlighttablecache * LIGHTTABLECACHEENTRYSIZE;
+	UINT8 *buffer = Z_Malloc(length, PU_STATIC, NULL), *p = buffer;
+	size_t i;
+
+	WRITEMEM(p, "SRB2LTC", 8);
+	WRITEUINT32(p, LIGHTTABLECACHEVERSION);
+	WRITEUINT32(p, numlighttablecache);
+
+	for (i = 0; i < numlighttablecache; i++)
+	{
+		lighttablecache_t *entry = &lighttablecache[i];
+
+		WRITEINT32(p, entry->key.rgba);
+		WRITEINT32(p, entry->key.fadergba);
+		WRITEUINT8(p, entry->key.fadestart);
+		WRITEUINT8(p, entry->key.fadeend);
+		WRITEUINT32(p, entry->key.palettehash);
+		WRITEUINT32(p, entry->lastused);
+		WRITEMEM(p, entry->table, LIGHTTABLESIZE);
+	}
+
+	if (FIL_WriteFile(va(pandf, srb2home, LIGHTTABLECACHEFILE), buffer, length))
+		lighttablecachedirty = false;
+
+	Z_Free(buffer);
+}
+
+// Copies a cached light table into lighttable, if there is one for key.
+static boolean R_FindCachedLightTable(const lighttablekey_t *key, lighttable_t *lighttable)
+{
+	size_t i;
+
+	if (!lighttablecacheloaded)
+		R_LoadLightTableCache();
+
+	for (i = 0; i < numlighttablecache; i++)
+	{
+		lighttablecache_t *entry = &lighttablecache[i];
+
+		if (!memcmp(&entry->key, key, sizeof (*key)))
+		{
+			entry->lastused = ++lighttablecacheclock;
+			M_Memcpy(lighttable, entry->table, LIGHTTABLESIZE);
+			lighttablecachehits++;
+			return true;
+		}
+	}
+
+	lighttablecachemisses++;
+	return false;
+}
+
+// Stores a freshly generated light table, evicting the least recently used one if full.
+static void R_CacheLightTable(const lighttablekey_t *key, const lighttable_t *lighttable)
+{
+	lighttablecache_t *entry = NULL;
+	size_t i;
+
+	// The same table may have been generated twice in one batch
+	for (i = 0; i < numlighttablecache; i++)
+		if (!memcmp(&lighttablecache[i].key, key, sizeof (*key)))
+		{
+			lighttablecache[i].lastused = ++lighttablecacheclock;
+			return;
+		}
+
+	if (numlighttablecache < LIGHTTABLECACHESIZE)
+	{
+		if (numlighttablecache == maxlighttablecache)
+		{
+			maxlighttablecache = min(maxlighttablecache + 16, LIGHTTABLECACHESIZE);
+			lighttablecache = Z_Realloc(lighttablecache, maxlighttablecache * sizeof (*lighttablecache), PU_STATIC, NULL);
+		}
+		entry = &lighttablecache[numlighttablecache++];
+	}
+	else
+	{
+		entry = &lighttablecache[0];
+		for (i = 1; i < numlighttablecache; i++)
+			if (lighttablecache[i].lastused < entry->lastused)
+				entry = &lighttablecache[i];
+	}
+
+	entry->key = *key;
+	entry->lastused = ++lighttablecacheclock;
+	M_Memcpy(entry->table, lighttable, LIGHTTABLESIZE);
+	lighttablecachedirty = true;
+}
+
+// Fills in a light table from a colormap's values.
+// Only reads the master palette and its lookup cube, so it is safe to run
+// on several threads once the cube is filled.
+static void R_GenerateLightTable(lighttable_t *lighttable, const lighttablekey_t *key)
+{
+	double deltas[256][3], map[256][3];
 	double cmaskr, cmaskg, cmaskb, cdestr, cdestg, cdestb;
 	double maskamt = 0, othermask = 0;
 
-	UINT8 cr = R_GetRgbaR(extra_colormap->rgba),
-		cg = R_GetRgbaG(extra_colormap->rgba),
-		cb = R_GetRgbaB(extra_colormap->rgba),
-		ca = R_GetRgbaA(extra_colormap->rgba),
-		cfr = R_GetRgbaR(extra_colormap->fadergba),
-		cfg = R_GetRgbaG(extra_colormap->fadergba),
-		cfb = R_GetRgbaB(extra_colormap->fadergba);
-//		cfa = R_GetRgbaA(extra_colormap->fadergba); // unused in software
+	UINT8 cr = R_GetRgbaR(key->rgba),
+		cg = R_GetRgbaG(key->rgba),
+		cb = R_GetRgbaB(key->rgba),
+		ca = R_GetRgbaA(key->rgba),
+		cfr = R_GetRgbaR(key->fadergba),
+		cfg = R_GetRgbaG(key->fadergba),
+		cfb = R_GetRgbaB(key->fadergba);
+//		cfa = R_GetRgbaA(key->fadergba); // unused in software
 
-	UINT8 fadestart = extra_colormap->fadestart,
-		fadedist = extra_colormap->fadeend - extra_colormap->fadestart;
+	UINT8 fadestart = key->fadestart,
+		fadedist = key->fadeend - key->fadestart;
 
-	lighttable_t *lighttable = NULL;
 	size_t i;
 
 	/////////////////////
@@ -786,10 +980,7 @@ lighttable_t *R_CreateLightTable(extracolormap_t *extra_colormap)
 			deltas[i][2] = (map[i][2] - cdestb) / (double)fadedist;
 		}
 
-		// Now allocate memory for the actual colormap array itself!
-		// aligned on 8 bit for asm code
-		colormap_p = Z_MallocAlign((256 * 34) + 10, PU_LEVEL, NULL, 8);
-		lighttable = (UINT8 *)colormap_p;
+		colormap_p = (char *)lighttable;
 
 		// Calculate the palette index for each palette index, for each light level
 		// (as well as the two unused colormap lines we inherited from Doom)
@@ -823,10 +1014,112 @@ lighttable_t *R_CreateLightTable(extracolormap_t *extra_colormap)
 			}
 		}
 	}
+}
+
+
+lighttable_t *R_CreateLightTable(extracolormap_t *extra_colormap)
+{
+	lighttablekey_t key;
+	lighttable_t *lighttable;
+
+	memset(&key, 0, sizeof (key)); // no stray padding in memcmp
+	key.rgba = extra_colormap->rgba;
+	key.fadergba = extra_colormap->fadergba;
+	key.fadestart = extra_colormap->fadestart;
+	key.fadeend = extra_colormap->fadeend;
+	key.palettehash = R_HashPalette();
+
+	// Now allocate memory for the actual colormap array itself!
+	// aligned on 8 bit for asm code
+	lighttable = Z_MallocAlign(LIGHTTABLESIZE + 10, PU_LEVEL, NULL, 8);
+
+	if (R_FindCachedLightTable(&key, lighttable))
+		return lighttable;
+
+	if (lighttablebatching)
+	{
+		if (numlighttablejobs == maxlighttablejobs)
+		{
+			maxlighttablejobs = max(maxlighttablejobs * 2, 32);
+			lighttablejobs = Z_Realloc(lighttablejobs, maxlighttablejobs * sizeof (*lighttablejobs), PU_STATIC, NULL);
+		}
+
+		lighttablejobs[numlighttablejobs].table = lighttable;
+		lighttablejobs[numlighttablejobs].key = key;
+		numlighttablejobs++;
+	}
+	else
+	{
+		R_GenerateLightTable(lighttable, &key);
+		R_CacheLightTable(&key, lighttable);
+	}
 
 	return lighttable;
 }
 
+//
+// R_BeginLightTableBatch
+//
+// Light tables created from here on are left blank until
+// R_FinishLightTableBatch, which generates them all at once.
+//
+void R_BeginLightTableBatch(void)
+{
+	lighttablebatching = true;
+	numlighttablejobs = 0;
+	lighttablecachehits = lighttablecachemisses = 0;
+}
+
+#ifdef HAVE_THREADS
+static void R_LightTableJobs(size_t start, size_t end, void *userdata)
+{
+	(void)userdata;
+	for (; start < end; start++)
+		R_GenerateLightTable(lighttablejobs[start].table, &lighttablejobs[start].key);
+}
+#endif
+
+void R_FinishLightTableBatch(void)
+{
+	precise_t t = I_GetPreciseTime();
+	size_t i;
+
+	lighttablebatching = false;
+
+#ifdef HAVE_THREADS
+	// Only worth filling the whole palette cube for a handful of tables
+	if (I_worker_count() && numlighttablejobs >= 4)
+	{
+		FillPaletteCube(&masterpalettecube);
+		I_parallel_for(numlighttablejobs, 1, R_LightTableJobs, NULL);
+	}
+	else
+#endif
+	{
+		for (i = 0; i < numlighttablejobs; i++)
+			R_GenerateLightTable(lighttablejobs[i].table, &lighttablejobs[i].key);
+	}
+
+	for (i = 0; i < numlighttablejobs; i++)
+		R_CacheLightTable(&lighttablejobs[i].key, lighttablejobs[i].table);
+
+	if (lighttablecachedirty)
+		R_SaveLightTableCache();
+
+	CONS_Debug(DBG_SETUP, "Light tables: %u cached, %u generated in %d us\n", lighttablecachehits, lighttablecachemisses,
+		(int)((I_GetPreciseTime() - t) * 1000000 / I_GetPrecisePrecision()));
+
+	numlighttablejobs = 0;
+}
+
+//
+// R_CreateColormapFromLinedef
+//
+// This is a more GL friendly way of doing colormaps: Specify colormap
+// data in a special linedef's texture areas and use that to generate
+// custom colormaps at runtime. NOTE: For GL mode, we only need to color
+// data and not the colormap data.
+//
 extracolormap_t *R_CreateColormapFromLinedef(char *p1, char *p2, char *p3)
 {
 	// default values
@@ -1119,6 +1412,9 @@ UINT8 NearestPaletteColor(UINT8 r, UINT8 g, UINT8 b, RGBA_t *palette)
 	if (palette == NULL)
 		palette = pMasterPalette;
 
+	if (palette == masterpalettecube.palette)
+		return GetPaletteCubeColor(&masterpalettecube, r, g, b);
+
 	for (i = 0; i < 256; i++)
 	{
 		dr = r - palette[i].s.red;
@@ -93,6 +93,8 @@ typedef enum
 } textmapcolormapflags_t;
 
 lighttable_t *R_CreateLightTable(extracolormap_t *extra_colormap);
+void R_BeginLightTableBatch(void);
+void R_FinishLightTableBatch(void);
 extracolormap_t * R_CreateColormapFromLinedef(char *p1, char *p2, char *p3);
 extracolormap_t* R_CreateColormap(INT32 rgba, INT32 fadergba, UINT8 fadestart, UINT8 fadeend, UINT8 flags);
 extracolormap_t *R_AddColormaps(extracolormap_t *exc_augend, extracolormap_t *exc_addend,
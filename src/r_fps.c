@@ -15,6 +15,7 @@
 #include "r_fps.h"
 
 #include "r_main.h"
+#include "i_system.h" // I_GetPreciseTime
 #include "g_game.h"
 #include "i_video.h"
 #include "r_plane.h"
@@ -408,6 +409,7 @@ static void AddInterpolator(levelinterpolator_t* interpolator)
 		);
 	}
 
+	interpolator->index = levelinterpolators_len;
 	levelinterpolators[levelinterpolators_len] = interpolator;
 	levelinterpolators_len += 1;
 }
@@ -421,6 +423,9 @@ static levelinterpolator_t *CreateInterpolator(levelinterpolator_type_e type, th
 	ret->type = type;
 	ret->thinker = thinker;
 
+	ret->thinkernext = thinker->interpolators;
+	thinker->interpolators = ret;
+
 	AddInterpolator(ret);
 
 	return ret;
@@ -566,18 +571,13 @@ void R_UpdateLevelInterpolators(void)
 
 void R_ClearLevelInterpolatorState(thinker_t *thinker)
 {
-	size_t i;
+	levelinterpolator_t *interp;
 
-	for (i = 0; i < levelinterpolators_len; i++)
+	for (interp = thinker->interpolators; interp; interp = interp->thinkernext)
 	{
-		levelinterpolator_t *interp = levelinterpolators[i];
-
-		if (interp->thinker == thinker)
-		{
-			// Do it twice to make the old state match the new
-			UpdateLevelInterpolatorState(interp);
-			UpdateLevelInterpolatorState(interp);
-		}
+		// Do it twice to make the old state match the new
+		UpdateLevelInterpolatorState(interp);
+		UpdateLevelInterpolatorState(interp);
 	}
 }
 
@@ -693,22 +693,21 @@ void R_RestoreLevelInterpolators(void)
 
 void R_DestroyLevelInterpolators(thinker_t *thinker)
 {
-	size_t i;
+	levelinterpolator_t *interp, *next;
 
-	for (i = 0; i < levelinterpolators_len; i++)
+	for (interp = thinker->interpolators; interp; interp = next)
 	{
-		levelinterpolator_t *interp = levelinterpolators[i];
+		next = interp->thinkernext;
 
-		if (interp->thinker == thinker)
-		{
-			// Swap the tail of the level interpolators to this spot
-			levelinterpolators[i] = levelinterpolators[levelinterpolators_len - 1];
-			levelinterpolators_len -= 1;
+		// Swap the tail of the level interpolators to this spot
+		levelinterpolators[interp->index] = levelinterpolators[levelinterpolators_len - 1];
+		levelinterpolators[interp->index]->index = interp->index;
+		levelinterpolators_len -= 1;
 
-			Z_Free(interp);
-			i -= 1;
-		}
+		Z_Free(interp);
 	}
+
+	thinker->interpolators = NULL;
 }
 
 static mobj_t **interpolated_mobjs = NULL;
@@ -738,6 +737,7 @@ void R_AddMobjInterpolator(mobj_t *mobj)
 		);
 	}
 
+	mobj->interpindex = interpolated_mobjs_len;
 	interpolated_mobjs[interpolated_mobjs_len] = mobj;
 	interpolated_mobjs_len += 1;
 
@@ -747,21 +747,17 @@ void R_AddMobjInterpolator(mobj_t *mobj)
 
 void R_RemoveMobjInterpolator(mobj_t *mobj)
 {
-	size_t i;
+	size_t i = mobj->interpindex;
 
-	if (interpolated_mobjs_len == 0) return;
+	// Not in the list (never added, or already removed)
+	if (i >= interpolated_mobjs_len || interpolated_mobjs[i] != mobj)
+		return;
 
-	for (i = 0; i < interpolated_mobjs_len; i++)
-	{
-		if (interpolated_mobjs[i] == mobj)
-		{
-			interpolated_mobjs[i] = interpolated_mobjs[
-				interpolated_mobjs_len - 1
-			];
-			interpolated_mobjs_len -= 1;
-			return;
-		}
-	}
+	interpolated_mobjs[i] = interpolated_mobjs[
+		interpolated_mobjs_len - 1
+	];
+	interpolated_mobjs[i]->interpindex = i;
+	interpolated_mobjs_len -= 1;
 }
 
 void R_InitMobjInterpolators(void)
@@ -822,28 +818,128 @@ void R_ResetMobjInterpolationState(mobj_t *mobj)
 }
 
 //
-// P_ResetPrecipitationMobjInterpolationState
+// R_InterpolatePrecipZ
 //
-// Reset the rendering interpolation state of the precipmobj.
+// Evaluate the interpolated height of precipitation drop i.
+// Drops never move sideways, so that is all there is to it.
 //
-void R_ResetPrecipitationMobjInterpolationState(precipmobj_t *mobj)
+fixed_t R_InterpolatePrecipZ(size_t i, fixed_t frac)
 {
-	mobj->old_x2 = mobj->old_x;
-	mobj->old_y2 = mobj->old_y;
-	mobj->old_z2 = mobj->old_z;
-	mobj->old_angle2 = mobj->old_angle;
-	mobj->old_pitch2 = mobj->old_pitch;
-	mobj->old_roll2 = mobj->old_roll;
-	mobj->old_spriteroll2 = mobj->old_spriteroll;
-	mobj->old_x = mobj->x;
-	mobj->old_y = mobj->y;
-	mobj->old_z = mobj->z;
-	mobj->old_angle = mobj->angle;
-	mobj->old_pitch = mobj->pitch;
-	mobj->old_roll = mobj->roll;
-	mobj->old_spriteroll = mobj->spriteroll;
-	mobj->old_spritexscale = mobj->spritexscale;
-	mobj->old_spriteyscale = mobj->spriteyscale;
-	mobj->old_spritexoffset = mobj->spritexoffset;
-	mobj->old_spriteyoffset = mobj->spriteyoffset;
+	if (frac == FRACUNIT)
+		return precipitation.z[i];
+
+	return R_LerpFixed(precipitation.oldz[i], precipitation.z[i], frac);
+}
+
+// Removes crowd[order[0]], crowd[order[1]] and so on from list the way
+// interpolators used to be removed, searching for each and swapping the
+// tail into its place.
+static precise_t R_BenchLinearRemoval(void **list, size_t len, mobj_t *crowd, const INT32 *order)
+{
+	precise_t start = I_GetPreciseTime();
+	size_t i, j;
+
+	for (i = 0; i < len; i++)
+	{
+		for (j = 0; j < len - i; j++)
+		{
+			if (list[j] == &crowd[order[i]])
+			{
+				list[j] = list[len - i - 1];
+				break;
+			}
+		}
+	}
+
+	return I_GetPreciseTime() - start;
+}
+
+/** Adds the given number of objects to the interpolated mobj list, each
+  * with a level interpolator of its own, then removes them in a random
+  * order and checks that both lists are still in order. The removal time
+  * is compared against searching the lists, as used to be done.
+  * Usage: interpbench [objects]
+  */
+void Command_InterpBench_f(void)
+{
+	INT32 numobjs = 10000, i;
+	size_t mobjslen = interpolated_mobjs_len, levellen = levelinterpolators_len, j;
+	precise_t addtime, removetime, lineartime;
+	UINT32 seed = 0x5EED;
+	mobj_t *crowd;
+	INT32 *order;
+	void **list;
+	boolean ok = true;
+
+	if (gamestate != GS_LEVEL || !numsectors)
+	{
+		CONS_Printf(M_GetText("You must be in a level to use this.\n"));
+		return;
+	}
+
+	if (COM_Argc() > 1)
+		numobjs = min(max(atoi(COM_Argv(1)), 1), 1000000);
+
+	crowd = Z_Calloc(numobjs * sizeof (*crowd), PU_STATIC, NULL);
+	order = Z_Malloc(numobjs * sizeof (*order), PU_STATIC, NULL);
+	list = Z_Malloc(numobjs * sizeof (*list), PU_STATIC, NULL);
+
+	// Shuffled removal order
+	for (i = 0; i < numobjs; i++)
+		order[i] = i;
+	for (i = numobjs - 1; i > 0; i--)
+	{
+		INT32 k, tmp;
+		seed = seed * 1103515245 + 12345;
+		k = (seed >> 8) % (i + 1);
+		tmp = order[i];
+		order[i] = order[k];
+		order[k] = tmp;
+	}
+
+	addtime = I_GetPreciseTime();
+	for (i = 0; i < numobjs; i++)
+	{
+		R_AddMobjInterpolator(&crowd[i]);
+		R_CreateInterpolator_SectorPlane(&crowd[i].thinker, &sectors[i % numsectors], false);
+	}
+	addtime = I_GetPreciseTime() - addtime;
+
+	removetime = I_GetPreciseTime();
+	for (i = 0; i < numobjs; i++)
+	{
+		R_RemoveMobjInterpolator(&crowd[order[i]]);
+		R_DestroyLevelInterpolators(&crowd[order[i]].thinker);
+	}
+	removetime = I_GetPreciseTime() - removetime;
+
+	// The old way, once for each list
+	for (i = 0; i < numobjs; i++)
+		list[i] = &crowd[i];
+	lineartime = R_BenchLinearRemoval(list, numobjs, crowd, order);
+	for (i = 0; i < numobjs; i++)
+		list[i] = &crowd[i];
+	lineartime += R_BenchLinearRemoval(list, numobjs, crowd, order);
+
+	if (interpolated_mobjs_len != mobjslen || levelinterpolators_len != levellen)
+		ok = false;
+	for (j = 0; j < interpolated_mobjs_len; j++)
+		if (interpolated_mobjs[j]->interpindex != j)
+			ok = false;
+	for (j = 0; j < levelinterpolators_len; j++)
+		if (levelinterpolators[j]->index != j)
+			ok = false;
+
+	Z_Free(list);
+	Z_Free(order);
+	Z_Free(crowd);
+
+	CONS_Printf("%d objects added in %d us\n", numobjs, (int)(addtime * 1000000 / I_GetPrecisePrecision()));
+	CONS_Printf("Removed in %d us, was %d us (%.2fx)\n",
+		(int)(removetime * 1000000 / I_GetPrecisePrecision()), (int)(lineartime * 1000000 / I_GetPrecisePrecision()),
+		removetime ? (double)lineartime / removetime : 0.0);
+	if (!ok)
+		CONS_Alert(CONS_WARNING, "The interpolator lists are out of order!\n");
+	else if (removetime > lineartime)
+		CONS_Alert(CONS_WARNING, "Removing interpolators took longer than searching for them!\n");
 }
@@ -86,6 +86,8 @@ typedef enum {
 typedef struct levelinterpolator_s {
 	levelinterpolator_type_e type;
 	thinker_t *thinker;
+	struct levelinterpolator_s *thinkernext; // next interpolator of the same thinker
+	size_t index; // position in the level interpolator list
 	union {
 		struct {
 			sector_t *sector;
@@ -134,6 +136,8 @@ angle_t R_InterpolateAngle(angle_t from, angle_t to);
 void R_InterpolateMobjState(mobj_t *mobj, fixed_t frac, interpmobjstate_t *out);
 // Evaluate the interpolated mobj state for the given precipmobj
 void R_InterpolatePrecipMobjState(precipmobj_t *mobj, fixed_t frac, interpmobjstate_t *out);
+// Evaluate the interpolated height of the given precipitation drop
+fixed_t R_InterpolatePrecipZ(size_t i, fixed_t frac);
 
 void R_CreateInterpolator_SectorPlane(thinker_t *thinker, sector_t *sector, boolean ceiling);
 void R_CreateInterpolator_SectorScroll(thinker_t *thinker, sector_t *sector, boolean ceiling);
@@ -162,6 +166,7 @@ void R_AddMobjInterpolator(mobj_t *mobj);
 void R_RemoveMobjInterpolator(mobj_t *mobj);
 void R_UpdateMobjInterpolators(void);
 void R_ResetMobjInterpolationState(mobj_t *mobj);
-void R_ResetPrecipitationMobjInterpolationState(precipmobj_t *mobj);
+
+void Command_InterpBench_f(void);
 
 #endif
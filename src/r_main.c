@@ -110,6 +110,7 @@ ps_metric_t ps_sw_spritecliptime = {0};
 ps_metric_t ps_sw_portaltime = {0};
 ps_metric_t ps_sw_planetime = {0};
 ps_metric_t ps_sw_maskedtime = {0};
+ps_metric_t ps_sw_spritesorttime = {0};
 
 ps_metric_t ps_numbspcalls = {0};
 ps_metric_t ps_numsprites = {0};
@@ -1590,6 +1591,7 @@ void R_RenderPlayerView(player_t *player)
 
 	// draw mid texture and sprite
 	// And now 3D floors/sides!
+	ps_sw_spritesorttime.value.p = 0;
 	PS_START_TIMING(ps_sw_maskedtime);
 	R_DrawMasked(masks, nummasks);
 	PS_STOP_TIMING(ps_sw_maskedtime);
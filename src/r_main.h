@@ -104,6 +104,7 @@ extern ps_metric_t ps_sw_spritecliptime;
 extern ps_metric_t ps_sw_portaltime;
 extern ps_metric_t ps_sw_planetime;
 extern ps_metric_t ps_sw_maskedtime;
+extern ps_metric_t ps_sw_spritesorttime;
 
 extern ps_metric_t ps_numbspcalls;
 extern ps_metric_t ps_numsprites;
@@ -388,6 +388,7 @@ static void SetSkin(player_t *player, INT32 skinnum)
 			player->mo->color = newcolor;
 		P_SetScale(player->mo, player->mo->scale);
 		player->mo->radius = radius;
+		P_UpdateBlockRadius(player->mo);
 
 		P_SetPlayerMobjState(player->mo, player->mo->state-states); // Prevent visual errors when switching between skins with differing number of frames
 	}
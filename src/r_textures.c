@@ -13,6 +13,7 @@
 
 #include "doomdef.h"
 #include "g_game.h"
+#include "i_system.h"
 #include "i_video.h"
 #include "r_local.h"
 #include "r_sky.h"
@@ -56,13 +57,25 @@ fixed_t *textureheight; // needed for texture pegging
 
 INT32 *texturetranslation;
 
-// Painfully simple texture id cacheing to make maps load faster. :3
-static struct {
-	char name[9];
-	UINT32 hash;
-	INT32 id;
-} *tidcache = NULL;
-static INT32 tidcachelen = 0;
+// Name lookup indexes for textures and flats, so maps load faster. :3
+// Each is a hash table of chains through the texture or flat list,
+// ordered so that whatever used to win the backwards scan comes first.
+// Both are rebuilt on demand after textures are (re)loaded, files are
+// added, or R_ClearTextureNumCache is called.
+static INT32 *texturebuckets = NULL;
+static INT32 *texturenext = NULL;
+static UINT8 *textureused = NULL; // looked up since the last R_ClearTextureNumCache
+static UINT32 texturebucketmask = 0;
+static boolean textureindexvalid = false;
+static INT32 numtexturesused = 0;
+
+static INT32 *flatbuckets = NULL;
+static INT32 *flatnext = NULL;
+static lumpnum_t *flatlumps = NULL;
+static UINT32 flatbucketmask = 0;
+static INT32 flatindexnumwads = -1; // numwadfiles when the flat index was built
+
+static precise_t texturelookuptime = 0; // spent in lookups since the last R_ClearTextureNumCache
 
 //
 // MAPTEXTURE_T CACHING
@@ -1053,6 +1066,8 @@ static INT32 R_DefineTextures(INT32 i, UINT16 w)
 static void R_FinishLoadingTextures(INT32 add)
 {
 	numtextures += add;
+	textureindexvalid = false;
+	flatindexnumwads = -1;
 
 #ifdef HWRENDER
 	if (rendermode == render_opengl)
@@ -1563,63 +1578,165 @@ void R_ParseTEXTURESLump(UINT16 wadNum, UINT16 lumpNum, INT32 *texindex)
 	Z_Free((void *)texturesText);
 }
 
-// Search for flat name.
-lumpnum_t R_GetFlatNumForName(const char *name)
+// Returns the bucket count for a name index holding n entries.
+static UINT32 R_NameIndexSize(size_t n)
 {
-	INT32 i;
-	lumpnum_t lump;
-	lumpnum_t start;
-	lumpnum_t end;
+	UINT32 size = 16;
+	while (size < n)
+		size <<= 1;
+	return size;
+}
 
-	// Scan wad files backwards so patched flats take preference.
-	for (i = numwadfiles - 1; i >= 0; i--)
+// Finds the flat range of a wad file, if it has one.
+static boolean R_GetFlatRangePwad(UINT16 wadnum, lumpnum_t *start, lumpnum_t *end)
+{
+	switch (wadfiles[wadnum]->type)
 	{
-		switch (wadfiles[i]->type)
+	case RET_WAD:
+		if ((*start = W_CheckNumForMarkerStartPwad("F_START", wadnum, 0)) == INT16_MAX)
 		{
-		case RET_WAD:
-			if ((start = W_CheckNumForMarkerStartPwad("F_START", (UINT16)i, 0)) == INT16_MAX)
-			{
-				if ((start = W_CheckNumForMarkerStartPwad("FF_START", (UINT16)i, 0)) == INT16_MAX)
-					continue;
-				else if ((end = W_CheckNumForNamePwad("FF_END", (UINT16)i, start)) == INT16_MAX)
-					continue;
-			}
-			else
-				if ((end = W_CheckNumForNamePwad("F_END", (UINT16)i, start)) == INT16_MAX)
-					continue;
-			break;
-		case RET_PK3:
-		case RET_FOLDER:
-			if ((start = W_CheckNumForFolderStartPK3("Flats/", i, 0)) == INT16_MAX)
-				continue;
-			if ((end = W_CheckNumForFolderEndPK3("Flats/", i, start)) == INT16_MAX)
-				continue;
-			break;
-		default:
-			continue;
+			if ((*start = W_CheckNumForMarkerStartPwad("FF_START", wadnum, 0)) == INT16_MAX)
+				return false;
+			else if ((*end = W_CheckNumForNamePwad("FF_END", wadnum, *start)) == INT16_MAX)
+				return false;
 		}
+		else
+			if ((*end = W_CheckNumForNamePwad("F_END", wadnum, *start)) == INT16_MAX)
+				return false;
+		return true;
+	case RET_PK3:
+	case RET_FOLDER:
+		if ((*start = W_CheckNumForFolderStartPK3("Flats/", wadnum, 0)) == INT16_MAX)
+			return false;
+		if ((*end = W_CheckNumForFolderEndPK3("Flats/", wadnum, *start)) == INT16_MAX)
+			return false;
+		return true;
+	default:
+		return false;
+	}
+}
 
-		// Now find lump with specified name in that range.
-		lump = W_CheckNumForNamePwad(name, (UINT16)i, start);
-		if (lump < end)
+//
+// R_BuildFlatNameIndex
+//
+// Chains every lump in every flat range. Wad files are walked forwards
+// and each range backwards, so a chain lists later files first, and the
+// first lump of a name within a file before any duplicates.
+//
+static void R_BuildFlatNameIndex(void)
+{
+	lumpnum_t *ranges = Z_Malloc(numwadfiles * 2 * sizeof (*ranges), PU_STATIC, NULL);
+	size_t numflats = 0;
+	INT32 n = 0;
+	UINT16 w;
+
+	for (w = 0; w < numwadfiles; w++)
+	{
+		if (R_GetFlatRangePwad(w, &ranges[w*2], &ranges[w*2 + 1]))
+			numflats += ranges[w*2 + 1] - ranges[w*2];
+		else
+			ranges[w*2] = ranges[w*2 + 1] = 0;
+	}
+
+	if (flatbuckets)
+	{
+		Z_Free(flatbuckets);
+		Z_Free(flatnext);
+		Z_Free(flatlumps);
+	}
+
+	flatbucketmask = R_NameIndexSize(numflats) - 1;
+	flatbuckets = Z_Malloc((flatbucketmask + 1) * sizeof (*flatbuckets), PU_STATIC, NULL);
+	flatnext = Z_Malloc(max(numflats, 1) * sizeof (*flatnext), PU_STATIC, NULL);
+	flatlumps = Z_Malloc(max(numflats, 1) * sizeof (*flatlumps), PU_STATIC, NULL);
+	memset(flatbuckets, 0xFF, (flatbucketmask + 1) * sizeof (*flatbuckets));
+
+	for (w = 0; w < numwadfiles; w++)
+	{
+		lumpnum_t lump = ranges[w*2 + 1];
+
+		while (lump-- > ranges[w*2])
 		{
-			lump += (i<<16); // found it, in our constraints
-			break;
+			INT32 bucket = wadfiles[w]->lumpinfo[lump].hash & flatbucketmask;
+			flatlumps[n] = (w<<16) + lump;
+			flatnext[n] = flatbuckets[bucket];
+			flatbuckets[bucket] = n++;
 		}
-		lump = LUMPERROR;
 	}
 
-	return lump;
+	Z_Free(ranges);
+	flatindexnumwads = numwadfiles;
+}
+
+// Search for flat name.
+lumpnum_t R_GetFlatNumForName(const char *name)
+{
+	char uname[8 + 1];
+	UINT32 hash;
+	INT32 i;
+	precise_t t = I_GetPreciseTime();
+
+	if (flatindexnumwads != numwadfiles)
+		R_BuildFlatNameIndex();
+
+	// Flats are matched the same way W_CheckNumForNamePwad does it.
+	strlcpy(uname, name, sizeof uname);
+	strupr(uname);
+	hash = quickncasehash(uname, 8);
+
+	for (i = flatbuckets[hash & flatbucketmask]; i != -1; i = flatnext[i])
+	{
+		lumpinfo_t *lump_p = &wadfiles[WADFILENUM(flatlumps[i])]->lumpinfo[LUMPNUM(flatlumps[i])];
+
+		if (lump_p->hash == hash && !strncmp(lump_p->name, uname, sizeof(uname) - 1))
+			break;
+	}
+
+	texturelookuptime += I_GetPreciseTime() - t;
+	return (i != -1) ? flatlumps[i] : LUMPERROR;
 }
 
 void R_ClearTextureNumCache(boolean btell)
 {
-	if (tidcache)
-		Z_Free(tidcache);
-	tidcache = NULL;
 	if (btell)
-		CONS_Debug(DBG_SETUP, "Fun Fact: There are %d textures used in this map.\n", tidcachelen);
-	tidcachelen = 0;
+		CONS_Debug(DBG_SETUP, "Fun Fact: There are %d textures used in this map. (%d us spent on name lookups)\n", numtexturesused, (int)(texturelookuptime * 1000000 / I_GetPrecisePrecision()));
+	textureindexvalid = false;
+	flatindexnumwads = -1;
+	texturelookuptime = 0;
+}
+
+//
+// R_BuildTextureNameIndex
+//
+// Textures are chained from first to last, so the newest texture of a
+// name comes first.
+//
+static void R_BuildTextureNameIndex(void)
+{
+	INT32 i;
+
+	if (texturebuckets)
+	{
+		Z_Free(texturebuckets);
+		Z_Free(texturenext);
+		Z_Free(textureused);
+	}
+
+	texturebucketmask = R_NameIndexSize(numtextures) - 1;
+	texturebuckets = Z_Malloc((texturebucketmask + 1) * sizeof (*texturebuckets), PU_STATIC, NULL);
+	texturenext = Z_Malloc(max(numtextures, 1) * sizeof (*texturenext), PU_STATIC, NULL);
+	textureused = Z_Calloc(max(numtextures, 1) * sizeof (*textureused), PU_STATIC, NULL);
+	memset(texturebuckets, 0xFF, (texturebucketmask + 1) * sizeof (*texturebuckets));
+
+	for (i = 0; i < numtextures; i++)
+	{
+		INT32 bucket = textures[i]->hash & texturebucketmask;
+		texturenext[i] = texturebuckets[bucket];
+		texturebuckets[bucket] = i;
+	}
+
+	numtexturesused = 0;
+	textureindexvalid = true;
 }
 
 //
@@ -1631,35 +1748,36 @@ INT32 R_CheckTextureNumForName(const char *name)
 {
 	INT32 i;
 	UINT32 hash;
+	precise_t t;
 
 	// "NoTexture" marker.
 	if (name[0] == '-')
 		return 0;
 
-	hash = quickncasehash(name, 8);
+	t = I_GetPreciseTime();
 
-	for (i = 0; i < tidcachelen; i++)
-		if (tidcache[i].hash == hash && !strncasecmp(tidcache[i].name, name, 8))
-			return tidcache[i].id;
+	if (!textureindexvalid)
+		R_BuildTextureNameIndex();
+
+	hash = quickncasehash(name, 8);
 
-	// Need to parse the list backwards, so textures loaded more recently are used in lieu of ones loaded earlier
-	//for (i = 0; i < numtextures; i++) <- old
-	for (i = (numtextures - 1); i >= 0; i--) // <- new
+	// Textures loaded more recently are used in lieu of ones loaded earlier
+	for (i = texturebuckets[hash & texturebucketmask]; i != -1; i = texturenext[i])
 		if (textures[i]->hash == hash && !strncasecmp(textures[i]->name, name, 8))
 		{
-			tidcachelen++;
-			Z_Realloc(tidcache, tidcachelen * sizeof(*tidcache), PU_STATIC, &tidcache);
-			strncpy(tidcache[tidcachelen-1].name, name, 8);
-			tidcache[tidcachelen-1].name[8] = '\0';
+			if (!textureused[i])
+			{
+				textureused[i] = 1;
+				numtexturesused++;
 #ifndef ZDEBUG
-			CONS_Debug(DBG_SETUP, "texture #%s: %s\n", sizeu1(tidcachelen), tidcache[tidcachelen-1].name);
+				CONS_Debug(DBG_SETUP, "texture #%d: %.8s\n", numtexturesused, textures[i]->name);
 #endif
-			tidcache[tidcachelen-1].hash = hash;
-			tidcache[tidcachelen-1].id = i;
-			return i;
+			}
+			break;
 		}
 
-	return -1;
+	texturelookuptime += I_GetPreciseTime() - t;
+	return i;
 }
 
 //
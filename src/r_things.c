@@ -603,6 +603,61 @@ void R_InitSprites(void)
 void R_ClearSprites(void)
 {
 	visspritecount = numvisiblesprites = clippedvissprites = 0;
+	R_ClearPrecipProxies();
+}
+
+//
+// Precipitation proxies
+//
+// Drops aren't mobjs, but vissprites (and the hardware renderer's
+// sorting and lighting) want one to point at. Every drop that makes it
+// into a vissprite borrows one of these until the sprites are cleared.
+//
+static precipmobj_t *precipproxychunks[MAXVISSPRITES >> VISSPRITECHUNKBITS] = {NULL};
+static UINT32 precipproxycount;
+
+void R_ClearPrecipProxies(void)
+{
+	precipproxycount = 0;
+}
+
+precipmobj_t *R_GetPrecipProxy(size_t i, fixed_t z)
+{
+	precipmobj_t *mobj;
+	state_t *st = &states[precipitation.state[i]];
+	UINT32 chunk;
+
+	if (precipproxycount == MAXVISSPRITES)
+		return NULL;
+
+	chunk = precipproxycount >> VISSPRITECHUNKBITS;
+
+	// Allocate chunk if necessary
+	if (!precipproxychunks[chunk])
+		Z_Malloc(sizeof(precipmobj_t) * VISSPRITESPERCHUNK, PU_LEVEL, &precipproxychunks[chunk]);
+
+	mobj = precipproxychunks[chunk] + (precipproxycount++ & VISSPRITEINDEXMASK);
+	memset(mobj, 0, sizeof (*mobj));
+
+	// Already interpolated, so the old positions are the same
+	mobj->x = mobj->old_x = mobj->old_x2 = precipitation.x[i];
+	mobj->y = mobj->old_y = mobj->old_y2 = precipitation.y[i];
+	mobj->z = mobj->old_z = mobj->old_z2 = z;
+
+	mobj->state = st;
+	mobj->tics = precipitation.tics[i];
+	mobj->sprite = st->sprite;
+	mobj->frame = precipitation.frame[i];
+	mobj->anim_duration = precipitation.animtics[i];
+	mobj->flags = mobjinfo[(precipitation.flags[i] & PCF_RAIN) ? MT_RAIN : MT_SNOWFLAKE].flags;
+	mobj->precipflags = precipitation.flags[i];
+
+	mobj->subsector = precipitation.subsector[i];
+	mobj->floorz = precipitation.floorz[i];
+	mobj->ceilingz = precipitation.ceilingz[i];
+	mobj->momz = precipitation.vz[i];
+
+	return mobj;
 }
 
 //
@@ -2378,7 +2433,7 @@ static void R_ProjectSprite(mobj_t *thing)
 	++objectsdrawn;
 }
 
-static void R_ProjectPrecipitationSprite(precipmobj_t *thing)
+static void R_ProjectPrecipitationSprite(size_t i)
 {
 	fixed_t tr_x, tr_y;
 	fixed_t tx, tz;
@@ -2391,6 +2446,10 @@ static void R_ProjectPrecipitationSprite(precipmobj_t *thing)
 	size_t lump;
 
 	vissprite_t *vis;
+	precipmobj_t *thing;
+	sector_t *sector = precipitation.subsector[i]->sector;
+	const spritenum_t sprite = states[precipitation.state[i]].sprite;
+	const UINT32 frame = precipitation.frame[i];
 
 	fixed_t iscale;
 
@@ -2398,21 +2457,18 @@ static void R_ProjectPrecipitationSprite(precipmobj_t *thing)
 	fixed_t gz, gzt;
 
 	// uncapped/interpolation
-	interpmobjstate_t interp = {0};
+	const fixed_t x = precipitation.x[i], y = precipitation.y[i];
+	fixed_t z;
 
 	// do interpolation
 	if (R_UsingFrameInterpolation() && !paused)
-	{
-		R_InterpolatePrecipMobjState(thing, rendertimefrac, &interp);
-	}
+		z = R_InterpolatePrecipZ(i, rendertimefrac);
 	else
-	{
-		R_InterpolatePrecipMobjState(thing, FRACUNIT, &interp);
-	}
+		z = R_InterpolatePrecipZ(i, FRACUNIT);
 
 	// transform the origin point
-	tr_x = interp.x - viewx;
-	tr_y = interp.y - viewy;
+	tr_x = x - viewx;
+	tr_y = y - viewy;
 
 	tz = FixedMul(tr_x, viewcos) + FixedMul(tr_y, viewsin); // near/far distance
 
@@ -2432,24 +2488,24 @@ static void R_ProjectPrecipitationSprite(precipmobj_t *thing)
 
 	// decide which patch to use for sprite relative to player
 #ifdef RANGECHECK
-	if ((unsigned)thing->sprite >= numsprites)
+	if ((unsigned)sprite >= numsprites)
 		I_Error("R_ProjectPrecipitationSprite: invalid sprite number %d ",
-			thing->sprite);
+			sprite);
 #endif
 
-	sprdef = &sprites[thing->sprite];
+	sprdef = &sprites[sprite];
 
 #ifdef RANGECHECK
-	if ((UINT8)(thing->frame&FF_FRAMEMASK) >= sprdef->numframes)
+	if ((UINT8)(frame&FF_FRAMEMASK) >= sprdef->numframes)
 		I_Error("R_ProjectPrecipitationSprite: invalid sprite frame %d : %d for %s",
-			thing->sprite, thing->frame, sprnames[thing->sprite]);
+			sprite, frame, sprnames[sprite]);
 #endif
 
-	sprframe = &sprdef->spriteframes[thing->frame & FF_FRAMEMASK];
+	sprframe = &sprdef->spriteframes[frame & FF_FRAMEMASK];
 
 #ifdef PARANOIA
 	if (!sprframe)
-		I_Error("R_ProjectPrecipitationSprite: sprframes NULL for sprite %d\n", thing->sprite);
+		I_Error("R_ProjectPrecipitationSprite: sprframes NULL for sprite %d\n", sprite);
 #endif
 
 	// use single rotation for all views
@@ -2476,31 +2532,35 @@ static void R_ProjectPrecipitationSprite(precipmobj_t *thing)
 		if (x2 < portalclipstart || x1 >= portalclipend)
 			return;
 
-		if (P_PointOnLineSide(interp.x, interp.y, portalclipline) != 0)
+		if (P_PointOnLineSide(x, y, portalclipline) != 0)
 			return;
 	}
 
 
 	//SoM: 3/17/2000: Disregard sprites that are out of view..
-	gzt = interp.z + spritecachedinfo[lump].topoffset;
+	gzt = z + spritecachedinfo[lump].topoffset;
 	gz = gzt - spritecachedinfo[lump].height;
 
-	if (thing->subsector->sector->cullheight)
+	if (sector->cullheight)
 	{
-		if (R_DoCulling(thing->subsector->sector->cullheight, viewsector->cullheight, viewz, gz, gzt))
-			goto weatherthink;
+		if (R_DoCulling(sector->cullheight, viewsector->cullheight, viewz, gz, gzt))
+			return;
 	}
 
+	thing = R_GetPrecipProxy(i, z);
+	if (!thing)
+		return;
+
 	// store information in a vissprite
 	vis = R_NewVisSprite();
 	vis->scale = vis->sortscale = yscale; //<<detailshift;
 	vis->dispoffset = 0; // Monster Iestyn: 23/11/15
-	vis->gx = interp.x;
-	vis->gy = interp.y;
+	vis->gx = x;
+	vis->gy = y;
 	vis->gz = gz;
 	vis->gzt = gzt;
 	vis->thingheight = 4*FRACUNIT;
-	vis->pz = interp.z;
+	vis->pz = z;
 	vis->pzt = vis->pz + vis->thingheight;
 	vis->texturemid = vis->gzt - viewz;
 	vis->scalestep = 0;
@@ -2512,7 +2572,7 @@ static void R_ProjectPrecipitationSprite(precipmobj_t *thing)
 	vis->x2 = x2 >= portalclipend ? portalclipend-1 : x2;
 
 	vis->xscale = xscale; //SoM: 4/17/2000
-	vis->sector = thing->subsector->sector;
+	vis->sector = sector;
 	vis->szt = (INT16)((centeryfrac - FixedMul(vis->gzt - viewz, yscale))>>FRACBITS);
 	vis->sz = (INT16)((centeryfrac - FixedMul(vis->gz - viewz, yscale))>>FRACBITS);
 
@@ -2529,31 +2589,20 @@ static void R_ProjectPrecipitationSprite(precipmobj_t *thing)
 	vis->patch = W_CachePatchNum(sprframe->lumppat[0], PU_SPRITE);
 
 	// specific translucency
-	if (thing->frame & FF_TRANSMASK)
-		vis->transmap = R_GetTranslucencyTable((thing->frame & FF_TRANSMASK) >> FF_TRANSSHIFT);
+	if (frame & FF_TRANSMASK)
+		vis->transmap = R_GetTranslucencyTable((frame & FF_TRANSMASK) >> FF_TRANSSHIFT);
 	else
 		vis->transmap = NULL;
 
 	vis->mobj = (mobj_t *)thing;
 	vis->mobjflags = 0;
 	vis->cut = SC_PRECIP;
-	vis->extra_colormap = thing->subsector->sector->extra_colormap;
-	vis->heightsec = thing->subsector->sector->heightsec;
+	vis->extra_colormap = sector->extra_colormap;
+	vis->heightsec = sector->heightsec;
 	vis->color = SKINCOLOR_NONE;
 
 	// Fullbright
 	vis->colormap = colormaps;
-
-weatherthink:
-	// okay... this is a hack, but weather isn't networked, so it should be ok
-	if (!(thing->precipflags & PCF_THUNK))
-	{
-		if (thing->precipflags & PCF_RAIN)
-			P_RainThinker(thing);
-		else
-			P_SnowThinker(thing);
-		thing->precipflags |= PCF_THUNK;
-	}
 }
 
 // R_AddSprites
@@ -2562,7 +2611,7 @@ weatherthink:
 void R_AddSprites(sector_t *sec, INT32 lightlevel)
 {
 	mobj_t *thing;
-	precipmobj_t *precipthing; // Tails 08-25-2002
+	size_t i, end; // precipitation drops
 	INT32 lightnum;
 	fixed_t limit_dist, hoop_limit_dist;
 
@@ -2622,12 +2671,13 @@ void R_AddSprites(sector_t *sec, INT32 lightlevel)
 	}
 
 	// no, no infinite draw distance for precipitation. this option at zero is supposed to turn it off
-	if ((limit_dist = (fixed_t)cv_drawdist_precip.value << FRACBITS))
+	if ((limit_dist = (fixed_t)cv_drawdist_precip.value << FRACBITS) && precipitation.block)
 	{
-		for (precipthing = sec->preciplist; precipthing; precipthing = precipthing->snext)
+		end = precipitation.sectorstart[sec - sectors + 1];
+		for (i = precipitation.sectorstart[sec - sectors]; i < end; i++)
 		{
-			if (R_PrecipThingVisible(precipthing, limit_dist))
-				R_ProjectPrecipitationSprite(precipthing);
+			if (R_PrecipDropVisible(i, limit_dist))
+				R_ProjectPrecipitationSprite(i);
 		}
 	}
 }
@@ -2647,17 +2697,86 @@ static boolean R_SortVisSpriteFunc(vissprite_t *ds, fixed_t bestscale, INT32 bes
 	return false;
 }
 
+//
+// Vissprite sort keys.
+// (sortscale, dispoffset) is packed into one unsigned key per sprite,
+// with both halves biased so that comparing the keys as unsigned
+// integers gives the same order as R_SortVisSpriteFunc.
+//
+#define VSPRSORTKEY_DIGITS 8
+
+static UINT64 vsprsortkeys[2][MAXVISSPRITES];
+static vissprite_t *vsprsortitems[2][MAXVISSPRITES];
+
+static inline UINT64 R_VisSpriteSortKey(const vissprite_t *ds)
+{
+	return ((UINT64)((UINT32)ds->sortscale ^ 0x80000000u) << 32)
+		| (UINT64)((UINT32)ds->dispoffset ^ 0x80000000u);
+}
+
+//
+// R_RadixSortVisSprites
+// Stable LSD radix sort of the cached keys, one byte per pass.
+// Passes whose digit is the same for every sprite are skipped, which
+// is most of them, since dispoffset rarely leaves the low byte.
+// Returns the buffer index holding the sorted result.
+//
+static UINT8 R_RadixSortVisSprites(UINT32 count)
+{
+	UINT32 histogram[VSPRSORTKEY_DIGITS][256];
+	UINT32 i, d, sum, tmp;
+	UINT8 src = 0;
+
+	memset(histogram, 0, sizeof(histogram));
+
+	for (i = 0; i < count; i++)
+	{
+		UINT64 key = vsprsortkeys[0][i];
+		for (d = 0; d < VSPRSORTKEY_DIGITS; d++)
+			histogram[d][(key >> (d << 3)) & 0xFF]++;
+	}
+
+	for (d = 0; d < VSPRSORTKEY_DIGITS; d++)
+	{
+		UINT32 *bucket = histogram[d];
+		const UINT32 shift = d << 3;
+		const UINT8 dst = src ^ 1;
+
+		// Every key has the same digit here, nothing to do
+		if (bucket[(vsprsortkeys[src][0] >> shift) & 0xFF] == count)
+			continue;
+
+		for (i = 0, sum = 0; i < 256; i++)
+		{
+			tmp = bucket[i];
+			bucket[i] = sum;
+			sum += tmp;
+		}
+
+		for (i = 0; i < count; i++)
+		{
+			UINT64 key = vsprsortkeys[src][i];
+			UINT32 pos = bucket[(key >> shift) & 0xFF]++;
+			vsprsortkeys[dst][pos] = key;
+			vsprsortitems[dst][pos] = vsprsortitems[src][i];
+		}
+
+		src = dst;
+	}
+
+	return src;
+}
+
 //
 // R_SortVisSprites
 //
 static void R_SortVisSprites(vissprite_t* vsprsortedhead, UINT32 start, UINT32 end)
 {
-	UINT32       i, linkedvissprites = 0;
+	UINT32       i, count;
+	UINT8        sorted;
 	vissprite_t *ds, *dsprev, *dsnext, *dsfirst;
-	vissprite_t *best = NULL;
 	vissprite_t  unsorted;
-	fixed_t      bestscale;
-	INT32        bestdispoffset;
+	precise_t    sorttime = I_GetPreciseTime();
 
 	unsorted.next = unsorted.prev = &unsorted;
 
@@ -2744,8 +2863,6 @@ static void R_SortVisSprites(vissprite_t* vsprsortedhead, UINT32 start, UINT32 e
 		if (ds->cut & SC_NOTVISIBLE)
 			continue;
 
-		linkedvissprites++;
-
 		if (dsfirst != &unsorted)
 		{
 			if (!(ds->cut & SC_FULLBRIGHT))
@@ -2776,37 +2893,53 @@ static void R_SortVisSprites(vissprite_t* vsprsortedhead, UINT32 start, UINT32 e
 		}
 	}
 
-	// pull the vissprites out by scale
-	vsprsortedhead->next = vsprsortedhead->prev = vsprsortedhead;
-	for (i = start; i < end-linkedvissprites; i++)
+	// gather what's left, in list order, with its sort key
+	for (ds = unsorted.next, count = 0; ds != &unsorted; ds = ds->next)
 	{
-		bestscale = bestdispoffset = INT32_MAX;
-		for (ds = unsorted.next; ds != &unsorted; ds = ds->next)
-		{
+		UINT64 key;
+
 #ifdef PARANOIA
-			if (ds->cut & SC_LINKDRAW)
-				I_Error("R_SortVisSprites: no link or discardal made for linkdraw!");
+		if (ds->cut & SC_LINKDRAW)
+			I_Error("R_SortVisSprites: no link or discardal made for linkdraw!");
 #endif
 
-			if (R_SortVisSpriteFunc(ds, bestscale, bestdispoffset) == true)
-			{
-				bestscale = ds->sortscale;
-				bestdispoffset = ds->dispoffset;
-				best = ds;
-			}
-		}
-		if (best)
-		{
-			best->next->prev = best->prev;
-			best->prev->next = best->next;
-			best->next = vsprsortedhead;
-			best->prev = vsprsortedhead->prev;
-			vsprsortedhead->prev->next = best;
-			vsprsortedhead->prev = best;
-		}
+		key = R_VisSpriteSortKey(ds);
+
+		// The old selection pass started from (INT32_MAX, INT32_MAX)
+		// and could never pick a sprite with exactly that key.
+		if (key == UINT64_MAX)
+			continue;
+
+		vsprsortkeys[0][count] = key;
+		vsprsortitems[0][count] = ds;
+		count++;
 	}
+
+	// pull the vissprites out by scale
+	vsprsortedhead->next = vsprsortedhead->prev = vsprsortedhead;
+
+	if (count == 0)
+	{
+		ps_sw_spritesorttime.value.p += I_GetPreciseTime() - sorttime;
+		return;
+	}
+
+	sorted = R_RadixSortVisSprites(count);
+
+	for (i = 0; i < count; i++)
+	{
+		ds = vsprsortitems[sorted][i];
+		ds->next = vsprsortedhead;
+		ds->prev = vsprsortedhead->prev;
+		vsprsortedhead->prev->next = ds;
+		vsprsortedhead->prev = ds;
+	}
+
+	ps_sw_spritesorttime.value.p += I_GetPreciseTime() - sorttime;
 }
 
+#undef VSPRSORTKEY_DIGITS
+
 //
 // R_CreateDrawNodes
 // Creates and sorts a list of drawnodes for the scene being rendered.
@@ -3589,16 +3722,16 @@ boolean R_ThingWithinDist (mobj_t *thing,
 	return true;
 }
 
-/* Check if precipitation may be drawn from our current view. */
-boolean R_PrecipThingVisible (precipmobj_t *precipthing,
+/* Check if precipitation drop i may be drawn from our current view. */
+boolean R_PrecipDropVisible (size_t i,
 		fixed_t limit_dist)
 {
 	fixed_t approx_dist;
 
-	if (( precipthing->precipflags & PCF_INVISIBLE ))
+	if (( precipitation.flags[i] & PCF_INVISIBLE ))
 		return false;
 
-	approx_dist = P_AproxDistance(viewx-precipthing->x, viewy-precipthing->y);
+	approx_dist = P_AproxDistance(viewx-precipitation.x[i], viewy-precipitation.y[i]);
 
 	return ( approx_dist <= limit_dist );
 }
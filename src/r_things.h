@@ -75,9 +75,12 @@ boolean R_ThingWithinDist (mobj_t *thing,
 		fixed_t        draw_dist,
 		fixed_t nights_draw_dist);
 
-boolean R_PrecipThingVisible (precipmobj_t *precipthing,
+boolean R_PrecipDropVisible (size_t i,
 		fixed_t precip_draw_dist);
 
+void R_ClearPrecipProxies(void);
+precipmobj_t *R_GetPrecipProxy(size_t i, fixed_t z);
+
 boolean R_ThingHorizontallyFlipped (mobj_t *thing);
 boolean R_ThingVerticallyFlipped (mobj_t *thing);
 
@@ -2378,16 +2378,17 @@ INT32 I_StartupSystem(void)
 	SDL_version SDLlinked;
 	SDL_VERSION(&SDLcompiled)
 	SDL_GetVersion(&SDLlinked);
-#ifdef HAVE_THREADS
-	I_start_threads();
-	I_AddExitFunc(I_stop_threads);
-#endif
 	I_StartupConsole();
 #ifdef NEWSIGNALHANDLER
 	// This is useful when debugging. It lets GDB attach to
 	// the correct process easily.
 	if (!M_CheckParm("-nofork"))
 		I_Fork();
+#endif
+#ifdef HAVE_THREADS
+	// After forking, so the worker threads belong to the game process
+	I_start_threads();
+	I_AddExitFunc(I_stop_threads);
 #endif
 	I_RegisterSignals();
 	I_OutputMsg("Compiled for SDL version: %d.%d.%d\n",
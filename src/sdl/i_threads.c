@@ -11,6 +11,8 @@
 
 #include "../doomdef.h"
 #include "../i_threads.h"
+#include "../i_system.h"
+#include "../m_argv.h"
 
 #include <SDL.h>
 
@@ -47,6 +49,58 @@ static I_mutex        i_cond_pool_mutex;
 
 static SDL_atomic_t   i_threads_running = {1};
 
+/*
+Job system. Every worker owns a deque: it pushes and pops jobs at the
+bottom, and idle workers steal from the top of the others. Jobs
+scheduled from outside the pool go in one extra shared deque. The deques
+are short-lived critical sections, so a plain mutex guards each.
+*/
+
+struct I_job
+{
+	I_thread_fn    entry;
+	void         * userdata;
+
+	SDL_atomic_t   waiting;/* unfinished dependencies, plus one until scheduled */
+	SDL_atomic_t   done;
+	SDL_atomic_t   refs;/* the handle and the pool */
+
+	Link           dependents;/* guarded by i_job_graph_mutex */
+};
+
+typedef struct
+{
+	I_job       * jobs;/* ring buffer */
+	size_t        capacity;
+	size_t        top;
+	size_t        bottom;
+
+	SDL_mutex   * mutex;
+} Deque;
+
+typedef struct
+{
+	Deque         deque;
+	SDL_Thread  * thread;
+
+	/* guarded by deque.mutex */
+	precise_t     busy;
+	precise_t     idle;
+	UINT32        jobs;
+} Job_worker;
+
+static Job_worker     i_workers[I_MAX_WORKERS + 1];/* last is the shared one */
+static int            i_num_workers;
+
+static SDL_mutex    * i_job_mutex;
+static SDL_cond     * i_job_cond;
+static SDL_mutex    * i_job_graph_mutex;
+static SDL_TLSID      i_worker_tls;
+
+static SDL_atomic_t   i_jobs_queued;
+static SDL_atomic_t   i_workers_running;
+static int            i_job_sleepers;/* guarded by i_job_mutex */
+
 static Link
 Insert_link (
 		Link * head,
@@ -155,6 +209,443 @@ Worker (
 	return 0;
 }
 
+static int
+Self_index (void)
+{
+	size_t id = (size_t)SDL_TLSGet(i_worker_tls);
+	return ( id ? (int)id - 1 : i_num_workers );
+}
+
+static void
+Push_deque (
+		Deque * dq,
+		I_job   job
+){
+	SDL_LockMutex(dq->mutex);
+	{
+		if (dq->bottom - dq->top == dq->capacity)
+		{
+			size_t  capacity = ( dq->capacity ? dq->capacity * 2 : 64 );
+			I_job * jobs     = malloc(capacity * sizeof *jobs);
+			size_t  i;
+
+			if (! jobs)
+				abort();
+
+			for (i = dq->top; i != dq->bottom; ++i)
+				jobs[i % capacity] = dq->jobs[i % dq->capacity];
+
+			free(dq->jobs);
+			dq->jobs     = jobs;
+			dq->capacity = capacity;
+		}
+
+		dq->jobs[dq->bottom++ % dq->capacity] = job;
+	}
+	SDL_UnlockMutex(dq->mutex);
+}
+
+static I_job
+Pop_deque (
+		Deque * dq,
+		int     steal
+){
+	I_job job = NULL;
+
+	SDL_LockMutex(dq->mutex);
+	{
+		if (dq->bottom != dq->top)
+		{
+			if (steal)
+				job = dq->jobs[dq->top++ % dq->capacity];
+			else
+				job = dq->jobs[--dq->bottom % dq->capacity];
+		}
+	}
+	SDL_UnlockMutex(dq->mutex);
+
+	return job;
+}
+
+static void
+Wake_job_sleepers (void)
+{
+	SDL_LockMutex(i_job_mutex);
+	{
+		if (i_job_sleepers)
+			SDL_CondBroadcast(i_job_cond);
+	}
+	SDL_UnlockMutex(i_job_mutex);
+}
+
+static void
+Push_job (I_job job)
+{
+	Push_deque(&i_workers[Self_index()].deque, job);
+	SDL_AtomicIncRef(&i_jobs_queued);
+	Wake_job_sleepers();
+}
+
+static I_job
+Find_job (int self)
+{
+	I_job job;
+	int   i;
+
+	if (! SDL_AtomicGet(&i_jobs_queued))
+		return NULL;
+
+	job = Pop_deque(&i_workers[self].deque, 0);
+
+	for (i = 1; ! job && i <= i_num_workers; ++i)
+		job = Pop_deque(&i_workers[( self + i ) % ( i_num_workers + 1 )].deque, 1);
+
+	if (job)
+		SDL_AtomicAdd(&i_jobs_queued, -1);
+
+	return job;
+}
+
+static void
+Release_job (I_job job)
+{
+	if (SDL_AtomicDecRef(&job->refs))
+		free(job);
+}
+
+static void
+Run_job (I_job job)
+{
+	Link link;
+	Link next;
+
+	(*job->entry)(job->userdata);
+
+	SDL_LockMutex(i_job_graph_mutex);
+	{
+		SDL_AtomicSet(&job->done, 1);
+		link = job->dependents;
+		job->dependents = NULL;
+	}
+	SDL_UnlockMutex(i_job_graph_mutex);
+
+	for (; link; link = next)
+	{
+		I_job dependent = link->data;
+
+		next = link->next;
+		free(link);
+
+		if (SDL_AtomicDecRef(&dependent->waiting))
+			Push_job(dependent);
+	}
+
+	Wake_job_sleepers();
+	Release_job(job);
+}
+
+/* sleeps until there is a job to take, *done is set or the pool stops */
+static void
+Wait_for_work (SDL_atomic_t *done)
+{
+	SDL_LockMutex(i_job_mutex);
+	{
+		while (
+				! SDL_AtomicGet(&i_jobs_queued) &&
+				! ( done && SDL_AtomicGet(done) ) &&
+				SDL_AtomicGet(&i_workers_running)
+		){
+			i_job_sleepers++;
+			SDL_CondWait(i_job_cond, i_job_mutex);
+			i_job_sleepers--;
+		}
+	}
+	SDL_UnlockMutex(i_job_mutex);
+}
+
+static int
+Job_worker_main (void *userdata)
+{
+	int          self = (int)(size_t)userdata;
+	Job_worker * w    = &i_workers[self];
+	precise_t    start;
+	precise_t    end;
+	I_job        job;
+
+	SDL_TLSSet(i_worker_tls, (void *)(size_t)( self + 1 ), NULL);
+
+	start = I_GetPreciseTime();
+
+	while (SDL_AtomicGet(&i_workers_running))
+	{
+		job = Find_job(self);
+
+		if (job)
+		{
+			Run_job(job);
+			end = I_GetPreciseTime();
+
+			SDL_LockMutex(w->deque.mutex);
+			w->busy += end - start;
+			w->jobs++;
+			SDL_UnlockMutex(w->deque.mutex);
+		}
+		else
+		{
+			Wait_for_work(NULL);
+			end = I_GetPreciseTime();
+
+			SDL_LockMutex(w->deque.mutex);
+			w->idle += end - start;
+			SDL_UnlockMutex(w->deque.mutex);
+		}
+
+		start = end;
+	}
+
+	return 0;
+}
+
+I_job
+I_schedule_job (
+		I_thread_fn    entry,
+		void         * userdata,
+		const I_job  * deps,
+		size_t         numdeps
+){
+	I_job  job;
+	size_t i;
+
+	job = malloc(sizeof *job);
+
+	if (! job)
+		abort();
+
+	job->entry      = entry;
+	job->userdata   = userdata;
+	job->dependents = NULL;
+
+	SDL_AtomicSet(&job->waiting, 1);
+	SDL_AtomicSet(&job->done,    0);
+	SDL_AtomicSet(&job->refs,    2);
+
+	if (numdeps)
+	{
+		SDL_LockMutex(i_job_graph_mutex);
+		{
+			for (i = 0; i < numdeps; ++i)
+			{
+				if (! SDL_AtomicGet(&deps[i]->done))
+				{
+					SDL_AtomicIncRef(&job->waiting);
+					Insert_link(&deps[i]->dependents, New_link(job));
+				}
+			}
+		}
+		SDL_UnlockMutex(i_job_graph_mutex);
+	}
+
+	if (SDL_AtomicDecRef(&job->waiting))
+		Push_job(job);
+
+	return job;
+}
+
+void
+I_wait_job (I_job job)
+{
+	I_job other;
+
+	while (! SDL_AtomicGet(&job->done))
+	{
+		other = Find_job(Self_index());
+
+		if (other)
+			Run_job(other);
+		else
+			Wait_for_work(&job->done);
+	}
+
+	Release_job(job);
+}
+
+int
+I_run_queued_job (void)
+{
+	I_job job = Find_job(Self_index());
+
+	if (! job)
+		return 0;
+
+	Run_job(job);
+	return 1;
+}
+
+typedef struct
+{
+	I_range_fn     fn;
+	void         * userdata;
+	size_t         count;
+	size_t         grain;
+	SDL_atomic_t   next;
+} Range;
+
+static void
+Range_job (void *userdata)
+{
+	Range  * range = userdata;
+	size_t   start;
+
+	for (;;)
+	{
+		start = (size_t)SDL_AtomicAdd(&range->next, 1) * range->grain;
+
+		if (start >= range->count)
+			break;
+
+		(*range->fn)(start, min(start + range->grain, range->count), range->userdata);
+	}
+}
+
+void
+I_parallel_for (
+		size_t       count,
+		size_t       grain,
+		I_range_fn   fn,
+		void       * userdata
+){
+	I_job  helpers[I_MAX_WORKERS];
+	Range  range;
+	size_t chunks;
+	size_t numhelpers;
+	size_t i;
+
+	if (! count)
+		return;
+
+	if (! grain)
+		grain = 1;
+
+	range.fn       = fn;
+	range.userdata = userdata;
+	range.count    = count;
+	range.grain    = grain;
+	SDL_AtomicSet(&range.next, 0);
+
+	chunks     = ( count + grain - 1 ) / grain;
+	numhelpers = min(chunks - 1, (size_t)i_num_workers);
+
+	for (i = 0; i < numhelpers; ++i)
+		helpers[i] = I_schedule_job(Range_job, &range, NULL, 0);
+
+	Range_job(&range);
+
+	for (i = 0; i < numhelpers; ++i)
+		I_wait_job(helpers[i]);
+}
+
+int
+I_worker_count (void)
+{
+	return i_num_workers;
+}
+
+void
+I_worker_stats (
+		int         worker,
+		precise_t * busy,
+		precise_t * idle,
+		UINT32    * jobs
+){
+	Job_worker * w = &i_workers[worker];
+
+	SDL_LockMutex(w->deque.mutex);
+	{
+		*busy = w->busy;
+		*idle = w->idle;
+		*jobs = w->jobs;
+
+		w->busy = w->idle = 0;
+		w->jobs = 0;
+	}
+	SDL_UnlockMutex(w->deque.mutex);
+}
+
+static void
+Start_workers (void)
+{
+	const char * p;
+	int          i;
+
+	i_job_mutex       = SDL_CreateMutex();
+	i_job_cond        = SDL_CreateCond();
+	i_job_graph_mutex = SDL_CreateMutex();
+	i_worker_tls      = SDL_TLSCreate();
+
+	if (!(
+				i_job_mutex       &&
+				i_job_cond        &&
+				i_job_graph_mutex &&
+				i_worker_tls
+	)){
+		abort();
+	}
+
+	if (M_CheckParm("-workers") && ( p = M_GetNextParm() ))
+		i_num_workers = atoi(p);
+	else
+		i_num_workers = SDL_GetCPUCount() - 1;/* the main thread helps out */
+
+	i_num_workers = max(0, min(i_num_workers, I_MAX_WORKERS));
+
+	for (i = 0; i <= i_num_workers; ++i)
+	{
+		i_workers[i].deque.mutex = SDL_CreateMutex();
+
+		if (! i_workers[i].deque.mutex)
+			abort();
+	}
+
+	SDL_AtomicSet(&i_workers_running, 1);
+
+	for (i = 0; i < i_num_workers; ++i)
+	{
+		i_workers[i].thread = SDL_CreateThread(
+				Job_worker_main,
+				"srb2worker",
+				(void *)(size_t)i
+		);
+
+		if (! i_workers[i].thread)
+			abort();
+	}
+}
+
+static void
+Stop_workers (void)
+{
+	int i;
+
+	SDL_AtomicSet(&i_workers_running, 0);
+
+	SDL_LockMutex(i_job_mutex);
+	SDL_CondBroadcast(i_job_cond);
+	SDL_UnlockMutex(i_job_mutex);
+
+	for (i = 0; i < i_num_workers; ++i)
+		SDL_WaitThread(i_workers[i].thread, NULL);
+
+	for (i = 0; i <= i_num_workers; ++i)
+	{
+		free(i_workers[i].deque.jobs);
+		SDL_DestroyMutex(i_workers[i].deque.mutex);
+	}
+
+	SDL_DestroyCond(i_job_cond);
+	SDL_DestroyMutex(i_job_mutex);
+	SDL_DestroyMutex(i_job_graph_mutex);
+}
+
 void
 I_spawn_thread (
 		const char  * name,
@@ -211,6 +702,8 @@ I_start_threads (void)
 	)){
 		abort();
 	}
+
+	Start_workers();
 }
 
 void
@@ -228,6 +721,8 @@ I_stop_threads (void)
 		/* rely on the good will of thread-san */
 		SDL_AtomicSet(&i_threads_running, 0);
 
+		Stop_workers();
+
 		I_lock_mutex(&i_thread_pool_mutex);
 		{
 			for (
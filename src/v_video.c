@@ -86,6 +86,7 @@ consvar_t cv_constextsize = CVAR_INIT ("con_textsize", "Medium", CV_SAVE|CV_CALL
 // local copy of the palette for V_GetColor()
 RGBA_t *pLocalPalette = NULL;
 RGBA_t *pMasterPalette = NULL;
+palettecube_t masterpalettecube;
 
 /*
 The following was an extremely helpful resource when developing my Colour Cube LUT.
@@ -340,6 +341,8 @@ static void LoadPalette(const char *lumpname)
 		if (Cubeapply)
 			V_CubeApply(&pLocalPalette[i].s.red, &pLocalPalette[i].s.green, &pLocalPalette[i].s.blue);
 	}
+
+	InitPaletteCube(&masterpalettecube, pMasterPalette);
 }
 
 void V_CubeApply(UINT8 *red, UINT8 *green, UINT8 *blue)
@@ -2667,6 +2670,123 @@ Unoptimized version
 #endif
 }
 
+// Resets a palette look-up cube to work with the given palette,
+// which it keeps a pointer to rather than a copy.
+void InitPaletteCube(palettecube_t *cube, RGBA_t *palette)
+{
+	cube->palette = palette;
+	cube->used = 1; // offset 0 means "not worked out yet"
+	if (cube->cells)
+		memset(cube->cells, 0, PALCUBECELLS * sizeof (*cube->cells));
+}
+
+// Works out which palette entries can be the nearest color to anything
+// in a cell: every entry whose closest point in the cell is no farther
+// than the least of the entries' farthest points.
+static UINT32 BuildPaletteCubeCell(palettecube_t *cube, INT32 cell)
+{
+	const INT32 width = 1 << (8 - PALCUBEBITS);
+	INT32 lo[3], dmin[256], bound = INT32_MAX;
+	INT32 i, c;
+	UINT32 offset;
+
+	lo[0] = ((cell >> (PALCUBEBITS * 2)) & ((1 << PALCUBEBITS) - 1)) * width;
+	lo[1] = ((cell >> PALCUBEBITS) & ((1 << PALCUBEBITS) - 1)) * width;
+	lo[2] = (cell & ((1 << PALCUBEBITS) - 1)) * width;
+
+	for (i = 0; i < 256; i++)
+	{
+		const INT32 v[3] = {cube->palette[i].s.red, cube->palette[i].s.green, cube->palette[i].s.blue};
+		INT32 dmax = 0;
+
+		dmin[i] = 0;
+		for (c = 0; c < 3; c++)
+		{
+			const INT32 tolo = v[c] - lo[c], tohi = v[c] - (lo[c] + width - 1);
+			const INT32 farthest = max(abs(tolo), abs(tohi));
+
+			if (tolo < 0)
+				dmin[i] += tolo * tolo;
+			else if (tohi > 0)
+				dmin[i] += tohi * tohi;
+			dmax += farthest * farthest;
+		}
+
+		if (dmax < bound)
+			bound = dmax;
+	}
+
+	if (cube->used + 257 > cube->size)
+	{
+		cube->size = max(cube->size * 2, 16384);
+		cube->candidates = Z_Realloc(cube->candidates, cube->size, PU_STATIC, &cube->candidates);
+	}
+
+	offset = (UINT32)cube->used++;
+	cube->candidates[offset] = 0;
+	for (i = 0; i < 256; i++)
+	{
+		if (dmin[i] <= bound)
+			cube->candidates[cube->used++] = (UINT8)i;
+	}
+	cube->candidates[offset] = (UINT8)(cube->used - offset - 2);
+
+	return (cube->cells[cell] = offset);
+}
+
+// Works out every cell up front, so that the cube
+// can be read from several threads at once.
+void FillPaletteCube(palettecube_t *cube)
+{
+	INT32 cell;
+
+	if (!cube->cells)
+		cube->cells = Z_Calloc(PALCUBECELLS * sizeof (*cube->cells), PU_STATIC, &cube->cells);
+
+	for (cell = 0; cell < PALCUBECELLS; cell++)
+		if (!cube->cells[cell])
+			BuildPaletteCubeCell(cube, cell);
+}
+
+UINT8 GetPaletteCubeColor(palettecube_t *cube, UINT8 r, UINT8 g, UINT8 b)
+{
+	const INT32 cell = PALCUBEINDEX(r, g, b);
+	INT32 dr, dg, db;
+	INT32 distortion, bestdistortion = 256 * 256 * 4, bestcolor = 0;
+	UINT32 offset;
+	UINT8 *candidate;
+	INT32 count;
+
+	if (!cube->cells)
+		cube->cells = Z_Calloc(PALCUBECELLS * sizeof (*cube->cells), PU_STATIC, &cube->cells);
+
+	if (!(offset = cube->cells[cell]))
+		offset = BuildPaletteCubeCell(cube, cell);
+
+	candidate = &cube->candidates[offset];
+	count = *candidate++ + 1;
+
+	// Same comparisons as NearestPaletteColor, so ties go the same way
+	for (; count--; candidate++)
+	{
+		const RGBA_t *color = &cube->palette[*candidate];
+		dr = r - color->s.red;
+		dg = g - color->s.green;
+		db = b - color->s.blue;
+		distortion = dr*dr + dg*dg + db*db;
+		if (distortion < bestdistortion)
+		{
+			if (!distortion)
+				return *candidate;
+
+			bestdistortion = distortion;
+			bestcolor = *candidate;
+		}
+	}
+
+	return (UINT8)bestcolor;
+}
+
 // Generates a RGB565 color look-up table
 void InitColorLUT(colorlookup_t *lut, RGBA_t *palette, boolean makecolors)
 {
@@ -2678,6 +2798,7 @@ void InitColorLUT(colorlookup_t *lut, RGBA_t *palette, boolean makecolors)
 
 		lut->init = true;
 		memcpy(lut->palette, palette, palsize);
+		InitPaletteCube(&lut->cube, lut->palette);
 
 		for (i = 0; i < 0xFFFF; i++)
 			lut->table[i] = 0xFFFF;
@@ -2692,7 +2813,7 @@ void InitColorLUT(colorlookup_t *lut, RGBA_t *palette, boolean makecolors)
 			{
 				i = CLUTINDEX(r, g, b);
 				if (lut->table[i] == 0xFFFF)
-					lut->table[i] = NearestPaletteColor(r, g, b, palette);
+					lut->table[i] = GetPaletteCubeColor(&lut->cube, r, g, b);
 			}
 		}
 	}
@@ -2702,7 +2823,7 @@ UINT8 GetColorLUT(colorlookup_t *lut, UINT8 r, UINT8 g, UINT8 b)
 {
 	INT32 i = CLUTINDEX(r, g, b);
 	if (lut->table[i] == 0xFFFF)
-		lut->table[i] = NearestPaletteColor(r, g, b, lut->palette);
+		lut->table[i] = GetPaletteCubeColor(&lut->cube, r, g, b);
 	return lut->table[i];
 }
 
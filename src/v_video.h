@@ -43,6 +43,26 @@ void V_Init(void);
 // Recalculates the viddef (dupx, dupy, etc.) according to the current screen resolution.
 void V_Recalc(void);
 
+// Palette look-up cube
+// The RGB space is split into cells, and each cell remembers which palette
+// entries could be the nearest color to anything inside it. A lookup only
+// measures those, and gives the same answer as a search of all 256.
+#define PALCUBEBITS 5
+#define PALCUBECELLS (1 << (PALCUBEBITS * 3))
+#define PALCUBEINDEX(r, g, b) ((((r) >> (8 - PALCUBEBITS)) << (PALCUBEBITS * 2)) | (((g) >> (8 - PALCUBEBITS)) << PALCUBEBITS) | ((b) >> (8 - PALCUBEBITS)))
+
+typedef struct
+{
+	RGBA_t *palette;
+	UINT32 *cells; // where each cell's candidates start, 0 if not worked out yet
+	UINT8 *candidates; // count - 1, then palette indices in ascending order
+	size_t size, used;
+} palettecube_t;
+
+void InitPaletteCube(palettecube_t *cube, RGBA_t *palette);
+void FillPaletteCube(palettecube_t *cube);
+UINT8 GetPaletteCubeColor(palettecube_t *cube, UINT8 r, UINT8 g, UINT8 b);
+
 // Color look-up table
 #define CLUTINDEX(r, g, b) (((r) >> 3) << 11) | (((g) >> 2) << 5) | ((b) >> 3)
 
@@ -51,6 +71,7 @@ typedef struct
 	boolean init;
 	RGBA_t palette[256];
 	UINT16 table[0xFFFF];
+	palettecube_t cube;
 } colorlookup_t;
 
 void InitColorLUT(colorlookup_t *lut, RGBA_t *palette, boolean makecolors);
@@ -67,6 +88,7 @@ const char *GetPalette(void);
 
 extern RGBA_t *pLocalPalette;
 extern RGBA_t *pMasterPalette;
+extern palettecube_t masterpalettecube;
 
 void V_CubeApply(UINT8 *red, UINT8 *green, UINT8 *blue);
 
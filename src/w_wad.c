@@ -32,6 +32,7 @@
 #ifdef __GNUC__
 #include <unistd.h>
 #endif
+#include <sys/stat.h>
 
 #define ZWAD
 
@@ -63,6 +64,8 @@
 #include "i_system.h"
 #include "i_video.h" // rendermode
 #include "md5.h"
+#include "byteptr.h"
+#include "i_threads.h"
 #include "lua_script.h"
 #ifdef SCANTHINGS
 #include "p_setup.h" // P_ScanThings
@@ -105,6 +108,18 @@ typedef struct lumpnum_cache_s
 static lumpnum_cache_t lumpnumcache[LUMPNUMCACHESIZE];
 static UINT16 lumpnumcacheindex = 0;
 
+// End of a name index chain
+#define LUMPINDEXEND UINT16_MAX
+
+// Name lookup statistics, see W_PrintLookupStats
+static struct
+{
+	UINT32 lookups;
+	UINT32 examined; // lumps compared through the name index
+	UINT32 linear; // lumps a linear scan would have compared
+	precise_t time;
+} lookupstats;
+
 //===========================================================================
 //                                                                    GLOBALS
 //===========================================================================
@@ -135,6 +150,10 @@ void W_Shutdown(void)
 			Z_Free(wad->lumpinfo[wad->numlumps].fullname);
 		}
 
+		Z_Free(wad->namebuckets);
+		Z_Free(wad->namenext);
+		Z_Free(wad->longnamebuckets);
+		Z_Free(wad->longnamenext);
 		Z_Free(wad->lumpinfo);
 		Z_Free(wad);
 	}
@@ -299,22 +318,461 @@ static void W_LoadDehackedLumps(UINT16 wadnum, boolean mainfile)
 #endif
 }
 
+#ifndef NOMD5
+//
+// MD5 digest cache
+//
+// Hashing every addon on startup and on every join is slow, so digests are
+// kept on disk between sessions, keyed by the file's canonical path, size
+// and modification time. If any of those differ the file is hashed again.
+//
+#define MD5CACHESIZE 1024
+#define MD5CACHEFILE "md5cache.dat"
+#define MD5CACHEVERSION 2
+
+typedef struct
+{
+	char *path;
+	UINT64 size;
+	INT64 mtime; // in nanoseconds, so rewriting a file within a second still counts
+	UINT8 md5sum[16];
+	UINT32 lastused;
+	boolean hashed; // digest was made this session, not loaded from disk
+} md5cache_t;
+
+static md5cache_t *md5cache = NULL;
+static size_t nummd5cache = 0, maxmd5cache = 0;
+static UINT32 md5cacheclock = 0;
+static boolean md5cacheloaded = false, md5cachedirty = false;
+static UINT32 md5cachehits = 0, md5cachemisses = 0;
+
+// Writes the absolute, symlink-free form of filename into path.
+static void W_CanonicalPath(const char *filename, char *path)
+{
+#if defined (_WIN32)
+	if (_fullpath(path, filename, MAX_WADPATH))
+		return;
+#elif defined (__unix__) || defined (UNIXCOMMON) || defined (__APPLE__)
+	char *real = realpath(filename, NULL);
+	if (real)
+	{
+		strlcpy(path, real, MAX_WADPATH);
+		free(real);
+		return;
+	}
+#endif
+	strlcpy(path, filename, MAX_WADPATH);
+}
+
+// Fills in the key for filename. Returns false if the file can't be stat'd.
+static boolean W_GetMD5CacheKey(const char *filename, char *path, UINT64 *size, INT64 *mtime)
+{
+	struct stat statbuf;
+
+	if (stat(filename, &statbuf) != 0)
+		return false;
+
+	W_CanonicalPath(filename, path);
+	*size = (UINT64)statbuf.st_size;
+	*mtime = (INT64)statbuf.st_mtime * 1000000000 + (INT64)STAT_MTIMENSEC(statbuf);
+	return true;
+}
+
+static void W_LoadMD5Cache(void)
+{
+	UINT8 *buffer, *p, *end;
+	size_t length;
+
+	md5cacheloaded = true;
+	I_AddExitFunc(W_SaveMD5Cache);
+
+	length = FIL_ReadFile(va(pandf, srb2home, MD5CACHEFILE), &buffer);
+	if (!length)
+		return;
+
+	p = buffer;
+	end = buffer + length;
+	if (length >= 16 && !memcmp(p, "SRB2MD5", 8))
+	{
+		UINT32 version, count;
+
+		p += 8;
+		version = READUINT32(p);
+		count = READUINT32(p);
+
+		if (version == MD5CACHEVERSION && count)
+		{
+			maxmd5cache = min(count, MD5CACHESIZE);
+			md5cache = Z_Realloc(md5cache, maxmd5cache * sizeof (*md5cache), PU_STATIC, NULL);
+
+			for (; count-- && nummd5cache < MD5CACHESIZE; nummd5cache++)
+			{
+				md5cache_t *entry = &md5cache[nummd5cache];
+				UINT16 pathlen;
+
+				if (end - p < 2)
+					break;
+				pathlen = READUINT16(p);
+				if (!pathlen || pathlen >= MAX_WADPATH || end - p < pathlen + 36)
+					break;
+
+				entry->path = Z_Malloc(pathlen + 1, PU_STATIC, NULL);
+				READMEM(p, entry->path, pathlen);
+				entry->path[pathlen] = '\0';
+				entry->size = READUINT32(p);
+				entry->size |= (UINT64)READUINT32(p) << 32;
+				entry->mtime = READUINT32(p);
+				entry->mtime |= (INT64)READUINT32(p) << 32;
+				READMEM(p, entry->md5sum, 16);
+				entry->lastused = READUINT32(p);
+				entry->hashed = false;
+
+				md5cacheclock = max(md5cacheclock, entry->lastused);
+			}
+		}
+	}
+
+	Z_Free(buffer);
+	CONS_Debug(DBG_SETUP, "Loaded %s cached MD5 digests\n", sizeu1(nummd5cache));
+}
+
+/** Writes the MD5 digest cache to disk, if anything in it changed.
+  */
+void W_SaveMD5Cache(void)
+{
+	size_t length = 16, i;
+	UINT8 *buffer, *p;
+
+	CONS_Debug(DBG_SETUP, "MD5 cache: %u hits, %u misses\n", md5cachehits, md5cachemisses);
+
+	if (!md5cachedirty)
+		return;
+
+	for (i = 0; i < nummd5cache; i++)
+		length += 2 + strlen(md5cache[i].path) + 36;
+
+	buffer = p = Z_Malloc(length, PU_STATIC, NULL);
+
+	WRITEMEM(p, "SRB2MD5", 8);
+	WRITEUINT32(p, MD5CACHEVERSION);
+	WRITEUINT32(p, nummd5cache);
+
+	for (i = 0; i < nummd5cache; i++)
+	{
+		md5cache_t *entry = &md5cache[i];
+		const UINT16 pathlen = (UINT16)strlen(entry->path);
+
+		WRITEUINT16(p, pathlen);
+		WRITEMEM(p, entry->path, pathlen);
+		WRITEUINT32(p, (UINT32)entry->size);
+		WRITEUINT32(p, (UINT32)(entry->size >> 32));
+		WRITEUINT32(p, (UINT32)entry->mtime);
+		WRITEUINT32(p, (UINT32)((UINT64)entry->mtime >> 32));
+		WRITEMEM(p, entry->md5sum, 16);
+		WRITEUINT32(p, entry->lastused);
+	}
+
+	if (FIL_WriteFile(va(pandf, srb2home, MD5CACHEFILE), buffer, length))
+		md5cachedirty = false;
+
+	Z_Free(buffer);
+}
+
+// Finds the cache entry for a path, whether or not its size and time still match.
+static md5cache_t *W_FindMD5CacheEntry(const char *path)
+{
+	size_t i;
+
+	if (!md5cacheloaded)
+		W_LoadMD5Cache();
+
+	for (i = 0; i < nummd5cache; i++)
+	{
+		if (!strcmp(md5cache[i].path, path))
+			return &md5cache[i];
+	}
+
+	return NULL;
+}
+
+// Stores a digest, replacing the path's old entry or the least recently used one if full.
+static void W_CacheMD5(const char *path, UINT64 size, INT64 mtime, const UINT8 *md5sum, boolean hashed)
+{
+	md5cache_t *entry = W_FindMD5CacheEntry(path);
+	size_t i;
+
+	if (!entry)
+	{
+		if (nummd5cache < MD5CACHESIZE)
+		{
+			if (nummd5cache == maxmd5cache)
+			{
+				maxmd5cache += 16;
+				md5cache = Z_Realloc(md5cache, maxmd5cache * sizeof (*md5cache), PU_STATIC, NULL);
+			}
+			entry = &md5cache[nummd5cache++];
+		}
+		else
+		{
+			entry = &md5cache[0];
+			for (i = 1; i < nummd5cache; i++)
+				if (md5cache[i].lastused < entry->lastused)
+					entry = &md5cache[i];
+			Z_Free(entry->path);
+		}
+		entry->path = Z_StrDup(path);
+	}
+
+	entry->size = size;
+	entry->mtime = mtime;
+	M_Memcpy(entry->md5sum, md5sum, 16);
+	entry->lastused = ++md5cacheclock;
+	entry->hashed = hashed;
+	md5cachedirty = true;
+}
+
+#ifdef HAVE_THREADS
+typedef struct
+{
+	char path[MAX_WADPATH];
+	UINT64 size;
+	INT64 mtime;
+	UINT8 md5sum[16];
+	boolean ok;
+} md5job_t;
+
+static void W_HashFileRange(size_t start, size_t end, void *userdata)
+{
+	md5job_t *jobs = userdata;
+
+	for (; start < end; start++)
+	{
+		FILE *fhandle = fopen(jobs[start].path, "rb");
+
+		if (fhandle)
+		{
+			jobs[start].ok = (md5_stream(fhandle, jobs[start].md5sum) == 0);
+			fclose(fhandle);
+		}
+	}
+}
+
+// Hashes the files in a list which aren't in the cache yet on the worker
+// threads, so W_InitFile only has to look them up.
+static void W_PrehashFiles(addfilelist_t *list)
+{
+	md5job_t *jobs;
+	size_t numjobs = 0, i;
+	precise_t t;
+
+	if (I_worker_count() < 1 || list->numfiles < 2)
+		return;
+
+	jobs = Z_Calloc(list->numfiles * sizeof (*jobs), PU_STATIC, NULL);
+
+	for (i = 0; i < list->numfiles; i++)
+	{
+		const char *fn = list->files[i];
+		char pathsep = fn[strlen(fn) - 1];
+		md5job_t *job = &jobs[numjobs];
+		md5cache_t *entry;
+
+		if (pathsep == '\\' || pathsep == '/')
+			continue;
+		if (!W_GetMD5CacheKey(fn, job->path, &job->size, &job->mtime))
+			continue;
+
+		entry = W_FindMD5CacheEntry(job->path);
+		if (entry && entry->size == job->size && entry->mtime == job->mtime)
+			continue;
+
+		numjobs++;
+	}
+
+	if (numjobs > 1)
+	{
+		t = I_GetPreciseTime();
+		I_parallel_for(numjobs, 1, W_HashFileRange, jobs);
+
+		for (i = 0; i < numjobs; i++)
+			if (jobs[i].ok)
+				W_CacheMD5(jobs[i].path, jobs[i].size, jobs[i].mtime, jobs[i].md5sum, true);
+
+		CONS_Debug(DBG_SETUP, "Hashed %s files on %d workers in %f seconds\n",
+			sizeu1(numjobs), I_worker_count(),
+			(double)(I_GetPreciseTime() - t) / I_GetPrecisePrecision());
+	}
+
+	Z_Free(jobs);
+}
+
+// Digests being made on the worker threads for W_QueueFileMD5
+typedef struct
+{
+	md5job_t job;
+	I_job handle;
+} md5queued_t;
+
+static md5queued_t **md5queue = NULL;
+static size_t nummd5queue = 0, maxmd5queue = 0;
+static UINT32 md5queuedone = 0;
+static I_mutex md5queue_mutex;
+
+static void W_QueuedMD5Job(void *userdata)
+{
+	md5queued_t *queued = userdata;
+
+	W_HashFileRange(0, 1, &queued->job);
+
+	I_lock_mutex(&md5queue_mutex);
+	md5queuedone++;
+	I_unlock_mutex(md5queue_mutex);
+}
+
+/** Starts hashing a file on the worker threads, unless its digest is
+  * already cached. Call W_FlushMD5Queue to add the results to the cache.
+  *
+  * \param filename path of file
+  */
+void W_QueueFileMD5(const char *filename)
+{
+	md5queued_t *queued;
+	md5cache_t *entry;
+	size_t i;
+
+	if (I_worker_count() < 1)
+		return;
+
+	queued = Z_Calloc(sizeof (*queued), PU_STATIC, NULL);
+
+	if (!W_GetMD5CacheKey(filename, queued->job.path, &queued->job.size, &queued->job.mtime))
+	{
+		Z_Free(queued);
+		return;
+	}
+
+	entry = W_FindMD5CacheEntry(queued->job.path);
+	if (entry && entry->size == queued->job.size && entry->mtime == queued->job.mtime)
+	{
+		Z_Free(queued);
+		return;
+	}
+
+	for (i = 0; i < nummd5queue; i++)
+	{
+		if (!strcmp(md5queue[i]->job.path, queued->job.path))
+		{
+			Z_Free(queued);
+			return;
+		}
+	}
+
+	if (nummd5queue == maxmd5queue)
+	{
+		maxmd5queue = maxmd5queue ? maxmd5queue * 2 : 16;
+		md5queue = Z_Realloc(md5queue, maxmd5queue * sizeof (*md5queue), PU_STATIC, NULL);
+	}
+
+	md5queue[nummd5queue++] = queued;
+	queued->handle = I_schedule_job(W_QueuedMD5Job, queued, NULL, 0);
+}
+
+/** Reports how far the queued digests have come.
+  *
+  * \param hashed if not NULL, set to the number of files hashed so far
+  * \param total if not NULL, set to the number of files queued
+  * \return true if some are still being made
+  */
+boolean W_GetMD5QueueProgress(UINT32 *hashed, UINT32 *total)
+{
+	UINT32 done;
+
+	I_lock_mutex(&md5queue_mutex);
+	done = md5queuedone;
+	I_unlock_mutex(md5queue_mutex);
+
+	if (hashed)
+		*hashed = done;
+	if (total)
+		*total = (UINT32)nummd5queue;
+
+	return (done < nummd5queue);
+}
+
+/** Waits for the queued digests and adds them to the MD5 cache.
+  */
+void W_FlushMD5Queue(void)
+{
+	size_t i;
+
+	if (!nummd5queue)
+		return;
+
+	for (i = 0; i < nummd5queue; i++)
+	{
+		md5queued_t *queued = md5queue[i];
+
+		I_wait_job(queued->handle);
+		if (queued->job.ok)
+			W_CacheMD5(queued->job.path, queued->job.size, queued->job.mtime, queued->job.md5sum, true);
+		Z_Free(queued);
+	}
+
+	CONS_Debug(DBG_SETUP, "Hashed %s queued files on %d workers\n", sizeu1(nummd5queue), I_worker_count());
+
+	nummd5queue = 0;
+	I_lock_mutex(&md5queue_mutex);
+	md5queuedone = 0;
+	I_unlock_mutex(md5queue_mutex);
+}
+#endif
+#endif
+
 /** Compute MD5 message digest for bytes read from STREAM of this filname.
   *
   * The resulting message digest number will be written into the 16 bytes
-  * beginning at RESBLOCK.
+  * beginning at RESBLOCK. Digests are looked up in the MD5 cache first, and
+  * the file is only read if its path, size or modification time changed.
   *
   * \param filename path of file
   * \param resblock resulting MD5 checksum
   * \return 0 if MD5 checksum was made, and is at resblock, 1 if error was found
   */
-static INT32 W_MakeFileMD5(const char *filename, void *resblock)
+INT32 W_MakeFileMD5(const char *filename, void *resblock)
 {
 #ifdef NOMD5
 	(void)filename;
 	memset(resblock, 0x00, 16);
 #else
 	FILE *fhandle;
+	char path[MAX_WADPATH];
+	UINT64 size;
+	INT64 mtime;
+	boolean haskey = W_GetMD5CacheKey(filename, path, &size, &mtime);
+
+	if (haskey)
+	{
+		md5cache_t *entry = W_FindMD5CacheEntry(path);
+
+		if (entry && entry->size == size && entry->mtime == mtime)
+		{
+			// Files hashed ahead of time by W_PrehashFiles still count as misses
+			if (entry->hashed)
+			{
+				entry->hashed = false;
+				md5cachemisses++;
+			}
+			else
+				md5cachehits++;
+
+			// Saved too, so eviction keeps the files that are in use
+			entry->lastused = ++md5cacheclock;
+			md5cachedirty = true;
+			M_Memcpy(resblock, entry->md5sum, 16);
+			CONS_Debug(DBG_SETUP, "Using cached MD5 for %s\n", filename);
+			return 0;
+		}
+	}
 
 	if ((fhandle = fopen(filename, "rb")) != NULL)
 	{
@@ -328,6 +786,10 @@ static INT32 W_MakeFileMD5(const char *filename, void *resblock)
 		CONS_Debug(DBG_SETUP, "MD5 calc for %s took %f seconds\n",
 			filename, (float)(I_GetTime() - t)/NEWTICRATE);
 		fclose(fhandle);
+
+		md5cachemisses++;
+		if (haskey)
+			W_CacheMD5(path, size, mtime, resblock, false);
 		return 0;
 	}
 #endif
@@ -340,6 +802,70 @@ static void W_InvalidateLumpnumCache(void)
 	memset(lumpnumcache, 0, sizeof (lumpnumcache));
 }
 
+static inline UINT32 W_LongNameHash(const char *name)
+{
+	return quickncasehash(name, 256);
+}
+
+// Builds the name hash index of a wad, so that W_CheckNumForNamePwad and
+// W_CheckNumForLongNamePwad do not have to scan every lump. Each bucket
+// chains its lumps in ascending order, which keeps the first-match
+// semantics of the linear search, startlump included.
+static void W_BuildLumpNameIndex(wadfile_t *wadfile)
+{
+	UINT32 numbuckets = 16, bucket;
+	UINT16 *nametail, *longnametail;
+	lumpinfo_t *lump_p = wadfile->lumpinfo;
+	UINT16 i;
+
+	while (numbuckets < wadfile->numlumps)
+		numbuckets <<= 1;
+
+	wadfile->namebucketmask = numbuckets - 1;
+	wadfile->namebuckets = Z_Malloc(numbuckets * sizeof (*wadfile->namebuckets), PU_STATIC, NULL);
+	wadfile->longnamebuckets = Z_Malloc(numbuckets * sizeof (*wadfile->longnamebuckets), PU_STATIC, NULL);
+	wadfile->namenext = Z_Malloc((wadfile->numlumps + 1) * sizeof (*wadfile->namenext), PU_STATIC, NULL);
+	wadfile->longnamenext = Z_Malloc((wadfile->numlumps + 1) * sizeof (*wadfile->longnamenext), PU_STATIC, NULL);
+	memset(wadfile->namebuckets, 0xFF, numbuckets * sizeof (*wadfile->namebuckets));
+	memset(wadfile->longnamebuckets, 0xFF, numbuckets * sizeof (*wadfile->longnamebuckets));
+
+	// Tails of each chain, so lumps can be appended in order
+	nametail = malloc(numbuckets * 2 * sizeof (*nametail));
+	if (!nametail)
+		I_Error("W_BuildLumpNameIndex: Out of memory");
+	longnametail = nametail + numbuckets;
+
+	for (i = 0; i < wadfile->numlumps; i++, lump_p++)
+	{
+		wadfile->namenext[i] = wadfile->longnamenext[i] = LUMPINDEXEND;
+
+		bucket = lump_p->hash & wadfile->namebucketmask;
+		if (wadfile->namebuckets[bucket] == LUMPINDEXEND)
+			wadfile->namebuckets[bucket] = i;
+		else
+			wadfile->namenext[nametail[bucket]] = i;
+		nametail[bucket] = i;
+
+		bucket = W_LongNameHash(lump_p->longname) & wadfile->namebucketmask;
+		if (wadfile->longnamebuckets[bucket] == LUMPINDEXEND)
+			wadfile->longnamebuckets[bucket] = i;
+		else
+			wadfile->longnamenext[longnametail[bucket]] = i;
+		longnametail[bucket] = i;
+	}
+
+	free(nametail);
+}
+
+// Prints how much scanning the name index has saved so far.
+void W_PrintLookupStats(void)
+{
+	CONS_Debug(DBG_SETUP, "W_CheckNumForName: %u lookups in %s us, %u lumps compared (linear scan: %u)\n",
+		lookupstats.lookups,
+		sizeu1((size_t)(lookupstats.time * 1000000 / I_GetPrecisePrecision())),
+		lookupstats.examined, lookupstats.linear);
+}
+
 /** Detect a file type.
  * \todo Actually detect the wad/pkzip headers and whatnot, instead of just checking the extensions.
  */
@@ -355,11 +881,76 @@ static restype_t ResourceFileDetect (const char* filename)
 	return RET_WAD;
 }
 
+#define MAXPARSEALERTS 8
+
+// A file's lump directory, as read by W_ParseDirectory. Parsing can happen
+// on a worker thread, so the lumps and their names are plain malloc'd
+// memory and alerts are held back, until W_AdoptLumps runs on the main
+// thread.
+typedef struct
+{
+	char filename[MAX_WADPATH];
+	restype_t type;
+	lumpinfo_t *lumpinfo;
+	UINT16 numlumps;
+	struct
+	{
+		alerttype_t level;
+		char text[128];
+	} alerts[MAXPARSEALERTS];
+	UINT8 numalerts;
+} wadparse_t;
+
+static void W_ParseAlert(wadparse_t *parse, alerttype_t level, const char *fmt, ...)
+{
+	va_list argptr;
+
+	if (parse->numalerts == MAXPARSEALERTS)
+		return;
+
+	va_start(argptr, fmt);
+	vsnprintf(parse->alerts[parse->numalerts].text, sizeof (parse->alerts[0].text), fmt, argptr);
+	va_end(argptr);
+	parse->alerts[parse->numalerts++].level = level;
+}
+
+// Frees the first numlumps lumps of a directory that was never adopted.
+static void W_FreeParsedLumps(lumpinfo_t *lumpinfo, size_t numlumps)
+{
+	size_t i;
+
+	for (i = 0; i < numlumps; i++)
+	{
+		free(lumpinfo[i].longname);
+		free(lumpinfo[i].fullname);
+	}
+	free(lumpinfo);
+}
+
+static char *W_ParsedName(const char *name, size_t length)
+{
+	char *copy = malloc(length + 1);
+
+	if (copy)
+	{
+		strncpy(copy, name, length);
+		copy[length] = '\0';
+	}
+	return copy;
+}
+
 /** Create a 1-lump lumpinfo_t for standalone files.
  */
-static lumpinfo_t* ResGetLumpsStandalone (FILE* handle, UINT16* numlumps, const char* lumpname)
+static lumpinfo_t* ResGetLumpsStandalone (FILE* handle, UINT16* numlumps, const char* lumpname, wadparse_t *parse)
 {
-	lumpinfo_t* lumpinfo = Z_Calloc(sizeof (*lumpinfo), PU_STATIC, NULL);
+	lumpinfo_t* lumpinfo = calloc(1, sizeof (*lumpinfo));
+
+	if (!lumpinfo)
+	{
+		W_ParseAlert(parse, CONS_ERROR, "Out of memory\n");
+		return NULL;
+	}
+
 	lumpinfo->position = 0;
 	fseek(handle, 0, SEEK_END);
 	lumpinfo->size = ftell(handle);
@@ -367,15 +958,15 @@ static lumpinfo_t* ResGetLumpsStandalone (FILE* handle, UINT16* numlumps, const
 	strcpy(lumpinfo->name, lumpname);
 	lumpinfo->hash = quickncasehash(lumpname, 8);
 
-	// Allocate the lump's long name.
-	lumpinfo->longname = Z_Malloc(9 * sizeof(char), PU_STATIC, NULL);
-	strcpy(lumpinfo->longname, lumpname);
-	lumpinfo->longname[8] = '\0';
-
-	// Allocate the lump's full name.
-	lumpinfo->fullname = Z_Malloc(9 * sizeof(char), PU_STATIC, NULL);
-	strcpy(lumpinfo->fullname, lumpname);
-	lumpinfo->fullname[8] = '\0';
+	// Allocate the lump's long and full names.
+	lumpinfo->longname = W_ParsedName(lumpname, 8);
+	lumpinfo->fullname = W_ParsedName(lumpname, 8);
+	if (!lumpinfo->longname || !lumpinfo->fullname)
+	{
+		W_ParseAlert(parse, CONS_ERROR, "Out of memory\n");
+		W_FreeParsedLumps(lumpinfo, 1);
+		return NULL;
+	}
 
 	*numlumps = 1;
 	return lumpinfo;
@@ -383,7 +974,7 @@ static lumpinfo_t* ResGetLumpsStandalone (FILE* handle, UINT16* numlumps, const
 
 /** Create a lumpinfo_t array for a WAD file.
  */
-static lumpinfo_t* ResGetLumpsWad (FILE* handle, UINT16* nlmp, const char* filename)
+static lumpinfo_t* ResGetLumpsWad (FILE* handle, UINT16* nlmp, wadparse_t *parse)
 {
 	UINT16 numlumps = *nlmp;
 	lumpinfo_t* lumpinfo;
@@ -398,7 +989,7 @@ static lumpinfo_t* ResGetLumpsWad (FILE* handle, UINT16* nlmp, const char* filen
 	// read the header
 	if (fread(&header, 1, sizeof header, handle) < sizeof header)
 	{
-		CONS_Alert(CONS_ERROR, M_GetText("Can't read wad header because %s\n"), M_FileError(handle));
+		W_ParseAlert(parse, CONS_ERROR, M_GetText("Can't read wad header because %s\n"), M_FileError(handle));
 		return NULL;
 	}
 
@@ -408,7 +999,7 @@ static lumpinfo_t* ResGetLumpsWad (FILE* handle, UINT16* nlmp, const char* filen
 		&& memcmp(header.identification, "PWAD", 4) != 0
 		&& memcmp(header.identification, "SDLL", 4) != 0)
 	{
-		CONS_Alert(CONS_ERROR, M_GetText("Invalid WAD header\n"));
+		W_ParseAlert(parse, CONS_ERROR, M_GetText("Invalid WAD header\n"));
 		return NULL;
 	}
 
@@ -418,10 +1009,10 @@ static lumpinfo_t* ResGetLumpsWad (FILE* handle, UINT16* nlmp, const char* filen
 	// read wad file directory
 	i = header.numlumps * sizeof (*fileinfo);
 	fileinfov = fileinfo = malloc(i);
-	if (fseek(handle, header.infotableofs, SEEK_SET) == -1
+	if ((!fileinfo && i) || fseek(handle, header.infotableofs, SEEK_SET) == -1
 		|| fread(fileinfo, 1, i, handle) < i)
 	{
-		CONS_Alert(CONS_ERROR, M_GetText("Corrupt wadfile directory (%s)\n"), M_FileError(handle));
+		W_ParseAlert(parse, CONS_ERROR, M_GetText("Corrupt wadfile directory (%s)\n"), M_FileError(handle));
 		free(fileinfov);
 		return NULL;
 	}
@@ -429,7 +1020,13 @@ static lumpinfo_t* ResGetLumpsWad (FILE* handle, UINT16* nlmp, const char* filen
 	numlumps = header.numlumps;
 
 	// fill in lumpinfo for this wad
-	lump_p = lumpinfo = Z_Malloc(numlumps * sizeof (*lumpinfo), PU_STATIC, NULL);
+	lump_p = lumpinfo = malloc(max(numlumps, 1) * sizeof (*lumpinfo));
+	if (!lumpinfo)
+	{
+		W_ParseAlert(parse, CONS_ERROR, "Out of memory\n");
+		free(fileinfov);
+		return NULL;
+	}
 	for (i = 0; i < numlumps; i++, lump_p++, fileinfo++)
 	{
 		lump_p->position = LONG(fileinfo->filepos);
@@ -442,8 +1039,11 @@ static lumpinfo_t* ResGetLumpsWad (FILE* handle, UINT16* nlmp, const char* filen
 				== -1 || fread(&realsize, 1, sizeof realsize,
 				handle) < sizeof realsize)
 			{
-				I_Error("corrupt compressed file: %s; maybe %s", /// \todo Avoid the bailout?
-					filename, M_FileError(handle));
+				W_ParseAlert(parse, CONS_ERROR, "Corrupt compressed file: %s; maybe %s\n",
+					parse->filename, M_FileError(handle));
+				W_FreeParsedLumps(lumpinfo, i);
+				free(fileinfov);
+				return NULL;
 			}
 			realsize = LONG(realsize);
 			if (realsize != 0)
@@ -466,15 +1066,16 @@ static lumpinfo_t* ResGetLumpsWad (FILE* handle, UINT16* nlmp, const char* filen
 		strncpy(lump_p->name, fileinfo->name, 8);
 		lump_p->hash = quickncasehash(lump_p->name, 8);
 
-		// Allocate the lump's long name.
-		lump_p->longname = Z_Malloc(9 * sizeof(char), PU_STATIC, NULL);
-		strncpy(lump_p->longname, fileinfo->name, 8);
-		lump_p->longname[8] = '\0';
-
-		// Allocate the lump's full name.
-		lump_p->fullname = Z_Malloc(9 * sizeof(char), PU_STATIC, NULL);
-		strncpy(lump_p->fullname, fileinfo->name, 8);
-		lump_p->fullname[8] = '\0';
+		// Allocate the lump's long and full names.
+		lump_p->longname = W_ParsedName(fileinfo->name, 8);
+		lump_p->fullname = W_ParsedName(fileinfo->name, 8);
+		if (!lump_p->longname || !lump_p->fullname)
+		{
+			W_ParseAlert(parse, CONS_ERROR, "Out of memory\n");
+			W_FreeParsedLumps(lumpinfo, i + 1);
+			free(fileinfov);
+			return NULL;
+		}
 	}
 	free(fileinfov);
 	*nlmp = numlumps;
@@ -562,7 +1163,7 @@ typedef struct zlentry_s
 
 /** Create a lumpinfo_t array for a PKZip file.
  */
-static lumpinfo_t* ResGetLumpsZip (FILE* handle, UINT16* nlmp)
+static lumpinfo_t* ResGetLumpsZip (FILE* handle, UINT16* nlmp, wadparse_t *parse)
 {
     zend_t zend;
     zentry_t zentry;
@@ -581,19 +1182,24 @@ static lumpinfo_t* ResGetLumpsZip (FILE* handle, UINT16* nlmp)
 	fseek(handle, 0, SEEK_END);
 	if (!ResFindSignature(handle, pat_end, max(0, ftell(handle) - (22 + 65536))))
 	{
-		CONS_Alert(CONS_ERROR, "Missing central directory\n");
+		W_ParseAlert(parse, CONS_ERROR, "Missing central directory\n");
 		return NULL;
 	}
 
 	fseek(handle, -4, SEEK_CUR);
 	if (fread(&zend, 1, sizeof zend, handle) < sizeof zend)
 	{
-		CONS_Alert(CONS_ERROR, "Corrupt central directory (%s)\n", M_FileError(handle));
+		W_ParseAlert(parse, CONS_ERROR, "Corrupt central directory (%s)\n", M_FileError(handle));
 		return NULL;
 	}
 	numlumps = zend.entries;
 
-	lump_p = lumpinfo = Z_Malloc(numlumps * sizeof (*lumpinfo), PU_STATIC, NULL);
+	lump_p = lumpinfo = calloc(max(numlumps, 1), sizeof (*lumpinfo));
+	if (!lumpinfo)
+	{
+		W_ParseAlert(parse, CONS_ERROR, "Out of memory\n");
+		return NULL;
+	}
 
 	fseek(handle, zend.cdiroffset, SEEK_SET);
 	for (i = 0; i < numlumps; i++, lump_p++)
@@ -604,14 +1210,14 @@ static lumpinfo_t* ResGetLumpsZip (FILE* handle, UINT16* nlmp)
 
 		if (fread(&zentry, 1, sizeof(zentry_t), handle) < sizeof(zentry_t))
 		{
-			CONS_Alert(CONS_ERROR, "Failed to read central directory (%s)\n", M_FileError(handle));
-			Z_Free(lumpinfo);
+			W_ParseAlert(parse, CONS_ERROR, "Failed to read central directory (%s)\n", M_FileError(handle));
+			W_FreeParsedLumps(lumpinfo, i);
 			return NULL;
 		}
 		if (memcmp(zentry.signature, pat_central, 4))
 		{
-			CONS_Alert(CONS_ERROR, "Central directory is corrupt\n");
-			Z_Free(lumpinfo);
+			W_ParseAlert(parse, CONS_ERROR, "Central directory is corrupt\n");
+			W_FreeParsedLumps(lumpinfo, i);
 			return NULL;
 		}
 
@@ -621,10 +1227,10 @@ static lumpinfo_t* ResGetLumpsZip (FILE* handle, UINT16* nlmp)
 		lump_p->size = zentry.size;
 
 		fullname = malloc(zentry.namelen + 1);
-		if (fgets(fullname, zentry.namelen + 1, handle) != fullname)
+		if (!fullname || fgets(fullname, zentry.namelen + 1, handle) != fullname)
 		{
-			CONS_Alert(CONS_ERROR, "Unable to read lumpname (%s)\n", M_FileError(handle));
-			Z_Free(lumpinfo);
+			W_ParseAlert(parse, CONS_ERROR, "Unable to read lumpname (%s)\n", M_FileError(handle));
+			W_FreeParsedLumps(lumpinfo, i);
 			free(fullname);
 			return NULL;
 		}
@@ -642,11 +1248,15 @@ static lumpinfo_t* ResGetLumpsZip (FILE* handle, UINT16* nlmp)
 		strncpy(lump_p->name, trimname, min(8, dotpos - trimname));
 		lump_p->hash = quickncasehash(lump_p->name, 8);
 
-		lump_p->longname = Z_Calloc(dotpos - trimname + 1, PU_STATIC, NULL);
-		strlcpy(lump_p->longname, trimname, dotpos - trimname + 1);
-
-		lump_p->fullname = Z_Calloc(zentry.namelen + 1, PU_STATIC, NULL);
-		strncpy(lump_p->fullname, fullname, zentry.namelen);
+		lump_p->longname = W_ParsedName(trimname, dotpos - trimname);
+		lump_p->fullname = W_ParsedName(fullname, zentry.namelen);
+		if (!lump_p->longname || !lump_p->fullname)
+		{
+			W_ParseAlert(parse, CONS_ERROR, "Out of memory\n");
+			W_FreeParsedLumps(lumpinfo, i + 1);
+			free(fullname);
+			return NULL;
+		}
 
 		switch(zentry.compression)
 		{
@@ -662,7 +1272,7 @@ static lumpinfo_t* ResGetLumpsZip (FILE* handle, UINT16* nlmp)
 			lump_p->compression = CM_LZF;
 			break;
 		default:
-			CONS_Alert(CONS_WARNING, "%s: Unsupported compression method\n", fullname);
+			W_ParseAlert(parse, CONS_WARNING, "%s: Unsupported compression method\n", fullname);
 			lump_p->compression = CM_UNSUPPORTED;
 			break;
 		}
@@ -672,8 +1282,8 @@ static lumpinfo_t* ResGetLumpsZip (FILE* handle, UINT16* nlmp)
 		// skip and ignore comments/extra fields
 		if (fseek(handle, zentry.xtralen + zentry.commlen, SEEK_CUR) != 0)
 		{
-			CONS_Alert(CONS_ERROR, "Central directory is corrupt\n");
-			Z_Free(lumpinfo);
+			W_ParseAlert(parse, CONS_ERROR, "Central directory is corrupt\n");
+			W_FreeParsedLumps(lumpinfo, i + 1);
 			return NULL;
 		}
 	}
@@ -684,8 +1294,8 @@ static lumpinfo_t* ResGetLumpsZip (FILE* handle, UINT16* nlmp)
 		// skip and ignore comments/extra fields
 		if ((fseek(handle, lump_p->position, SEEK_SET) != 0) || (fread(&zlentry, 1, sizeof(zlentry_t), handle) < sizeof(zlentry_t)))
 		{
-			CONS_Alert(CONS_ERROR, "Local headers for lump %s are corrupt\n", lump_p->fullname);
-			Z_Free(lumpinfo);
+			W_ParseAlert(parse, CONS_ERROR, "Local headers for lump %s are corrupt\n", lump_p->fullname);
+			W_FreeParsedLumps(lumpinfo, numlumps);
 			return NULL;
 		}
 
@@ -696,6 +1306,182 @@ static lumpinfo_t* ResGetLumpsZip (FILE* handle, UINT16* nlmp)
 	return lumpinfo;
 }
 
+// Reads the lump directory of an open file.
+static void W_ParseDirectory(wadparse_t *parse, FILE *handle)
+{
+	switch (parse->type)
+	{
+	case RET_SOC:
+		parse->lumpinfo = ResGetLumpsStandalone(handle, &parse->numlumps, "OBJCTCFG", parse);
+		break;
+	case RET_LUA:
+		parse->lumpinfo = ResGetLumpsStandalone(handle, &parse->numlumps, "LUA_INIT", parse);
+		break;
+	case RET_PK3:
+		parse->lumpinfo = ResGetLumpsZip(handle, &parse->numlumps, parse);
+		break;
+	case RET_WAD:
+		parse->lumpinfo = ResGetLumpsWad(handle, &parse->numlumps, parse);
+		break;
+	default:
+		W_ParseAlert(parse, CONS_ERROR, "Unsupported file format\n");
+	}
+}
+
+// Prints the alerts of a parsed directory and moves its lumps into the
+// zone. Returns NULL if parsing failed.
+static lumpinfo_t *W_AdoptLumps(wadparse_t *parse)
+{
+	lumpinfo_t *lumpinfo;
+	UINT16 i;
+
+	for (i = 0; i < parse->numalerts; i++)
+		CONS_Alert(parse->alerts[i].level, "%s", parse->alerts[i].text);
+
+	if (!parse->lumpinfo)
+		return NULL;
+
+	lumpinfo = Z_Malloc(max(parse->numlumps, 1) * sizeof (*lumpinfo), PU_STATIC, NULL);
+
+	for (i = 0; i < parse->numlumps; i++)
+	{
+		lumpinfo[i] = parse->lumpinfo[i];
+		lumpinfo[i].longname = Z_StrDup(parse->lumpinfo[i].longname);
+		lumpinfo[i].fullname = Z_StrDup(parse->lumpinfo[i].fullname);
+	}
+
+	W_FreeParsedLumps(parse->lumpinfo, parse->numlumps);
+	parse->lumpinfo = NULL;
+	return lumpinfo;
+}
+
+#ifdef HAVE_THREADS
+// A directory being parsed on the worker threads for W_PreloadFile
+typedef struct
+{
+	wadparse_t parse;
+	I_job handle;
+	boolean opened; // false if the worker couldn't open the file
+	boolean done;
+} wadpreload_t;
+
+static wadpreload_t *wadpreloads[MAX_WADFILES];
+static size_t numwadpreloads = 0;
+static I_mutex wadpreload_mutex;
+
+static void W_PreloadJob(void *userdata)
+{
+	wadpreload_t *preload = userdata;
+	FILE *handle = fopen(preload->parse.filename, "rb");
+
+	if (handle)
+	{
+		W_ParseDirectory(&preload->parse, handle);
+		fclose(handle);
+	}
+
+	I_lock_mutex(&wadpreload_mutex);
+	preload->opened = (handle != NULL);
+	preload->done = true;
+	I_unlock_mutex(wadpreload_mutex);
+}
+
+static wadpreload_t *W_FindPreload(const char *filename, size_t *index)
+{
+	size_t i;
+
+	for (i = 0; i < numwadpreloads; i++)
+	{
+		if (!strcmp(wadpreloads[i]->parse.filename, filename))
+		{
+			if (index)
+				*index = i;
+			return wadpreloads[i];
+		}
+	}
+
+	return NULL;
+}
+
+/** Starts reading the lump directory of a file on the worker threads, so
+  * a later W_InitFile of the same path only has to register it.
+  *
+  * \param filename path of file, exactly as it will be passed to W_InitFile
+  */
+void W_PreloadFile(const char *filename)
+{
+	wadpreload_t *preload;
+
+	if (I_worker_count() < 1 || numwadpreloads == MAX_WADFILES || W_FindPreload(filename, NULL))
+		return;
+
+	preload = Z_Calloc(sizeof (*preload), PU_STATIC, NULL);
+	strlcpy(preload->parse.filename, filename, MAX_WADPATH);
+	preload->parse.type = ResourceFileDetect(filename);
+
+	wadpreloads[numwadpreloads++] = preload;
+	preload->handle = I_schedule_job(W_PreloadJob, preload, NULL, 0);
+}
+
+/** Checks whether W_InitFile can add a file without waiting on its preload.
+  *
+  * \param filename path of file
+  * \return true if the file was never preloaded or its directory is ready
+  */
+boolean W_PreloadDone(const char *filename)
+{
+	wadpreload_t *preload = W_FindPreload(filename, NULL);
+	boolean done;
+
+	if (!preload)
+		return true;
+
+	I_lock_mutex(&wadpreload_mutex);
+	done = preload->done;
+	I_unlock_mutex(wadpreload_mutex);
+
+	return done;
+}
+
+// Hands over the preloaded directory of a file, waiting for it if needed.
+// Returns false if there is none, and the file has to be parsed here.
+static boolean W_TakePreload(const char *filename, wadparse_t *parse)
+{
+	size_t index;
+	wadpreload_t *preload = W_FindPreload(filename, &index);
+	boolean opened;
+
+	if (!preload)
+		return false;
+
+	I_wait_job(preload->handle);
+	opened = preload->opened;
+	if (opened)
+		*parse = preload->parse;
+	else if (preload->parse.lumpinfo)
+		W_FreeParsedLumps(preload->parse.lumpinfo, preload->parse.numlumps);
+
+	Z_Free(preload);
+	wadpreloads[index] = wadpreloads[--numwadpreloads];
+	return opened;
+}
+
+/** Waits for and throws away every preloaded directory that wasn't used.
+  */
+void W_ClearPreloads(void)
+{
+	while (numwadpreloads)
+	{
+		wadpreload_t *preload = wadpreloads[--numwadpreloads];
+
+		I_wait_job(preload->handle);
+		if (preload->parse.lumpinfo)
+			W_FreeParsedLumps(preload->parse.lumpinfo, preload->parse.numlumps);
+		Z_Free(preload);
+	}
+}
+#endif
+
 static INT32 CheckPathsNotEqual(const char *path1, const char *path2)
 {
 	INT32 stat = samepaths(path1, path2);
@@ -852,6 +1638,7 @@ UINT16 W_InitFile(const char *filename, boolean mainfile, boolean startup)
 #endif
 	UINT8 md5sum[16];
 	int important;
+	wadparse_t parse;
 
 	if (!(refreshdirmenu & REFRESHDIR_ADDFILE))
 		refreshdirmenu = REFRESHDIR_NORMAL|REFRESHDIR_ADDFILE; // clean out cons_alerts that happened earlier
@@ -913,24 +1700,21 @@ UINT16 W_InitFile(const char *filename, boolean mainfile, boolean startup)
 	}
 #endif
 
-	switch(type = ResourceFileDetect(filename))
+	type = ResourceFileDetect(filename);
+
+#ifdef HAVE_THREADS
+	if (!W_TakePreload(filename, &parse))
+#endif
 	{
-	case RET_SOC:
-		lumpinfo = ResGetLumpsStandalone(handle, &numlumps, "OBJCTCFG");
-		break;
-	case RET_LUA:
-		lumpinfo = ResGetLumpsStandalone(handle, &numlumps, "LUA_INIT");
-		break;
-	case RET_PK3:
-		lumpinfo = ResGetLumpsZip(handle, &numlumps);
-		break;
-	case RET_WAD:
-		lumpinfo = ResGetLumpsWad(handle, &numlumps, filename);
-		break;
-	default:
-		CONS_Alert(CONS_ERROR, "Unsupported file format\n");
+		memset(&parse, 0, sizeof (parse));
+		strlcpy(parse.filename, filename, MAX_WADPATH);
+		parse.type = type;
+		W_ParseDirectory(&parse, handle);
 	}
 
+	lumpinfo = W_AdoptLumps(&parse);
+	numlumps = parse.numlumps;
+
 	if (lumpinfo == NULL)
 	{
 		fclose(handle);
@@ -967,6 +1751,7 @@ UINT16 W_InitFile(const char *filename, boolean mainfile, boolean startup)
 	//
 	Z_Calloc(numlumps * sizeof (*wadfile->lumpcache), PU_STATIC, &wadfile->lumpcache);
 	Z_Calloc(numlumps * sizeof (*wadfile->patchcache), PU_STATIC, &wadfile->patchcache);
+	W_BuildLumpNameIndex(wadfile);
 
 	//
 	// add the wadfile
@@ -1150,6 +1935,7 @@ UINT16 W_InitFolder(const char *path, boolean mainfile, boolean startup)
 
 	Z_Calloc(numlumps * sizeof (*wadfile->lumpcache), PU_STATIC, &wadfile->lumpcache);
 	Z_Calloc(numlumps * sizeof (*wadfile->patchcache), PU_STATIC, &wadfile->patchcache);
+	W_BuildLumpNameIndex(wadfile);
 
 	CONS_Printf(M_GetText("Added folder %s (%u files, %u folders)\n"), fn, numlumps, foldercount);
 	wadfiles = Z_Realloc(wadfiles, sizeof(wadfile_t *) * (numwadfiles + 1), PU_STATIC, NULL);
@@ -1178,6 +1964,10 @@ void W_InitMultipleFiles(addfilelist_t *list)
 {
 	size_t i = 0;
 
+#if defined (HAVE_THREADS) && !defined (NOMD5)
+	W_PrehashFiles(list);
+#endif
+
 	for (; i < list->numfiles; i++)
 	{
 		const char *fn = list->files[i];
@@ -1191,6 +1981,9 @@ void W_InitMultipleFiles(addfilelist_t *list)
 		else
 			W_InitFile(fn, mainfile, true);
 	}
+#ifndef NOMD5
+	W_SaveMD5Cache();
+#endif
 }
 
 /** Make sure a lump number is valid.
@@ -1235,6 +2028,7 @@ UINT16 W_CheckNumForNamePwad(const char *name, UINT16 wad, UINT16 startlump)
 	UINT16 i;
 	static char uname[8 + 1];
 	UINT32 hash;
+	wadfile_t *wadfile;
 
 	if (!TestValidLump(wad,0))
 		return INT16_MAX;
@@ -1244,16 +2038,29 @@ UINT16 W_CheckNumForNamePwad(const char *name, UINT16 wad, UINT16 startlump)
 	hash = quickncasehash(uname, 8);
 
 	//
-	// scan forward
+	// walk the name index
 	// start at 'startlump', useful parameter when there are multiple
 	//                       resources with the same name
 	//
-	if (startlump < wadfiles[wad]->numlumps)
+	wadfile = wadfiles[wad];
+	if (startlump < wadfile->numlumps)
 	{
-		lumpinfo_t *lump_p = wadfiles[wad]->lumpinfo + startlump;
-		for (i = startlump; i < wadfiles[wad]->numlumps; i++, lump_p++)
+		for (i = wadfile->namebuckets[hash & wadfile->namebucketmask]; i != LUMPINDEXEND; i = wadfile->namenext[i])
+		{
+			lumpinfo_t *lump_p = wadfile->lumpinfo + i;
+
+			if (i < startlump)
+				continue;
+
+			lookupstats.examined++;
 			if (lump_p->hash == hash && !strncmp(lump_p->name, uname, sizeof(uname) - 1))
+			{
+				lookupstats.linear += i - startlump + 1;
 				return i;
+			}
+		}
+
+		lookupstats.linear += wadfile->numlumps - startlump;
 	}
 
 	// not found.
@@ -1270,24 +2077,38 @@ UINT16 W_CheckNumForLongNamePwad(const char *name, UINT16 wad, UINT16 startlump)
 {
 	UINT16 i;
 	static char uname[256 + 1];
+	UINT32 hash;
+	wadfile_t *wadfile;
 
 	if (!TestValidLump(wad,0))
 		return INT16_MAX;
 
 	strlcpy(uname, name, sizeof uname);
 	strupr(uname);
+	hash = W_LongNameHash(uname);
 
 	//
-	// scan forward
+	// walk the long name index
 	// start at 'startlump', useful parameter when there are multiple
 	//                       resources with the same name
 	//
-	if (startlump < wadfiles[wad]->numlumps)
+	wadfile = wadfiles[wad];
+	if (startlump < wadfile->numlumps)
 	{
-		lumpinfo_t *lump_p = wadfiles[wad]->lumpinfo + startlump;
-		for (i = startlump; i < wadfiles[wad]->numlumps; i++, lump_p++)
-			if (!strcmp(lump_p->longname, uname))
+		for (i = wadfile->longnamebuckets[hash & wadfile->namebucketmask]; i != LUMPINDEXEND; i = wadfile->longnamenext[i])
+		{
+			if (i < startlump)
+				continue;
+
+			lookupstats.examined++;
+			if (!strcmp(wadfile->lumpinfo[i].longname, uname))
+			{
+				lookupstats.linear += i - startlump + 1;
 				return i;
+			}
+		}
+
+		lookupstats.linear += wadfile->numlumps - startlump;
 	}
 
 	// not found.
@@ -1364,6 +2185,7 @@ lumpnum_t W_CheckNumForName(const char *name)
 {
 	INT32 i;
 	lumpnum_t check = INT16_MAX;
+	precise_t starttime;
 
 	if (!*name) // some doofus gave us an empty string?
 		return LUMPERROR;
@@ -1381,12 +2203,15 @@ lumpnum_t W_CheckNumForName(const char *name)
 	}
 
 	// scan wad files backwards so patch lump files take precedence
+	starttime = I_GetPreciseTime();
 	for (i = numwadfiles - 1; i >= 0; i--)
 	{
 		check = W_CheckNumForNamePwad(name,(UINT16)i,0);
 		if (check != INT16_MAX)
 			break; //found it
 	}
+	lookupstats.time += I_GetPreciseTime() - starttime;
+	lookupstats.lookups++;
 
 	if (check == INT16_MAX) return LUMPERROR;
 	else
@@ -1411,6 +2236,7 @@ lumpnum_t W_CheckNumForLongName(const char *name)
 {
 	INT32 i;
 	lumpnum_t check = INT16_MAX;
+	precise_t starttime;
 
 	if (!*name) // some doofus gave us an empty string?
 		return LUMPERROR;
@@ -1427,12 +2253,15 @@ lumpnum_t W_CheckNumForLongName(const char *name)
 	}
 
 	// scan wad files backwards so patch lump files take precedence
+	starttime = I_GetPreciseTime();
 	for (i = numwadfiles - 1; i >= 0; i--)
 	{
 		check = W_CheckNumForLongNamePwad(name,(UINT16)i,0);
 		if (check != INT16_MAX)
 			break; //found it
 	}
+	lookupstats.time += I_GetPreciseTime() - starttime;
+	lookupstats.lookups++;
 
 	if (check == INT16_MAX) return LUMPERROR;
 	else
@@ -128,6 +128,9 @@ typedef struct wadfile_s
 	lumpinfo_t *lumpinfo;
 	lumpcache_t *lumpcache;
 	lumpcache_t *patchcache;
+	UINT16 *namebuckets, *namenext; // lump index by name hash, chained in lump order
+	UINT16 *longnamebuckets, *longnamenext; // same, by long name
+	UINT32 namebucketmask;
 	UINT16 numlumps; // this wad's number of resources
 	UINT16 foldercount; // folder count
 	FILE *handle;
@@ -152,9 +155,28 @@ typedef struct
 // =========================================================================
 
 void W_Shutdown(void);
+void W_PrintLookupStats(void);
 
 // Opens a WAD file. Returns the FILE * handle for the file, or NULL if not found or could not be opened
 FILE *W_OpenWadFile(const char **filename, boolean useerrors);
+// Makes the MD5 digest of a file, using the on-disk digest cache when it is still valid
+INT32 W_MakeFileMD5(const char *filename, void *resblock);
+#ifndef NOMD5
+// Writes new digests back to the cache in srb2home
+void W_SaveMD5Cache(void);
+#ifdef HAVE_THREADS
+// Hashes files on the worker threads ahead of W_MakeFileMD5
+void W_QueueFileMD5(const char *filename);
+boolean W_GetMD5QueueProgress(UINT32 *hashed, UINT32 *total);
+void W_FlushMD5Queue(void);
+#endif
+#endif
+#ifdef HAVE_THREADS
+// Reads lump directories on the worker threads ahead of W_InitFile
+void W_PreloadFile(const char *filename);
+boolean W_PreloadDone(const char *filename);
+void W_ClearPreloads(void);
+#endif
 // Load and add a wadfile to the active wad files, returns numbers of lumps, INT16_MAX on error
 UINT16 W_InitFile(const char *filename, boolean mainfile, boolean startup);
 // Adds a folder as a file
@@ -610,6 +610,109 @@ void Z_SetUser(void *ptr, void **newuser)
 	*newuser = ptr;
 }
 
+// ----------------------
+// Fixed-size block pools
+// ----------------------
+
+// Slabs start with this header, padded so the blocks stay 16-byte aligned
+typedef union zpoolslab_u
+{
+	union zpoolslab_u *next;
+	UINT8 pad[16];
+} zpoolslab_t;
+
+/** Sets up an empty block pool. No memory is allocated until the first
+  * Z_PoolAlloc.
+  *
+  * \param pool The pool to set up.
+  * \param blocksize Size of each block, in bytes.
+  * \param blocksperslab How many blocks to allocate at once.
+  * \param tag Zone tag used for the slabs.
+  * \sa Z_PoolAlloc, Z_PoolClear
+  */
+void Z_PoolInit(zpool_t *pool, size_t blocksize, size_t blocksperslab, INT32 tag)
+{
+	memset(pool, 0, sizeof (*pool));
+	pool->blocksize = (max(blocksize, sizeof (void *)) + 15) & ~(size_t)15;
+	pool->blocksperslab = max(blocksperslab, 1);
+	pool->tag = tag;
+}
+
+/** Takes a block from a pool, allocating a new slab if all are in use.
+  * The block is not cleared.
+  *
+  * \param pool The pool to allocate from.
+  * \return A pointer to the block.
+  * \sa Z_PoolFree
+  */
+void *Z_PoolAlloc(zpool_t *pool)
+{
+	void *block;
+
+	if (!pool->freelist)
+	{
+		zpoolslab_t *slab = Z_Malloc(sizeof (zpoolslab_t) + pool->blocksize * pool->blocksperslab, pool->tag, NULL);
+		UINT8 *blocks = (UINT8 *)(slab + 1);
+		size_t i = pool->blocksperslab;
+
+		slab->next = pool->slabs;
+		pool->slabs = slab;
+		pool->numslabs++;
+
+		// Thread backwards so blocks are handed out in address order
+		while (i--)
+		{
+			*(void **)(blocks + i * pool->blocksize) = pool->freelist;
+			pool->freelist = blocks + i * pool->blocksize;
+		}
+	}
+
+	block = pool->freelist;
+	pool->freelist = *(void **)block;
+	pool->numused++;
+	return block;
+}
+
+/** Returns a block to its pool.
+  * Like Z_Free, Lua userdata pointing at the block is invalidated
+  * unless the pool belongs to Lua itself.
+  *
+  * \param pool The pool the block was allocated from.
+  * \param ptr The block. Can be NULL.
+  * \sa Z_PoolAlloc
+  */
+void Z_PoolFree(zpool_t *pool, void *ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	if (pool->tag != PU_LUA)
+		LUA_InvalidateUserdata(ptr);
+
+	*(void **)ptr = pool->freelist;
+	pool->freelist = ptr;
+	pool->numused--;
+}
+
+/** Frees every slab of a pool at once. All blocks from it become invalid.
+  *
+  * \param pool The pool to clear.
+  * \sa Z_PoolInit
+  */
+void Z_PoolClear(zpool_t *pool)
+{
+	zpoolslab_t *slab, *next;
+
+	for (slab = pool->slabs; slab; slab = next)
+	{
+		next = slab->next;
+		Z_Free(slab);
+	}
+
+	pool->slabs = pool->freelist = NULL;
+	pool->numslabs = pool->numused = 0;
+}
+
 // -----------------
 // Zone memory usage
 // -----------------
@@ -664,6 +767,15 @@ static void Command_Memfree_f(void)
 	CONS_Printf(M_GetText("All purgable           : %7s KB\n"),
 		sizeu1(Z_TagsUsage(PU_PURGELEVEL, INT32_MAX)>>10));
 
+	{
+		size_t luaused, luareserved, lualarge;
+		LUA_GetHeapStats(&luaused, &luareserved, &lualarge);
+		CONS_Printf(M_GetText("Lua (small objects)    : %7s KB, %s KB in slabs (%s%% unused)\n"),
+			sizeu1(luaused>>10), sizeu2(luareserved>>10),
+			sizeu3(luareserved ? 100 - luaused * 100 / luareserved : 0));
+		CONS_Printf(M_GetText("Lua (large objects)    : %7s KB\n"), sizeu1(lualarge>>10));
+	}
+
 #ifdef HWRENDER
 	if (rendermode == render_opengl)
 	{
@@ -148,6 +148,30 @@ void Z_SetUser(void *ptr, void **newuser);
 size_t Z_TagsUsage(INT32 lowtag, INT32 hightag);
 #define Z_TotalUsage() Z_TagsUsage(0, INT32_MAX)
 
+//
+// Fixed-size block pools
+//
+// Blocks are carved out of zone-allocated slabs and recycled through
+// a free list, so allocating and freeing one costs no malloc and no
+// zone bookkeeping. Slabs are only given back all at once.
+//
+typedef struct zpool_s
+{
+	size_t blocksize; // rounded up to a multiple of 16 bytes
+	size_t blocksperslab;
+	INT32 tag; // zone tag of the slabs
+	void *slabs; // linked list of slabs
+	void *freelist; // linked list of free blocks
+	size_t numslabs;
+	size_t numused; // blocks currently handed out
+} zpool_t;
+
+void Z_PoolInit(zpool_t *pool, size_t blocksize, size_t blocksperslab, INT32 tag);
+void *Z_PoolAlloc(zpool_t *pool);
+void Z_PoolFree(zpool_t *pool, void *ptr);
+void Z_PoolClear(zpool_t *pool);
+#define Z_PoolReserved(pool) ((pool)->numslabs * (pool)->blocksperslab * (pool)->blocksize)
+
 //
 // Miscellaneous functions
 //